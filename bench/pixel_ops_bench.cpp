@@ -0,0 +1,191 @@
+// Benchmark for the pixel row operations in src/pixel_ops.cpp. Each operation
+// is run over the rows of a full HD image repeatedly and compared against a
+// copy of the per-pixel loop (or memcmp + memcpy) it replaced; the results of
+// the two are also checked to be equal.
+//
+// Usage: pixel_ops_bench [--frames=N]
+//
+// The results are printed as CSV with one row per operation, scenario and
+// implementation.
+
+#include "pixel_ops.hpp"
+
+using namespace browservice;
+
+namespace {
+
+const int Width = 1920;
+const int Height = 1080;
+
+void legacyFill(uint8_t* dest, int count, uint8_t r, uint8_t g, uint8_t b) {
+    uint8_t* pos = dest;
+    for(int x = 0; x < count; ++x) {
+        *(pos + 2) = r;
+        *(pos + 1) = g;
+        *(pos + 0) = b;
+        pos += 4;
+    }
+}
+
+void legacyBlitMasked(
+    uint8_t* dest,
+    const uint8_t* mask,
+    int count,
+    uint8_t r, uint8_t g, uint8_t b
+) {
+    for(int x = 0; x < count; ++x) {
+        if(*mask) {
+            *(dest + 0) = b;
+            *(dest + 1) = g;
+            *(dest + 2) = r;
+        }
+        ++mask;
+        dest += 4;
+    }
+}
+
+bool legacyCompareAndCopy(uint8_t* dest, const uint8_t* src, int count) {
+    if(memcmp(src, dest, 4 * count)) {
+        memcpy(dest, src, 4 * count);
+        return true;
+    }
+    return false;
+}
+
+// Runs func(row) for each row of the image frames times and returns the
+// elapsed time in seconds. Before each frame, prepare() is called (outside of
+// the timing).
+template <typename Prepare, typename Func>
+double timeRows(int frames, Prepare prepare, Func func) {
+    steady_clock::duration total = steady_clock::duration::zero();
+    for(int frame = 0; frame < frames; ++frame) {
+        prepare();
+        steady_clock::time_point start = steady_clock::now();
+        for(int y = 0; y < Height; ++y) {
+            func(y);
+        }
+        total += steady_clock::now() - start;
+    }
+    return std::chrono::duration<double>(total).count();
+}
+
+void printResult(
+    const char* op,
+    const char* scenario,
+    const char* impl,
+    int frames,
+    double seconds
+) {
+    double bytes = (double)frames * (double)Height * (double)Width * 4.0;
+    std::cout
+        << op << ","
+        << scenario << ","
+        << impl << ","
+        << frames << ","
+        << seconds << ","
+        << bytes / seconds / 1e9 << "\n";
+    std::cout.flush();
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    int frames = 200;
+
+    for(int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if(arg.rfind("--frames=", 0) == 0) {
+            optional<int> parsed = parseString<int>(arg.substr(9));
+            if(!parsed || *parsed < 1) {
+                PANIC("Invalid frame count '", arg.substr(9), "'");
+            }
+            frames = *parsed;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--frames=N]\n";
+            return 1;
+        }
+    }
+
+    std::mt19937 rng(1);
+    size_t pixelCount = (size_t)Width * (size_t)Height;
+
+    vector<uint8_t> image(4 * pixelCount);
+    for(uint8_t& val : image) {
+        val = (uint8_t)rng();
+    }
+    vector<uint8_t> mask(pixelCount);
+    for(uint8_t& val : mask) {
+        val = rng() % 3 == 0 ? 1 : 0;
+    }
+
+    std::cout << "op,scenario,impl,frames,seconds,gb_per_s\n";
+
+    // Fill and masked blit
+    vector<uint8_t> dest1 = image;
+    vector<uint8_t> dest2 = image;
+    double fillSeconds = timeRows(frames, [](){}, [&](int y) {
+        fillPixels(&dest1[4 * y * Width], Width, 12, 34, 56);
+    });
+    double legacyFillSeconds = timeRows(frames, [](){}, [&](int y) {
+        legacyFill(&dest2[4 * y * Width], Width, 12, 34, 56);
+    });
+    REQUIRE(dest1 == dest2);
+    printResult("fill", "full_rows", "pixel_ops", frames, fillSeconds);
+    printResult("fill", "full_rows", "legacy", frames, legacyFillSeconds);
+
+    dest1 = image;
+    dest2 = image;
+    double blitSeconds = timeRows(frames, [](){}, [&](int y) {
+        blitMaskedPixels(&dest1[4 * y * Width], &mask[y * Width], Width, 12, 34, 56);
+    });
+    double legacyBlitSeconds = timeRows(frames, [](){}, [&](int y) {
+        legacyBlitMasked(&dest2[4 * y * Width], &mask[y * Width], Width, 12, 34, 56);
+    });
+    REQUIRE(dest1 == dest2);
+    printResult("blit_masked", "third_covered", "pixel_ops", frames, blitSeconds);
+    printResult("blit_masked", "third_covered", "legacy", frames, legacyBlitSeconds);
+
+    // Compare and copy, with the destination in different states relative to
+    // the source before each frame
+    vector<uint8_t> src = image;
+    for(const char* scenario : {"unchanged", "one_pixel_per_row", "all_changed"}) {
+        vector<uint8_t> prevFrame = image;
+        if(string(scenario) == "one_pixel_per_row") {
+            for(int y = 0; y < Height; ++y) {
+                prevFrame[4 * (y * Width + (int)(rng() % Width))] ^= 1;
+            }
+        } else if(string(scenario) == "all_changed") {
+            for(uint8_t& val : prevFrame) {
+                val ^= 1;
+            }
+        }
+
+        uint64_t changedRows = 0;
+        double seconds = timeRows(
+            frames,
+            [&]() { dest1 = prevFrame; },
+            [&](int y) {
+                pair<int, int> changed = copyChangedPixels(
+                    &dest1[4 * y * Width], &src[4 * y * Width], Width
+                );
+                changedRows += changed.first != changed.second;
+            }
+        );
+        uint64_t legacyChangedRows = 0;
+        double legacySeconds = timeRows(
+            frames,
+            [&]() { dest2 = prevFrame; },
+            [&](int y) {
+                legacyChangedRows += legacyCompareAndCopy(
+                    &dest2[4 * y * Width], &src[4 * y * Width], Width
+                );
+            }
+        );
+        REQUIRE(dest1 == src && dest2 == src);
+        REQUIRE(changedRows == legacyChangedRows);
+        printResult("compare_and_copy", scenario, "pixel_ops", frames, seconds);
+        printResult("compare_and_copy", scenario, "legacy", frames, legacySeconds);
+    }
+
+    return 0;
+}
@@ -9,10 +9,10 @@ namespace browservice {
 
 namespace {
 
-CefMouseEvent createMouseEvent(int x, int y, uint32_t eventModifiers) {
+CefMouseEvent createMouseEvent(pair<int, int> pos, uint32_t eventModifiers) {
     CefMouseEvent event;
-    event.x = x;
-    event.y = y;
+    event.x = pos.first;
+    event.y = pos.second;
     event.modifiers = eventModifiers;
     return event;
 }
@@ -101,9 +101,8 @@ public:
     virtual void GetViewRect(CefRefPtr<CefBrowser>, CefRect& rect) override {
         REQUIRE_UI_THREAD();
 
-        ImageSlice viewport = browserArea_->getViewport();
-        int width = max(min(viewport.width(), 4096), 64);
-        int height = max(min(viewport.height(), 4096), 64);
+        int width, height;
+        tie(width, height) = browserArea_->getViewSize_();
 
         rect.Set(0, 0, width, height);
     }
@@ -114,7 +113,10 @@ public:
         CefRect rect;
         GetViewRect(browser, rect);
 
-        info.device_scale_factor = 1.0;
+        // The view rect is in DIPs at the full size of the viewport, so
+        // Chromium lays out the page at full size but renders only
+        // renderScale_ times as many pixels in each direction.
+        info.device_scale_factor = (float)browserArea_->renderScale_;
         info.rect = rect;
         info.available_rect = rect;
 
@@ -136,11 +138,17 @@ public:
     virtual void OnPopupSize(CefRefPtr<CefBrowser> browser, const CefRect& rect) override {
         REQUIRE_UI_THREAD();
 
+        // The popup rect is given in DIPs, but it is used in OnPaint in
+        // pixels.
+        double scale = browserArea_->renderScale_;
+        auto toPixels = [scale](int val) {
+            return (int)std::round(val * scale);
+        };
         browserArea_->popupRect_ = Rect(
-            rect.x,
-            rect.x + rect.width,
-            rect.y,
-            rect.y + rect.height
+            toPixels(rect.x),
+            toPixels(rect.x + rect.width),
+            toPixels(rect.y),
+            toPixels(rect.y + rect.height)
         );
 
         if(browserArea_->popupOpen_) {
@@ -194,17 +202,13 @@ public:
                     return;
                 }
 
-                uint8_t* src = &((uint8_t*)buffer)[4 * (y * bufWidth + ax)];
+                const uint8_t* src = &((const uint8_t*)buffer)[4 * (y * bufWidth + ax)];
                 uint8_t* dest = viewport.getPixelPtr(ax + offsetX, y + offsetY);
-                int byteCount = 4 * (bx - ax);
-
-                if(updated) {
-                    memcpy(dest, src, byteCount);
-                } else {
-                    if(memcmp(src, dest, byteCount)) {
-                        updated = true;
-                        memcpy(dest, src, byteCount);
-                    }
+
+                // Only rows whose pixels actually changed mark the view dirty.
+                pair<int, int> changed = copyChangedPixels(dest, src, bx - ax);
+                if(changed.first != changed.second) {
+                    updated = true;
                 }
             };
 
@@ -231,7 +235,11 @@ public:
         }
 
         if(updated) {
-            postTask(
+            browserArea_->dirty_ = true;
+
+            // CEF may paint several times before the UI thread gets to the
+            // notification; the handler only needs to run once.
+            postUniqueTask(
                 browserArea_->eventHandler_,
                 &BrowserAreaEventHandler::onBrowserAreaViewDirty
             );
@@ -256,6 +264,8 @@ BrowserArea::BrowserArea(CKey,
     eventModifiers_ = 0;
     errorActive_ = false;
     errorLayout_ = TextLayout::create();
+    renderScale_ = 1.0;
+    dirty_ = false;
 }
 
 BrowserArea::~BrowserArea() {}
@@ -282,7 +292,7 @@ void BrowserArea::refreshStatusEvents() {
 
     int x, y;
     tie(x, y) = getLastMousePos_();
-    CefMouseEvent event = createMouseEvent(x, y, eventModifiers_);
+    CefMouseEvent event = createMouseEvent(toViewCoords_(x, y), eventModifiers_);
     browser_->GetHost()->SendMouseMoveEvent(event, !isMouseOver_());
 }
 
@@ -315,9 +325,56 @@ void BrowserArea::setCursor(int cursor) {
     setCursor_(cursor);
 }
 
+bool BrowserArea::popDirty() {
+    REQUIRE_UI_THREAD();
+
+    bool ret = dirty_;
+    dirty_ = false;
+    return ret;
+}
+
+void BrowserArea::setRenderScale(double scale) {
+    REQUIRE_UI_THREAD();
+    REQUIRE(scale >= 0.25 && scale <= 1.0);
+
+    if(scale == renderScale_) {
+        return;
+    }
+    renderScale_ = scale;
+
+    if(browser_) {
+        browser_->GetHost()->WasResized();
+        browser_->GetHost()->Invalidate(PET_VIEW);
+        browser_->GetHost()->Invalidate(PET_POPUP);
+    }
+}
+
+pair<int, int> BrowserArea::getViewSize_() {
+    ImageSlice viewport = getViewport();
+    int width = (int)std::round(viewport.width() / renderScale_);
+    int height = (int)std::round(viewport.height() / renderScale_);
+    width = max(min(width, 4096), 64);
+    height = max(min(height, 4096), 64);
+    return {width, height};
+}
+
+pair<int, int> BrowserArea::toViewCoords_(int x, int y) {
+    if(renderScale_ >= 1.0) {
+        return {x, y};
+    }
+    return {
+        (int)std::floor(x / renderScale_),
+        (int)std::floor(y / renderScale_)
+    };
+}
+
 void BrowserArea::widgetViewportUpdated_() {
     REQUIRE_UI_THREAD();
 
+    // The whole viewport is rendered and reported as damage by the widget
+    // tree after a viewport change, so the pending change is not needed.
+    dirty_ = false;
+
     if(browser_) {
         browser_->GetHost()->WasResized();
         browser_->GetHost()->Invalidate(PET_VIEW);
@@ -325,6 +382,11 @@ void BrowserArea::widgetViewportUpdated_() {
     }
 }
 
+bool BrowserArea::widgetRendersOpaque_() {
+    // The browser area renders the whole viewport by itself.
+    return true;
+}
+
 void BrowserArea::widgetMouseDownEvent_(int x, int y, int button) {
     REQUIRE_UI_THREAD();
 
@@ -333,7 +395,7 @@ void BrowserArea::widgetMouseDownEvent_(int x, int y, int button) {
     tie(buttonType, buttonFlag) = getMouseButtonInfo(button);
 
     if(browser_) {
-        CefMouseEvent event = createMouseEvent(x, y, eventModifiers_);
+        CefMouseEvent event = createMouseEvent(toViewCoords_(x, y), eventModifiers_);
         browser_->GetHost()->SendMouseClickEvent(event, buttonType, false, 1);
     }
 
@@ -348,7 +410,7 @@ void BrowserArea::widgetMouseUpEvent_(int x, int y, int button) {
     tie(buttonType, buttonFlag) = getMouseButtonInfo(button);
 
     if(browser_) {
-        CefMouseEvent event = createMouseEvent(x, y, eventModifiers_);
+        CefMouseEvent event = createMouseEvent(toViewCoords_(x, y), eventModifiers_);
         browser_->GetHost()->SendMouseClickEvent(event, buttonType, true, 1);
     }
 
@@ -359,7 +421,7 @@ void BrowserArea::widgetMouseDoubleClickEvent_(int x, int y) {
     REQUIRE_UI_THREAD();
     if(!browser_) return;
 
-    CefMouseEvent event = createMouseEvent(x, y, eventModifiers_);
+    CefMouseEvent event = createMouseEvent(toViewCoords_(x, y), eventModifiers_);
     browser_->GetHost()->SendMouseClickEvent(event, MBT_LEFT, false, 2);
     browser_->GetHost()->SendMouseClickEvent(event, MBT_LEFT, true, 2);
 }
@@ -368,7 +430,7 @@ void BrowserArea::widgetMouseWheelEvent_(int x, int y, int delta) {
     REQUIRE_UI_THREAD();
     if(!browser_) return;
 
-    CefMouseEvent event = createMouseEvent(x, y, eventModifiers_);
+    CefMouseEvent event = createMouseEvent(toViewCoords_(x, y), eventModifiers_);
     browser_->GetHost()->SendMouseWheelEvent(event, 0, delta);
 }
 
@@ -376,7 +438,7 @@ void BrowserArea::widgetMouseMoveEvent_(int x, int y) {
     REQUIRE_UI_THREAD();
     if(!browser_) return;
 
-    CefMouseEvent event = createMouseEvent(x, y, eventModifiers_);
+    CefMouseEvent event = createMouseEvent(toViewCoords_(x, y), eventModifiers_);
     browser_->GetHost()->SendMouseMoveEvent(event, false);
 }
 
@@ -384,7 +446,7 @@ void BrowserArea::widgetMouseEnterEvent_(int x, int y) {
     REQUIRE_UI_THREAD();
     if(!browser_) return;
 
-    CefMouseEvent event = createMouseEvent(x, y, eventModifiers_);
+    CefMouseEvent event = createMouseEvent(toViewCoords_(x, y), eventModifiers_);
     browser_->GetHost()->SendMouseMoveEvent(event, false);
 }
 
@@ -392,7 +454,7 @@ void BrowserArea::widgetMouseLeaveEvent_(int x, int y) {
     REQUIRE_UI_THREAD();
     if(!browser_) return;
 
-    CefMouseEvent event = createMouseEvent(x, y, eventModifiers_);
+    CefMouseEvent event = createMouseEvent(toViewCoords_(x, y), eventModifiers_);
     browser_->GetHost()->SendMouseMoveEvent(event, true);
 }
 
@@ -52,10 +52,30 @@ public:
     // Notify the browser area that the browser has changed the cursor type.
     void setCursor(int cursor);
 
+    // Returns true if the browser has changed the contents of the viewport
+    // since the previous call, and clears the flag. The changes are found by
+    // comparing the painted pixels to the previous contents, so paints that
+    // do not change any pixels do not count.
+    bool popDirty();
+
+    // Set the device scale factor (between 0.25 and 1) of the browser. The
+    // page is laid out for the viewport size divided by the factor and
+    // rendered at the resolution of the viewport, and mouse event coordinates
+    // are scaled accordingly.
+    void setRenderScale(double scale);
+
 private:
     class RenderHandler;
 
+    // Size of the view of the browser in DIPs (the viewport size divided by
+    // renderScale_).
+    pair<int, int> getViewSize_();
+
+    // Converts viewport coordinates to view coordinates (DIPs) of the browser.
+    pair<int, int> toViewCoords_(int x, int y);
+
     virtual void widgetViewportUpdated_() override;
+    virtual bool widgetRendersOpaque_() override;
 
     virtual void widgetMouseDownEvent_(int x, int y, int button) override;
     virtual void widgetMouseUpEvent_(int x, int y, int button) override;
@@ -79,6 +99,12 @@ private:
 
     bool errorActive_;
     shared_ptr<TextLayout> errorLayout_;
+
+    double renderScale_;
+
+    // Set when the browser has changed the viewport contents; returned and
+    // cleared by popDirty.
+    bool dirty_;
 };
 
 }
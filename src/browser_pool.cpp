@@ -0,0 +1,164 @@
+#include "browser_pool.hpp"
+
+namespace browservice {
+
+BrowserPool::BrowserPool(CKey,
+    weak_ptr<BrowserPoolEventHandler> eventHandler,
+    CefRefPtr<CefRequestContext> requestContext,
+    int size,
+    bool showSoftNavigationButtons,
+    double renderScale
+) {
+    REQUIRE_UI_THREAD();
+    REQUIRE(requestContext);
+    REQUIRE(size >= 0);
+
+    eventHandler_ = eventHandler;
+    requestContext_ = requestContext;
+    size_ = size;
+    showSoftNavigationButtons_ = showSoftNavigationButtons;
+    renderScale_ = renderScale;
+    state_ = Running;
+    refillScheduled_ = false;
+    nextWindowHandle_ = 1;
+}
+
+shared_ptr<Window> BrowserPool::tryTake(
+    shared_ptr<WindowEventHandler> eventHandler,
+    uint64_t handle,
+    optional<string> uri
+) {
+    REQUIRE_UI_THREAD();
+    REQUIRE(eventHandler);
+    REQUIRE(handle);
+
+    if(state_ != Running || pooledWindows_.empty()) {
+        return {};
+    }
+
+    auto it = pooledWindows_.begin();
+    shared_ptr<Window> window = it->second;
+    pooledWindows_.erase(it);
+
+    window->adopt(eventHandler, handle, move(uri));
+
+    scheduleRefill_();
+    return window;
+}
+
+void BrowserPool::shutdown() {
+    REQUIRE_UI_THREAD();
+
+    if(state_ == Running) {
+        state_ = WaitWindows;
+        if(size_ > 0) {
+            INFO_LOG("Shutting down browser pool");
+        }
+
+        map<uint64_t, shared_ptr<Window>> windows;
+        swap(windows, pooledWindows_);
+        for(pair<uint64_t, shared_ptr<Window>> p : windows) {
+            p.second->close();
+            REQUIRE(cleanupWindows_.insert(p).second);
+        }
+
+        checkCleanupComplete_();
+    }
+}
+
+void BrowserPool::onWindowClose(uint64_t handle) {
+    REQUIRE_UI_THREAD();
+    REQUIRE(state_ != ShutdownComplete);
+
+    // The window may have already been adopted (in which case the event
+    // belongs to its new handler) or closed by shutdown.
+    auto it = pooledWindows_.find(handle);
+    if(it == pooledWindows_.end()) {
+        return;
+    }
+
+    WARNING_LOG("Pooled window ", handle, " closed unexpectedly");
+
+    shared_ptr<Window> window = it->second;
+    pooledWindows_.erase(it);
+    REQUIRE(cleanupWindows_.emplace(handle, window).second);
+
+    scheduleRefill_();
+}
+
+void BrowserPool::onWindowCleanupComplete(uint64_t handle) {
+    REQUIRE_UI_THREAD();
+    REQUIRE(state_ != ShutdownComplete);
+
+    REQUIRE(cleanupWindows_.erase(handle));
+    checkCleanupComplete_();
+}
+
+optional<pair<vector<string>, size_t>> BrowserPool::onWindowQualitySelectorQuery(
+    uint64_t handle
+) {
+    return {};
+}
+
+bool BrowserPool::onWindowNeedsClipboardButtonQuery(uint64_t handle) {
+    return false;
+}
+
+bool BrowserPool::onWindowStartFileUpload(uint64_t handle) {
+    return false;
+}
+
+void BrowserPool::onWindowCreatePopupRequest(
+    uint64_t handle,
+    function<shared_ptr<Window>(uint64_t)> accept
+) {
+    REQUIRE_UI_THREAD();
+    INFO_LOG("Denying popup window request from pooled window ", handle);
+}
+
+void BrowserPool::afterConstruct_(shared_ptr<BrowserPool> self) {
+    scheduleRefill_();
+}
+
+void BrowserPool::refill_() {
+    REQUIRE_UI_THREAD();
+
+    refillScheduled_ = false;
+    if(state_ != Running || (int)pooledWindows_.size() >= size_) {
+        return;
+    }
+
+    uint64_t handle = nextWindowHandle_++;
+    REQUIRE(handle);
+
+    shared_ptr<Window> window = Window::tryCreatePooled(
+        shared_from_this(), requestContext_, handle, showSoftNavigationButtons_, renderScale_
+    );
+    if(window) {
+        REQUIRE(pooledWindows_.emplace(handle, window).second);
+
+        // Start the browsers one at a time to avoid stalling the UI thread.
+        scheduleRefill_();
+    } else {
+        WARNING_LOG("Creating pooled window failed, leaving browser pool partially filled");
+    }
+}
+
+void BrowserPool::scheduleRefill_() {
+    REQUIRE_UI_THREAD();
+
+    if(state_ == Running && !refillScheduled_ && (int)pooledWindows_.size() < size_) {
+        refillScheduled_ = true;
+        postTask(shared_from_this(), &BrowserPool::refill_);
+    }
+}
+
+void BrowserPool::checkCleanupComplete_() {
+    if(state_ == WaitWindows && cleanupWindows_.empty()) {
+        REQUIRE(pooledWindows_.empty());
+        state_ = ShutdownComplete;
+        postTask(eventHandler_, &BrowserPoolEventHandler::onBrowserPoolShutdownComplete);
+    }
+}
+
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "window.hpp"
+
+namespace browservice {
+
+class BrowserPoolEventHandler {
+public:
+    virtual void onBrowserPoolShutdownComplete() = 0;
+};
+
+// Pool of windows whose CEF browsers have been started in advance at
+// about:blank. Taking a window from the pool avoids waiting for the browser
+// and its renderer process to start when a new window is requested; the pool
+// is refilled in the background. Before destruction, call shutdown and wait
+// for the onBrowserPoolShutdownComplete event.
+class BrowserPool :
+    public WindowEventHandler,
+    public enable_shared_from_this<BrowserPool>
+{
+SHARED_ONLY_CLASS(BrowserPool);
+public:
+    BrowserPool(CKey,
+        weak_ptr<BrowserPoolEventHandler> eventHandler,
+        CefRefPtr<CefRequestContext> requestContext,
+        int size,
+        bool showSoftNavigationButtons,
+        double renderScale
+    );
+
+    // Returns a window from the pool adopted using Window::adopt with the given
+    // arguments, or an empty pointer if the pool is empty.
+    shared_ptr<Window> tryTake(
+        shared_ptr<WindowEventHandler> eventHandler,
+        uint64_t handle,
+        optional<string> uri
+    );
+
+    // Shutdown the pool if it is not already shut down
+    void shutdown();
+
+    // WindowEventHandler:
+    virtual void onWindowClose(uint64_t handle) override;
+    virtual void onWindowCleanupComplete(uint64_t handle) override;
+    virtual void onWindowViewImageChanged(uint64_t handle) override {}
+    virtual void onWindowTitleChanged(uint64_t handle) override {}
+    virtual void onWindowCursorChanged(uint64_t handle, int cursor) override {}
+    virtual optional<pair<vector<string>, size_t>> onWindowQualitySelectorQuery(
+        uint64_t handle
+    ) override;
+    virtual void onWindowQualityChanged(uint64_t handle, size_t idx) override {}
+    virtual bool onWindowNeedsClipboardButtonQuery(uint64_t handle) override;
+    virtual void onWindowClipboardButtonPressed(uint64_t handle) override {}
+    virtual void onWindowDownloadCompleted(
+        uint64_t handle, shared_ptr<CompletedDownload> file
+    ) override {}
+    virtual bool onWindowStartFileUpload(uint64_t handle) override;
+    virtual void onWindowCancelFileUpload(uint64_t handle) override {}
+    virtual void onWindowCreatePopupRequest(
+        uint64_t handle,
+        function<shared_ptr<Window>(uint64_t)> accept
+    ) override;
+
+private:
+    void afterConstruct_(shared_ptr<BrowserPool> self);
+
+    // Creates a new pooled window if the pool is not full and schedules itself
+    // to run again if more windows are needed.
+    void refill_();
+    void scheduleRefill_();
+
+    void checkCleanupComplete_();
+
+    weak_ptr<BrowserPoolEventHandler> eventHandler_;
+    CefRefPtr<CefRequestContext> requestContext_;
+    int size_;
+    bool showSoftNavigationButtons_;
+    double renderScale_;
+
+    enum {Running, WaitWindows, ShutdownComplete} state_;
+    bool refillScheduled_;
+
+    // Handles of the pooled windows are only used internally by the pool; the
+    // windows get their actual handles when they are taken from the pool.
+    uint64_t nextWindowHandle_;
+
+    // Ordered by creation time, so that the oldest (most likely fully started)
+    // window is taken first.
+    map<uint64_t, shared_ptr<Window>> pooledWindows_;
+    map<uint64_t, shared_ptr<Window>> cleanupWindows_;
+};
+
+}
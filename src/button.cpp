@@ -72,6 +72,10 @@ void Button::widgetRender_() {
     }
 }
 
+bool Button::widgetRendersOpaque_() {
+    return true;
+}
+
 void Button::widgetMouseDownEvent_(int x, int y, int button) {
     REQUIRE_UI_THREAD();
 
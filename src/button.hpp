@@ -23,6 +23,7 @@ public:
 private:
     // Widget:
     virtual void widgetRender_() override;
+    virtual bool widgetRendersOpaque_() override;
     virtual void widgetMouseDownEvent_(int x, int y, int button) override;
     virtual void widgetMouseUpEvent_(int x, int y, int button) override;
     virtual void widgetMouseMoveEvent_(int x, int y) override;
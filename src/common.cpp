@@ -127,11 +127,120 @@ void enablePanicUsingCEFFatalError() {
     panicUsingCEFFatalError_.store(true);
 }
 
+namespace {
+
+// The tasks waiting to be run by the next CEF task. A single batch shared by
+// all the threads keeps the tasks in the order they were posted.
+mutex taskBatchMutex;
+vector<function<void()>> taskBatch;
+set<UniqueTaskKey> taskBatchUniqueKeys;
+bool taskBatchCefTaskPending = false;
+
+atomic<uint64_t> postedTaskCount(0);
+atomic<uint64_t> duplicateTaskCount(0);
+atomic<uint64_t> cefTaskCount(0);
+
+void runTaskBatch() {
+    vector<function<void()>> tasks;
+    {
+        lock_guard<mutex> lock(taskBatchMutex);
+        REQUIRE(taskBatchCefTaskPending);
+        taskBatchCefTaskPending = false;
+        swap(tasks, taskBatch);
+        taskBatchUniqueKeys.clear();
+    }
+
+    // The tasks posted by these tasks go to a new batch that is run on the
+    // next CEF task, giving CEF the chance to process its own events first.
+    for(function<void()>& task : tasks) {
+        task();
+        task = nullptr;
+    }
+}
+
+// Must be called with taskBatchMutex locked. Returns true if the caller
+// should call postTaskBatch after unlocking the mutex.
+bool addToTaskBatch(function<void()> func) {
+    taskBatch.push_back(move(func));
+    if(taskBatchCefTaskPending) {
+        return false;
+    }
+    taskBatchCefTaskPending = true;
+    return true;
+}
+
+// Posts the CEF task that runs the batch; must be called without
+// taskBatchMutex locked. If posting fails (e.g. during CEF shutdown), the
+// tasks stay in the batch and the next postTask tries again.
+void postTaskBatch() {
+    cefTaskCount.fetch_add(1, memory_order_relaxed);
+    if(!CefPostTask(TID_UI, base::BindOnce(runTaskBatch))) {
+        {
+            lock_guard<mutex> lock(taskBatchMutex);
+            taskBatchCefTaskPending = false;
+        }
+        WARNING_LOG("Posting a task batch to the CEF UI thread failed");
+    }
+}
+
+}
+
+bool UniqueTaskKey::operator<(const UniqueTaskKey& other) const {
+    if(object_.owner_before(other.object_)) {
+        return true;
+    }
+    if(other.object_.owner_before(object_)) {
+        return false;
+    }
+    return func_ < other.func_;
+}
+
 void postTask(function<void()> func) {
-    void (*call)(function<void()>) = [](function<void()> func) {
-        func();
-    };
-    CefPostTask(TID_UI, base::BindOnce(call, func));
+    postedTaskCount.fetch_add(1, memory_order_relaxed);
+
+    bool needsPost;
+    {
+        lock_guard<mutex> lock(taskBatchMutex);
+        needsPost = addToTaskBatch(move(func));
+    }
+    if(needsPost) {
+        postTaskBatch();
+    }
+}
+
+void postUniqueTask(UniqueTaskKey key, function<void()> func) {
+    postedTaskCount.fetch_add(1, memory_order_relaxed);
+
+    bool needsPost;
+    {
+        lock_guard<mutex> lock(taskBatchMutex);
+        if(!taskBatchUniqueKeys.insert(move(key)).second) {
+            duplicateTaskCount.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+        needsPost = addToTaskBatch(move(func));
+    }
+    if(needsPost) {
+        postTaskBatch();
+    }
+}
+
+void discardPostedTasks() {
+    vector<function<void()>> tasks;
+    {
+        lock_guard<mutex> lock(taskBatchMutex);
+        taskBatchCefTaskPending = false;
+        swap(tasks, taskBatch);
+        taskBatchUniqueKeys.clear();
+    }
+}
+
+PostTaskStats getPostTaskStats() {
+    PostTaskStats stats;
+    stats.postedTaskCount = postedTaskCount.load(memory_order_relaxed);
+    stats.duplicateTaskCount = duplicateTaskCount.load(memory_order_relaxed);
+    stats.cefTaskCount = cefTaskCount.load(memory_order_relaxed);
+    return stats;
 }
 
 atomic<bool> requireUIThreadEnabled_(false);
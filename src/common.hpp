@@ -298,7 +298,9 @@ public:
         DISABLE_COPY_MOVE(ClassName)
 
 // Convenience functions for posting tasks to be run from the CEF UI thread
-// loop. May be called from any thread.
+// loop. May be called from any thread. The tasks posted between two runs of
+// the loop are collected into a batch that is run by a single CEF task, in the
+// order in which they were posted.
 void postTask(function<void()> func);
 
 template <typename T, typename... Args>
@@ -317,6 +319,68 @@ void postTask(weak_ptr<T> weakPtr, void (T::*func)(Args...), Args... args) {
     });
 }
 
+// Key identifying a notification posted using postUniqueTask: the target
+// object and the member function called on it.
+class UniqueTaskKey {
+public:
+    template <typename T>
+    UniqueTaskKey(weak_ptr<T> object, void (T::*func)()) : object_(object) {
+        static_assert(sizeof(func) <= sizeof(func_));
+        fill(func_.begin(), func_.end(), (unsigned char)0);
+        memcpy(func_.data(), &func, sizeof(func));
+    }
+
+    bool operator<(const UniqueTaskKey& other) const;
+
+private:
+    // The object is compared by its control block, which stays alive as long
+    // as the task holds a weak pointer to it, so the key cannot be confused
+    // with a new object at the same address.
+    weak_ptr<void> object_;
+    array<unsigned char, 2 * sizeof(void*)> func_;
+};
+
+// Like postTask, but the call is ignored if a task with the same key is
+// already waiting in the current batch. Use for idempotent notifications
+// (such as "view dirty") that are posted often but only need to be handled
+// once per run of the loop.
+void postUniqueTask(UniqueTaskKey key, function<void()> func);
+
+template <typename T>
+void postUniqueTask(weak_ptr<T> weakPtr, void (T::*func)()) {
+    postUniqueTask(UniqueTaskKey(weakPtr, func), [weakPtr, func]() {
+        if(shared_ptr<T> ptr = weakPtr.lock()) {
+            (ptr.get()->*func)();
+        }
+    });
+}
+
+template <typename T>
+void postUniqueTask(shared_ptr<T> ptr, void (T::*func)()) {
+    postUniqueTask(UniqueTaskKey(weak_ptr<T>(ptr), func), [ptr, func]() {
+        (ptr.get()->*func)();
+    });
+}
+
+struct PostTaskStats {
+    // Number of calls to postTask and postUniqueTask.
+    uint64_t postedTaskCount;
+
+    // Number of postUniqueTask calls ignored as duplicates.
+    uint64_t duplicateTaskCount;
+
+    // Number of CEF tasks posted to run the batches.
+    uint64_t cefTaskCount;
+};
+
+// May be called from any thread.
+PostTaskStats getPostTaskStats();
+
+// Destroys the posted tasks that have not been run. Called after shutting
+// down CEF, which drops the pending CEF tasks (including the one that would
+// have run the batch).
+void discardPostedTasks();
+
 // The macro REQUIRE_UI_THREAD is a version of CEF_REQUIRE_UI_THREAD that is
 // allowed to be called in any thread unless specifically enabled by
 // setRequireUIThreadEnabled. It should be enabled only when the control is in
@@ -31,9 +31,11 @@ public:
     const string startPage;
     const string dataDir;
     const int windowLimit;
+    const int browserPoolSize;
     const vector<pair<string, optional<string>>> chromiumArgs;
     const optional<bool> showSoftNavigationButtons;
     const double initialZoom;
+    const double renderScale;
     const BrowserFontRenderMode browserFontRenderMode;
     const set<string> certificateCheckExceptions;
     const bool showControlBar;
@@ -12,9 +12,11 @@
     CONF_FOREACH_OPT_ITEM(startPage) \
     CONF_FOREACH_OPT_ITEM(dataDir) \
     CONF_FOREACH_OPT_ITEM(windowLimit) \
+    CONF_FOREACH_OPT_ITEM(browserPoolSize) \
     CONF_FOREACH_OPT_ITEM(chromiumArgs) \
     CONF_FOREACH_OPT_ITEM(showSoftNavigationButtons) \
     CONF_FOREACH_OPT_ITEM(initialZoom) \
+    CONF_FOREACH_OPT_ITEM(renderScale) \
     CONF_FOREACH_OPT_ITEM(browserFontRenderMode) \
     CONF_FOREACH_OPT_ITEM(certificateCheckExceptions) \
     CONF_FOREACH_OPT_ITEM(showControlBar)
@@ -124,6 +126,22 @@ CONF_DEF_OPT_INFO(windowLimit) {
     }
 };
 
+CONF_DEF_OPT_INFO(browserPoolSize) {
+    const char* name = "browser-pool-size";
+    const char* valSpec = "COUNT";
+    string desc() {
+        return
+            "number of browsers started in advance in the background to make opening new windows faster "
+            "(each idle pooled browser consumes resources similarly to an open window)";
+    }
+    int defaultVal() {
+        return 0;
+    }
+    bool validate(int val) {
+        return val >= 0;
+    }
+};
+
 CONF_DEF_OPT_INFO(chromiumArgs) {
     const char* name = "chromium-args";
     const char* valSpec = "NAME(=VAL),...";
@@ -213,6 +231,20 @@ CONF_DEF_OPT_INFO(initialZoom) {
     }
 };
 
+CONF_DEF_OPT_INFO(renderScale) {
+    const char* name = "render-scale";
+    const char* valSpec = "FACTOR";
+    string desc() {
+        return "factor (between 0.25 and 1) by which the whole window image, including the control bar, is rendered at a reduced resolution and upscaled in the client; the page is laid out at full size, but the control bar is laid out for the reduced width and looks blocky when upscaled; smaller factors reduce rendering, compression and transfer work at the cost of sharpness (requires vice plugin support)";
+    }
+    double defaultVal() {
+        return 1.0;
+    }
+    bool validate(double val) {
+        return std::isfinite(val) && val >= 0.25 && val <= 1.0;
+    }
+};
+
 CONF_DEF_OPT_INFO(browserFontRenderMode) {
     const char* name = "browser-font-render-mode";
     const char* valSpec = "MODE";
@@ -977,7 +977,7 @@ void ControlBar::setLoading(bool loading) {
 
     if(loading != loading_) {
         loading_ = loading;
-        signalViewDirty_();
+        signalRegionDirty_(loadingBarRect_(layout_()));
     }
 }
 
@@ -1005,9 +1005,16 @@ void ControlBar::setDownloadProgress(vector<int> progress) {
     REQUIRE_UI_THREAD();
 
     if(progress != downloadProgress_) {
+        // The download button is shrunk to make room for the progress bar
+        // when it is shown.
+        bool layoutChanged = progress.empty() != downloadProgress_.empty();
         downloadProgress_ = move(progress);
-        signalViewDirty_();
-        widgetViewportUpdated_();
+        if(layoutChanged) {
+            signalViewDirty_();
+            widgetViewportUpdated_();
+        } else {
+            signalRegionDirty_(downloadProgressRect_(layout_()));
+        }
     }
 }
 
@@ -1254,11 +1261,92 @@ void ControlBar::widgetViewportUpdated_() {
     }
 }
 
-void ControlBar::widgetRender_() {
-    REQUIRE_UI_THREAD();
+Rect ControlBar::loadingBarRect_(const Layout& layout) {
+    return Rect(
+        layout.addrFieldStart - 2, layout.addrBoxEnd - 2,
+        Height - 7, Height - 6
+    );
+}
 
+Rect ControlBar::downloadProgressRect_(const Layout& layout) {
+    return Rect(layout.downloadStart, layout.downloadEnd, Height - 9, Height - 4);
+}
+
+void ControlBar::renderLoadingBar_(ImageSlice viewport, const Layout& layout) {
     animationTimeout_->clear(false);
 
+    Rect rect = loadingBarRect_(layout);
+    ImageSlice slice = viewport.subRect(
+        rect.startX, rect.endX, rect.startY, rect.endY
+    );
+
+    // Address field background
+    slice.fill(0, slice.width(), 0, slice.height(), 255);
+
+    if(loading_) {
+        int64_t elapsed;
+        if(loadingAnimationStartTime_) {
+            elapsed = duration_cast<milliseconds>(
+                steady_clock::now() - *loadingAnimationStartTime_
+            ).count();
+        } else {
+            elapsed = 0;
+            loadingAnimationStartTime_ = steady_clock::now();
+        }
+
+        if(!slice.isEmpty()) {
+            int barWidth = slice.width() / 12;
+            int64_t p = elapsed * (int64_t)slice.width() / (int64_t)5000;
+            int barStart = p % slice.width();
+            int barEnd = (p + barWidth) % slice.width();
+
+            if(barStart <= barEnd) {
+                slice.fill(barStart, barEnd, 0, slice.height(), 0, 0, 255);
+            } else {
+                slice.fill(0, barEnd, 0, slice.height(), 0, 0, 255);
+                slice.fill(barStart, slice.width(), 0, slice.height(), 0, 0, 255);
+            }
+        }
+
+        weak_ptr<ControlBar> selfWeak = shared_from_this();
+        animationTimeout_->set([selfWeak]() {
+            if(shared_ptr<ControlBar> self = selfWeak.lock()) {
+                self->signalRegionDirty_(self->loadingBarRect_(self->layout_()));
+            }
+        });
+    } else {
+        loadingAnimationStartTime_.reset();
+    }
+}
+
+void ControlBar::renderDownloadProgress_(
+    ImageSlice viewport,
+    const Layout& layout
+) {
+    if(!downloadProgress_.empty()) {
+        int startY = Height - 9;
+        int endY = Height - 4;
+
+        int startX = layout.downloadStart;
+        int downloadCount = (int)downloadProgress_.size();
+        int rangeLength = layout.downloadEnd - layout.downloadStart;
+        for(int i = 0; i < downloadCount; ++i) {
+            int endX =
+                layout.downloadStart +
+                ((i + 1) * rangeLength + downloadCount - 1) / downloadCount;
+            int barMaxX = endX - (i == downloadCount - 1 ? 0 : 1);
+            int barEndX = startX + downloadProgress_[i] * (barMaxX - startX) / 100;
+            viewport.fill(startX, barEndX, startY, endY, 0, 0, 255);
+            viewport.fill(barEndX, endX, startY, endY, 192);
+
+            startX = endX;
+        }
+    }
+}
+
+void ControlBar::widgetRender_() {
+    REQUIRE_UI_THREAD();
+
     ImageSlice viewport = getViewport();
     Layout layout = layout_();
 
@@ -1331,67 +1419,30 @@ void ControlBar::widgetRender_() {
         );
     }
 
-    // Download progress bar
-    if(!downloadProgress_.empty()) {
-        int startY = Height - 9;
-        int endY = Height - 4;
-
-        int startX = layout.downloadStart;
-        int downloadCount = (int)downloadProgress_.size();
-        int rangeLength = layout.downloadEnd - layout.downloadStart;
-        for(int i = 0; i < downloadCount; ++i) {
-            int endX =
-                layout.downloadStart +
-                ((i + 1) * rangeLength + downloadCount - 1) / downloadCount;
-            int barMaxX = endX - (i == downloadCount - 1 ? 0 : 1);
-            int barEndX = startX + downloadProgress_[i] * (barMaxX - startX) / 100;
-            viewport.fill(startX, barEndX, startY, endY, 0, 0, 255);
-            viewport.fill(barEndX, endX, startY, endY, 192);
-
-            startX = endX;
-        }
-    }
-
-    // Loading bar
-    if(loading_) {
-        int64_t elapsed;
-        if(loadingAnimationStartTime_) {
-            elapsed = duration_cast<milliseconds>(
-                steady_clock::now() - *loadingAnimationStartTime_
-            ).count();
-        } else {
-            elapsed = 0;
-            loadingAnimationStartTime_ = steady_clock::now();
-        }
-
-        ImageSlice slice = viewport.subRect(
-            layout.addrFieldStart - 2, layout.addrBoxEnd - 2,
-            Height - 7, Height - 6
-        );
+    renderDownloadProgress_(viewport, layout);
+    renderLoadingBar_(viewport, layout);
+}
 
-        if(!slice.isEmpty()) {
-            int barWidth = slice.width() / 12;
-            int64_t p = elapsed * (int64_t)slice.width() / (int64_t)5000;
-            int barStart = p % slice.width();
-            int barEnd = (p + barWidth) % slice.width();
+bool ControlBar::widgetRenderRegion_(Rect region) {
+    REQUIRE_UI_THREAD();
 
-            if(barStart <= barEnd) {
-                slice.fill(barStart, barEnd, 0, slice.height(), 0, 0, 255);
-            } else {
-                slice.fill(0, barEnd, 0, slice.height(), 0, 0, 255);
-                slice.fill(barStart, slice.width(), 0, slice.height(), 0, 0, 255);
-            }
-        }
+    ImageSlice viewport = getViewport();
+    Layout layout = layout_();
 
-        weak_ptr<ControlBar> selfWeak = shared_from_this();
-        animationTimeout_->set([selfWeak]() {
-            if(shared_ptr<ControlBar> self = selfWeak.lock()) {
-                self->signalViewDirty_();
-            }
-        });
-    } else {
-        loadingAnimationStartTime_.reset();
+    if(loadingBarRect_(layout).contains(region)) {
+        renderLoadingBar_(viewport, layout);
+        return true;
     }
+    if(downloadProgressRect_(layout).contains(region)) {
+        renderDownloadProgress_(viewport, layout);
+        return true;
+    }
+    return false;
+}
+
+bool ControlBar::widgetRendersOpaque_() {
+    REQUIRE_UI_THREAD();
+    return layout_().width == getViewport().width();
 }
 
 vector<shared_ptr<Widget>> ControlBar::widgetListChildren_() {
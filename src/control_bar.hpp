@@ -94,11 +94,20 @@ private:
     struct Layout;
     Layout layout_();
 
+    // The animated parts of the control bar are rendered separately so that
+    // their updates do not require rendering the whole control bar.
+    Rect loadingBarRect_(const Layout& layout);
+    Rect downloadProgressRect_(const Layout& layout);
+    void renderLoadingBar_(ImageSlice viewport, const Layout& layout);
+    void renderDownloadProgress_(ImageSlice viewport, const Layout& layout);
+
     void setBookmarkID_(optional<uint64_t> bookmarkID);
 
     // Widget:
     virtual void widgetViewportUpdated_() override;
     virtual void widgetRender_() override;
+    virtual bool widgetRenderRegion_(Rect region) override;
+    virtual bool widgetRendersOpaque_() override;
     virtual vector<shared_ptr<Widget>> widgetListChildren_() override;
 
     weak_ptr<ControlBarEventHandler> eventHandler_;
@@ -170,6 +170,7 @@ void FindBar::open() {
     if(!isOpen_) {
         isOpen_ = true;
         findResult_ = true;
+        textField_->setBackgroundColor(255, 255, 255);
         text_.reset();
         textField_->setText("");
         lastDirForward_ = true;
@@ -204,6 +205,11 @@ void FindBar::setFindResult(bool found) {
 
     if(isOpen_ && findResult_ != found) {
         findResult_ = found;
+        if(found) {
+            textField_->setBackgroundColor(255, 255, 255);
+        } else {
+            textField_->setBackgroundColor(255, 176, 176);
+        }
         signalViewDirty_();
     }
 }
@@ -355,6 +361,13 @@ void FindBar::widgetRender_() {
     }
 }
 
+bool FindBar::widgetRendersOpaque_() {
+    // When open, the text field area is rendered by widgetRender_ and the rest
+    // is covered by the buttons.
+    ImageSlice viewport = getViewport();
+    return isOpen_ && viewport.width() <= Width && viewport.height() <= Height;
+}
+
 vector<shared_ptr<Widget>> FindBar::widgetListChildren_() {
     return {textField_, downButton_, upButton_, closeButton_};
 }
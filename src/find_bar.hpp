@@ -52,6 +52,7 @@ private:
     // Widget:
     virtual void widgetViewportUpdated_() override;
     virtual void widgetRender_() override;
+    virtual bool widgetRendersOpaque_() override;
     virtual vector<shared_ptr<Widget>> widgetListChildren_() override;
 
     weak_ptr<FindBarEventHandler> eventHandler_;
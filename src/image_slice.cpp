@@ -8,13 +8,21 @@ ImageSlice ImageSlice::createImage(int width, int height, uint8_t r, uint8_t g,
     return slice;
 }
 
-ImageSlice ImageSlice::createImage(int width, int height, uint8_t rgb) {
+namespace {
+
+void checkImageSize(int width, int height) {
     REQUIRE(width >= 0 && height >= 0);
     const int Limit = INT_MAX / 9;
     REQUIRE(width < Limit && height < Limit);
     if(height > 0) {
         REQUIRE(width < Limit / height);
     }
+}
+
+}
+
+ImageSlice ImageSlice::createImage(int width, int height, uint8_t rgb) {
+    checkImageSize(width, height);
 
     ImageSlice slice;
     slice.globalBuf_.reset(new vector<uint8_t>(4 * width * height, rgb));
@@ -27,6 +35,37 @@ ImageSlice ImageSlice::createImage(int width, int height, uint8_t rgb) {
     return slice;
 }
 
+ImageSlice ImageSlice::createImageReusingBuffer(
+    ImageSlice image,
+    int width, int height,
+    uint8_t rgb
+) {
+    checkImageSize(width, height);
+
+    size_t size = 4 * (size_t)width * (size_t)height;
+    if(!image.globalBuf_ || image.globalBuf_->size() < size) {
+        // Grow the capacity by at least half so that a sequence of small
+        // increases in size does not reallocate every time.
+        size_t capacity = size;
+        if(image.globalBuf_) {
+            capacity = max(capacity, image.globalBuf_->size() * 3 / 2);
+        }
+        image.globalBuf_.reset(new vector<uint8_t>(capacity, rgb));
+    } else {
+        std::fill(image.globalBuf_->begin(), image.globalBuf_->begin() + size, rgb);
+    }
+
+    ImageSlice slice;
+    slice.globalBuf_ = image.globalBuf_;
+    slice.buf_ = slice.globalBuf_->data();
+    slice.width_ = width;
+    slice.height_ = height;
+    slice.pitch_ = width;
+    slice.globalX_ = 0;
+    slice.globalY_ = 0;
+    return slice;
+}
+
 ImageSlice ImageSlice::createImageFromStrings(
     const vector<string>& rows,
     const map<char, array<uint8_t, 3>>& colors
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "pixel_ops.hpp"
 #include "rect.hpp"
 
 namespace browservice {
@@ -22,6 +23,18 @@ public:
     static ImageSlice createImage(int width, int height, uint8_t r, uint8_t g, uint8_t b);
     static ImageSlice createImage(int width, int height, uint8_t rgb = 255);
 
+    // Like createImage(width, height, rgb), but reuses the buffer of image
+    // (originally created using createImage or createImageReusingBuffer) if it
+    // has enough capacity; otherwise, a new buffer is allocated with some
+    // extra capacity for further growth. As the buffer may be overwritten,
+    // image and any slices sharing its buffer should no longer be used after
+    // this call.
+    static ImageSlice createImageReusingBuffer(
+        ImageSlice image,
+        int width, int height,
+        uint8_t rgb = 255
+    );
+
     // Create new buffer with contents given by strings. In rows, each element
     // contains the pixels of each row as characters. The colors mapping
     // describes which color each character represents (given as RGB triplet).
@@ -144,13 +157,7 @@ public:
         endY = max(endY, startY);
 
         for(int y = startY; y < endY; ++y) {
-            uint8_t* pos = getPixelPtr(startX, y);
-            for(int x = startX; x < endX; ++x) {
-                *(pos + 2) = r;
-                *(pos + 1) = g;
-                *(pos + 0) = b;
-                pos += 4;
-            }
+            fillPixels(getPixelPtr(startX, y), endX - startX, r, g, b);
         }
     }
     void fill(int startX, int endX, int startY, int endY, uint8_t rgb) {
@@ -317,7 +317,15 @@ int main(int argc, char* argv[]) {
 
         REQUIRE(cefQuitMessageLoopCalled);
 
+        PostTaskStats postTaskStats = getPostTaskStats();
+        INFO_LOG(
+            "Posted ", postTaskStats.postedTaskCount, " tasks (",
+            postTaskStats.duplicateTaskCount, " coalesced as duplicates) using ",
+            postTaskStats.cefTaskCount, " CEF tasks"
+        );
+
         CefShutdown();
+        discardPostedTasks();
 
         app = nullptr;
     }
@@ -49,8 +49,9 @@ void MenuButton::widgetRender_() {
     int width = icon_.first.width() + 3;
     int height = icon_.first.height() + 3;
 
-    // Background
-    viewport.fill(0, width, 0, height, 192);
+    // Background (the whole viewport, so that the button can be rendered
+    // without its parent)
+    viewport.fill(0, viewport.width(), 0, viewport.height(), 192);
 
     if(mouseOver_) {
         // Frame
@@ -67,6 +68,10 @@ void MenuButton::widgetRender_() {
     }
 }
 
+bool MenuButton::widgetRendersOpaque_() {
+    return true;
+}
+
 void MenuButton::widgetMouseDownEvent_(int x, int y, int button) {
     REQUIRE_UI_THREAD();
 
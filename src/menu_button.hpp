@@ -37,6 +37,7 @@ private:
 
     // Widget:
     virtual void widgetRender_() override;
+    virtual bool widgetRendersOpaque_() override;
     virtual void widgetMouseDownEvent_(int x, int y, int button) override;
     virtual void widgetMouseUpEvent_(int x, int y, int button) override;
     virtual void widgetMouseMoveEvent_(int x, int y) override;
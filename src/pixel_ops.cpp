@@ -0,0 +1,217 @@
+#include "pixel_ops.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define BROWSERVICE_PIXEL_OPS_SSE2
+#define BROWSERVICE_PIXEL_OPS_VECTOR
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define BROWSERVICE_PIXEL_OPS_NEON
+#define BROWSERVICE_PIXEL_OPS_VECTOR
+#include <arm_neon.h>
+#endif
+
+namespace browservice {
+
+namespace {
+
+uint32_t packColor(uint8_t r, uint8_t g, uint8_t b) {
+    uint8_t bytes[4] = {b, g, r, 0};
+    uint32_t ret;
+    memcpy(&ret, bytes, 4);
+    return ret;
+}
+
+// Mask of the color bytes in a pixel loaded as uint32_t.
+uint32_t colorMask() {
+    return packColor(255, 255, 255);
+}
+
+uint32_t loadPixel(const uint8_t* pos) {
+    uint32_t ret;
+    memcpy(&ret, pos, 4);
+    return ret;
+}
+
+void storePixel(uint8_t* pos, uint32_t val) {
+    memcpy(pos, &val, 4);
+}
+
+// Minimal wrappers for the vector instructions used below; each vector holds 4
+// pixels.
+#if defined(BROWSERVICE_PIXEL_OPS_SSE2)
+
+const int VecPixels = 4;
+typedef __m128i Vec;
+
+Vec vecLoad(const uint8_t* pos) {
+    return _mm_loadu_si128((const __m128i*)pos);
+}
+void vecStore(uint8_t* pos, Vec val) {
+    _mm_storeu_si128((__m128i*)pos, val);
+}
+Vec vecSplat(uint32_t val) {
+    return _mm_set1_epi32((int)val);
+}
+Vec vecAnd(Vec a, Vec b) {
+    return _mm_and_si128(a, b);
+}
+// Returns (a & mask) | (b & ~mask).
+Vec vecSelect(Vec mask, Vec a, Vec b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+// Returns a mask that has all bits of pixel i set if mask[i] is nonzero.
+Vec vecExpandMask(const uint8_t* mask) {
+    Vec bytes = _mm_cvtsi32_si128((int)loadPixel(mask));
+    Vec zero = _mm_cmpeq_epi8(bytes, _mm_setzero_si128());
+    zero = _mm_unpacklo_epi8(zero, zero);
+    zero = _mm_unpacklo_epi16(zero, zero);
+    return _mm_xor_si128(zero, _mm_set1_epi32(-1));
+}
+// Returns a bitmask where bit i is set if pixel i differs between a and b.
+unsigned vecDiffBits(Vec a, Vec b) {
+    unsigned eq = (unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(a, b)));
+    return ~eq & 0xF;
+}
+
+#elif defined(BROWSERVICE_PIXEL_OPS_NEON)
+
+const int VecPixels = 4;
+typedef uint32x4_t Vec;
+
+Vec vecLoad(const uint8_t* pos) {
+    return vreinterpretq_u32_u8(vld1q_u8(pos));
+}
+void vecStore(uint8_t* pos, Vec val) {
+    vst1q_u8(pos, vreinterpretq_u8_u32(val));
+}
+Vec vecSplat(uint32_t val) {
+    return vdupq_n_u32(val);
+}
+Vec vecAnd(Vec a, Vec b) {
+    return vandq_u32(a, b);
+}
+Vec vecSelect(Vec mask, Vec a, Vec b) {
+    return vbslq_u32(mask, a, b);
+}
+Vec vecExpandMask(const uint8_t* mask) {
+    uint32_t vals[4] = {mask[0], mask[1], mask[2], mask[3]};
+    Vec val = vld1q_u32(vals);
+    return vtstq_u32(val, val);
+}
+unsigned vecDiffBits(Vec a, Vec b) {
+    const uint32_t bitVals[4] = {1, 2, 4, 8};
+    Vec diff = vmvnq_u32(vceqq_u32(a, b));
+    return vaddvq_u32(vandq_u32(diff, vld1q_u32(bitVals)));
+}
+
+#endif
+
+}
+
+void fillPixels(uint8_t* dest, int count, uint8_t r, uint8_t g, uint8_t b) {
+    REQUIRE(count >= 0);
+
+    uint32_t color = packColor(r, g, b);
+    uint32_t mask = colorMask();
+
+    int i = 0;
+#ifdef BROWSERVICE_PIXEL_OPS_VECTOR
+    Vec colorVec = vecSplat(color);
+    Vec maskVec = vecSplat(mask);
+    for(; i + VecPixels <= count; i += VecPixels) {
+        uint8_t* pos = dest + 4 * i;
+        vecStore(pos, vecSelect(maskVec, colorVec, vecLoad(pos)));
+    }
+#endif
+    for(; i < count; ++i) {
+        uint8_t* pos = dest + 4 * i;
+        storePixel(pos, color | (loadPixel(pos) & ~mask));
+    }
+}
+
+void blitMaskedPixels(
+    uint8_t* dest,
+    const uint8_t* mask,
+    int count,
+    uint8_t r, uint8_t g, uint8_t b
+) {
+    REQUIRE(count >= 0);
+
+    uint32_t color = packColor(r, g, b);
+    uint32_t writeMask = colorMask();
+
+    int i = 0;
+#ifdef BROWSERVICE_PIXEL_OPS_VECTOR
+    Vec colorVec = vecSplat(color);
+    Vec writeMaskVec = vecSplat(writeMask);
+    for(; i + VecPixels <= count; i += VecPixels) {
+        if(!loadPixel(mask + i)) {
+            continue;
+        }
+        uint8_t* pos = dest + 4 * i;
+        Vec pixelMask = vecAnd(vecExpandMask(mask + i), writeMaskVec);
+        vecStore(pos, vecSelect(pixelMask, colorVec, vecLoad(pos)));
+    }
+#endif
+    for(; i < count; ++i) {
+        if(mask[i]) {
+            uint8_t* pos = dest + 4 * i;
+            storePixel(pos, color | (loadPixel(pos) & ~writeMask));
+        }
+    }
+}
+
+pair<int, int> copyChangedPixels(uint8_t* dest, const uint8_t* src, int count) {
+    REQUIRE(count >= 0);
+
+    // Instead of copying while comparing, we find the first and the last
+    // differing pixel by scanning from both ends and copy the range between
+    // them with a single memcpy. Most rows either do not change at all or
+    // change in a narrow range, and in both cases each pixel is compared
+    // only once.
+    int first = 0;
+#ifdef BROWSERVICE_PIXEL_OPS_VECTOR
+    while(first + 4 * VecPixels <= count) {
+        const uint8_t* a = src + 4 * first;
+        const uint8_t* b = dest + 4 * first;
+        unsigned diff = 0;
+        for(int j = 0; j < 4; ++j) {
+            diff |= vecDiffBits(vecLoad(a + 16 * j), vecLoad(b + 16 * j));
+        }
+        if(diff) {
+            break;
+        }
+        first += 4 * VecPixels;
+    }
+#endif
+    while(first < count && loadPixel(src + 4 * first) == loadPixel(dest + 4 * first)) {
+        ++first;
+    }
+    if(first == count) {
+        return {0, 0};
+    }
+
+    int end = count;
+#ifdef BROWSERVICE_PIXEL_OPS_VECTOR
+    while(end - 4 * VecPixels > first) {
+        const uint8_t* a = src + 4 * (end - 4 * VecPixels);
+        const uint8_t* b = dest + 4 * (end - 4 * VecPixels);
+        unsigned diff = 0;
+        for(int j = 0; j < 4; ++j) {
+            diff |= vecDiffBits(vecLoad(a + 16 * j), vecLoad(b + 16 * j));
+        }
+        if(diff) {
+            break;
+        }
+        end -= 4 * VecPixels;
+    }
+#endif
+    while(loadPixel(src + 4 * (end - 1)) == loadPixel(dest + 4 * (end - 1))) {
+        --end;
+    }
+
+    memcpy(dest + 4 * first, src + 4 * first, 4 * (size_t)(end - first));
+    return {first, end};
+}
+
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "common.hpp"
+
+namespace browservice {
+
+// Operations on rows of pixels in the format of ImageSlice (4 bytes per pixel
+// in order blue, green, red and an unused byte). The operations process
+// multiple pixels at a time using SSE2 on x86-64 and NEON on AArch64, and fall
+// back to plain loops on other platforms.
+
+// Set the color of count pixels starting from dest to (r, g, b). The unused
+// bytes of the pixels are left intact.
+void fillPixels(uint8_t* dest, int count, uint8_t r, uint8_t g, uint8_t b);
+
+// Set the color of each of the count pixels starting from dest to (r, g, b) if
+// the corresponding byte in mask is nonzero. The unused bytes of the pixels
+// are left intact.
+void blitMaskedPixels(
+    uint8_t* dest,
+    const uint8_t* mask,
+    int count,
+    uint8_t r, uint8_t g, uint8_t b
+);
+
+// Make the count pixels starting from dest equal to the pixels starting from
+// src (all four bytes of each pixel), copying only the range from the first to
+// the last differing pixel. Returns that range as [start, end), or (0, 0) if
+// the pixels were already equal (in which case dest is not written to).
+pair<int, int> copyChangedPixels(uint8_t* dest, const uint8_t* src, int count);
+
+}
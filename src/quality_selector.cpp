@@ -206,6 +206,11 @@ void QualitySelector::widgetRender_() {
     drawButton(11, false, downKeyPressed_ || downButtonPressed_, choiceIdx_ > (size_t)0);
 }
 
+bool QualitySelector::widgetRendersOpaque_() {
+    ImageSlice viewport = getViewport();
+    return viewport.width() <= Width && viewport.height() <= Height;
+}
+
 vector<shared_ptr<Widget>> QualitySelector::widgetListChildren_() {
     REQUIRE_UI_THREAD();
     return {textField_};
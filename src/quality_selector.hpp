@@ -48,6 +48,7 @@ private:
     // Widget:
     virtual void widgetViewportUpdated_() override;
     virtual void widgetRender_() override;
+    virtual bool widgetRendersOpaque_() override;
     virtual vector<shared_ptr<Widget>> widgetListChildren_() override;
     virtual void widgetMouseDownEvent_(int x, int y, int button) override;
     virtual void widgetMouseUpEvent_(int x, int y, int button) override;
@@ -19,6 +19,7 @@ Server::Server(CKey,
     viceCtx_ = viceCtx;
     clipboardContentRequested_ = false;
     requestContext_ = requestContext;
+    browserPoolShutdownComplete_ = false;
 
     // Setup is finished in afterConstruct_
 }
@@ -38,6 +39,8 @@ void Server::shutdown() {
             REQUIRE(cleanupWindows_.insert(p).second);
         }
 
+        browserPool_->shutdown();
+
         checkCleanupComplete_();
     }
 }
@@ -65,15 +68,10 @@ uint64_t Server::onViceContextCreateWindowRequest(string& reason, optional<strin
     uint64_t handle = nextWindowHandle_++;
     REQUIRE(handle);
 
-    bool showNavigationButtons;
-    if(globals->config->showSoftNavigationButtons.has_value()) {
-        showNavigationButtons = globals->config->showSoftNavigationButtons.value();
-    } else {
-        optional<bool> viceHasNavigationControls = viceCtx_->hasNavigationControls();
-        showNavigationButtons = !viceHasNavigationControls.has_value() || viceHasNavigationControls.value() == false;
+    shared_ptr<Window> window = browserPool_->tryTake(shared_from_this(), handle, uri);
+    if(!window) {
+        window = Window::tryCreate(shared_from_this(), requestContext_, handle, uri, showSoftNavigationButtons_(), viceCtx_->renderScale());
     }
-
-    shared_ptr<Window> window = Window::tryCreate(shared_from_this(), requestContext_, handle, uri, showNavigationButtons);
     if(window) {
         REQUIRE(openWindows_.emplace(handle, window).second);
         return handle;
@@ -477,12 +475,45 @@ void Server::onWindowCreatePopupRequest(
     }
 }
 
+void Server::onBrowserPoolShutdownComplete() {
+    REQUIRE_UI_THREAD();
+    REQUIRE(state_ == WaitWindows);
+
+    browserPoolShutdownComplete_ = true;
+    checkCleanupComplete_();
+}
+
 void Server::afterConstruct_(shared_ptr<Server> self) {
     viceCtx_->start(self);
+
+    // The pool is warmed up only after the context has started, as the pooled
+    // windows depend on the features of the running context. The plugin
+    // events are delivered through pumpEvents in later tasks, so the pool
+    // exists before the first window request.
+    browserPool_ = BrowserPool::create(
+        self,
+        requestContext_,
+        globals->config->browserPoolSize,
+        showSoftNavigationButtons_(),
+        viceCtx_->renderScale()
+    );
+}
+
+bool Server::showSoftNavigationButtons_() {
+    if(globals->config->showSoftNavigationButtons.has_value()) {
+        return globals->config->showSoftNavigationButtons.value();
+    } else {
+        optional<bool> viceHasNavigationControls = viceCtx_->hasNavigationControls();
+        return !viceHasNavigationControls.has_value() || viceHasNavigationControls.value() == false;
+    }
 }
 
 void Server::checkCleanupComplete_() {
-    if(state_ == WaitWindows && cleanupWindows_.empty()) {
+    if(
+        state_ == WaitWindows &&
+        cleanupWindows_.empty() &&
+        browserPoolShutdownComplete_
+    ) {
         REQUIRE(openWindows_.empty());
         state_ = WaitViceContext;
         viceCtx_->shutdown();
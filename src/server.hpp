@@ -1,6 +1,6 @@
 #pragma once
 
-#include "window.hpp"
+#include "browser_pool.hpp"
 #include "vice.hpp"
 
 namespace browservice {
@@ -16,6 +16,7 @@ public:
 class Server :
     public ViceContextEventHandler,
     public WindowEventHandler,
+    public BrowserPoolEventHandler,
     public enable_shared_from_this<Server>
 {
 SHARED_ONLY_CLASS(Server);
@@ -92,9 +93,14 @@ public:
         function<shared_ptr<Window>(uint64_t)> accept
     ) override;
 
+    // BrowserPoolEventHandler:
+    virtual void onBrowserPoolShutdownComplete() override;
+
 private:
     void afterConstruct_(shared_ptr<Server> self);
 
+    bool showSoftNavigationButtons_();
+
     void checkCleanupComplete_();
 
     weak_ptr<ServerEventHandler> eventHandler_;
@@ -106,6 +112,9 @@ private:
     map<uint64_t, shared_ptr<Window>> openWindows_;
     map<uint64_t, shared_ptr<Window>> cleanupWindows_;
 
+    shared_ptr<BrowserPool> browserPool_;
+    bool browserPoolShutdownComplete_;
+
     bool clipboardContentRequested_;
 
     CefRefPtr<CefRequestContext> requestContext_;
@@ -95,6 +95,52 @@ private:
 
 }
 
+namespace {
+
+struct Graymap {
+    int width;
+    int height;
+    vector<uint8_t> buffer;
+    FT_Bitmap ftBitmap;
+
+    Graymap(int pWidth, int pHeight) {
+        width = pWidth;
+        height = pHeight;
+
+        REQUIRE(width >= 1);
+        REQUIRE(height >= 1);
+
+        const int Limit = INT_MAX / 9;
+        REQUIRE(width < Limit / height);
+
+        buffer.resize(width * height);
+        ftBitmap.rows = height;
+        ftBitmap.width = width;
+        ftBitmap.pitch = width;
+        ftBitmap.buffer = buffer.data();
+        ftBitmap.pixel_mode = FT_PIXEL_MODE_GRAY;
+    }
+
+    Graymap(const Graymap&) = delete;
+    Graymap& operator=(const Graymap&) = delete;
+
+    Graymap(Graymap&&) = default;
+    Graymap& operator=(Graymap&&) = default;
+};
+
+// Rasterized glyph as rendered by pango_ft2_render into an empty graymap,
+// cropped to the nonzero pixels. The position of the bitmap is given relative
+// to the glyph origin on the baseline.
+struct GlyphBitmap {
+    int left;
+    int top;
+    int width;
+    int height;
+    vector<uint8_t> buffer;
+};
+
+}
+
 struct TextRenderContext::Impl {
     PangoFontMap* fontMap;
     PangoContext* pangoCtx;
@@ -136,48 +182,106 @@ struct TextRenderContext::Impl {
     }
 
     ~Impl() {
+        clearGlyphCache();
         pango_font_description_free(fontDesc);
         g_object_unref(pangoCtx);
         g_object_unref(fontMap);
     }
 
     DISABLE_COPY_MOVE(Impl);
-};
 
-namespace {
+    // Returns the rasterized glyph from the cache, rasterizing it if it is
+    // not already there.
+    shared_ptr<const GlyphBitmap> getGlyph(PangoFont* font, PangoGlyph glyph) {
+        pair<PangoFont*, PangoGlyph> key(font, glyph);
+        auto it = glyphCache.find(key);
+        if(it != glyphCache.end()) {
+            return it->second;
+        }
 
-struct Graymap {
-    int width;
-    int height;
-    vector<uint8_t> buffer;
-    FT_Bitmap ftBitmap;
+        // Layouts hold their own references to the glyphs, so we can simply
+        // start over if the cache grows too large.
+        if(glyphCache.size() >= MaxGlyphCacheSize) {
+            clearGlyphCache();
+        }
 
-    Graymap(int pWidth, int pHeight) {
-        width = pWidth;
-        height = pHeight;
+        shared_ptr<const GlyphBitmap> ret = rasterizeGlyph(font, glyph);
 
-        REQUIRE(width >= 1);
-        REQUIRE(height >= 1);
+        // Keep the font alive while it is in the cache so that its address is
+        // not reused for a different font.
+        g_object_ref(font);
+        glyphCache.emplace(key, ret);
 
-        const int Limit = INT_MAX / 9;
-        REQUIRE(width < Limit / height);
+        return ret;
+    }
 
-        buffer.resize(width * height);
-        ftBitmap.rows = height;
-        ftBitmap.width = width;
-        ftBitmap.pitch = width;
-        ftBitmap.buffer = buffer.data();
-        ftBitmap.pixel_mode = FT_PIXEL_MODE_GRAY;
+    void clearGlyphCache() {
+        for(const auto& elem : glyphCache) {
+            g_object_unref(elem.first.first);
+        }
+        glyphCache.clear();
     }
 
-    Graymap(const Graymap&) = delete;
-    Graymap& operator=(const Graymap&) = delete;
+    static shared_ptr<const GlyphBitmap> rasterizeGlyph(
+        PangoFont* font,
+        PangoGlyph glyph
+    ) {
+        PangoRectangle ink;
+        pango_font_get_glyph_extents(font, glyph, &ink, nullptr);
+        pango_extents_to_pixels(&ink, nullptr);
+
+        // The ink extents reported by Pango may be slightly off for the
+        // hinted glyphs, so we render with a margin and crop the result.
+        const int Margin = 4;
+        int originX = Margin - ink.x;
+        int originY = Margin - ink.y;
+        Graymap graymap(
+            max(ink.width, 0) + 2 * Margin,
+            max(ink.height, 0) + 2 * Margin
+        );
 
-    Graymap(Graymap&&) = default;
-    Graymap& operator=(Graymap&&) = default;
-};
+        PangoGlyphString* glyphs = pango_glyph_string_new();
+        pango_glyph_string_set_size(glyphs, 1);
+        glyphs->glyphs[0].glyph = glyph;
+        glyphs->glyphs[0].geometry.width = 0;
+        glyphs->glyphs[0].geometry.x_offset = 0;
+        glyphs->glyphs[0].geometry.y_offset = 0;
+        glyphs->glyphs[0].attr.is_cluster_start = 1;
+        pango_ft2_render(&graymap.ftBitmap, font, glyphs, originX, originY);
+        pango_glyph_string_free(glyphs);
+
+        // The glyphs are thresholded only after they have been composited
+        // into the layout, so we keep all the nonzero coverage.
+        Rect bounds;
+        for(int y = 0; y < graymap.height; ++y) {
+            for(int x = 0; x < graymap.width; ++x) {
+                if(graymap.buffer[y * graymap.width + x] != 0) {
+                    bounds = Rect::boundingBox(bounds, Rect(x, x + 1, y, y + 1));
+                }
+            }
+        }
 
-}
+        shared_ptr<GlyphBitmap> ret = make_shared<GlyphBitmap>();
+        ret->left = bounds.startX - originX;
+        ret->top = bounds.startY - originY;
+        ret->width = bounds.endX - bounds.startX;
+        ret->height = bounds.endY - bounds.startY;
+        ret->buffer.resize((size_t)ret->width * (size_t)ret->height);
+        for(int y = 0; y < ret->height; ++y) {
+            memcpy(
+                &ret->buffer[y * ret->width],
+                &graymap.buffer[(bounds.startY + y) * graymap.width + bounds.startX],
+                ret->width
+            );
+        }
+        return ret;
+    }
+
+    static constexpr size_t MaxGlyphCacheSize = 4096;
+
+    // Cache of rasterized glyphs shared by all the layouts of the context.
+    map<pair<PangoFont*, PangoGlyph>, shared_ptr<const GlyphBitmap>> glyphCache;
+};
 
 struct TextLayout::Impl {
     shared_ptr<TextRenderContext> ctx;
@@ -185,7 +289,10 @@ struct TextLayout::Impl {
 
     string text;
 
-    optional<Graymap> graymap;
+    // The layout rendered lazily into a graymap covering its logical extents
+    // and thresholded to a mask (1 for the pixels to draw, 0 otherwise).
+    optional<vector<uint8_t>> mask;
+    PangoRectangle maskExtents;
 
     Impl(shared_ptr<TextRenderContext> ctx) : ctx(ctx) {
         layout = pango_layout_new(ctx->impl_->pangoCtx);
@@ -203,7 +310,7 @@ struct TextLayout::Impl {
     DISABLE_COPY_MOVE(Impl);
 
     void setText(string newText) {
-        graymap.reset();
+        mask.reset();
 
         pango_layout_set_text(layout, newText.data(), (int)newText.size());
 
@@ -264,12 +371,14 @@ struct TextLayout::Impl {
         int offsetX, int offsetY,
         uint8_t r, uint8_t g, uint8_t b
     ) {
-        ensureGraymapRendered();
+        ensureMaskRendered();
 
-        offsetY += dest.height() - graymap->height;
+        int width = maskExtents.width;
+        int height = maskExtents.height;
+        offsetY += dest.height() - height;
 
         Rect rect = Rect::intersection(
-            Rect(0, graymap->width, 0, graymap->height),
+            Rect(0, width, 0, height),
             Rect::translate(
                 Rect(0, dest.width(), 0, dest.height()),
                 -offsetX, -offsetY
@@ -278,20 +387,12 @@ struct TextLayout::Impl {
 
         if(!rect.isEmpty()) {
             for(int y = rect.startY; y < rect.endY; ++y) {
-                uint8_t* graymapPos =
-                    &graymap->buffer[y * graymap->width + rect.startX];
-                uint8_t* destPos =
-                    dest.getPixelPtr(rect.startX + offsetX, y + offsetY);
-
-                for(int x = rect.startX; x < rect.endX; ++x) {
-                    if(*graymapPos >= 128) {
-                        *(destPos + 0) = b;
-                        *(destPos + 1) = g;
-                        *(destPos + 2) = r;
-                    }
-                    ++graymapPos;
-                    destPos += 4;
-                }
+                blitMaskedPixels(
+                    dest.getPixelPtr(rect.startX + offsetX, y + offsetY),
+                    &(*mask)[y * width + rect.startX],
+                    rect.endX - rect.startX,
+                    r, g, b
+                );
             }
         }
     }
@@ -304,12 +405,70 @@ struct TextLayout::Impl {
         return extents;
     }
 
-    void ensureGraymapRendered() {
-        if(graymap) return;
+    // Renders the layout the same way as pango_ft2_render_layout would
+    // (compositing the glyphs with saturating addition), using the rasterized
+    // glyphs from the glyph cache of the context instead of rasterizing the
+    // whole layout, and thresholds the result.
+    void ensureMaskRendered() {
+        if(mask) return;
 
         PangoRectangle extents = getExtents();
-        graymap = Graymap(extents.width, extents.height);
-        pango_ft2_render_layout(&graymap->ftBitmap, layout, -extents.x, -extents.y);
+        Graymap graymap(extents.width, extents.height);
+        Rect graymapRect(0, graymap.width, 0, graymap.height);
+
+        PangoLayoutIter* iter = pango_layout_get_iter(layout);
+        REQUIRE(iter != nullptr);
+        do {
+            PangoLayoutRun* run = pango_layout_iter_get_run_readonly(iter);
+            if(run == nullptr) {
+                continue;
+            }
+
+            PangoRectangle runRect;
+            pango_layout_iter_get_run_extents(iter, nullptr, &runRect);
+            int baseline = pango_layout_iter_get_baseline(iter);
+
+            PangoFont* font = run->item->analysis.font;
+            PangoGlyphString* glyphs = run->glyphs;
+            int x = runRect.x;
+            for(int i = 0; i < glyphs->num_glyphs; ++i) {
+                const PangoGlyphInfo& info = glyphs->glyphs[i];
+                if(info.glyph != PANGO_GLYPH_EMPTY) {
+                    shared_ptr<const GlyphBitmap> glyph =
+                        ctx->impl_->getGlyph(font, info.glyph);
+
+                    // Position of the top left corner of the glyph bitmap in
+                    // the graymap.
+                    int glyphX = PANGO_PIXELS(x + info.geometry.x_offset) + glyph->left - extents.x;
+                    int glyphY = PANGO_PIXELS(baseline + info.geometry.y_offset) + glyph->top - extents.y;
+                    Rect rect = Rect::intersection(
+                        graymapRect,
+                        Rect(
+                            glyphX, glyphX + glyph->width,
+                            glyphY, glyphY + glyph->height
+                        )
+                    );
+                    for(int y = rect.startY; y < rect.endY; ++y) {
+                        uint8_t* dest =
+                            &graymap.buffer[y * graymap.width + rect.startX];
+                        const uint8_t* src = &glyph->buffer[
+                            (y - glyphY) * glyph->width + (rect.startX - glyphX)
+                        ];
+                        for(int j = 0; j < rect.endX - rect.startX; ++j) {
+                            dest[j] = (uint8_t)min((int)dest[j] + (int)src[j], 255);
+                        }
+                    }
+                }
+                x += info.geometry.width;
+            }
+        } while(pango_layout_iter_next_run(iter));
+        pango_layout_iter_free(iter);
+
+        maskExtents = extents;
+        mask.emplace(graymap.buffer.size());
+        for(size_t i = 0; i < graymap.buffer.size(); ++i) {
+            (*mask)[i] = graymap.buffer[i] >= 128 ? 1 : 0;
+        }
     }
 };
 
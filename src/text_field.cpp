@@ -23,6 +23,10 @@ TextField::TextField(CKey,
     removeCaretOnSubmit_ = true;
     allowEmptySubmit_ = true;
 
+    backgroundR_ = 255;
+    backgroundG_ = 255;
+    backgroundB_ = 255;
+
     hasFocus_ = false;
     leftMouseButtonDown_ = false;
     shiftKeyDown_ = false;
@@ -71,6 +75,17 @@ void TextField::setAllowEmptySubmit(bool value) {
     allowEmptySubmit_ = value;
 }
 
+void TextField::setBackgroundColor(uint8_t r, uint8_t g, uint8_t b) {
+    REQUIRE_UI_THREAD();
+
+    if(r != backgroundR_ || g != backgroundG_ || b != backgroundB_) {
+        backgroundR_ = r;
+        backgroundG_ = g;
+        backgroundB_ = b;
+        signalViewDirty_();
+    }
+}
+
 void TextField::unsetCaret_() {
     if(caretActive_) {
         caretActive_ = false;
@@ -206,6 +221,10 @@ void TextField::widgetRender_() {
 
     ImageSlice viewport = getViewport();
 
+    viewport.fill(
+        0, viewport.width(), 0, viewport.height(),
+        backgroundR_, backgroundG_, backgroundB_
+    );
     textLayout_->render(viewport);
 
     int caretStartY = viewport.height() - 14;
@@ -247,6 +266,10 @@ void TextField::widgetRender_() {
     }
 }
 
+bool TextField::widgetRendersOpaque_() {
+    return true;
+}
+
 void TextField::widgetMouseDownEvent_(int x, int y, int button) {
     REQUIRE_UI_THREAD();
 
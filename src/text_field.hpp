@@ -42,6 +42,10 @@ public:
     void setRemoveCaretOnSubmit(bool value);
     void setAllowEmptySubmit(bool value);
 
+    // Set the color used to fill the viewport under the text (white by
+    // default)
+    void setBackgroundColor(uint8_t r, uint8_t g, uint8_t b);
+
 private:
     void unsetCaret_();
     void setCaret_(int start, int end);
@@ -57,6 +61,7 @@ private:
     // Widget:
     virtual void widgetViewportUpdated_() override;
     virtual void widgetRender_() override;
+    virtual bool widgetRendersOpaque_() override;
     virtual void widgetMouseDownEvent_(int x, int y, int button) override;
     virtual void widgetMouseUpEvent_(int x, int y, int button) override;
     virtual void widgetMouseDoubleClickEvent_(int x, int y) override;
@@ -74,6 +79,10 @@ private:
     bool removeCaretOnSubmit_;
     bool allowEmptySubmit_;
 
+    uint8_t backgroundR_;
+    uint8_t backgroundG_;
+    uint8_t backgroundB_;
+
     bool hasFocus_;
     bool leftMouseButtonDown_;
     bool shiftKeyDown_;
@@ -53,7 +53,8 @@ struct VicePlugin::APIFuncs {
     FOREACH_VICE_API_FUNC_ITEM(PluginNavigationControlSupportQuery_query) \
     FOREACH_VICE_API_FUNC_ITEM(WindowTitle_enable) \
     FOREACH_VICE_API_FUNC_ITEM(WindowTitle_notifyWindowTitleChanged) \
-    FOREACH_VICE_API_FUNC_ITEM(ZoomInput_enable)
+    FOREACH_VICE_API_FUNC_ITEM(ZoomInput_enable) \
+    FOREACH_VICE_API_FUNC_ITEM(RenderScale_enable)
 
 #define FOREACH_VICE_API_FUNC_ITEM(name) \
     decltype(&vicePluginAPI_ ## name) name = nullptr;
@@ -281,6 +282,9 @@ shared_ptr<VicePlugin> VicePlugin::load(string filename) {
     if(apiFuncs->isExtensionSupported(APIVersion, "ZoomInput")) {
         LOAD_API_FUNC(ZoomInput_enable);
     }
+    if(apiFuncs->isExtensionSupported(APIVersion, "RenderScale")) {
+        LOAD_API_FUNC(RenderScale_enable);
+    }
 
     return VicePlugin::create(
         CKey(),
@@ -556,6 +560,14 @@ optional<bool> ViceContext::hasNavigationControls() {
     return hasNavigationControls_;
 }
 
+double ViceContext::renderScale() {
+    if(plugin_->apiFuncs_->RenderScale_enable != nullptr) {
+        return globals->config->renderScale;
+    } else {
+        return 1.0;
+    }
+}
+
 void ViceContext::start(shared_ptr<ViceContextEventHandler> eventHandler) {
     REQUIRE_UI_THREAD();
     REQUIRE(state_ == Pending);
@@ -641,6 +653,17 @@ void ViceContext::start(shared_ptr<ViceContextEventHandler> eventHandler) {
         plugin_->apiFuncs_->ZoomInput_enable(ctx_, zoomInputCallbacks);
     }
 
+    if(globals->config->renderScale < 1.0) {
+        if(plugin_->apiFuncs_->RenderScale_enable != nullptr) {
+            plugin_->apiFuncs_->RenderScale_enable(ctx_, globals->config->renderScale);
+        } else {
+            WARNING_LOG(
+                "Ignoring --render-scale, as the vice plugin does not support the RenderScale "
+                "extension needed to upscale the images for the user"
+            );
+        }
+    }
+
     VicePluginAPI_Callbacks callbacks;
     memset(&callbacks, 0, sizeof(VicePluginAPI_Callbacks));
 
@@ -151,6 +151,12 @@ public:
     // not support the PluginNavigationControlSupportQuery plugin.)
     optional<bool> hasNavigationControls();
 
+    // The factor by which the window images are scaled relative to the window
+    // sizes requested by the plugin: --render-scale if the plugin supports the
+    // RenderScale extension (that lets it upscale the images for the user),
+    // and 1 otherwise.
+    double renderScale();
+
     // Start running the context. Before quitting CEF message loop, call
     // shutdown and wait for onViceContextShutdownComplete event. Pointer to
     // the event handler will be retained until shutdown is complete.
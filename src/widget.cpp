@@ -9,6 +9,7 @@ Widget::Widget(weak_ptr<WidgetParent> parent) {
 
     parent_ = parent;
     viewDirty_ = false;
+    childDirty_ = false;
 
     mouseOver_ = false;
     focused_ = false;
@@ -33,15 +34,51 @@ ImageSlice Widget::getViewport() {
     return viewport_;
 }
 
-void Widget::render() {
+void Widget::render(vector<Rect>& damage) {
     REQUIRE_UI_THREAD();
 
-    viewDirty_ = false;
-    widgetRender_();
+    if(viewDirty_) {
+        renderAll_();
+        damage.push_back(globalRect_(Rect(0, viewport_.width(), 0, viewport_.height())));
+        return;
+    }
 
-    for(shared_ptr<Widget> child : widgetListChildren_()) {
+    Rect region = dirtyRegion_;
+    bool childDirty = childDirty_;
+    dirtyRegion_ = Rect();
+    childDirty_ = false;
+
+    vector<shared_ptr<Widget>> children = widgetListChildren_();
+
+    // Changed children that are not opaque must be rendered on top of the
+    // part of this widget under them.
+    if(childDirty) {
+        for(const shared_ptr<Widget>& child : children) {
+            REQUIRE(child);
+            if(child->needsRender_() && !child->widgetRendersOpaque_()) {
+                region = Rect::boundingBox(region, localViewportRect_(child));
+            }
+        }
+    }
+
+    if(!region.isEmpty()) {
+        if(!widgetRenderRegion_(region)) {
+            renderAll_();
+            damage.push_back(globalRect_(Rect(0, viewport_.width(), 0, viewport_.height())));
+            return;
+        }
+        damage.push_back(globalRect_(region));
+    }
+
+    for(const shared_ptr<Widget>& child : children) {
         REQUIRE(child);
-        child->render();
+        Rect childRect = localViewportRect_(child);
+        if(!Rect::intersection(region, childRect).isEmpty()) {
+            child->renderAll_();
+            damage.push_back(globalRect_(childRect));
+        } else if(child->needsRender_()) {
+            child->render(damage);
+        }
     }
 }
 
@@ -233,7 +270,10 @@ void Widget::sendLoseFocusEvent() {
 
 void Widget::onWidgetViewDirty() {
     REQUIRE_UI_THREAD();
-    signalViewDirty_();
+
+    bool wasDirty = needsRender_();
+    childDirty_ = true;
+    notifyBecameDirty_(wasDirty);
 }
 
 void Widget::onWidgetCursorChanged() {
@@ -277,12 +317,22 @@ void Widget::onGlobalHotkeyPressed(GlobalHotkey key) {
 void Widget::signalViewDirty_() {
     REQUIRE_UI_THREAD();
 
-    if(!viewDirty_) {
-        viewDirty_ = true;
-        if(shared_ptr<WidgetParent> parent = parent_.lock()) {
-            parent->onWidgetViewDirty();
-        }
+    bool wasDirty = needsRender_();
+    viewDirty_ = true;
+    notifyBecameDirty_(wasDirty);
+}
+
+void Widget::signalRegionDirty_(Rect rect) {
+    REQUIRE_UI_THREAD();
+
+    rect = Rect::intersection(rect, Rect(0, viewport_.width(), 0, viewport_.height()));
+    if(rect.isEmpty() || viewDirty_) {
+        return;
     }
+
+    bool wasDirty = needsRender_();
+    dirtyRegion_ = Rect::boundingBox(dirtyRegion_, rect);
+    notifyBecameDirty_(wasDirty);
 }
 
 void Widget::setCursor_(int newCursor) {
@@ -365,6 +415,46 @@ shared_ptr<Widget> Widget::childByPoint_(int x, int y) {
     return {};
 }
 
+bool Widget::needsRender_() {
+    return viewDirty_ || childDirty_ || !dirtyRegion_.isEmpty();
+}
+
+void Widget::notifyBecameDirty_(bool wasDirty) {
+    // The parent only needs to be notified when the widget becomes dirty, as
+    // the whole dirty subtree is handled in the next render.
+    if(!wasDirty) {
+        if(shared_ptr<WidgetParent> parent = parent_.lock()) {
+            parent->onWidgetViewDirty();
+        }
+    }
+}
+
+void Widget::renderAll_() {
+    viewDirty_ = false;
+    dirtyRegion_ = Rect();
+    childDirty_ = false;
+
+    widgetRender_();
+
+    for(shared_ptr<Widget> child : widgetListChildren_()) {
+        REQUIRE(child);
+        child->renderAll_();
+    }
+}
+
+Rect Widget::globalRect_(Rect rect) {
+    return Rect::translate(rect, viewport_.globalX(), viewport_.globalY());
+}
+
+Rect Widget::localViewportRect_(const shared_ptr<Widget>& child) {
+    ImageSlice& childViewport = child->viewport_;
+    return Rect::translate(
+        Rect(0, childViewport.width(), 0, childViewport.height()),
+        childViewport.globalX() - viewport_.globalX(),
+        childViewport.globalY() - viewport_.globalY()
+    );
+}
+
 void Widget::updateCursor_() {
     int newCursor;
     if(mouseOverChild_) {
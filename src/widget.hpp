@@ -39,7 +39,10 @@ public:
     void setViewport(ImageSlice viewport);
     ImageSlice getViewport();
 
-    void render();
+    // Render the parts of the widget tree that have changed since the last
+    // call, appending the rectangles that were rendered (in global coordinates)
+    // to damage. Subtrees that have not changed are not rendered at all.
+    void render(vector<Rect>& damage);
 
     int cursor();
 
@@ -73,6 +76,11 @@ protected:
     // should be rendered
     void signalViewDirty_();
 
+    // Like signalViewDirty_, but only the given rectangle (in local
+    // coordinates) of the widget has changed. The rectangle is passed to
+    // widgetRenderRegion_ in the next render.
+    void signalRegionDirty_(Rect rect);
+
     // The widget should call this to update its own cursor; the effects might
     // not be immediately visible if mouse is not over this widget
     void setCursor_(int newCursor);
@@ -100,6 +108,23 @@ protected:
     // widgetListChildren_) are rendered after this call.
     virtual void widgetRender_() {}
 
+    // Called instead of widgetRender_ when only a part of the widget needs to
+    // be rendered: the region (in local coordinates) contains the regions
+    // given to signalRegionDirty_ and the viewports of the changed children
+    // that are not opaque. The children intersecting the region are rendered
+    // after this call. The implementation may render more than the region; if
+    // it returns false, the whole widget is rendered using widgetRender_.
+    virtual bool widgetRenderRegion_(Rect region) {
+        return false;
+    }
+
+    // Should return true if widgetRender_ together with the children always
+    // covers the whole viewport, allowing the widget to be rendered without
+    // rendering its parent first.
+    virtual bool widgetRendersOpaque_() {
+        return false;
+    }
+
     // This function should list the child widgets of this widget; it is used
     // to route events to the correct widget and to know which widgets to render
     // after this widget
@@ -131,6 +156,12 @@ private:
 
     void updateCursor_();
 
+    bool needsRender_();
+    void notifyBecameDirty_(bool wasDirty);
+    void renderAll_();
+    Rect globalRect_(Rect rect);
+    Rect localViewportRect_(const shared_ptr<Widget>& child);
+
     void forwardMouseDownEvent_(int x, int y, int button);
     void forwardMouseUpEvent_(int x, int y, int button);
     void forwardMouseDoubleClickEvent_(int x, int y);
@@ -145,7 +176,13 @@ private:
 
     weak_ptr<WidgetParent> parent_;
     ImageSlice viewport_;
+
+    // viewDirty_: the whole widget needs to be rendered
+    // dirtyRegion_: the given region of the widget needs to be rendered
+    // childDirty_: some of the descendants need to be rendered
     bool viewDirty_;
+    Rect dirtyRegion_;
+    bool childDirty_;
 
     shared_ptr<Widget> focusChild_;
     shared_ptr<Widget> mouseOverChild_;
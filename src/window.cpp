@@ -26,6 +26,54 @@ bool isLocalFileRequestURL(string url) {
     return false;
 }
 
+// Interval of the watchdog checks, which are only a safety net for the state
+// changes that the CEF event handlers do not catch.
+constexpr int64_t WatchdogIntervalMs = 2000;
+
+// Resizes that follow the previous one within this delay are coalesced, and
+// only the latest size is applied once the delay passes without resizes.
+constexpr int64_t ResizeSettleMs = 150;
+
+// Size of the root viewport for a window dimension of the given size.
+int scaleSize(int size, double renderScale) {
+    return max((int)std::ceil(size * renderScale), 1);
+}
+
+// Checks whether the current navigation entry directly follows an about:blank
+// entry at the start of the history.
+class BlankHistoryStartVisitor : public CefNavigationEntryVisitor {
+public:
+    BlankHistoryStartVisitor() {
+        firstIsBlank_ = false;
+        currentIdx_ = -1;
+    }
+
+    virtual bool Visit(
+        CefRefPtr<CefNavigationEntry> entry,
+        bool current,
+        int index,
+        int total
+    ) override {
+        if(index == 0) {
+            firstIsBlank_ = entry->GetURL().ToString() == "about:blank";
+        }
+        if(current) {
+            currentIdx_ = index;
+        }
+        return true;
+    }
+
+    bool followsBlankStart() {
+        return firstIsBlank_ && currentIdx_ == 1;
+    }
+
+private:
+    bool firstIsBlank_;
+    int currentIdx_;
+
+    IMPLEMENT_REFCOUNTING(BlankHistoryStartVisitor);
+};
+
 // Adjust zoom in steps of sixth root of 2.
 constexpr double ZoomFactorStep = 1.122462048309373;
 
@@ -66,6 +114,89 @@ optional<string> extractDomainFromHTTPSURL(string url) {
 }
 }
 
+// Runs Window::watchdog_ for all the registered windows in the same periodic
+// tick, so that there is only one timer regardless of the number of windows.
+// There is at most one instance at a time; it is kept alive by the windows
+// that use it.
+class Window::Watchdog : public enable_shared_from_this<Window::Watchdog> {
+SHARED_ONLY_CLASS(Watchdog);
+public:
+    Watchdog(CKey) {
+        REQUIRE_UI_THREAD();
+        timeout_ = Timeout::create(WatchdogIntervalMs);
+    }
+
+    ~Watchdog() {
+        timeout_->clear(false);
+    }
+
+    // Returns the current instance, creating it if necessary.
+    static shared_ptr<Watchdog> getShared() {
+        REQUIRE_UI_THREAD();
+
+        static weak_ptr<Watchdog> instance;
+        shared_ptr<Watchdog> ret = instance.lock();
+        if(!ret) {
+            ret = Watchdog::create();
+            instance = ret;
+        }
+        return ret;
+    }
+
+    void add(shared_ptr<Window> window) {
+        REQUIRE_UI_THREAD();
+
+        windows_[window.get()] = window;
+        if(!timeout_->isActive()) {
+            schedule_();
+        }
+    }
+
+    void remove(Window* window) {
+        REQUIRE_UI_THREAD();
+
+        windows_.erase(window);
+        if(windows_.empty()) {
+            timeout_->clear(false);
+        }
+    }
+
+private:
+    void schedule_() {
+        weak_ptr<Watchdog> selfWeak = shared_from_this();
+        timeout_->set([selfWeak]() {
+            if(shared_ptr<Watchdog> self = selfWeak.lock()) {
+                self->tick_();
+            }
+        });
+    }
+
+    void tick_() {
+        REQUIRE_UI_THREAD();
+
+        // The windows may be removed while we run the checks.
+        vector<shared_ptr<Window>> windows;
+        for(auto it = windows_.begin(); it != windows_.end();) {
+            if(shared_ptr<Window> window = it->second.lock()) {
+                windows.push_back(window);
+                ++it;
+            } else {
+                it = windows_.erase(it);
+            }
+        }
+        for(const shared_ptr<Window>& window : windows) {
+            window->watchdog_();
+        }
+
+        if(!windows_.empty() && !timeout_->isActive()) {
+            schedule_();
+        }
+    }
+
+    map<Window*, weak_ptr<Window>> windows_;
+    shared_ptr<Timeout> timeout_;
+};
+
 class Window::Client :
     public CefClient,
     public CefLifeSpanHandler,
@@ -174,7 +305,7 @@ public:
                 );
 
                 shared_ptr<Window> newWindow = Window::create(Window::CKey());
-                newWindow->init_(window_->eventHandler_, window_->requestContext_, newHandle, window_->showSoftNavigationButtons_);
+                newWindow->init_(window_->eventHandler_, window_->requestContext_, newHandle, window_->showSoftNavigationButtons_, window_->renderScale_);
 
                 windowInfo.SetAsWindowless(kNullWindowHandle);
                 browserSettings.background_color = (cef_color_t)-1;
@@ -211,6 +342,16 @@ public:
         window_->rootWidget_->browserArea()->setBrowser(browser);
 
         window_->updateSecurityStatus_();
+        window_->updateZoom_();
+
+        if(window_->pendingURI_) {
+            // Window was adopted from the pool before its browser started.
+            string uri = move(*window_->pendingURI_);
+            window_->pendingURI_.reset();
+            if(window_->state_ == Open) {
+                window_->navigateToURI(uri);
+            }
+        }
 
         if(window_->state_ == Closed) {
             // Browser close deferred from close().
@@ -284,6 +425,9 @@ public:
             // Make sure that the loaded page gets the correct idea about the
             // focus and mouse over status
             window_->rootWidget_->browserArea()->refreshStatusEvents();
+
+            // The browser may reset the zoom level when navigating.
+            window_->updateZoom_();
         }
     }
 
@@ -298,6 +442,7 @@ public:
         if(window_->state_ == Open) {
             window_->rootWidget_->controlBar()->setLoading(isLoading);
             window_->updateSecurityStatus_();
+            window_->updateZoom_();
         }
     }
 
@@ -359,6 +504,7 @@ public:
             window_->rootWidget_->controlBar()->setAddress(url);
         }
         window_->updateSecurityStatus_();
+        window_->updateZoom_();
     }
 
     virtual void OnTitleChange(CefRefPtr<CefBrowser> browser, const CefString& origTitle) override {
@@ -424,7 +570,8 @@ public:
     ) override {
         CEF_REQUIRE_IO_THREAD();
 
-        postTask(window_, &Window::updateSecurityStatus_);
+        // Called for every resource request, so we coalesce the updates.
+        postUniqueTask(window_, &Window::updateSecurityStatus_);
         return nullptr;
     }
 
@@ -592,45 +739,44 @@ shared_ptr<Window> Window::tryCreate(
     CefRefPtr<CefRequestContext> requestContext,
     uint64_t handle,
     optional<string> uri,
-    bool showSoftNavigationButtons
+    bool showSoftNavigationButtons,
+    double renderScale
 ) {
     REQUIRE_UI_THREAD();
-    REQUIRE(eventHandler);
-    REQUIRE(requestContext);
-    REQUIRE(handle);
 
     INFO_LOG("Creating window ", handle);
 
-    shared_ptr<Window> window = Window::create(CKey());
-    window->init_(eventHandler, requestContext, handle, showSoftNavigationButtons);
-
-    CefRefPtr<CefClient> client = new Client(window);
-
-    CefWindowInfo windowInfo;
-    windowInfo.SetAsWindowless(kNullWindowHandle);
-
-    CefBrowserSettings browserSettings;
-    browserSettings.background_color = (cef_color_t)-1;
-
-    if(!CefBrowserHost::CreateBrowser(
-        windowInfo,
-        client,
+    return tryCreate_(
+        eventHandler,
+        requestContext,
+        handle,
         (uri.has_value() && !uri.value().empty()) ? uri.value() : globals->config->startPage,
-        browserSettings,
-        nullptr,
-        requestContext
-    )) {
-        WARNING_LOG(
-            "Opening CEF browser for window ", handle, " failed, ",
-            "aborting window creation"
-        );
-        window->createFailed_();
-        return {};
-    }
+        showSoftNavigationButtons,
+        renderScale,
+        false
+    );
+}
 
-    window->createSuccessful_();
+shared_ptr<Window> Window::tryCreatePooled(
+    shared_ptr<WindowEventHandler> eventHandler,
+    CefRefPtr<CefRequestContext> requestContext,
+    uint64_t handle,
+    bool showSoftNavigationButtons,
+    double renderScale
+) {
+    REQUIRE_UI_THREAD();
 
-    return window;
+    INFO_LOG("Creating pooled window ", handle);
+
+    return tryCreate_(
+        eventHandler,
+        requestContext,
+        handle,
+        "about:blank",
+        showSoftNavigationButtons,
+        renderScale,
+        true
+    );
 }
 
 Window::Window(CKey, CKey) {}
@@ -657,6 +803,42 @@ void Window::close() {
     }
 }
 
+void Window::adopt(
+    shared_ptr<WindowEventHandler> eventHandler,
+    uint64_t handle,
+    optional<string> uri
+) {
+    REQUIRE_UI_THREAD();
+    REQUIRE(state_ == Open);
+    REQUIRE(pooled_);
+    REQUIRE(eventHandler);
+    REQUIRE(handle);
+
+    INFO_LOG("Adopting pooled window ", handle_, " as window ", handle);
+
+    pooled_ = false;
+    adoptedFromPool_ = true;
+    handle_ = handle;
+    eventHandler_ = eventHandler;
+
+    // The previous event handler may have swallowed change notifications, so
+    // we make sure that the new handler gets notified of new changes.
+    imageChanged_ = false;
+    titleChanged_ = false;
+
+    queryControlBarFeatures_();
+
+    string url =
+        (uri.has_value() && !uri.value().empty()) ? uri.value() : globals->config->startPage;
+    if(url != "about:blank") {
+        if(browser_) {
+            navigateToURI(url);
+        } else {
+            pendingURI_ = url;
+        }
+    }
+}
+
 void Window::resize(int width, int height) {
     REQUIRE_UI_THREAD();
     REQUIRE(state_ == Open);
@@ -664,10 +846,33 @@ void Window::resize(int width, int height) {
     width = max(min(width, 4096), 64);
     height = max(min(height, 4096), 64);
 
-    if(rootViewport_.width() != width || rootViewport_.height() != height) {
-        rootViewport_ = ImageSlice::createImage(width, height);
-        rootWidget_->setViewport(rootViewport_);
+    pair<int, int> target = pendingResize_.value_or(size_);
+    if(target == make_pair(width, height)) {
+        return;
     }
+
+    // The first resize is applied immediately. While the client keeps
+    // resizing (for example when the user drags the edge of the window),
+    // each resize only restarts the settle timeout, and the latest size is
+    // applied when it expires, avoiding a relayout in the browser for every
+    // intermediate size.
+    if(resizeTimeout_->isActive()) {
+        resizeTimeout_->clear(false);
+        pendingResize_ = make_pair(width, height);
+    } else {
+        applyResize_(width, height);
+    }
+
+    weak_ptr<Window> selfWeak = shared_from_this();
+    resizeTimeout_->set([selfWeak]() {
+        if(shared_ptr<Window> self = selfWeak.lock()) {
+            if(self->state_ == Open && self->pendingResize_) {
+                pair<int, int> size = *self->pendingResize_;
+                self->pendingResize_.reset();
+                self->applyResize_(size.first, size.second);
+            }
+        }
+    });
 }
 
 ImageSlice Window::fetchViewImage() {
@@ -693,7 +898,19 @@ void Window::navigate(int direction) {
 
     if(browser_) {
         if(direction == -1) {
-            browser_->GoBack();
+            // The history of a window adopted from the pool starts with the
+            // about:blank page loaded by the pool, which is not supposed to
+            // be visible to the user.
+            bool skip = false;
+            if(adoptedFromPool_) {
+                CefRefPtr<BlankHistoryStartVisitor> visitor =
+                    new BlankHistoryStartVisitor();
+                browser_->GetHost()->GetNavigationEntries(visitor, false);
+                skip = visitor->followsBlankStart();
+            }
+            if(!skip) {
+                browser_->GoBack();
+            }
         }
         if(direction == 0) {
             browser_->Reload();
@@ -749,7 +966,7 @@ void Window::sendMouseDownEvent(int x, int y, int button) {
     REQUIRE(state_ == Open);
 
     if(button >= 0 && button <= 2) {
-        clampMouseCoords_(x, y);
+        mapMouseCoords_(x, y);
         rootWidget_->sendMouseDownEvent(x, y, button);
     }
 }
@@ -759,7 +976,7 @@ void Window::sendMouseUpEvent(int x, int y, int button) {
     REQUIRE(state_ == Open);
 
     if(button >= 0 && button <= 2) {
-        clampMouseCoords_(x, y);
+        mapMouseCoords_(x, y);
         rootWidget_->sendMouseUpEvent(x, y, button);
     }
 }
@@ -768,7 +985,7 @@ void Window::sendMouseMoveEvent(int x, int y) {
     REQUIRE_UI_THREAD();
     REQUIRE(state_ == Open);
 
-    clampMouseCoords_(x, y);
+    mapMouseCoords_(x, y);
     rootWidget_->sendMouseMoveEvent(x, y);
 }
 
@@ -777,7 +994,7 @@ void Window::sendMouseDoubleClickEvent(int x, int y, int button) {
     REQUIRE(state_ == Open);
 
     if(button == 0) {
-        clampMouseCoords_(x, y);
+        mapMouseCoords_(x, y);
         rootWidget_->sendMouseDoubleClickEvent(x, y);
     }
 }
@@ -786,7 +1003,7 @@ void Window::sendMouseWheelEvent(int x, int y, int dx, int dy) {
     REQUIRE_UI_THREAD();
     REQUIRE(state_ == Open);
 
-    clampMouseCoords_(x, y);
+    mapMouseCoords_(x, y);
     int delta = max(-180, min(180, -dy));
     rootWidget_->sendMouseWheelEvent(x, y, delta);
 }
@@ -795,7 +1012,7 @@ void Window::sendMouseLeaveEvent(int x, int y) {
     REQUIRE_UI_THREAD();
     REQUIRE(state_ == Open);
 
-    clampMouseCoords_(x, y);
+    mapMouseCoords_(x, y);
     rootWidget_->sendMouseLeaveEvent(x, y);
 }
 
@@ -858,8 +1075,11 @@ void Window::onWidgetViewDirty() {
     shared_ptr<Window> self = shared_from_this();
     postTask([self]() {
         if(self->state_ == Open) {
-            self->rootWidget_->render();
-            self->signalImageChanged_();
+            vector<Rect> damage;
+            self->rootWidget_->render(damage);
+            if(!damage.empty()) {
+                self->signalImageChanged_();
+            }
         }
     });
 }
@@ -1009,7 +1229,7 @@ void Window::onOpenBookmarksButtonPressed() {
                 INFO_LOG("Creating bookmark popup window ", newHandle);
 
                 shared_ptr<Window> newWindow =
-                    Window::tryCreate(eventHandler_, requestContext_, newHandle, "browservice://bookmarks/", showSoftNavigationButtons_);
+                    Window::tryCreate(eventHandler_, requestContext_, newHandle, "browservice://bookmarks/", showSoftNavigationButtons_, renderScale_);
 
                 popupDenied = false;
                 return newWindow;
@@ -1050,7 +1270,11 @@ void Window::onBrowserAreaViewDirty() {
     REQUIRE_UI_THREAD();
 
     if(state_ == Open) {
-        signalImageChanged_();
+        // The change may have been superseded by a viewport change since the
+        // notification was posted.
+        if(rootWidget_->browserArea()->popDirty()) {
+            signalImageChanged_();
+        }
     }
 }
 
@@ -1073,11 +1297,12 @@ void Window::onDownloadCompleted(shared_ptr<CompletedDownload> file) {
     }
 }
 
-void Window::init_(shared_ptr<WindowEventHandler> eventHandler, CefRefPtr<CefRequestContext> requestContext, uint64_t handle, bool showSoftNavigationButtons) {
+void Window::init_(shared_ptr<WindowEventHandler> eventHandler, CefRefPtr<CefRequestContext> requestContext, uint64_t handle, bool showSoftNavigationButtons, double renderScale) {
     REQUIRE_UI_THREAD();
     REQUIRE(eventHandler);
     REQUIRE(requestContext);
     REQUIRE(handle);
+    REQUIRE(renderScale > 0.0 && renderScale <= 1.0);
 
     handle_ = handle;
     state_ = Open;
@@ -1085,6 +1310,10 @@ void Window::init_(shared_ptr<WindowEventHandler> eventHandler, CefRefPtr<CefReq
     requestContext_ = requestContext;
 
     showSoftNavigationButtons_ = showSoftNavigationButtons;
+    renderScale_ = renderScale;
+
+    pooled_ = false;
+    adoptedFromPool_ = false;
 
     imageChanged_ = false;
 
@@ -1093,13 +1322,19 @@ void Window::init_(shared_ptr<WindowEventHandler> eventHandler, CefRefPtr<CefReq
 
     shared_ptr<Window> self = shared_from_this();
 
-    rootViewport_ = ImageSlice::createImage(800, 600);
+    size_ = make_pair(800, 600);
+    rootViewport_ = ImageSlice::createImage(
+        scaleSize(800, renderScale_), scaleSize(600, renderScale_)
+    );
     rootWidget_ = RootWidget::create(self, self, self, showSoftNavigationButtons);
     rootWidget_->setViewport(rootViewport_);
+    rootWidget_->browserArea()->setRenderScale(renderScale_);
 
     downloadManager_ = DownloadManager::create(self);
 
-    watchdogTimeout_ = Timeout::create(250);
+    watchdogTimer_ = Watchdog::getShared();
+    watchdogTimer_->add(self);
+    resizeTimeout_ = Timeout::create(ResizeSettleMs);
 
     zoomLevel_ = zoomFactorToZoomLevel(globals->config->initialZoom);
 }
@@ -1111,6 +1346,70 @@ void Window::createSuccessful_() {
 
     postTask(self, &Window::watchdog_);
 
+    // For pooled windows, the query is made in adopt() instead.
+    if(!pooled_) {
+        queryControlBarFeatures_();
+    }
+}
+
+void Window::createFailed_() {
+    REQUIRE_UI_THREAD();
+
+    state_ = CleanupComplete;
+    eventHandler_.reset();
+}
+
+shared_ptr<Window> Window::tryCreate_(
+    shared_ptr<WindowEventHandler> eventHandler,
+    CefRefPtr<CefRequestContext> requestContext,
+    uint64_t handle,
+    string url,
+    bool showSoftNavigationButtons,
+    double renderScale,
+    bool pooled
+) {
+    REQUIRE_UI_THREAD();
+    REQUIRE(eventHandler);
+    REQUIRE(requestContext);
+    REQUIRE(handle);
+
+    shared_ptr<Window> window = Window::create(CKey());
+    window->init_(eventHandler, requestContext, handle, showSoftNavigationButtons, renderScale);
+    window->pooled_ = pooled;
+
+    CefRefPtr<CefClient> client = new Client(window);
+
+    CefWindowInfo windowInfo;
+    windowInfo.SetAsWindowless(kNullWindowHandle);
+
+    CefBrowserSettings browserSettings;
+    browserSettings.background_color = (cef_color_t)-1;
+
+    if(!CefBrowserHost::CreateBrowser(
+        windowInfo,
+        client,
+        url,
+        browserSettings,
+        nullptr,
+        requestContext
+    )) {
+        WARNING_LOG(
+            "Opening CEF browser for window ", handle, " failed, ",
+            "aborting window creation"
+        );
+        window->createFailed_();
+        return {};
+    }
+
+    window->createSuccessful_();
+
+    return window;
+}
+
+void Window::queryControlBarFeatures_() {
+    REQUIRE_UI_THREAD();
+
+    shared_ptr<Window> self = shared_from_this();
     postTask([self]() {
         if(self->state_ != Open) {
             return;
@@ -1134,18 +1433,13 @@ void Window::createSuccessful_() {
     });
 }
 
-void Window::createFailed_() {
-    REQUIRE_UI_THREAD();
-
-    state_ = CleanupComplete;
-    eventHandler_.reset();
-}
-
 void Window::afterClose_() {
     REQUIRE_UI_THREAD();
     REQUIRE(state_ == Closed);
 
-    watchdogTimeout_->clear(false);
+    watchdogTimer_->remove(this);
+    resizeTimeout_->clear(false);
+    pendingResize_.reset();
 
     if(fileUploadCallback_) {
         fileUploadCallback_->Cancel();
@@ -1153,7 +1447,8 @@ void Window::afterClose_() {
     }
 }
 
-// Called every 0.25s for an Open window for various checks.
+// Called for an Open window after creation and then every
+// WatchdogIntervalMs by the shared Watchdog for various checks.
 void Window::watchdog_() {
     REQUIRE_UI_THREAD();
 
@@ -1161,23 +1456,11 @@ void Window::watchdog_() {
         return;
     }
 
-    // Make sure that security status is not incorrect for extended periods of
-    // time just in case our event handlers do not catch all the changes.
+    // The security status and the zoom level are updated from the CEF event
+    // handlers; we make sure that they are not incorrect for extended periods
+    // of time just in case the event handlers do not catch all the changes.
     updateSecurityStatus_();
-
-    // Make sure that the zoom level is set correctly. The browser typically
-    // resets the zoom during initialization, so we need to initialize it in
-    // the watchdog and keep making sure it is set correctly just in case.
     updateZoom_();
-
-    if(!watchdogTimeout_->isActive()) {
-        weak_ptr<Window> selfWeak = shared_from_this();
-        watchdogTimeout_->set([selfWeak]() {
-            if(shared_ptr<Window> self = selfWeak.lock()) {
-                self->watchdog_();
-            }
-        });
-    }
 }
 
 void Window::updateSecurityStatus_() {
@@ -1229,7 +1512,29 @@ void Window::updateZoom_() {
     }
 }
 
-void Window::clampMouseCoords_(int& x, int& y) {
+void Window::applyResize_(int width, int height) {
+    REQUIRE_UI_THREAD();
+    REQUIRE(state_ == Open);
+
+    size_ = make_pair(width, height);
+
+    int viewportWidth = scaleSize(width, renderScale_);
+    int viewportHeight = scaleSize(height, renderScale_);
+    if(rootViewport_.width() != viewportWidth || rootViewport_.height() != viewportHeight) {
+        // The widgets get slices of the new viewport in setViewport, so the
+        // old buffer can be reused.
+        rootViewport_ = ImageSlice::createImageReusingBuffer(
+            rootViewport_, viewportWidth, viewportHeight
+        );
+        rootWidget_->setViewport(rootViewport_);
+    }
+}
+
+void Window::mapMouseCoords_(int& x, int& y) {
+    if(renderScale_ < 1.0) {
+        x = (int)std::floor(x * renderScale_);
+        y = (int)std::floor(y * renderScale_);
+    }
     x = max(x, -1000);
     y = max(y, -1000);
     x = min(x, rootViewport_.width() + 1000);
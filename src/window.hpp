@@ -79,7 +79,20 @@ public:
         CefRefPtr<CefRequestContext> requestContext,
         uint64_t handle,
         optional<string> uri,
-        bool showSoftNavigationButtons
+        bool showSoftNavigationButtons,
+        double renderScale
+    );
+
+    // Creates a window for the browser pool: the CEF browser is started
+    // immediately at about:blank so that the window can later be handed over to
+    // its actual user using adopt() without waiting for the browser to start.
+    // Returns empty pointer if CEF browser creation fails.
+    static shared_ptr<Window> tryCreatePooled(
+        shared_ptr<WindowEventHandler> eventHandler,
+        CefRefPtr<CefRequestContext> requestContext,
+        uint64_t handle,
+        bool showSoftNavigationButtons,
+        double renderScale
     );
 
     // Private constructor.
@@ -89,6 +102,16 @@ public:
     ~Window();
 
     void close();
+
+    // Hands over an open window created using tryCreatePooled to a new event
+    // handler under a new handle and navigates it to the given URI (or the
+    // start page if empty). May be called at most once for each window.
+    void adopt(
+        shared_ptr<WindowEventHandler> eventHandler,
+        uint64_t handle,
+        optional<string> uri
+    );
+
     void resize(int width, int height);
     ImageSlice fetchViewImage();
 
@@ -148,6 +171,9 @@ private:
     // Class that implements CefClient interfaces for the window.
     class Client;
 
+    // Shared timer for the watchdog_ checks of all windows.
+    class Watchdog;
+
     // To create a window:
     //   - Create the object using the private constructor.
     //   - Call init_().
@@ -157,17 +183,35 @@ private:
     //         after this, the window is open.
     //       - If creating the browser failed, call createFailed_() and let the
     //         object destruct.
-    void init_(shared_ptr<WindowEventHandler> eventHandler, CefRefPtr<CefRequestContext> requestContext, uint64_t handle, bool showSoftNavigationButtons);
+    void init_(shared_ptr<WindowEventHandler> eventHandler, CefRefPtr<CefRequestContext> requestContext, uint64_t handle, bool showSoftNavigationButtons, double renderScale);
     void createSuccessful_();
     void createFailed_();
 
+    static shared_ptr<Window> tryCreate_(
+        shared_ptr<WindowEventHandler> eventHandler,
+        CefRefPtr<CefRequestContext> requestContext,
+        uint64_t handle,
+        string url,
+        bool showSoftNavigationButtons,
+        double renderScale,
+        bool pooled
+    );
+
+    // Queries the quality selector and clipboard button status from the event
+    // handler in a posted task.
+    void queryControlBarFeatures_();
+
     void afterClose_();
 
     void watchdog_();
     void updateSecurityStatus_();
     void updateZoom_();
 
-    void clampMouseCoords_(int& x, int& y);
+    void applyResize_(int width, int height);
+
+    // Maps mouse coordinates given in the window size requested with resize
+    // to rootViewport_ and clamps them.
+    void mapMouseCoords_(int& x, int& y);
 
     // May call onWindowViewImageChanged immediately.
     void signalImageChanged_();
@@ -185,6 +229,25 @@ private:
 
     bool showSoftNavigationButtons_;
 
+    // The factor by which rootViewport_ is scaled relative to the window size
+    // requested with resize; the browser renders the page at full layout size
+    // with the same device scale factor, but the other widgets (such as the
+    // control bar) are laid out and rendered in the scaled viewport.
+    double renderScale_;
+
+    // True if the window was created using tryCreatePooled and has not yet
+    // been adopted.
+    bool pooled_;
+
+    // True if the window was adopted from the pool; the first entry of its
+    // navigation history is then the about:blank page loaded by the pool,
+    // which is skipped when navigating back.
+    bool adoptedFromPool_;
+
+    // URI to load as soon as the browser has been created (set if the window
+    // is adopted before its browser has started).
+    optional<string> pendingURI_;
+
     bool imageChanged_;
 
     bool titleChanged_;
@@ -194,12 +257,20 @@ private:
     // states if the browser has not yet started.
     CefRefPtr<CefBrowser> browser_;
 
+    // The window size last applied by applyResize_ (before scaling).
+    pair<int, int> size_;
     ImageSlice rootViewport_;
     shared_ptr<RootWidget> rootWidget_;
 
     shared_ptr<DownloadManager> downloadManager_;
 
-    shared_ptr<Timeout> watchdogTimeout_;
+    shared_ptr<Watchdog> watchdogTimer_;
+
+    // resizeTimeout_ is active for the settle period after each resize;
+    // pendingResize_ is the latest size given to resize during the period if
+    // it has not been applied yet.
+    shared_ptr<Timeout> resizeTimeout_;
+    optional<pair<int, int>> pendingResize_;
 
     // The window is in file upload mode when fileUploadCallback_ is nonempty.
     CefRefPtr<CefFileDialogCallback> fileUploadCallback_;
@@ -911,6 +911,30 @@ VICE_PLUGIN_API_FUNC_DECLSPEC void vicePluginAPI_ZoomInput_enable(
     VicePluginAPI_ZoomInput_Callbacks callbacks
 );
 
+/***************************************************************************************************
+ *** API extension "RenderScale" ***
+ ***********************************/
+
+/* Extension that allows the program to render the window view images at a reduced resolution to
+ * save rendering work and bandwidth. Once the program has enabled the extension using
+ * vicePluginAPI_RenderScale_enable, the view image of a window for which the plugin has requested
+ * the size width x height using the resizeWindow callback is approximately of size
+ * (scale * width) x (scale * height), and the plugin should show it to the user upscaled by the
+ * factor 1 / scale. The whole image is scaled, including any user interface elements the program
+ * draws into it (such as its control bar). The coordinates in the mouse input events relayed by the
+ * plugin should still be given in the unscaled window coordinates (matching the size requested with
+ * resizeWindow); the program maps them to the image.
+ */
+
+/* Enables the RenderScale extension in given context with given scale factor (0 < scale <= 1). May
+ * only be called once for each context, after vicePluginAPI_initContext and before
+ * vicePluginAPI_start.
+ */
+VICE_PLUGIN_API_FUNC_DECLSPEC void vicePluginAPI_RenderScale_enable(
+    VicePluginAPI_Context* ctx,
+    double scale
+);
+
 /***************************************************************************************************
  *** Deprecated API versions 1000000 and 1000001 ***
  ***************************************************/
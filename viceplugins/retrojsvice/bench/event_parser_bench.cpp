@@ -0,0 +1,118 @@
+// Micro-benchmark for the image request path and event string parsers in
+// src/event_parser.cpp. For reference, the same input is also parsed using the
+// string-based splitStr/parseString approach used previously.
+
+#include "event_parser.hpp"
+
+using namespace retrojsvice;
+
+namespace {
+
+// Constructs a typical image request path suffix with a batch of events as sent
+// by a client that has accumulated mostly mouse moves between two requests.
+string makeImagePath(mt19937& rng, int eventCount) {
+    uniform_int_distribution<int> coordDist(0, 1920);
+    uniform_int_distribution<int> kindDist(0, 9);
+
+    stringstream ss;
+    ss << "3/1234/0/1280/720/5678/";
+    for(int i = 0; i < eventCount; ++i) {
+        int kind = kindDist(rng);
+        if(kind <= 6) {
+            ss << "MMO_" << coordDist(rng) << "_" << coordDist(rng) << "/";
+        } else if(kind == 7) {
+            ss << "MDN_" << coordDist(rng) << "_" << coordDist(rng) << "_0/";
+        } else if(kind == 8) {
+            ss << "KPR_" << coordDist(rng) << "/";
+        } else {
+            ss << "FOUT/";
+        }
+    }
+    return ss.str();
+}
+
+uint64_t parseNew(const string& path) {
+    uint64_t checksum = 0;
+    ImageRequestPath imagePath;
+    REQUIRE(parseImageRequestPath(path, imagePath));
+    checksum += imagePath.mainIdx + imagePath.width;
+
+    string_view eventStr = imagePath.eventStr;
+    while(optional<string_view> item = popEvent(eventStr)) {
+        ParsedEvent event;
+        REQUIRE(parseEvent(*item, event));
+        checksum += event.name.size();
+        for(int i = 0; i < event.argCount; ++i) {
+            checksum += (uint64_t)event.args[i];
+        }
+    }
+    return checksum;
+}
+
+uint64_t parseReference(const string& path) {
+    uint64_t checksum = 0;
+    vector<string> split = splitStr(path, '/', 6);
+    REQUIRE(split.size() == 7);
+    optional<uint64_t> mainIdx = parseString<uint64_t>(split[0]);
+    optional<int> width = parseString<int>(split[3]);
+    REQUIRE(mainIdx && width);
+    checksum += *mainIdx + *width;
+
+    const string& eventStr = split[6];
+    size_t start = 0;
+    while(true) {
+        size_t end = eventStr.find('/', start);
+        if(end == string::npos) {
+            break;
+        }
+        vector<string> tokens =
+            splitStr(eventStr.substr(start, end - start), '_');
+        checksum += tokens[0].size();
+        for(size_t i = 1; i < tokens.size(); ++i) {
+            optional<int> arg = parseString<int>(tokens[i]);
+            REQUIRE(arg);
+            checksum += (uint64_t)*arg;
+        }
+        start = end + 1;
+    }
+    return checksum;
+}
+
+template <typename F>
+void run(const char* name, const vector<string>& paths, int eventCount, F func) {
+    const int Rounds = 200;
+
+    uint64_t checksum = 0;
+    steady_clock::time_point start = steady_clock::now();
+    for(int round = 0; round < Rounds; ++round) {
+        for(const string& path : paths) {
+            checksum += func(path);
+        }
+    }
+    double seconds =
+        std::chrono::duration<double>(steady_clock::now() - start).count();
+
+    double requestCount = (double)Rounds * (double)paths.size();
+    std::cout
+        << name << ": "
+        << 1e9 * seconds / requestCount << " ns/request, "
+        << 1e9 * seconds / (requestCount * eventCount) << " ns/event "
+        << "(checksum " << checksum << ")\n";
+}
+
+}
+
+int main() {
+    mt19937 rng(42);
+    for(int eventCount : {0, 1, 10, 100}) {
+        vector<string> paths;
+        for(int i = 0; i < 1000; ++i) {
+            paths.push_back(makeImagePath(rng, eventCount));
+        }
+        std::cout << eventCount << " events per request:\n";
+        run("  event_parser", paths, max(eventCount, 1), parseNew);
+        run("  reference   ", paths, max(eventCount, 1), parseReference);
+        REQUIRE(parseNew(paths[0]) == parseReference(paths[0]));
+    }
+    return 0;
+}
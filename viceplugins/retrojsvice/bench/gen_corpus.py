@@ -0,0 +1,216 @@
+#!/usr/bin/env python3
+
+# Generates the synthetic frame corpus in bench/corpus used by the image codec
+# benchmark. The frames imitate typical browser content: text pages in light
+# and dark themes, a photo, a video still and a sequence of scrolled frames.
+# The output is deterministic.
+#
+# Corpus file format (gzip-compressed): the ASCII header "BGRX <width>
+# <height>\n" followed by width * height pixels of 4 bytes each (blue, green,
+# red, unused), row by row. Real screenshots may be added to the corpus in the
+# same format, e.g. using ImageMagick:
+#   (printf 'BGRX 1024 768\n'; convert shot.png -depth 8 bgra:-) | gzip > x.bgrx.gz
+
+import gzip
+import math
+import os
+import random
+
+OUT_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "corpus")
+
+
+class Frame:
+    def __init__(self, width, height, color):
+        self.width = width
+        self.height = height
+        self.data = bytearray(bytes((color[2], color[1], color[0], 255)) * (width * height))
+
+    def fill(self, x0, y0, x1, y1, color):
+        x0 = max(x0, 0)
+        y0 = max(y0, 0)
+        x1 = min(x1, self.width)
+        y1 = min(y1, self.height)
+        if x0 >= x1:
+            return
+        row = bytes((color[2], color[1], color[0], 255)) * (x1 - x0)
+        for y in range(y0, y1):
+            start = 4 * (y * self.width + x0)
+            self.data[start:start + len(row)] = row
+
+    def blend(self, x, y, color, alpha):
+        if x < 0 or y < 0 or x >= self.width or y >= self.height:
+            return
+        i = 4 * (y * self.width + x)
+        for c in range(3):
+            old = self.data[i + c]
+            self.data[i + c] = int(old + (color[2 - c] - old) * alpha + 0.5)
+
+    def crop(self, y0, height):
+        ret = Frame(self.width, height, (0, 0, 0))
+        start = 4 * y0 * self.width
+        ret.data[:] = self.data[start:start + 4 * height * self.width]
+        return ret
+
+    def save(self, name):
+        path = os.path.join(OUT_DIR, name + ".bgrx.gz")
+        header = "BGRX {} {}\n".format(self.width, self.height).encode("ascii")
+        with open(path, "wb") as fp:
+            with gzip.GzipFile(fileobj=fp, mode="wb", compresslevel=9, mtime=0) as gz:
+                gz.write(header)
+                gz.write(bytes(self.data))
+        print("Wrote", path)
+
+
+# Pseudo glyphs: each letter is a random set of strokes in a 5x8 box, drawn
+# with antialiased edges, which is close enough to real text for the purposes
+# of compression.
+def make_glyphs(rng, count):
+    glyphs = []
+    for _ in range(count):
+        pixels = {}
+        for _ in range(rng.randint(2, 4)):
+            if rng.random() < 0.5:
+                x = rng.randint(0, 4)
+                y0 = rng.randint(0, 4)
+                for y in range(y0, rng.randint(y0 + 3, 8)):
+                    pixels[(x, y)] = 1.0
+            else:
+                y = rng.randint(2, 7)
+                x0 = rng.randint(0, 2)
+                for x in range(x0, rng.randint(x0 + 2, 5)):
+                    pixels[(x, y)] = 1.0
+        edges = {}
+        for (x, y) in pixels:
+            for (dx, dy) in ((1, 0), (0, 1)):
+                p = (x + dx, y + dy)
+                if p not in pixels:
+                    edges[p] = max(edges.get(p, 0.0), 0.35)
+        edges.update(pixels)
+        glyphs.append(sorted(edges.items()))
+    return glyphs
+
+
+def draw_text(frame, glyphs, rng, x, y, width, color, scale=1, lines=1, line_height=16):
+    char_width = 6 * scale
+    for line in range(lines):
+        cx = x
+        cy = y + line * line_height
+        line_end = x + width - (rng.randint(0, width // 3) if line == lines - 1 else 0)
+        while cx + char_width < line_end:
+            word = rng.randint(2, 9)
+            if cx + word * char_width > line_end:
+                break
+            for _ in range(word):
+                for ((gx, gy), alpha) in glyphs[rng.randrange(len(glyphs))]:
+                    for sy in range(scale):
+                        for sx in range(scale):
+                            frame.blend(cx + gx * scale + sx, cy + gy * scale + sy, color, alpha)
+                cx += char_width
+            cx += char_width
+
+
+def plasma(frame, x0, y0, x1, y1, seed, noise, blur=1):
+    rng = random.Random(seed)
+    a = [rng.uniform(0.005, 0.03) for _ in range(6)]
+    p = [rng.uniform(0, 6.28) for _ in range(6)]
+    state = seed * 2654435761 % 4294967296 or 1
+    for y in range(y0, y1):
+        for x in range(x0, x1):
+            bx = x // blur * blur
+            by = y // blur * blur
+            v = []
+            for c in range(3):
+                s = math.sin(bx * a[2 * c] + p[2 * c]) + math.sin(by * a[2 * c + 1] + p[2 * c + 1])
+                s += math.sin((bx + by) * a[(2 * c + 3) % 6] + p[c])
+                v.append(128 + 40 * s)
+            state = (state * 1103515245 + 12345) % 2147483648
+            n = (state >> 16) % (2 * noise + 1) - noise if noise else 0
+            i = 4 * (y * frame.width + x)
+            frame.data[i + 0] = max(0, min(255, int(v[2] + n)))
+            frame.data[i + 1] = max(0, min(255, int(v[1] + n)))
+            frame.data[i + 2] = max(0, min(255, int(v[0] + n)))
+
+
+def text_page(width, height, seed):
+    rng = random.Random(seed)
+    glyphs = make_glyphs(rng, 40)
+    frame = Frame(width, height, (255, 255, 255))
+
+    # Site header and navigation sidebar
+    frame.fill(0, 0, width, 56, (36, 41, 46))
+    draw_text(frame, glyphs, rng, 24, 18, 300, (255, 255, 255), scale=2)
+    frame.fill(0, 56, 200, height, (246, 248, 250))
+    for i in range((height - 80) // 28):
+        draw_text(frame, glyphs, rng, 16, 80 + 28 * i, 150, (3, 102, 214))
+
+    # Article with an embedded image
+    y = 80
+    draw_text(frame, glyphs, rng, 232, y, 600, (36, 41, 46), scale=3)
+    y += 50
+    while y < height:
+        if rng.random() < 0.15 and y + 170 < height:
+            plasma(frame, 232, y, 432, y + 150, rng.randint(0, 1000), 6)
+            draw_text(frame, glyphs, rng, 452, y, width - 480, (36, 41, 46), lines=9)
+            y += 170
+        else:
+            lines = rng.randint(2, 6)
+            draw_text(frame, glyphs, rng, 232, y, width - 260, (36, 41, 46), lines=lines)
+            if rng.random() < 0.5:
+                lx = rng.randint(232, width - 200)
+                frame.fill(lx, y + 11, lx + 80, y + 12, (3, 102, 214))
+            y += lines * 16 + 14
+    return frame
+
+
+def code_editor(width, height, seed):
+    rng = random.Random(seed)
+    glyphs = make_glyphs(rng, 40)
+    frame = Frame(width, height, (30, 30, 30))
+    frame.fill(0, 0, width, 32, (51, 51, 51))
+    frame.fill(0, 32, 48, height, (37, 37, 38))
+    colors = [(212, 212, 212), (86, 156, 214), (206, 145, 120), (106, 153, 85), (197, 134, 192)]
+    for i in range((height - 40) // 18):
+        y = 40 + 18 * i
+        draw_text(frame, glyphs, rng, 8, y, 36, (133, 133, 133))
+        x = 64 + 24 * rng.randint(0, 4)
+        for _ in range(rng.randint(0, 5)):
+            w = rng.randint(20, 160)
+            if x + w > width - 16:
+                break
+            draw_text(frame, glyphs, rng, x, y, w, rng.choice(colors))
+            x += w + 6
+    return frame
+
+
+def photo(width, height, seed):
+    frame = Frame(width, height, (0, 0, 0))
+    plasma(frame, 0, 0, width, height, seed, 4)
+    return frame
+
+
+def video_still(width, height, seed):
+    rng = random.Random(seed)
+    glyphs = make_glyphs(rng, 40)
+    frame = Frame(width, height, (0, 0, 0))
+    bar = height // 8
+    plasma(frame, 0, bar, width, height - bar, seed, 2, blur=4)
+    draw_text(frame, glyphs, rng, width // 4, height - bar - 48, width // 2, (255, 255, 255), scale=2)
+    return frame
+
+
+def main():
+    os.makedirs(OUT_DIR, exist_ok=True)
+
+    text_page(1024, 768, 1).save("text_page")
+    code_editor(1024, 768, 2).save("text_dark")
+    photo(512, 384, 3).save("photo")
+    video_still(854, 480, 4).save("video_still")
+
+    # Scroll sequence: the same page scrolled down by 48 pixels per frame
+    page = text_page(1024, 768 + 3 * 48, 5)
+    for i in range(4):
+        page.crop(48 * i, 768).save("scroll_{:02}".format(i))
+
+
+if __name__ == "__main__":
+    main()
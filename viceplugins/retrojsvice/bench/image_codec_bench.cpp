@@ -0,0 +1,303 @@
+// Benchmark for the PNG and JPEG encoders in src/png.cpp and src/jpeg.cpp. Each
+// frame of the given corpus (see gen_corpus.py for the file format) is
+// compressed using each codec configuration repeatedly and the results are
+// written to stdout in CSV format, one line per frame and configuration. PNG
+// is compressed using each of the given deflate encoders (codecs png-screen
+// and png-zlib); before measuring, the outputs of the encoders are decompressed
+// and checked to be equal.
+//
+// Usage: image_codec_bench [--threads=1,2,4] [--qualities=png,90,70,40]
+//                          [--png-encoders=screen,zlib]
+//                          [--min-time=SECONDS] FRAME...
+
+#include "jpeg.hpp"
+#include "png.hpp"
+
+#include "common.hpp"
+
+#include <zlib.h>
+
+using namespace retrojsvice;
+
+namespace {
+
+struct Frame {
+    string name;
+    size_t width;
+    size_t height;
+    vector<uint8_t> data;
+};
+
+Frame loadFrame(const string& path) {
+    gzFile file = gzopen(path.c_str(), "rb");
+    if(file == nullptr) {
+        PANIC("Could not open corpus file '", path, "'");
+    }
+
+    string data;
+    const size_t BufSize = 1 << 16;
+    vector<char> buf(BufSize);
+    while(true) {
+        int count = gzread(file, buf.data(), (unsigned)BufSize);
+        if(count < 0) {
+            PANIC("Reading corpus file '", path, "' failed");
+        }
+        if(count == 0) {
+            break;
+        }
+        data.append(buf.data(), (size_t)count);
+    }
+    gzclose(file);
+
+    size_t headerEnd = data.find('\n');
+    REQUIRE(headerEnd != string::npos);
+    vector<string> header = splitStr(data.substr(0, headerEnd), ' ');
+    REQUIRE(header.size() == 3 && header[0] == "BGRX");
+
+    Frame frame;
+    string baseName = path.substr(path.rfind('/') + 1);
+    frame.name = baseName.substr(0, baseName.find('.'));
+    frame.width = parseString<size_t>(header[1]).value_or(0);
+    frame.height = parseString<size_t>(header[2]).value_or(0);
+    REQUIRE(frame.width && frame.height);
+    REQUIRE(data.size() - headerEnd - 1 == 4 * frame.width * frame.height);
+    frame.data.assign(data.begin() + headerEnd + 1, data.end());
+    return frame;
+}
+
+// Quality 101 stands for PNG as in ImageCompressor.
+vector<int> parseQualities(const string& value) {
+    vector<int> ret;
+    for(const string& item : splitStr(value, ',')) {
+        if(item == "png") {
+            ret.push_back(101);
+        } else {
+            optional<int> quality = parseString<int>(item);
+            if(!quality || *quality < 1 || *quality > 100) {
+                PANIC("Invalid quality '", item, "'");
+            }
+            ret.push_back(*quality);
+        }
+    }
+    return ret;
+}
+
+vector<PNGCompressor::Encoder> parsePNGEncoders(const string& value) {
+    vector<PNGCompressor::Encoder> ret;
+    for(const string& item : splitStr(value, ',')) {
+        if(item == "screen") {
+            ret.push_back(PNGCompressor::Encoder::Screen);
+        } else if(item == "zlib") {
+            ret.push_back(PNGCompressor::Encoder::Zlib);
+        } else {
+            PANIC("Invalid PNG encoder '", item, "'");
+        }
+    }
+    return ret;
+}
+
+const char* pngCodecName(PNGCompressor::Encoder encoder) {
+    return encoder == PNGCompressor::Encoder::Screen ? "png-screen" : "png-zlib";
+}
+
+// Returns the decompressed image data of the PNG given as chunks, checking
+// the CRCs of the PNG chunks and the Adler-32 checksum of the zlib stream.
+vector<uint8_t> decompressPNG(const vector<vector<uint8_t>>& chunks) {
+    vector<uint8_t> png;
+    for(const vector<uint8_t>& chunk : chunks) {
+        png.insert(png.end(), chunk.begin(), chunk.end());
+    }
+
+    auto readU32 = [&](size_t pos) {
+        REQUIRE(pos + 4 <= png.size());
+        return
+            ((uint32_t)png[pos] << 24) | ((uint32_t)png[pos + 1] << 16) |
+            ((uint32_t)png[pos + 2] << 8) | (uint32_t)png[pos + 3];
+    };
+    vector<uint8_t> zData;
+    size_t pos = 8;
+    while(pos < png.size()) {
+        size_t length = readU32(pos);
+        REQUIRE(pos + 12 + length <= png.size());
+        uint32_t crc = (uint32_t)crc32(0, &png[pos + 4], (uInt)(length + 4));
+        REQUIRE(crc == readU32(pos + 8 + length));
+        if(!memcmp(&png[pos + 4], "IDAT", 4)) {
+            zData.insert(zData.end(), &png[pos + 8], &png[pos + 8 + length]);
+        }
+        pos += 12 + length;
+    }
+
+    vector<uint8_t> ret;
+    z_stream zStream = {};
+    REQUIRE(inflateInit(&zStream) == Z_OK);
+    zStream.next_in = zData.data();
+    zStream.avail_in = (uInt)zData.size();
+    int res;
+    do {
+        size_t oldSize = ret.size();
+        ret.resize(oldSize + (1 << 20));
+        zStream.next_out = ret.data() + oldSize;
+        zStream.avail_out = 1 << 20;
+        res = inflate(&zStream, Z_NO_FLUSH);
+        REQUIRE(res == Z_OK || res == Z_STREAM_END);
+        ret.resize(ret.size() - zStream.avail_out);
+    } while(res != Z_STREAM_END);
+    REQUIRE(zStream.avail_in == 0);
+    inflateEnd(&zStream);
+    return ret;
+}
+
+vector<int> parseThreadCounts(const string& value) {
+    vector<int> ret;
+    for(const string& item : splitStr(value, ',')) {
+        optional<int> threadCount = parseString<int>(item);
+        if(!threadCount || *threadCount < 1) {
+            PANIC("Invalid thread count '", item, "'");
+        }
+        ret.push_back(*threadCount);
+    }
+    return ret;
+}
+
+// Compresses the frame repeatedly for at least minTime (and at least 3 times)
+// and writes the result line.
+template <typename F>
+void measure(
+    const Frame& frame,
+    const char* codec,
+    int quality,
+    int threadCount,
+    double minTime,
+    F compress
+) {
+    compress();
+
+    int iterations = 0;
+    uint64_t totalBytes = 0;
+    steady_clock::time_point start = steady_clock::now();
+    double seconds;
+    while(true) {
+        totalBytes += compress();
+        ++iterations;
+        seconds = std::chrono::duration<double>(steady_clock::now() - start).count();
+        if(iterations >= 3 && seconds >= minTime) {
+            break;
+        }
+    }
+
+    double inputBytes = 4.0 * (double)frame.width * (double)frame.height;
+    double bytesPerFrame = (double)totalBytes / (double)iterations;
+    double secondsPerFrame = seconds / (double)iterations;
+    std::cout
+        << frame.name << ","
+        << frame.width << ","
+        << frame.height << ","
+        << codec << ","
+        << quality << ","
+        << threadCount << ","
+        << iterations << ","
+        << 1000.0 * secondsPerFrame << ","
+        << inputBytes / secondsPerFrame / 1e6 << ","
+        << bytesPerFrame << ","
+        << inputBytes / bytesPerFrame << "\n";
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    vector<int> threadCounts = {1, 2, 4};
+    vector<int> qualities = {101, 90, 70, 40};
+    vector<PNGCompressor::Encoder> pngEncoders = {
+        PNGCompressor::Encoder::Screen, PNGCompressor::Encoder::Zlib
+    };
+    double minTime = 0.5;
+    vector<string> paths;
+
+    for(int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if(arg.rfind("--threads=", 0) == 0) {
+            threadCounts = parseThreadCounts(arg.substr(10));
+        } else if(arg.rfind("--qualities=", 0) == 0) {
+            qualities = parseQualities(arg.substr(12));
+        } else if(arg.rfind("--png-encoders=", 0) == 0) {
+            pngEncoders = parsePNGEncoders(arg.substr(15));
+        } else if(arg.rfind("--min-time=", 0) == 0) {
+            optional<double> parsed = parseString<double>(arg.substr(11));
+            if(!parsed || *parsed < 0.0) {
+                PANIC("Invalid minimum time '", arg.substr(11), "'");
+            }
+            minTime = *parsed;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if(paths.empty()) {
+        std::cerr << "Usage: " << argv[0]
+            << " [--threads=1,2,4] [--qualities=png,90,70,40]"
+            << " [--png-encoders=screen,zlib] [--min-time=SECONDS] FRAME...\n";
+        return 1;
+    }
+
+    std::cout
+        << "frame,width,height,codec,quality,threads,iterations,"
+        << "ms_per_frame,input_mb_per_s,bytes_per_frame,compression_ratio\n";
+
+    for(const string& path : paths) {
+        Frame frame = loadFrame(path);
+        for(int quality : qualities) {
+            if(quality == 101) {
+                optional<vector<uint8_t>> expected;
+                for(PNGCompressor::Encoder encoder : pngEncoders) {
+                    for(int threadCount : threadCounts) {
+                        PNGCompressor compressor((size_t)threadCount, encoder);
+                        vector<uint8_t> decompressed = decompressPNG(
+                            compressor.compress(
+                                frame.data.data(),
+                                frame.width,
+                                frame.height,
+                                frame.width
+                            )
+                        );
+                        if(expected) {
+                            REQUIRE(decompressed == *expected);
+                        } else {
+                            expected = move(decompressed);
+                        }
+
+                        measure(
+                            frame,
+                            pngCodecName(encoder),
+                            quality,
+                            threadCount,
+                            minTime,
+                            [&]() {
+                                uint64_t length = 0;
+                                for(const vector<uint8_t>& chunk : compressor.compress(
+                                    frame.data.data(), frame.width, frame.height, frame.width
+                                )) {
+                                    length += chunk.size();
+                                }
+                                return length;
+                            }
+                        );
+                    }
+                }
+            } else {
+                // The JPEG encoder is single-threaded.
+                measure(frame, "jpeg", quality, 1, minTime, [&]() {
+                    JPEGData jpeg = compressJPEG(
+                        frame.data.data(),
+                        frame.width,
+                        frame.height,
+                        frame.width,
+                        quality
+                    );
+                    return (uint64_t)jpeg.length;
+                });
+            }
+            std::cout.flush();
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,237 @@
+// Throughput benchmark for postTask under contention: a number of producer
+// threads (standing in for the HTTP server threads) post small tasks to a
+// single TaskQueue that is drained by a consumer thread acting as the API
+// thread. For reference, the same load is run against a copy of the previous
+// mutex-protected vector<function<void()>> queue.
+//
+// Usage: task_queue_bench [--threads=1,2,4,8,16] [--tasks=N]
+//
+// The results are printed as CSV with one row per implementation and producer
+// thread count.
+
+#include "task_queue.hpp"
+
+using namespace retrojsvice;
+
+namespace {
+
+// Wakes up the consumer thread when the queue needs runTasks to be called.
+class Notifier : public TaskQueueEventHandler {
+public:
+    Notifier() {
+        pending_ = false;
+        shutdownComplete_ = false;
+    }
+
+    virtual void onTaskQueueNeedsRunTasks() override {
+        {
+            lock_guard<mutex> lock(mutex_);
+            pending_ = true;
+        }
+        cv_.notify_one();
+    }
+
+    virtual void onTaskQueueShutdownComplete() override {
+        shutdownComplete_ = true;
+    }
+
+    // Waits until onTaskQueueNeedsRunTasks has been called since the previous
+    // call.
+    void wait() {
+        unique_lock<mutex> lock(mutex_);
+        cv_.wait(lock, [&]() { return pending_; });
+        pending_ = false;
+    }
+
+    bool shutdownComplete() {
+        return shutdownComplete_;
+    }
+
+private:
+    mutex mutex_;
+    condition_variable cv_;
+    bool pending_;
+    bool shutdownComplete_;
+};
+
+// The previous implementation of the immediate task path of TaskQueue.
+class LegacyTaskQueue {
+public:
+    LegacyTaskQueue(Notifier& notifier) : notifier_(notifier) {
+        runTasksPending_ = false;
+    }
+
+    void post(function<void()> func) {
+        lock_guard lock(mutex_);
+        tasks_.push_back(func);
+        if(!runTasksPending_) {
+            runTasksPending_ = true;
+            notifier_.onTaskQueueNeedsRunTasks();
+        }
+    }
+
+    void runTasks() {
+        vector<function<void()>> tasksToRun;
+        {
+            lock_guard lock(mutex_);
+            runTasksPending_ = false;
+            swap(tasks_, tasksToRun);
+        }
+        for(function<void()>& task : tasksToRun) {
+            task();
+            task = []() {};
+        }
+    }
+
+private:
+    Notifier& notifier_;
+    mutex mutex_;
+    bool runTasksPending_;
+    vector<function<void()>> tasks_;
+};
+
+// Runs producerCount threads that each call produce(tasksPerProducer, done)
+// to post tasks that increment done, while the calling thread calls runTasks
+// whenever notified until all the tasks have run. Returns the elapsed time in
+// seconds.
+template <typename Produce, typename RunTasks>
+double runLoad(
+    Notifier& notifier,
+    int producerCount,
+    uint64_t tasksPerProducer,
+    Produce produce,
+    RunTasks runTasks
+) {
+    uint64_t done = 0;
+    uint64_t totalTasks = (uint64_t)producerCount * tasksPerProducer;
+
+    atomic<bool> go(false);
+    vector<thread> producers;
+    for(int i = 0; i < producerCount; ++i) {
+        producers.emplace_back([&]() {
+            while(!go) {
+                std::this_thread::yield();
+            }
+            produce(tasksPerProducer, &done);
+        });
+    }
+
+    steady_clock::time_point start = steady_clock::now();
+    go = true;
+    while(done < totalTasks) {
+        notifier.wait();
+        runTasks();
+    }
+    double seconds =
+        std::chrono::duration<double>(steady_clock::now() - start).count();
+
+    for(thread& producer : producers) {
+        producer.join();
+    }
+    return seconds;
+}
+
+double runTaskQueue(int producerCount, uint64_t tasksPerProducer) {
+    inAPIThread_ = true;
+
+    shared_ptr<Notifier> notifier = make_shared<Notifier>();
+    shared_ptr<TaskQueue> taskQueue = TaskQueue::create(notifier);
+
+    double seconds = runLoad(
+        *notifier,
+        producerCount,
+        tasksPerProducer,
+        [&](uint64_t count, uint64_t* done) {
+            ActiveTaskQueueLock lock(taskQueue);
+            for(uint64_t i = 0; i < count; ++i) {
+                postTask([done]() { ++*done; });
+            }
+        },
+        [&]() {
+            taskQueue->runTasks(mce);
+        }
+    );
+
+    {
+        ActiveTaskQueueLock lock(taskQueue);
+        taskQueue->shutdown();
+    }
+    while(!notifier->shutdownComplete()) {
+        taskQueue->runTasks(mce);
+    }
+    return seconds;
+}
+
+double runLegacy(int producerCount, uint64_t tasksPerProducer) {
+    Notifier notifier;
+    LegacyTaskQueue taskQueue(notifier);
+    return runLoad(
+        notifier,
+        producerCount,
+        tasksPerProducer,
+        [&](uint64_t count, uint64_t* done) {
+            for(uint64_t i = 0; i < count; ++i) {
+                taskQueue.post([done]() { ++*done; });
+            }
+        },
+        [&]() {
+            taskQueue.runTasks();
+        }
+    );
+}
+
+vector<int> parseThreadCounts(const string& str) {
+    vector<int> ret;
+    for(const string& item : splitStr(str, ',')) {
+        optional<int> count = parseString<int>(item);
+        if(!count || *count < 1) {
+            PANIC("Invalid thread count '", item, "'");
+        }
+        ret.push_back(*count);
+    }
+    return ret;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    vector<int> threadCounts = {1, 2, 4, 8, 16};
+    uint64_t totalTasks = 4000000;
+
+    for(int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if(arg.rfind("--threads=", 0) == 0) {
+            threadCounts = parseThreadCounts(arg.substr(10));
+        } else if(arg.rfind("--tasks=", 0) == 0) {
+            optional<uint64_t> parsed = parseString<uint64_t>(arg.substr(8));
+            if(!parsed || *parsed < 1) {
+                PANIC("Invalid task count '", arg.substr(8), "'");
+            }
+            totalTasks = *parsed;
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                << " [--threads=1,2,4,8,16] [--tasks=N]\n";
+            return 1;
+        }
+    }
+
+    std::cout << "impl,producers,tasks,seconds,tasks_per_s\n";
+    for(int threadCount : threadCounts) {
+        uint64_t tasksPerProducer = max(totalTasks / (uint64_t)threadCount, (uint64_t)1);
+        uint64_t taskCount = tasksPerProducer * (uint64_t)threadCount;
+        for(const char* impl : {"mpsc", "mutex"}) {
+            double seconds = string(impl) == "mpsc"
+                ? runTaskQueue(threadCount, tasksPerProducer)
+                : runLegacy(threadCount, tasksPerProducer);
+            std::cout
+                << impl << ","
+                << threadCount << ","
+                << taskCount << ","
+                << seconds << ","
+                << (double)taskCount / seconds << "\n";
+            std::cout.flush();
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,81 @@
+// Fuzz harness for the image request path and event string parsers in
+// src/event_parser.cpp. Checks that parsing arbitrary input does not crash and
+// that the results are consistent with the input.
+//
+// By default, this builds a standalone program that runs the harness on the
+// files given as arguments (such as the seed corpus in corpus/event_parser).
+// To fuzz with libFuzzer, compile with clang using -fsanitize=fuzzer and
+// -DRETROJSVICE_LIBFUZZER.
+
+#include "event_parser.hpp"
+
+using namespace retrojsvice;
+
+namespace {
+
+void checkEvents(string_view eventStr) {
+    while(optional<string_view> item = popEvent(eventStr)) {
+        REQUIRE(!item->empty() && item->back() == '/');
+        REQUIRE(item->find('/') == item->size() - 1);
+
+        ParsedEvent event;
+        if(parseEvent(*item, event)) {
+            REQUIRE(event.argCount >= 0 && event.argCount <= MaxEventArgCount);
+            REQUIRE(event.name.find_first_of("_/") == string_view::npos);
+            REQUIRE(item->substr(0, event.name.size()) == event.name);
+
+            // Reconstructing the event from the parsed values should give a
+            // string that parses to the same values.
+            string rebuilt(event.name);
+            for(int i = 0; i < event.argCount; ++i) {
+                rebuilt += "_" + toString(event.args[i]);
+            }
+            rebuilt += "/";
+            ParsedEvent event2;
+            REQUIRE(parseEvent(rebuilt, event2));
+            REQUIRE(event2.name == event.name);
+            REQUIRE(event2.argCount == event.argCount);
+            for(int i = 0; i < event.argCount; ++i) {
+                REQUIRE(event2.args[i] == event.args[i]);
+            }
+        }
+    }
+    REQUIRE(eventStr.find('/') == string_view::npos);
+}
+
+void runOne(const uint8_t* data, size_t size) {
+    string_view input((const char*)data, size);
+
+    ImageRequestPath path;
+    if(parseImageRequestPath(input, path)) {
+        REQUIRE(path.immediate == 0 || path.immediate == 1);
+        REQUIRE(path.width >= 0 && path.height >= 0);
+        REQUIRE(path.eventStr.data() + path.eventStr.size() == input.data() + input.size());
+        checkEvents(path.eventStr);
+    }
+
+    checkEvents(input);
+}
+
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+    runOne(data, size);
+    return 0;
+}
+
+#ifndef RETROJSVICE_LIBFUZZER
+int main(int argc, char* argv[]) {
+    for(int i = 1; i < argc; ++i) {
+        ifstream fp(argv[i], std::ios::binary);
+        REQUIRE(fp.good());
+        string data(
+            (std::istreambuf_iterator<char>(fp)),
+            std::istreambuf_iterator<char>()
+        );
+        runOne((const uint8_t*)data.data(), data.size());
+    }
+    std::cout << "Ran " << argc - 1 << " inputs\n";
+    return 0;
+}
+#endif
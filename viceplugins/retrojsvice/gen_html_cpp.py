@@ -3,11 +3,16 @@
 import os
 import re
 
+# Each template is split into static segments and the slots between them. The
+# generated render functions append the segments (string literals with lengths
+# known at compile time) and the slot values to a string that is reserved to
+# the final size up front.
+
 print('#include "../src/html.hpp"')
 print()
 print('namespace retrojsvice {')
 
-for filename in os.listdir("html"):
+for filename in sorted(os.listdir("html")):
     if not filename.endswith(".html"):
         continue
 
@@ -16,11 +21,37 @@ for filename in os.listdir("html"):
     with open("html/" + filename) as fp:
         code = fp.read()
 
-    code = re.sub(r'%-([a-zA-Z0-9]+)-%', r')DELIM" << data.\1 << R"DELIM(', code)
+    parts = re.split(r'%-([a-zA-Z0-9]+)-%', code)
+    segments = parts[0::2]
+    slots = parts[1::2]
+
+    staticSize = sum(len(segment.encode("utf-8")) for segment in segments)
 
     print()
-    print('void write{}HTML(ostream& out, const {}HTMLData& data) {{'.format(name, name))
-    print('    out << R"DELIM(' + code + ')DELIM";')
+    print('namespace {')
+    print()
+    print('const size_t {}HTMLStaticSize = {};'.format(name, staticSize))
+    print()
+    print('const string_view {}HTMLSegments[] = {{'.format(name))
+    for segment in segments:
+        print('    string_view(R"DELIM(' + segment + ')DELIM"),')
+    print('};')
+    print()
+    print('}')
+    print()
+    print('string render{}HTML(const {}HTMLData& data) {{'.format(name, name))
+    print('    string out;')
+    print('    out.reserve(')
+    print('        {}HTMLStaticSize'.format(name))
+    for slot in slots:
+        print('        + html_::slotSize(data.{})'.format(slot))
+    print('    );')
+    for i, segment in enumerate(segments):
+        if segment:
+            print('    out.append({}HTMLSegments[{}]);'.format(name, i))
+        if i < len(slots):
+            print('    html_::appendSlot(out, data.{});'.format(slots[i]))
+    print('    return out;')
     print('}')
 
 print()
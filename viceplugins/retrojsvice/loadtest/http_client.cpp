@@ -0,0 +1,177 @@
+#include "http_client.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace retrojsvice {
+
+HTTPClient::HTTPClient(string serverAddr, string userAgent) {
+    size_t colon = serverAddr.rfind(':');
+    REQUIRE(colon != string::npos);
+    host_ = serverAddr.substr(0, colon);
+    optional<int> port = parseString<int>(serverAddr.substr(colon + 1));
+    REQUIRE(port && *port > 0 && *port < 65536);
+    port_ = *port;
+
+    // Connecting to the wildcard address is not portable
+    if(host_ == "0.0.0.0") {
+        host_ = "127.0.0.1";
+    }
+
+    userAgent_ = move(userAgent);
+    fd_ = -1;
+}
+
+HTTPClient::~HTTPClient() {
+    disconnect_();
+}
+
+optional<HTTPClient::Response> HTTPClient::get(const string& path) {
+    optional<Response> empty;
+
+    if(fd_ < 0 && !connect_()) {
+        return empty;
+    }
+
+    string request =
+        "GET " + path + " HTTP/1.1\r\n"
+        "Host: " + host_ + ":" + toString(port_) + "\r\n"
+        "User-Agent: " + userAgent_ + "\r\n"
+        "Connection: keep-alive\r\n"
+        "\r\n";
+    size_t pos = 0;
+    while(pos < request.size()) {
+        ssize_t count = send(fd_, request.data() + pos, request.size() - pos, MSG_NOSIGNAL);
+        if(count <= 0) {
+            disconnect_();
+            return empty;
+        }
+        pos += (size_t)count;
+    }
+
+    size_t headerEnd;
+    while((headerEnd = readBuf_.find("\r\n\r\n")) == string::npos) {
+        if(!readMore_()) {
+            disconnect_();
+            return empty;
+        }
+    }
+
+    vector<string> headerLines =
+        splitStr(readBuf_.substr(0, headerEnd), '\n');
+    readBuf_.erase(0, headerEnd + 4);
+
+    Response response;
+    vector<string> statusLine = splitStr(headerLines[0], ' ');
+    optional<int> status;
+    if(statusLine.size() >= 2) {
+        status = parseString<int>(statusLine[1]);
+    }
+    if(!status) {
+        disconnect_();
+        return empty;
+    }
+    response.status = *status;
+
+    optional<size_t> contentLength;
+    bool close = false;
+    for(size_t i = 1; i < headerLines.size(); ++i) {
+        string line = headerLines[i];
+        if(!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        size_t colon = line.find(':');
+        if(colon == string::npos) {
+            continue;
+        }
+        string name = line.substr(0, colon);
+        for(char& c : name) {
+            c = tolower(c);
+        }
+        string value = line.substr(colon + 1);
+        while(!value.empty() && value[0] == ' ') {
+            value.erase(0, 1);
+        }
+        if(name == "content-length") {
+            contentLength = parseString<size_t>(value);
+        } else if(name == "connection") {
+            for(char& c : value) {
+                c = tolower(c);
+            }
+            close = value == "close";
+        }
+    }
+    if(!contentLength) {
+        disconnect_();
+        return empty;
+    }
+
+    while(readBuf_.size() < *contentLength) {
+        if(!readMore_()) {
+            disconnect_();
+            return empty;
+        }
+    }
+    response.body = readBuf_.substr(0, *contentLength);
+    readBuf_.erase(0, *contentLength);
+
+    if(close) {
+        disconnect_();
+    }
+    return response;
+}
+
+bool HTTPClient::connect_() {
+    REQUIRE(fd_ < 0);
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port_);
+    if(inet_pton(AF_INET, host_.c_str(), &addr.sin_addr) != 1) {
+        PANIC("Invalid IPv4 address '", host_, "'");
+    }
+
+    fd_ = socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(fd_ >= 0);
+
+    // The plugin responds to long polls within a few seconds, so a much
+    // longer wait means that something is broken.
+    timeval timeout;
+    timeout.tv_sec = 30;
+    timeout.tv_usec = 0;
+    setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd_, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    int one = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if(connect(fd_, (sockaddr*)&addr, sizeof(addr)) != 0) {
+        disconnect_();
+        return false;
+    }
+    return true;
+}
+
+void HTTPClient::disconnect_() {
+    if(fd_ >= 0) {
+        close(fd_);
+        fd_ = -1;
+    }
+    readBuf_.clear();
+}
+
+bool HTTPClient::readMore_() {
+    char buf[65536];
+    ssize_t count = recv(fd_, buf, sizeof(buf), 0);
+    if(count <= 0) {
+        return false;
+    }
+    readBuf_.append(buf, (size_t)count);
+    return true;
+}
+
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "common.hpp"
+
+namespace retrojsvice {
+
+// Minimal blocking HTTP/1.1 client for load testing that keeps a single
+// connection to the server alive between requests, like a browser loading
+// images from retrojsvice would. Only GET requests with responses delimited by
+// Content-Length are supported, which is sufficient for retrojsvice. Not
+// thread-safe; each simulated client should have its own instance.
+class HTTPClient {
+public:
+    // The server address is given as HOST:PORT, where HOST is an IPv4 address.
+    HTTPClient(string serverAddr, string userAgent);
+    ~HTTPClient();
+
+    DISABLE_COPY_MOVE(HTTPClient);
+
+    struct Response {
+        int status;
+        string body;
+    };
+
+    // Sends a GET request and waits for the response; returns an empty value
+    // if the connection fails or times out (after which the next call will
+    // reconnect).
+    optional<Response> get(const string& path);
+
+private:
+    bool connect_();
+    void disconnect_();
+    bool readMore_();
+
+    string host_;
+    int port_;
+    string userAgent_;
+
+    int fd_;
+    string readBuf_;
+};
+
+}
@@ -0,0 +1,541 @@
+// Headless load test driver for retrojsvice. The driver loads the plugin
+// library through the vice plugin API and acts as a fake program that serves
+// synthetic animated window contents; simultaneously, a number of scripted
+// clients open windows over HTTP and poll for images using the same long-poll
+// protocol as html/main.html. At the end, the throughput and latency observed
+// by the clients is printed as key=value pairs.
+//
+// Usage: loadtest --plugin=PATH [--windows=N] [--duration=SECONDS]
+//                 [--ramp=SECONDS] [--width=W] [--height=H] [--fps=F]
+//                 [--content=text|video|solid] [--events=N]
+//                 [--option=NAME=VALUE]...
+
+#include "http_client.hpp"
+#include "plugin.hpp"
+
+#include "histogram.hpp"
+
+namespace retrojsvice {
+
+namespace {
+
+enum class Content {Text, Video, Solid};
+
+struct Config {
+    string pluginPath;
+    int windowCount = 10;
+    double duration = 30.0;
+    double ramp = 0.0;
+    int width = 1024;
+    int height = 768;
+    double fps = 10.0;
+    Content content = Content::Text;
+    int eventsPerRequest = 0;
+    vector<pair<string, string>> options;
+    string listenAddr = "127.0.0.1:18080";
+};
+
+uint32_t hashInts(uint32_t a, uint32_t b) {
+    uint32_t h = a * 0x9E3779B1u ^ (b + 0x7F4A7C15u + (a << 6) + (a >> 2));
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    return h;
+}
+
+// Renders frame number frameIdx of the given content type into data (BGRX).
+// Text imitates scrolling a text page, video changes every pixel in every
+// frame and solid fills the frame with a single changing color.
+void renderFrame(
+    Content content,
+    size_t width,
+    size_t height,
+    uint64_t frameIdx,
+    vector<uint8_t>& data
+) {
+    data.resize(4 * width * height);
+    uint8_t* out = data.data();
+    for(size_t y = 0; y < height; ++y) {
+        if(content == Content::Text) {
+            const size_t LineHeight = 16;
+            size_t docY = y + 8 * (size_t)frameIdx;
+            uint32_t line = (uint32_t)(docY / LineHeight);
+            size_t lineY = docY % LineHeight;
+            for(size_t x = 0; x < width; ++x) {
+                uint8_t v = 255;
+                if(lineY >= 3 && lineY < 12 && x >= 16 && x + 16 < width) {
+                    uint32_t word = (uint32_t)(x / 6);
+                    uint32_t h = hashInts(line, word);
+                    if((h & 7) != 0 && ((h >> 3) & 3) != 0 && x % 6 != 5) {
+                        v = (uint8_t)(32 + (hashInts(h, (uint32_t)lineY) & 63));
+                    }
+                }
+                out[0] = v;
+                out[1] = v;
+                out[2] = v;
+                out[3] = 255;
+                out += 4;
+            }
+        } else if(content == Content::Video) {
+            for(size_t x = 0; x < width; ++x) {
+                uint32_t h = hashInts(
+                    (uint32_t)(x / 8 + frameIdx),
+                    (uint32_t)(y / 8 + 3 * frameIdx)
+                );
+                out[0] = (uint8_t)((x + frameIdx) & 255);
+                out[1] = (uint8_t)(h & 255);
+                out[2] = (uint8_t)((y + 2 * frameIdx) & 255);
+                out[3] = 255;
+                out += 4;
+            }
+        } else {
+            uint32_t h = hashInts((uint32_t)frameIdx, 0);
+            for(size_t x = 0; x < width; ++x) {
+                out[0] = (uint8_t)(h & 255);
+                out[1] = (uint8_t)((h >> 8) & 255);
+                out[2] = (uint8_t)((h >> 16) & 255);
+                out[3] = 255;
+                out += 4;
+            }
+        }
+    }
+}
+
+int64_t nowMicroseconds() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+// State of a window shared between the fake program and the client that
+// opened it.
+struct WindowState {
+    // Time of the oldest view change not yet seen by the client in
+    // microseconds, or 0 if the client has received all changes. The update
+    // latency is measured from this time to the time the next image response
+    // is received; as the image may have been compressed before the change,
+    // this is an approximation.
+    atomic<int64_t> pendingChangeTime{0};
+};
+
+struct Stats {
+    atomic<uint64_t> windowsOpened{0};
+    atomic<uint64_t> images{0};
+    atomic<uint64_t> imageBytes{0};
+    atomic<uint64_t> events{0};
+    atomic<uint64_t> errors{0};
+    Histogram requestLatency;
+    Histogram updateLatency;
+};
+
+class FakeProgram {
+public:
+    FakeProgram(Config config, shared_ptr<PluginAPI> api)
+        : config_(move(config)),
+          api_(api)
+    {
+        ctx_ = nullptr;
+        eventNotified_ = false;
+        shutdownComplete_ = false;
+        nextHandle_ = 1;
+        frameIdx_ = 0;
+        clientsRunning_ = 0;
+        stopClients_ = false;
+    }
+
+    DISABLE_COPY_MOVE(FakeProgram);
+
+    void run() {
+        vector<pair<string, string>> options = config_.options;
+        options.emplace_back("http-listen-addr", config_.listenAddr);
+        options.emplace_back("navigation-forwarding", "no");
+        ctx_ = initPluginContext(*api_, options, "Load test");
+
+        VicePluginAPI_Callbacks callbacks = createIgnoringCallbacks();
+        callbacks.eventNotify = [](void* self) {
+            ((FakeProgram*)self)->eventNotify_();
+        };
+        callbacks.shutdownComplete = [](void* self) {
+            ((FakeProgram*)self)->shutdownComplete_ = true;
+        };
+        callbacks.createWindow = [](void* self, char**) {
+            return ((FakeProgram*)self)->createWindow_();
+        };
+        callbacks.closeWindow = [](void* self, uint64_t window) {
+            ((FakeProgram*)self)->closeWindow_(window);
+        };
+        callbacks.fetchWindowImage = [](
+            void* self,
+            uint64_t window,
+            void (*putImageFunc)(void*, const uint8_t*, size_t, size_t, size_t),
+            void* data
+        ) {
+            ((FakeProgram*)self)->fetchWindowImage_(window, putImageFunc, data);
+        };
+
+        api_->start(ctx_, callbacks, this);
+
+        steady_clock::time_point startTime = steady_clock::now();
+        for(int i = 0; i < config_.windowCount; ++i) {
+            double offset = config_.windowCount > 1
+                ? config_.ramp * (double)i / (double)(config_.windowCount - 1)
+                : 0.0;
+            ++clientsRunning_;
+            clientThreads_.emplace_back([this, offset]() {
+                sleep_for(std::chrono::duration_cast<steady_clock::duration>(
+                    std::chrono::duration<double>(offset)
+                ));
+                runClient_();
+                --clientsRunning_;
+                eventNotify_();
+            });
+        }
+        eventLoop_(startTime);
+
+        for(thread& clientThread : clientThreads_) {
+            clientThread.join();
+        }
+        api_->destroyContext(ctx_);
+        ctx_ = nullptr;
+
+        double seconds = std::chrono::duration<double>(
+            steady_clock::now() - startTime
+        ).count();
+        printStats_(seconds);
+    }
+
+private:
+    void eventNotify_() {
+        {
+            lock_guard<mutex> lock(mutex_);
+            eventNotified_ = true;
+        }
+        cv_.notify_one();
+    }
+
+    void eventLoop_(steady_clock::time_point startTime) {
+        steady_clock::duration frameInterval = steady_clock::duration::max();
+        if(config_.fps > 0.0) {
+            frameInterval = std::chrono::duration_cast<steady_clock::duration>(
+                std::chrono::duration<double>(1.0 / config_.fps)
+            );
+        }
+        steady_clock::time_point endTime =
+            startTime + std::chrono::duration_cast<steady_clock::duration>(
+                std::chrono::duration<double>(config_.duration)
+            );
+        steady_clock::time_point nextFrame = startTime;
+        bool shutdownCalled = false;
+
+        while(!shutdownComplete_) {
+            bool pump;
+            {
+                unique_lock<mutex> lock(mutex_);
+                steady_clock::time_point wakeTime = min(nextFrame, endTime);
+                if(stopClients_) {
+                    wakeTime = steady_clock::now() + milliseconds(100);
+                }
+                cv_.wait_until(lock, wakeTime, [&]() { return eventNotified_; });
+                pump = eventNotified_;
+                eventNotified_ = false;
+            }
+            if(pump) {
+                api_->pumpEvents(ctx_);
+            }
+            if(shutdownComplete_) {
+                break;
+            }
+
+            steady_clock::time_point now = steady_clock::now();
+            if(now >= nextFrame && !shutdownCalled) {
+                ++frameIdx_;
+                int64_t changeTime = nowMicroseconds();
+                for(const pair<const uint64_t, shared_ptr<WindowState>>& p : windows_) {
+                    int64_t expected = 0;
+                    p.second->pendingChangeTime.compare_exchange_strong(
+                        expected, changeTime
+                    );
+                    api_->notifyWindowViewChanged(ctx_, p.first);
+                }
+                if(frameInterval == steady_clock::duration::max()) {
+                    nextFrame = steady_clock::time_point::max();
+                } else {
+                    nextFrame = max(nextFrame + frameInterval, now);
+                }
+            }
+            if(now >= endTime) {
+                stopClients_ = true;
+            }
+            if(stopClients_ && !shutdownCalled && clientsRunning_ == 0) {
+                api_->shutdown(ctx_);
+                shutdownCalled = true;
+            }
+        }
+    }
+
+    uint64_t createWindow_() {
+        uint64_t handle = nextHandle_++;
+        shared_ptr<WindowState> state = make_shared<WindowState>();
+        windows_[handle] = state;
+        {
+            lock_guard<mutex> lock(mutex_);
+            sharedWindows_[handle] = state;
+        }
+        ++stats_.windowsOpened;
+        return handle;
+    }
+
+    void closeWindow_(uint64_t window) {
+        windows_.erase(window);
+        lock_guard<mutex> lock(mutex_);
+        sharedWindows_.erase(window);
+    }
+
+    void fetchWindowImage_(
+        uint64_t window,
+        void (*putImageFunc)(void*, const uint8_t*, size_t, size_t, size_t),
+        void* data
+    ) {
+        REQUIRE(windows_.count(window));
+        size_t width = (size_t)config_.width;
+        size_t height = (size_t)config_.height;
+        renderFrame(config_.content, width, height, frameIdx_, frameBuf_);
+        putImageFunc(data, frameBuf_.data(), width, height, width);
+    }
+
+    shared_ptr<WindowState> findWindow_(uint64_t handle) {
+        lock_guard<mutex> lock(mutex_);
+        auto it = sharedWindows_.find(handle);
+        if(it == sharedWindows_.end()) {
+            return nullptr;
+        }
+        return it->second;
+    }
+
+    // Simulates a single user: opens a new window and requests images until
+    // the test ends.
+    void runClient_() {
+        HTTPClient http(
+            config_.listenAddr,
+            "Mozilla/4.0 (compatible; MSIE 6.0; Windows NT 5.1) retrojsvice-loadtest"
+        );
+
+        // The new window page redirects to the main page using JavaScript.
+        optional<HTTPClient::Response> response = http.get("/");
+        const string RedirectStart = "window.location.href = \"";
+        size_t start;
+        if(
+            !response ||
+            response->status != 200 ||
+            (start = response->body.find(RedirectStart)) == string::npos
+        ) {
+            WARNING_LOG("Opening a new window failed");
+            ++stats_.errors;
+            return;
+        }
+        start += RedirectStart.size();
+        string pathPrefix = response->body.substr(
+            start, response->body.find('"', start) - start
+        );
+
+        vector<string> pathSplit = splitStr(pathPrefix, '/');
+        optional<uint64_t> handle;
+        if(pathSplit.size() >= 2) {
+            handle = parseString<uint64_t>(pathSplit[1]);
+        }
+        shared_ptr<WindowState> window;
+        if(handle) {
+            window = findWindow_(*handle);
+        }
+        if(!window) {
+            WARNING_LOG("Unexpected new window path '", pathPrefix, "'");
+            ++stats_.errors;
+            return;
+        }
+
+        response = http.get(pathPrefix);
+        if(!response || response->status != 200) {
+            WARNING_LOG("Loading main page of window ", *handle, " failed");
+            ++stats_.errors;
+            return;
+        }
+
+        mt19937 rng((uint32_t)*handle);
+        std::uniform_int_distribution<int> xDist(0, config_.width - 1);
+        std::uniform_int_distribution<int> yDist(0, config_.height - 1);
+
+        uint64_t imgIdx = 0;
+        uint64_t eventIdx = 0;
+        int consecutiveErrors = 0;
+        while(!stopClients_) {
+            ++imgIdx;
+            stringstream path;
+            path
+                << pathPrefix << "image/1/" << imgIdx << "/"
+                << (imgIdx == 1 ? 1 : 0) << "/"
+                << config_.width << "/" << config_.height << "/"
+                << eventIdx << "/";
+            for(int i = 0; i < config_.eventsPerRequest; ++i) {
+                path << "MMO_" << xDist(rng) << "_" << yDist(rng) << "/";
+            }
+            eventIdx += (uint64_t)config_.eventsPerRequest;
+
+            steady_clock::time_point requestTime = steady_clock::now();
+            response = http.get(path.str());
+            if(!response || response->status != 200) {
+                ++stats_.errors;
+                if(++consecutiveErrors >= 10) {
+                    WARNING_LOG("Too many errors in window ", *handle, ", giving up");
+                    return;
+                }
+                continue;
+            }
+            consecutiveErrors = 0;
+
+            stats_.requestLatency.record(steady_clock::now() - requestTime);
+            int64_t changeTime = window->pendingChangeTime.exchange(0);
+            if(changeTime != 0) {
+                stats_.updateLatency.record(
+                    std::chrono::microseconds(nowMicroseconds() - changeTime)
+                );
+            }
+            ++stats_.images;
+            stats_.imageBytes += response->body.size();
+            stats_.events += (uint64_t)config_.eventsPerRequest;
+        }
+    }
+
+    void printStats_(double seconds) {
+        auto ms = [](Histogram& histogram, double q) {
+            return histogram.quantileMicroseconds(q) / 1000.0;
+        };
+        std::cout
+            << "windows=" << stats_.windowsOpened.load() << "\n"
+            << "seconds=" << seconds << "\n"
+            << "images=" << stats_.images.load() << "\n"
+            << "images_per_s=" << (double)stats_.images.load() / seconds << "\n"
+            << "image_bytes_per_s=" << (double)stats_.imageBytes.load() / seconds << "\n"
+            << "events=" << stats_.events.load() << "\n"
+            << "errors=" << stats_.errors.load() << "\n"
+            << "request_latency_ms_p50=" << ms(stats_.requestLatency, 0.5) << "\n"
+            << "request_latency_ms_p95=" << ms(stats_.requestLatency, 0.95) << "\n"
+            << "request_latency_ms_p99=" << ms(stats_.requestLatency, 0.99) << "\n"
+            << "update_latency_ms_p50=" << ms(stats_.updateLatency, 0.5) << "\n"
+            << "update_latency_ms_p95=" << ms(stats_.updateLatency, 0.95) << "\n"
+            << "update_latency_ms_p99=" << ms(stats_.updateLatency, 0.99) << "\n";
+    }
+
+    Config config_;
+    shared_ptr<PluginAPI> api_;
+    VicePluginAPI_Context* ctx_;
+
+    mutex mutex_;
+    condition_variable cv_;
+    bool eventNotified_;
+
+    // Accessed only in the program (main) thread.
+    bool shutdownComplete_;
+    uint64_t nextHandle_;
+    uint64_t frameIdx_;
+    map<uint64_t, shared_ptr<WindowState>> windows_;
+    vector<uint8_t> frameBuf_;
+
+    // Protected by mutex_; used by the clients to find their windows.
+    map<uint64_t, shared_ptr<WindowState>> sharedWindows_;
+
+    vector<thread> clientThreads_;
+    atomic<int> clientsRunning_;
+    atomic<bool> stopClients_;
+
+    Stats stats_;
+};
+
+void usage(const char* program) {
+    std::cerr
+        << "Usage: " << program << " --plugin=PATH [--windows=N] "
+        << "[--duration=SECONDS] [--ramp=SECONDS] [--width=W] [--height=H] "
+        << "[--fps=F] [--content=text|video|solid] [--events=N] "
+        << "[--option=NAME=VALUE]...\n";
+    exit(1);
+}
+
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    using namespace retrojsvice;
+
+    Config config;
+    for(int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        size_t eq = arg.find('=');
+        if(arg.substr(0, 2) != "--" || eq == string::npos) {
+            usage(argv[0]);
+        }
+        string name = arg.substr(2, eq - 2);
+        string value = arg.substr(eq + 1);
+
+        auto parseNumber = [&](auto& target, auto minValue) {
+            optional<std::remove_reference_t<decltype(target)>> parsed =
+                parseString<std::remove_reference_t<decltype(target)>>(value);
+            if(!parsed || *parsed < minValue) {
+                PANIC("Invalid value '", value, "' for option --", name);
+            }
+            target = *parsed;
+        };
+
+        if(name == "plugin") {
+            config.pluginPath = value;
+        } else if(name == "windows") {
+            parseNumber(config.windowCount, 1);
+        } else if(name == "duration") {
+            parseNumber(config.duration, 0.0);
+        } else if(name == "ramp") {
+            parseNumber(config.ramp, 0.0);
+        } else if(name == "width") {
+            parseNumber(config.width, 1);
+        } else if(name == "height") {
+            parseNumber(config.height, 1);
+        } else if(name == "fps") {
+            parseNumber(config.fps, 0.0);
+        } else if(name == "events") {
+            parseNumber(config.eventsPerRequest, 0);
+        } else if(name == "content") {
+            if(value == "text") {
+                config.content = Content::Text;
+            } else if(value == "video") {
+                config.content = Content::Video;
+            } else if(value == "solid") {
+                config.content = Content::Solid;
+            } else {
+                PANIC("Invalid value '", value, "' for option --content");
+            }
+        } else if(name == "option") {
+            size_t optEq = value.find('=');
+            if(optEq == string::npos) {
+                usage(argv[0]);
+            }
+            string optName = value.substr(0, optEq);
+            string optValue = value.substr(optEq + 1);
+            if(optName == "http-listen-addr") {
+                config.listenAddr = optValue;
+            } else if(optName == "navigation-forwarding") {
+                PANIC("Plugin option navigation-forwarding is not supported by the load test");
+            } else {
+                config.options.emplace_back(optName, optValue);
+            }
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if(config.pluginPath.empty()) {
+        usage(argv[0]);
+    }
+
+    shared_ptr<PluginAPI> api = loadPlugin(config.pluginPath);
+    FakeProgram program(move(config), api);
+    program.run();
+
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include "plugin.hpp"
+
+#include <dlfcn.h>
+
+namespace retrojsvice {
+
+namespace {
+
+const uint64_t APIVersion = 2000000;
+
+}
+
+shared_ptr<PluginAPI> loadPlugin(string path) {
+    void* lib = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if(lib == nullptr) {
+        const char* err = dlerror();
+        PANIC("Loading plugin library '", path, "' failed: ", err ? err : "");
+    }
+
+    shared_ptr<PluginAPI> api = make_shared<PluginAPI>();
+
+#define FOREACH_LOADTEST_PLUGIN_API_FUNC_ITEM(name) \
+    api->name = (decltype(api->name))dlsym(lib, "vicePluginAPI_" #name); \
+    if(api->name == nullptr) { \
+        PANIC("Plugin library '", path, "' is missing function vicePluginAPI_" #name); \
+    }
+
+    FOREACH_LOADTEST_PLUGIN_API_FUNC
+#undef FOREACH_LOADTEST_PLUGIN_API_FUNC_ITEM
+
+    if(!api->isAPIVersionSupported(APIVersion)) {
+        PANIC("Plugin library '", path, "' does not support API version ", APIVersion);
+    }
+
+    return api;
+}
+
+VicePluginAPI_Context* initPluginContext(
+    PluginAPI& api,
+    const vector<pair<string, string>>& options,
+    string programName
+) {
+    vector<const char*> names;
+    vector<const char*> values;
+    for(const pair<string, string>& option : options) {
+        names.push_back(option.first.c_str());
+        values.push_back(option.second.c_str());
+    }
+
+    char* initErrorMsg = nullptr;
+    VicePluginAPI_Context* ctx = api.initContext(
+        APIVersion,
+        names.data(),
+        values.data(),
+        options.size(),
+        programName.c_str(),
+        &initErrorMsg
+    );
+    if(ctx == nullptr) {
+        string msg = initErrorMsg != nullptr ? initErrorMsg : "";
+        if(initErrorMsg != nullptr) {
+            api.free(initErrorMsg);
+        }
+        PANIC("Initializing plugin context failed: ", msg);
+    }
+    return ctx;
+}
+
+VicePluginAPI_Callbacks createIgnoringCallbacks() {
+    VicePluginAPI_Callbacks callbacks;
+    memset(&callbacks, 0, sizeof(VicePluginAPI_Callbacks));
+    callbacks.resizeWindow = [](void*, uint64_t, size_t, size_t) {};
+    callbacks.mouseDown = [](void*, uint64_t, int, int, int) {};
+    callbacks.mouseUp = [](void*, uint64_t, int, int, int) {};
+    callbacks.mouseMove = [](void*, uint64_t, int, int) {};
+    callbacks.mouseDoubleClick = [](void*, uint64_t, int, int, int) {};
+    callbacks.mouseWheel = [](void*, uint64_t, int, int, int, int) {};
+    callbacks.mouseLeave = [](void*, uint64_t, int, int) {};
+    callbacks.keyDown = [](void*, uint64_t, int) {};
+    callbacks.keyUp = [](void*, uint64_t, int) {};
+    callbacks.loseFocus = [](void*, uint64_t) {};
+    callbacks.navigate = [](void*, uint64_t, int) {};
+    callbacks.copyToClipboard = [](void*, const char*) {};
+    callbacks.requestClipboardContent = [](void*) { return 0; };
+    callbacks.uploadFile = [](
+        void*, uint64_t, const char*, const char*,
+        void (*cleanup)(void*), void* cleanupData
+    ) {
+        cleanup(cleanupData);
+    };
+    callbacks.cancelFileUpload = [](void*, uint64_t) {};
+    return callbacks;
+}
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "common.hpp"
+
+#include "../../../vice_plugin_api.h"
+
+namespace retrojsvice {
+
+// Function pointers to the vice plugin API functions of a plugin shared library
+// loaded using dlopen. Only the functions needed by the load testing tools are
+// included.
+struct PluginAPI {
+#define FOREACH_LOADTEST_PLUGIN_API_FUNC \
+    FOREACH_LOADTEST_PLUGIN_API_FUNC_ITEM(isAPIVersionSupported) \
+    FOREACH_LOADTEST_PLUGIN_API_FUNC_ITEM(free) \
+    FOREACH_LOADTEST_PLUGIN_API_FUNC_ITEM(initContext) \
+    FOREACH_LOADTEST_PLUGIN_API_FUNC_ITEM(destroyContext) \
+    FOREACH_LOADTEST_PLUGIN_API_FUNC_ITEM(start) \
+    FOREACH_LOADTEST_PLUGIN_API_FUNC_ITEM(shutdown) \
+    FOREACH_LOADTEST_PLUGIN_API_FUNC_ITEM(pumpEvents) \
+    FOREACH_LOADTEST_PLUGIN_API_FUNC_ITEM(closeWindow) \
+    FOREACH_LOADTEST_PLUGIN_API_FUNC_ITEM(notifyWindowViewChanged)
+
+#define FOREACH_LOADTEST_PLUGIN_API_FUNC_ITEM(name) \
+    decltype(&vicePluginAPI_ ## name) name = nullptr;
+
+    FOREACH_LOADTEST_PLUGIN_API_FUNC
+#undef FOREACH_LOADTEST_PLUGIN_API_FUNC_ITEM
+};
+
+// Loads the plugin shared library in given path, panicking on failure. The
+// library is never unloaded; the plugin uses its default logging.
+shared_ptr<PluginAPI> loadPlugin(string path);
+
+// Initializes a plugin context with given options for API version 2000000,
+// panicking on failure.
+VicePluginAPI_Context* initPluginContext(
+    PluginAPI& api,
+    const vector<pair<string, string>>& options,
+    string programName
+);
+
+// Returns plugin callbacks that ignore all input and user actions; the caller
+// should set at least eventNotify, shutdownComplete, createWindow, closeWindow
+// and fetchWindowImage.
+VicePluginAPI_Callbacks createIgnoringCallbacks();
+
+}
@@ -0,0 +1,678 @@
+// Replays window sessions recorded by retrojsvice (see the session-record-dir
+// option and src/session_recorder.hpp) against the plugin, in the same way as
+// the load test driver in loadtest.cpp: the driver acts as a fake program that
+// notifies view changes and serves the recorded frames at the recorded times,
+// and for each replayed window, a scripted client sends the recorded input
+// events to the plugin in its image requests. Time can be accelerated using
+// --speed. At the end, the throughput and latency observed by the clients is
+// printed as key=value pairs.
+//
+// The clients do not abort pending image requests when new events arrive like
+// html/main.html does; instead, the events are sent in the next request. The
+// resulting delay is reported as event_delay_ms.
+//
+// Usage: replay --plugin=PATH [--windows=N] [--speed=X] [--option=NAME=VALUE]...
+//               TRACE...
+//
+// By default, one window is replayed per trace file; if --windows is given,
+// the traces are assigned to the windows in round-robin order.
+
+#include "http_client.hpp"
+#include "plugin.hpp"
+
+#include "histogram.hpp"
+#include "session_recorder.hpp"
+
+#include <zlib.h>
+
+namespace retrojsvice {
+
+namespace {
+
+struct Config {
+    string pluginPath;
+    int windowCount = 0;
+    double speed = 1.0;
+    vector<string> tracePaths;
+    vector<pair<string, string>> options;
+    string listenAddr = "127.0.0.1:18080";
+};
+
+struct TraceRecord {
+    uint8_t type;
+    int64_t time;
+
+    // SessionTraceEvent
+    string event;
+
+    // SessionTraceFrame
+    size_t width;
+    size_t height;
+    size_t rectX;
+    size_t rectY;
+    size_t rectWidth;
+    size_t rectHeight;
+    string compressed;
+};
+
+struct Trace {
+    string path;
+    vector<TraceRecord> records;
+    int64_t endTime;
+};
+
+shared_ptr<Trace> loadTrace(string path) {
+    ifstream fp(path, std::ios::binary);
+    if(!fp.good()) {
+        PANIC("Opening trace file '", path, "' failed");
+    }
+    string data(
+        (std::istreambuf_iterator<char>(fp)),
+        std::istreambuf_iterator<char>()
+    );
+
+    size_t pos = 0;
+    auto fail = [&]() {
+        PANIC("Trace file '", path, "' is corrupted at offset ", pos);
+    };
+    auto read = [&](size_t count) {
+        if(data.size() - pos < count) {
+            fail();
+        }
+        const char* ret = data.data() + pos;
+        pos += count;
+        return ret;
+    };
+    auto readUInt = [&](size_t bytes) {
+        const char* ptr = read(bytes);
+        uint64_t val = 0;
+        for(size_t i = 0; i < bytes; ++i) {
+            val |= (uint64_t)(uint8_t)ptr[i] << (8 * i);
+        }
+        return val;
+    };
+
+    if(memcmp(read(sizeof(SessionTraceMagic)), SessionTraceMagic, sizeof(SessionTraceMagic))) {
+        PANIC("File '", path, "' is not a session trace");
+    }
+
+    shared_ptr<Trace> trace = make_shared<Trace>();
+    trace->path = path;
+    trace->endTime = 0;
+    while(pos < data.size()) {
+        TraceRecord record;
+        record.type = (uint8_t)readUInt(1);
+        record.time = (int64_t)readUInt(8);
+        if(record.type == SessionTraceEvent) {
+            size_t length = (size_t)readUInt(4);
+            record.event = string(read(length), length);
+        } else if(record.type == SessionTraceFrame) {
+            record.width = (size_t)readUInt(4);
+            record.height = (size_t)readUInt(4);
+            record.rectX = (size_t)readUInt(4);
+            record.rectY = (size_t)readUInt(4);
+            record.rectWidth = (size_t)readUInt(4);
+            record.rectHeight = (size_t)readUInt(4);
+            size_t length = (size_t)readUInt(4);
+            record.compressed = string(read(length), length);
+            if(
+                !record.width || !record.height ||
+                record.rectX + record.rectWidth > record.width ||
+                record.rectY + record.rectHeight > record.height
+            ) {
+                fail();
+            }
+        } else if(record.type != SessionTraceViewChanged) {
+            fail();
+        }
+        trace->endTime = max(trace->endTime, record.time);
+        trace->records.push_back(move(record));
+    }
+
+    size_t frameCount = 0;
+    for(const TraceRecord& record : trace->records) {
+        if(record.type == SessionTraceFrame) {
+            ++frameCount;
+        }
+    }
+    if(frameCount == 0) {
+        PANIC("Trace file '", path, "' does not contain any frames");
+    }
+    return trace;
+}
+
+int64_t nowMicroseconds() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+// State of a replayed window shared between the fake program and the client
+// that opened it.
+struct WindowState {
+    shared_ptr<Trace> trace;
+
+    // The start time of the replay in microseconds (nowMicroseconds).
+    int64_t startTime;
+
+    // See WindowState in loadtest.cpp.
+    atomic<int64_t> pendingChangeTime{0};
+};
+
+// Replay state of a window accessed only in the program (main) thread.
+struct ProgramWindow {
+    shared_ptr<WindowState> state;
+
+    // Index of the next trace record to replay.
+    size_t recordIdx;
+
+    // The frame reconstructed from the replayed frame records (BGRX).
+    vector<uint8_t> frame;
+    size_t width;
+    size_t height;
+};
+
+struct Stats {
+    atomic<uint64_t> windowsOpened{0};
+    atomic<uint64_t> images{0};
+    atomic<uint64_t> imageBytes{0};
+    atomic<uint64_t> events{0};
+    atomic<uint64_t> errors{0};
+    Histogram requestLatency;
+    Histogram updateLatency;
+    Histogram eventDelay;
+};
+
+class ReplayProgram {
+public:
+    ReplayProgram(
+        Config config,
+        shared_ptr<PluginAPI> api,
+        vector<shared_ptr<Trace>> traces
+    )
+        : config_(move(config)),
+          api_(api),
+          traces_(move(traces))
+    {
+        ctx_ = nullptr;
+        eventNotified_ = false;
+        shutdownComplete_ = false;
+        nextHandle_ = 1;
+        nextTraceIdx_ = 0;
+        clientsRunning_ = 0;
+    }
+
+    DISABLE_COPY_MOVE(ReplayProgram);
+
+    void run() {
+        vector<pair<string, string>> options = config_.options;
+        options.emplace_back("http-listen-addr", config_.listenAddr);
+        options.emplace_back("navigation-forwarding", "no");
+        ctx_ = initPluginContext(*api_, options, "Replay");
+
+        VicePluginAPI_Callbacks callbacks = createIgnoringCallbacks();
+        callbacks.eventNotify = [](void* self) {
+            ((ReplayProgram*)self)->eventNotify_();
+        };
+        callbacks.shutdownComplete = [](void* self) {
+            ((ReplayProgram*)self)->shutdownComplete_ = true;
+        };
+        callbacks.createWindow = [](void* self, char**) {
+            return ((ReplayProgram*)self)->createWindow_();
+        };
+        callbacks.closeWindow = [](void* self, uint64_t window) {
+            ((ReplayProgram*)self)->closeWindow_(window);
+        };
+        callbacks.fetchWindowImage = [](
+            void* self,
+            uint64_t window,
+            void (*putImageFunc)(void*, const uint8_t*, size_t, size_t, size_t),
+            void* data
+        ) {
+            ((ReplayProgram*)self)->fetchWindowImage_(window, putImageFunc, data);
+        };
+
+        api_->start(ctx_, callbacks, this);
+
+        steady_clock::time_point startTime = steady_clock::now();
+        for(int i = 0; i < config_.windowCount; ++i) {
+            ++clientsRunning_;
+            clientThreads_.emplace_back([this]() {
+                runClient_();
+                --clientsRunning_;
+                eventNotify_();
+            });
+        }
+        eventLoop_();
+
+        for(thread& clientThread : clientThreads_) {
+            clientThread.join();
+        }
+        api_->destroyContext(ctx_);
+        ctx_ = nullptr;
+
+        double seconds = std::chrono::duration<double>(
+            steady_clock::now() - startTime
+        ).count();
+        printStats_(seconds);
+    }
+
+private:
+    void eventNotify_() {
+        {
+            lock_guard<mutex> lock(mutex_);
+            eventNotified_ = true;
+        }
+        cv_.notify_one();
+    }
+
+    // Converts a trace timestamp of given window to a nowMicroseconds value.
+    int64_t realTime_(const WindowState& state, int64_t traceTime) {
+        return state.startTime + (int64_t)((double)traceTime / config_.speed);
+    }
+
+    void eventLoop_() {
+        bool shutdownCalled = false;
+
+        while(!shutdownComplete_) {
+            int64_t wakeTime = nowMicroseconds() + 100000;
+            for(const pair<const uint64_t, ProgramWindow>& p : windows_) {
+                const ProgramWindow& window = p.second;
+                const vector<TraceRecord>& records = window.state->trace->records;
+                if(window.recordIdx < records.size()) {
+                    wakeTime = min(
+                        wakeTime,
+                        realTime_(*window.state, records[window.recordIdx].time)
+                    );
+                }
+            }
+
+            bool pump;
+            {
+                unique_lock<mutex> lock(mutex_);
+                cv_.wait_until(
+                    lock,
+                    steady_clock::time_point(std::chrono::microseconds(wakeTime)),
+                    [&]() { return eventNotified_; }
+                );
+                pump = eventNotified_;
+                eventNotified_ = false;
+            }
+            if(pump) {
+                api_->pumpEvents(ctx_);
+            }
+            if(shutdownComplete_) {
+                break;
+            }
+
+            if(!shutdownCalled) {
+                for(pair<const uint64_t, ProgramWindow>& p : windows_) {
+                    replayWindow_(p.first, p.second);
+                }
+            }
+            if(!shutdownCalled && clientsRunning_ == 0) {
+                api_->shutdown(ctx_);
+                shutdownCalled = true;
+            }
+        }
+    }
+
+    // Replays the view change and frame records of the window that are due.
+    void replayWindow_(uint64_t handle, ProgramWindow& window) {
+        const vector<TraceRecord>& records = window.state->trace->records;
+        int64_t now = nowMicroseconds();
+        bool changed = false;
+        while(
+            window.recordIdx < records.size() &&
+            realTime_(*window.state, records[window.recordIdx].time) <= now
+        ) {
+            const TraceRecord& record = records[window.recordIdx++];
+            if(record.type == SessionTraceViewChanged) {
+                changed = true;
+            } else if(record.type == SessionTraceFrame) {
+                applyFrame_(window, record);
+            }
+        }
+        if(changed) {
+            int64_t expected = 0;
+            window.state->pendingChangeTime.compare_exchange_strong(expected, now);
+            api_->notifyWindowViewChanged(ctx_, handle);
+        }
+    }
+
+    void applyFrame_(ProgramWindow& window, const TraceRecord& record) {
+        if(record.width != window.width || record.height != window.height) {
+            window.width = record.width;
+            window.height = record.height;
+            window.frame.assign(4 * window.width * window.height, 255);
+        }
+
+        vector<uint8_t> rect(4 * record.rectWidth * record.rectHeight);
+        uLongf length = (uLongf)rect.size();
+        if(
+            uncompress(
+                rect.data(),
+                &length,
+                (const Bytef*)record.compressed.data(),
+                (uLong)record.compressed.size()
+            ) != Z_OK ||
+            length != rect.size()
+        ) {
+            PANIC("Decompressing frame in trace '", window.state->trace->path, "' failed");
+        }
+
+        for(size_t y = 0; y < record.rectHeight; ++y) {
+            memcpy(
+                window.frame.data() +
+                    4 * ((record.rectY + y) * window.width + record.rectX),
+                rect.data() + 4 * y * record.rectWidth,
+                4 * record.rectWidth
+            );
+        }
+    }
+
+    uint64_t createWindow_() {
+        uint64_t handle = nextHandle_++;
+
+        shared_ptr<WindowState> state = make_shared<WindowState>();
+        state->trace = traces_[nextTraceIdx_];
+        nextTraceIdx_ = (nextTraceIdx_ + 1) % traces_.size();
+        state->startTime = nowMicroseconds();
+
+        // Start with the first frame of the trace so that the initial image
+        // request can be served before the first frame record is due.
+        ProgramWindow window;
+        window.state = state;
+        window.recordIdx = 0;
+        window.width = 0;
+        window.height = 0;
+        for(const TraceRecord& record : state->trace->records) {
+            if(record.type == SessionTraceFrame) {
+                applyFrame_(window, record);
+                break;
+            }
+        }
+        windows_[handle] = move(window);
+
+        {
+            lock_guard<mutex> lock(mutex_);
+            sharedWindows_[handle] = state;
+        }
+        ++stats_.windowsOpened;
+        return handle;
+    }
+
+    void closeWindow_(uint64_t window) {
+        windows_.erase(window);
+        lock_guard<mutex> lock(mutex_);
+        sharedWindows_.erase(window);
+    }
+
+    void fetchWindowImage_(
+        uint64_t handle,
+        void (*putImageFunc)(void*, const uint8_t*, size_t, size_t, size_t),
+        void* data
+    ) {
+        auto it = windows_.find(handle);
+        REQUIRE(it != windows_.end());
+        ProgramWindow& window = it->second;
+        putImageFunc(data, window.frame.data(), window.width, window.height, window.width);
+    }
+
+    shared_ptr<WindowState> findWindow_(uint64_t handle) {
+        lock_guard<mutex> lock(mutex_);
+        auto it = sharedWindows_.find(handle);
+        if(it == sharedWindows_.end()) {
+            return nullptr;
+        }
+        return it->second;
+    }
+
+    // Opens a new window and replays the input events of its trace until the
+    // end of the trace.
+    void runClient_() {
+        HTTPClient http(
+            config_.listenAddr,
+            "Mozilla/4.0 (compatible; MSIE 6.0; Windows NT 5.1) retrojsvice-replay"
+        );
+
+        // The new window page redirects to the main page using JavaScript.
+        optional<HTTPClient::Response> response = http.get("/");
+        const string RedirectStart = "window.location.href = \"";
+        size_t start;
+        if(
+            !response ||
+            response->status != 200 ||
+            (start = response->body.find(RedirectStart)) == string::npos
+        ) {
+            WARNING_LOG("Opening a new window failed");
+            ++stats_.errors;
+            return;
+        }
+        start += RedirectStart.size();
+        string pathPrefix = response->body.substr(
+            start, response->body.find('"', start) - start
+        );
+
+        vector<string> pathSplit = splitStr(pathPrefix, '/');
+        optional<uint64_t> handle;
+        if(pathSplit.size() >= 2) {
+            handle = parseString<uint64_t>(pathSplit[1]);
+        }
+        shared_ptr<WindowState> window;
+        if(handle) {
+            window = findWindow_(*handle);
+        }
+        if(!window) {
+            WARNING_LOG("Unexpected new window path '", pathPrefix, "'");
+            ++stats_.errors;
+            return;
+        }
+
+        response = http.get(pathPrefix);
+        if(!response || response->status != 200) {
+            WARNING_LOG("Loading main page of window ", *handle, " failed");
+            ++stats_.errors;
+            return;
+        }
+
+        const Trace& trace = *window->trace;
+        size_t recordIdx = 0;
+        size_t width = 0;
+        size_t height = 0;
+        for(const TraceRecord& record : trace.records) {
+            if(record.type == SessionTraceFrame) {
+                width = record.width;
+                height = record.height;
+                break;
+            }
+        }
+
+        uint64_t imgIdx = 0;
+        uint64_t eventIdx = 0;
+        int consecutiveErrors = 0;
+        while(true) {
+            // The client window size follows the size of the recorded frames.
+            int64_t now = nowMicroseconds();
+            vector<const TraceRecord*> events;
+            while(
+                recordIdx < trace.records.size() &&
+                realTime_(*window, trace.records[recordIdx].time) <= now
+            ) {
+                const TraceRecord& record = trace.records[recordIdx++];
+                if(record.type == SessionTraceEvent) {
+                    events.push_back(&record);
+                } else if(record.type == SessionTraceFrame) {
+                    width = record.width;
+                    height = record.height;
+                }
+            }
+            if(recordIdx == trace.records.size() && events.empty()) {
+                break;
+            }
+
+            ++imgIdx;
+            stringstream path;
+            path
+                << pathPrefix << "image/1/" << imgIdx << "/"
+                << (imgIdx == 1 ? 1 : 0) << "/"
+                << width << "/" << height << "/"
+                << eventIdx << "/";
+            for(const TraceRecord* event : events) {
+                path << event->event;
+                stats_.eventDelay.record(std::chrono::microseconds(
+                    now - realTime_(*window, event->time)
+                ));
+            }
+            eventIdx += events.size();
+
+            steady_clock::time_point requestTime = steady_clock::now();
+            response = http.get(path.str());
+            if(!response || response->status != 200) {
+                ++stats_.errors;
+                if(++consecutiveErrors >= 10) {
+                    WARNING_LOG("Too many errors in window ", *handle, ", giving up");
+                    return;
+                }
+                continue;
+            }
+            consecutiveErrors = 0;
+
+            stats_.requestLatency.record(steady_clock::now() - requestTime);
+            int64_t changeTime = window->pendingChangeTime.exchange(0);
+            if(changeTime != 0) {
+                stats_.updateLatency.record(
+                    std::chrono::microseconds(nowMicroseconds() - changeTime)
+                );
+            }
+            ++stats_.images;
+            stats_.imageBytes += response->body.size();
+            stats_.events += events.size();
+        }
+    }
+
+    void printStats_(double seconds) {
+        auto ms = [](Histogram& histogram, double q) {
+            return histogram.quantileMicroseconds(q) / 1000.0;
+        };
+        std::cout
+            << "windows=" << stats_.windowsOpened.load() << "\n"
+            << "seconds=" << seconds << "\n"
+            << "images=" << stats_.images.load() << "\n"
+            << "images_per_s=" << (double)stats_.images.load() / seconds << "\n"
+            << "image_bytes_per_s=" << (double)stats_.imageBytes.load() / seconds << "\n"
+            << "events=" << stats_.events.load() << "\n"
+            << "errors=" << stats_.errors.load() << "\n"
+            << "request_latency_ms_p50=" << ms(stats_.requestLatency, 0.5) << "\n"
+            << "request_latency_ms_p95=" << ms(stats_.requestLatency, 0.95) << "\n"
+            << "request_latency_ms_p99=" << ms(stats_.requestLatency, 0.99) << "\n"
+            << "update_latency_ms_p50=" << ms(stats_.updateLatency, 0.5) << "\n"
+            << "update_latency_ms_p95=" << ms(stats_.updateLatency, 0.95) << "\n"
+            << "update_latency_ms_p99=" << ms(stats_.updateLatency, 0.99) << "\n"
+            << "event_delay_ms_p50=" << ms(stats_.eventDelay, 0.5) << "\n"
+            << "event_delay_ms_p95=" << ms(stats_.eventDelay, 0.95) << "\n"
+            << "event_delay_ms_p99=" << ms(stats_.eventDelay, 0.99) << "\n";
+    }
+
+    Config config_;
+    shared_ptr<PluginAPI> api_;
+    vector<shared_ptr<Trace>> traces_;
+    VicePluginAPI_Context* ctx_;
+
+    mutex mutex_;
+    condition_variable cv_;
+    bool eventNotified_;
+
+    // Accessed only in the program (main) thread.
+    bool shutdownComplete_;
+    uint64_t nextHandle_;
+    size_t nextTraceIdx_;
+    map<uint64_t, ProgramWindow> windows_;
+
+    // Protected by mutex_; used by the clients to find their windows.
+    map<uint64_t, shared_ptr<WindowState>> sharedWindows_;
+
+    vector<thread> clientThreads_;
+    atomic<int> clientsRunning_;
+
+    Stats stats_;
+};
+
+void usage(const char* program) {
+    std::cerr
+        << "Usage: " << program << " --plugin=PATH [--windows=N] [--speed=X] "
+        << "[--option=NAME=VALUE]... TRACE...\n";
+    exit(1);
+}
+
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    using namespace retrojsvice;
+
+    Config config;
+    for(int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if(arg.substr(0, 2) != "--") {
+            config.tracePaths.push_back(arg);
+            continue;
+        }
+        size_t eq = arg.find('=');
+        if(eq == string::npos) {
+            usage(argv[0]);
+        }
+        string name = arg.substr(2, eq - 2);
+        string value = arg.substr(eq + 1);
+
+        if(name == "plugin") {
+            config.pluginPath = value;
+        } else if(name == "windows") {
+            optional<int> parsed = parseString<int>(value);
+            if(!parsed || *parsed < 1) {
+                PANIC("Invalid value '", value, "' for option --windows");
+            }
+            config.windowCount = *parsed;
+        } else if(name == "speed") {
+            optional<double> parsed = parseString<double>(value);
+            if(!parsed || !(*parsed > 0.0)) {
+                PANIC("Invalid value '", value, "' for option --speed");
+            }
+            config.speed = *parsed;
+        } else if(name == "option") {
+            size_t optEq = value.find('=');
+            if(optEq == string::npos) {
+                usage(argv[0]);
+            }
+            string optName = value.substr(0, optEq);
+            string optValue = value.substr(optEq + 1);
+            if(optName == "http-listen-addr") {
+                config.listenAddr = optValue;
+            } else if(optName == "navigation-forwarding") {
+                PANIC("Plugin option navigation-forwarding is not supported by the replay tool");
+            } else {
+                config.options.emplace_back(optName, optValue);
+            }
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if(config.pluginPath.empty() || config.tracePaths.empty()) {
+        usage(argv[0]);
+    }
+    if(config.windowCount == 0) {
+        config.windowCount = (int)config.tracePaths.size();
+    }
+
+    vector<shared_ptr<Trace>> traces;
+    for(const string& path : config.tracePaths) {
+        traces.push_back(loadTrace(path));
+    }
+
+    shared_ptr<PluginAPI> api = loadPlugin(config.pluginPath);
+    ReplayProgram program(move(config), api, move(traces));
+    program.run();
+
+    return 0;
+}
@@ -7,9 +7,11 @@
 #include <algorithm>
 #include <atomic>
 #include <cctype>
+#include <charconv>
 #include <chrono>
 #include <codecvt>
 #include <condition_variable>
+#include <cstddef>
 #include <cstdlib>
 #include <cstring>
 #include <exception>
@@ -18,6 +20,7 @@
 #include <future>
 #include <iostream>
 #include <limits>
+#include <list>
 #include <locale>
 #include <map>
 #include <memory>
@@ -29,6 +32,7 @@
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <thread>
 #include <tuple>
 #include <utility>
@@ -51,6 +55,7 @@ using std::get;
 using std::get_if;
 using std::ifstream;
 using std::istream;
+using std::list;
 using std::lock_guard;
 using std::make_pair;
 using std::make_shared;
@@ -76,6 +81,7 @@ using std::seed_seq;
 using std::set;
 using std::shared_ptr;
 using std::string;
+using std::string_view;
 using std::stringstream;
 using std::swap;
 using std::thread;
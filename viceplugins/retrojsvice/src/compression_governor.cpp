@@ -0,0 +1,246 @@
+#include "compression_governor.hpp"
+
+#include "task_queue.hpp"
+
+namespace retrojsvice {
+
+namespace {
+
+const steady_clock::duration SampleInterval = milliseconds(1000);
+
+// The effort is restored only after this many consecutive samples in which
+// the CPU load has been under RestoreBudgetFactor times the budget and the
+// compression load under MaxRestoreCompressionLoad; lowering the effort
+// reduces the load, so restoring it too eagerly would make the level
+// oscillate. The margin is relative so that small budgets can also be
+// restored.
+const int RestoreSampleCount = 5;
+const double RestoreBudgetFactor = 0.8;
+const double MaxRestoreCompressionLoad = 0.5;
+
+// With more images being compressed at the same time than there are cores,
+// the compressions of the different windows are queueing for the CPU.
+const double MaxCompressionLoad = 1.0;
+
+struct LevelLimits {
+    int maxJPEGQuality;
+    size_t maxPNGThreadCount; // zero if unlimited
+    int minFrameIntervalMs;
+};
+
+const LevelLimits Levels[CompressionGovernor::LevelCount] = {
+    {100, 0, 0},
+    {70, 2, 50},
+    {50, 1, 100},
+    {30, 1, 200}
+};
+
+// Returns the total busy and total time of all the CPUs of the host in
+// clock ticks since boot, or nothing if they are not available.
+optional<pair<uint64_t, uint64_t>> readCPUTimes() {
+    ifstream fp("/proc/stat");
+    string label;
+    if(!(fp >> label) || label != "cpu") {
+        return {};
+    }
+
+    // user, nice, system, idle, iowait, irq, softirq, steal
+    uint64_t busy = 0;
+    uint64_t total = 0;
+    for(int i = 0; i < 8; ++i) {
+        uint64_t val;
+        if(!(fp >> val)) {
+            return {};
+        }
+        total += val;
+        if(i != 3 && i != 4) {
+            busy += val;
+        }
+    }
+    return make_pair(busy, total);
+}
+
+}
+
+CompressionGovernor::CompressionGovernor(CKey, double cpuBudget) {
+    REQUIRE_API_THREAD();
+    REQUIRE(cpuBudget >= 0.0 && cpuBudget <= 1.0);
+
+    cpuBudget_ = cpuBudget;
+    stopped_ = false;
+    level_ = 0;
+    samplesUnderBudget_ = 0;
+
+    cpuLoad_ = -1.0;
+
+    compressionLoad_ = 0.0;
+    coreCount_ = max((int)thread::hardware_concurrency(), 1);
+    compressionsInProgress_ = 0;
+    sampleStartTime_ = steady_clock::now();
+    lastCompressionChangeTime_ = sampleStartTime_;
+    compressionTime_ = std::chrono::duration<double>::zero();
+}
+
+CompressionGovernor::~CompressionGovernor() {}
+
+void CompressionGovernor::stop() {
+    REQUIRE_API_THREAD();
+
+    stopped_ = true;
+    sampleTag_.reset();
+}
+
+int CompressionGovernor::level() {
+    REQUIRE_API_THREAD();
+    return level_;
+}
+
+int CompressionGovernor::maxJPEGQuality() {
+    REQUIRE_API_THREAD();
+    return Levels[level_].maxJPEGQuality;
+}
+
+size_t CompressionGovernor::maxPNGThreadCount() {
+    REQUIRE_API_THREAD();
+    return Levels[level_].maxPNGThreadCount;
+}
+
+steady_clock::duration CompressionGovernor::minFrameInterval() {
+    REQUIRE_API_THREAD();
+    return milliseconds(Levels[level_].minFrameIntervalMs);
+}
+
+void CompressionGovernor::compressionStarted() {
+    REQUIRE_API_THREAD();
+
+    updateCompressionTime_(steady_clock::now());
+    ++compressionsInProgress_;
+}
+
+void CompressionGovernor::compressionFinished() {
+    REQUIRE_API_THREAD();
+    REQUIRE(compressionsInProgress_ > 0);
+
+    updateCompressionTime_(steady_clock::now());
+    --compressionsInProgress_;
+}
+
+double CompressionGovernor::cpuLoad() {
+    REQUIRE_API_THREAD();
+    return cpuLoad_;
+}
+
+double CompressionGovernor::compressionLoad() {
+    REQUIRE_API_THREAD();
+    return compressionLoad_;
+}
+
+void CompressionGovernor::afterConstruct_(shared_ptr<CompressionGovernor> self) {
+    if(cpuBudget_ == 0.0) {
+        INFO_LOG("Compression governor disabled");
+        return;
+    }
+
+    prevCPUTimes_ = readCPUTimes();
+    if(!prevCPUTimes_) {
+        WARNING_LOG(
+            "Reading CPU times from /proc/stat failed, the compression "
+            "governor only follows the compression load"
+        );
+    }
+    scheduleSample_();
+}
+
+void CompressionGovernor::scheduleSample_() {
+    weak_ptr<CompressionGovernor> weakSelf = shared_from_this();
+    sampleTag_ = postDelayedTask(SampleInterval, [weakSelf]() {
+        REQUIRE_API_THREAD();
+        if(shared_ptr<CompressionGovernor> self = weakSelf.lock()) {
+            self->sample_();
+        }
+    });
+}
+
+void CompressionGovernor::sample_() {
+    REQUIRE_API_THREAD();
+
+    if(stopped_) {
+        return;
+    }
+
+    steady_clock::time_point now = steady_clock::now();
+    updateCompressionTime_(now);
+    double elapsed = std::chrono::duration<double>(now - sampleStartTime_).count();
+    if(elapsed > 0.0) {
+        compressionLoad_ = compressionTime_.count() / elapsed / (double)coreCount_;
+    }
+    sampleStartTime_ = now;
+    compressionTime_ = std::chrono::duration<double>::zero();
+
+    optional<pair<uint64_t, uint64_t>> cpuTimes = readCPUTimes();
+    cpuLoad_ = -1.0;
+    if(
+        cpuTimes && prevCPUTimes_ &&
+        cpuTimes->first >= prevCPUTimes_->first &&
+        cpuTimes->second > prevCPUTimes_->second
+    ) {
+        cpuLoad_ =
+            (double)(cpuTimes->first - prevCPUTimes_->first) /
+            (double)(cpuTimes->second - prevCPUTimes_->second);
+    }
+    prevCPUTimes_ = cpuTimes;
+
+    if(cpuLoad_ > cpuBudget_ || compressionLoad_ > MaxCompressionLoad) {
+        samplesUnderBudget_ = 0;
+        if(level_ + 1 < LevelCount) {
+            setLevel_(level_ + 1);
+        }
+    } else if(
+        cpuLoad_ < RestoreBudgetFactor * cpuBudget_ &&
+        compressionLoad_ < MaxRestoreCompressionLoad
+    ) {
+        ++samplesUnderBudget_;
+        if(samplesUnderBudget_ >= RestoreSampleCount && level_ > 0) {
+            samplesUnderBudget_ = 0;
+            setLevel_(level_ - 1);
+        }
+    } else {
+        samplesUnderBudget_ = 0;
+    }
+
+    scheduleSample_();
+}
+
+void CompressionGovernor::updateCompressionTime_(steady_clock::time_point now) {
+    compressionTime_ += (now - lastCompressionChangeTime_) * compressionsInProgress_;
+    lastCompressionChangeTime_ = now;
+}
+
+void CompressionGovernor::setLevel_(int level) {
+    REQUIRE(level >= 0 && level < LevelCount);
+
+    bool lowered = level > level_;
+    level_ = level;
+
+    const LevelLimits& limits = Levels[level_];
+    string cpuLoadStr = "n/a";
+    if(cpuLoad_ >= 0.0) {
+        cpuLoadStr = toString((int)(100.0 * cpuLoad_ + 0.5)) + "%";
+    }
+    string limitStr = "full effort";
+    if(level_ > 0) {
+        limitStr =
+            "JPEG quality <= " + toString(limits.maxJPEGQuality) +
+            ", PNG threads <= " + toString(limits.maxPNGThreadCount) +
+            ", frame interval >= " + toString(limits.minFrameIntervalMs) + "ms";
+    }
+    INFO_LOG(
+        "Compression effort ", lowered ? "lowered" : "restored",
+        " to level ", level_, "/", LevelCount - 1,
+        " (CPU load ", cpuLoadStr,
+        ", compression load ", (int)(100.0 * compressionLoad_ + 0.5), "%): ",
+        limitStr
+    );
+}
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "common.hpp"
+
+namespace retrojsvice {
+
+class DelayedTaskTag;
+
+// Limits the compression effort of the image compressors of all windows when
+// the host is overloaded (for example, when many windows are playing video),
+// so that the input latency stays tolerable for everyone. Once per second, the
+// governor samples the CPU load of the host (from /proc/stat, if available)
+// and the compression load, i.e. the average number of images being compressed
+// at the same time per CPU core. While either of them is over budget, the
+// effort level is raised by one step per sample; once both have stayed clearly
+// under budget for several samples, the level is lowered by one step. Each
+// level limits the JPEG quality, the number of PNG compression threads and the
+// frame rate of each window.
+//
+// Must be stopped using stop() before the task queue is shut down.
+class CompressionGovernor : public enable_shared_from_this<CompressionGovernor> {
+SHARED_ONLY_CLASS(CompressionGovernor);
+public:
+    // The effort is lowered when the CPU load of the host exceeds cpuBudget
+    // (0 < cpuBudget <= 1). If cpuBudget is zero, the governor is disabled and
+    // the level stays at 0.
+    CompressionGovernor(CKey, double cpuBudget);
+    ~CompressionGovernor();
+
+    void stop();
+
+    static constexpr int LevelCount = 4;
+
+    // The current effort level; 0 is the full effort and LevelCount - 1 the
+    // lowest.
+    int level();
+
+    // The limits of the current level.
+    int maxJPEGQuality();
+    size_t maxPNGThreadCount();
+    steady_clock::duration minFrameInterval();
+
+    // Called by the image compressors when they start and finish compressing
+    // an image.
+    void compressionStarted();
+    void compressionFinished();
+
+    // The values measured in the most recent sample. The CPU load is negative
+    // if it is not available.
+    double cpuLoad();
+    double compressionLoad();
+
+private:
+    void afterConstruct_(shared_ptr<CompressionGovernor> self);
+
+    void scheduleSample_();
+    void sample_();
+    void updateCompressionTime_(steady_clock::time_point now);
+    void setLevel_(int level);
+
+    double cpuBudget_;
+    bool stopped_;
+    int level_;
+    int samplesUnderBudget_;
+
+    double cpuLoad_;
+    optional<pair<uint64_t, uint64_t>> prevCPUTimes_;
+
+    double compressionLoad_;
+    int coreCount_;
+    int compressionsInProgress_;
+    steady_clock::time_point sampleStartTime_;
+    steady_clock::time_point lastCompressionChangeTime_;
+    std::chrono::duration<double> compressionTime_;
+
+    shared_ptr<DelayedTaskTag> sampleTag_;
+};
+
+}
@@ -1,8 +1,12 @@
 #include "context.hpp"
 
+#include "compression_governor.hpp"
 #include "download.hpp"
 #include "html.hpp"
+#include "latency_trace.hpp"
+#include "metrics.hpp"
 #include "secrets.hpp"
+#include "session_recorder.hpp"
 #include "upload.hpp"
 
 namespace retrojsvice {
@@ -11,10 +15,28 @@ namespace {
 
 const string defaultHTTPListenAddr = "127.0.0.1:8080";
 const int defaultHTTPMaxThreads = 100;
+const int defaultCompressionCPUBudget = 90;
+const int defaultUploadCacheFiles = 0;
+const int defaultUploadCacheSizeMB = 0;
 
 set<string> trueValues = {"1", "yes", "true", "enable", "enabled"};
 set<string> falseValues = {"0", "no", "false", "disable", "disabled"};
 
+// Returns true if the given HTTP path starts with '/' and does not collide
+// with the paths handled by the plugin itself: the new window paths ("/" and
+// "/goto/URI"), the clipboard page ("/clipboard/") and the paths of the
+// windows ("/HANDLE/...").
+bool isValidMetricsPath(const string& path) {
+    if(path.empty() || path[0] != '/' || path == "/") {
+        return false;
+    }
+    string firstSegment = splitStr(path, '/', 2)[1];
+    return
+        !isNonEmptyNumericStr(firstSegment) &&
+        firstSegment != "goto" &&
+        firstSegment != "clipboard";
+}
+
 // Returns (true, value) or (false, error message).
 pair<bool, string> parseHTTPAuthOption(string optValue) {
     if(optValue.empty()) {
@@ -203,6 +225,13 @@ variant<shared_ptr<Context>, string> Context::init(
     string httpAuthCredentials;
     bool allowQualitySelector = true;
     bool setupNavigationForwarding = true;
+    bool latencyTracing = false;
+    string latencyTraceFile;
+    string metricsPath;
+    string sessionRecordDir;
+    int compressionCPUBudget = defaultCompressionCPUBudget;
+    int uploadCacheFiles = defaultUploadCacheFiles;
+    int uploadCacheSizeMB = defaultUploadCacheSizeMB;
 
     for(const pair<string, string>& option : options) {
         const string& name = option.first;
@@ -215,6 +244,8 @@ variant<shared_ptr<Context>, string> Context::init(
             }
             if(lowValue == "png") {
                 defaultQuality = 101;
+            } else if(lowValue == "hybrid") {
+                defaultQuality = 102;
             } else {
                 optional<int> parsed = parseString<int>(value);
                 if(!parsed.has_value() || *parsed < 10 || *parsed > 100) {
@@ -265,6 +296,45 @@ variant<shared_ptr<Context>, string> Context::init(
             } else {
                 return "Invalid value '" + value + "' for option navigation-forwarding";
             }
+        } else if(name == "latency-tracing") {
+            string lowValue = value;
+            for(char& c : lowValue) {
+                c = tolower(c);
+            }
+            if(trueValues.count(lowValue)) {
+                latencyTracing = true;
+            } else if(falseValues.count(lowValue)) {
+                latencyTracing = false;
+            } else {
+                return "Invalid value '" + value + "' for option latency-tracing";
+            }
+        } else if(name == "latency-trace-file") {
+            latencyTraceFile = value;
+        } else if(name == "metrics-path") {
+            if(!value.empty() && !isValidMetricsPath(value)) {
+                return "Invalid value '" + value + "' for option metrics-path";
+            }
+            metricsPath = value;
+        } else if(name == "session-record-dir") {
+            sessionRecordDir = value;
+        } else if(name == "compression-cpu-budget") {
+            optional<int> parsed = parseString<int>(value);
+            if(!parsed.has_value() || *parsed < 0 || *parsed > 100) {
+                return "Invalid value '" + value + "' for option compression-cpu-budget";
+            }
+            compressionCPUBudget = *parsed;
+        } else if(name == "upload-cache-files") {
+            optional<int> parsed = parseString<int>(value);
+            if(!parsed.has_value() || *parsed < 0) {
+                return "Invalid value '" + value + "' for option upload-cache-files";
+            }
+            uploadCacheFiles = *parsed;
+        } else if(name == "upload-cache-size") {
+            optional<int> parsed = parseString<int>(value);
+            if(!parsed.has_value() || *parsed < 0) {
+                return "Invalid value '" + value + "' for option upload-cache-size";
+            }
+            uploadCacheSizeMB = *parsed;
         } else {
             return "Unrecognized option '" + name + "'";
         }
@@ -278,6 +348,13 @@ variant<shared_ptr<Context>, string> Context::init(
         httpAuthCredentials,
         allowQualitySelector,
         setupNavigationForwarding,
+        latencyTracing,
+        latencyTraceFile,
+        metricsPath,
+        sessionRecordDir,
+        compressionCPUBudget,
+        uploadCacheFiles,
+        uploadCacheSizeMB,
         programName
     );
 }
@@ -289,6 +366,13 @@ Context::Context(CKey, CKey,
     string httpAuthCredentials,
     bool allowQualitySelector,
     bool setupNavigationForwarding,
+    bool latencyTracing,
+    string latencyTraceFile,
+    string metricsPath,
+    string sessionRecordDir,
+    int compressionCPUBudget,
+    int uploadCacheFiles,
+    int uploadCacheSizeMB,
     string programName
 )
     : httpListenAddr_(httpListenAddr)
@@ -300,6 +384,13 @@ Context::Context(CKey, CKey,
     httpAuthCredentials_ = httpAuthCredentials;
     allowQualitySelector_ = allowQualitySelector;
     setupNavigationForwarding_ = setupNavigationForwarding;
+    latencyTracing_ = latencyTracing;
+    latencyTraceFile_ = move(latencyTraceFile);
+    metricsPath_ = move(metricsPath);
+    sessionRecordDir_ = move(sessionRecordDir);
+    compressionCPUBudget_ = compressionCPUBudget;
+    uploadCacheFiles_ = uploadCacheFiles;
+    uploadCacheSizeMB_ = uploadCacheSizeMB;
     programName_ = sanitizeProgramName(programName);
 
     state_ = Pending;
@@ -337,6 +428,16 @@ int Context::PluginNavigationControlSupportQuery_query() {
     return 1;
 }
 
+void Context::RenderScale_enable(double scale) {
+    APILock apiLock(this);
+
+    REQUIRE(state_ == Pending);
+    REQUIRE(scale > 0.0 && scale <= 1.0);
+
+    REQUIRE(!renderScale_.has_value());
+    renderScale_ = scale;
+}
+
 void Context::start(
     VicePluginAPI_Callbacks callbacks,
     void* callbackData
@@ -361,18 +462,36 @@ void Context::start(
 
     RunningAPILock runningApiLock(move(apiLock));
 
+    metrics_ = Metrics::create();
     httpServer_ = HTTPServer::create(
         shared_from_this(),
         httpListenAddr_,
-        httpMaxThreads_
+        httpMaxThreads_,
+        metrics_,
+        UploadStorage::create(
+            (size_t)uploadCacheFiles_, (uint64_t)uploadCacheSizeMB_ << 20
+        )
     );
     secretGen_ = SecretGenerator::create();
+    if(latencyTracing_) {
+        latencyTracer_ = LatencyTracer::create(latencyTraceFile_);
+    }
+    if(!sessionRecordDir_.empty()) {
+        sessionRecorder_ = SessionRecorder::create(sessionRecordDir_);
+    }
+    compressionGovernor_ =
+        CompressionGovernor::create((double)compressionCPUBudget_ / 100.0);
     windowManager_ = WindowManager::create(
         shared_from_this(),
         secretGen_,
         programName_,
+        renderScale_.value_or(1.0),
         defaultQuality_,
-        setupNavigationForwarding_
+        setupNavigationForwarding_,
+        latencyTracer_,
+        compressionGovernor_,
+        metrics_,
+        sessionRecorder_
     );
 
     clipboardCSRFToken_ = secretGen_->generateCSRFToken();
@@ -403,6 +522,9 @@ void Context::shutdown() {
         // Will only result in onWindowManagerCloseWindow events
         self->windowManager_->close(mce);
 
+        REQUIRE(self->compressionGovernor_);
+        self->compressionGovernor_->stop();
+
         self->shutdownPhase_ = WaitHTTPServer;
 
         REQUIRE(self->httpServer_);
@@ -550,7 +672,7 @@ void Context::putClipboardContent(const char* text) {
     for(shared_ptr<HTTPRequest> request : requests) {
         request->sendHTMLResponse(
             200,
-            writeClipboardHTML,
+            renderClipboardHTML,
             {programName_, htmlEscapeString(sanitizedText), clipboardCSRFToken_}
         );
     }
@@ -595,7 +717,9 @@ vector<tuple<string, string, string, string>> Context::getOptionDocs() {
     ret.emplace_back(
         "default-quality",
         "QUALITY",
-        "initial image quality for each window (10..100 or PNG)",
+        "initial image quality for each window (10..100, PNG or hybrid; "
+        "in the hybrid mode, rapidly changing areas such as videos are sent "
+        "as JPEG under a PNG with transparency)",
         "default: PNG"
     );
     ret.emplace_back(
@@ -633,6 +757,63 @@ vector<tuple<string, string, string, string>> Context::getOptionDocs() {
         "may have compatibility issues with some clients",
         "default: yes"
     );
+    ret.emplace_back(
+        "latency-tracing",
+        "YES/NO",
+        "measure the latency from receiving input events to sending the "
+        "resulting image at each stage of the image pipeline, and "
+        "periodically log the latency percentiles",
+        "default: no"
+    );
+    ret.emplace_back(
+        "latency-trace-file",
+        "PATH",
+        "if nonempty and latency tracing is enabled, the latency traces are "
+        "also written to this file in the Chrome trace event JSON format",
+        "default empty"
+    );
+    ret.emplace_back(
+        "metrics-path",
+        "PATH",
+        "if nonempty, serve metrics in the Prometheus text format at this "
+        "HTTP path (protected by http-auth like all other paths); the path "
+        "must start with '/' and its first segment may not be numeric, 'goto' "
+        "or 'clipboard', as these are used by the plugin",
+        "default empty"
+    );
+    ret.emplace_back(
+        "session-record-dir",
+        "PATH",
+        "if nonempty, record the frames and input events of each window into "
+        "a trace file in this existing directory for offline replay",
+        "default empty"
+    );
+    ret.emplace_back(
+        "compression-cpu-budget",
+        "PERCENT",
+        "when the CPU load of the host exceeds this percentage or the image "
+        "compressions of the windows are queueing for the CPU, gradually "
+        "lower the JPEG quality, PNG compression threads and frame rate of "
+        "all windows until the load falls (0 disables)",
+        "default: " + toString(defaultCompressionCPUBudget)
+    );
+    ret.emplace_back(
+        "upload-cache-files",
+        "COUNT",
+        "maximum number of uploaded files kept in the temporary directory "
+        "after they are no longer used, so that repeated uploads of the same "
+        "file are not written to disk again (note that this keeps the "
+        "contents of the files uploaded by the users on the server; 0 deletes "
+        "the files immediately after use)",
+        "default: " + toString(defaultUploadCacheFiles)
+    );
+    ret.emplace_back(
+        "upload-cache-size",
+        "MEGABYTES",
+        "maximum total size of the uploaded files kept in the temporary "
+        "directory after they are no longer used (see upload-cache-files)",
+        "default: " + toString(defaultUploadCacheSizeMB)
+    );
 
     return ret;
 }
@@ -657,6 +838,11 @@ void Context::onHTTPServerRequest(shared_ptr<HTTPRequest> request) {
         }
     }
 
+    if(!metricsPath_.empty() && request->path() == metricsPath_) {
+        handleMetricsHTTPRequest_(mce, request);
+        return;
+    }
+
     if(shutdownPhase_ != NoPendingShutdown) {
         request->sendTextResponse(503, "ERROR: Service is shutting down\n");
         return;
@@ -693,6 +879,19 @@ void Context::onTaskQueueShutdownComplete() {
     state_ = ShutdownComplete;
     shutdownPhase_ = NoPendingShutdown;
 
+    if(latencyTracer_) {
+        latencyTracer_->logSummary();
+        latencyTracer_.reset();
+    }
+
+    // The window manager and the windows may still hold references to the
+    // recorder, so we close it explicitly to flush the remaining trace data to
+    // the files.
+    if(sessionRecorder_) {
+        sessionRecorder_->close();
+        sessionRecorder_.reset();
+    }
+
     INFO_LOG("Plugin shutdown complete");
 
     REQUIRE(callbacks_.shutdownComplete != nullptr);
@@ -898,7 +1097,7 @@ void Context::handleClipboardHTTPRequest_(MCE,
     auto sendPage = [&](const string& text) {
         request->sendHTMLResponse(
             200,
-            writeClipboardHTML,
+            renderClipboardHTML,
             {programName_, htmlEscapeString(text), clipboardCSRFToken_}
         );
     };
@@ -941,6 +1140,39 @@ void Context::handleClipboardHTTPRequest_(MCE,
     }
 }
 
+void Context::handleMetricsHTTPRequest_(MCE,
+    shared_ptr<HTTPRequest> request
+) {
+    REQUIRE(state_ == Running);
+    REQUIRE(metrics_);
+
+    if(request->method() != "GET") {
+        request->sendTextResponse(400, "ERROR: Invalid request method\n");
+        return;
+    }
+
+    Metrics::Snapshot snapshot;
+    snapshot.httpConnections = httpServer_->currentConnections();
+    snapshot.taskQueueDepth = taskQueue_->pendingTaskCount();
+    snapshot.compressionEffortLevel = compressionGovernor_->level();
+    snapshot.hostCPULoad = compressionGovernor_->cpuLoad();
+    snapshot.compressionLoad = compressionGovernor_->compressionLoad();
+
+    stringstream ss;
+    metrics_->write(ss, snapshot);
+    string text = ss.str();
+
+    uint64_t contentLength = text.size();
+    request->sendResponse(
+        200,
+        "text/plain; version=0.0.4; charset=utf-8",
+        contentLength,
+        [text{move(text)}](ostream& out) {
+            out << text;
+        }
+    );
+}
+
 void Context::startClipboardTimeout_() {
     REQUIRE(state_ == Running);
 
@@ -960,7 +1192,7 @@ void Context::startClipboardTimeout_() {
             for(shared_ptr<HTTPRequest> request : requests) {
                 request->sendHTMLResponse(
                     200,
-                    writeClipboardHTML,
+                    renderClipboardHTML,
                     {self->programName_, "", self->clipboardCSRFToken_}
                 );
             }
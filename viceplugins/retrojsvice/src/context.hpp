@@ -7,6 +7,10 @@
 
 namespace retrojsvice {
 
+class CompressionGovernor;
+class LatencyTracer;
+class Metrics;
+class SessionRecorder;
 class SecretGenerator;
 
 // The implementation of the vice plugin context, exposed through the C API in
@@ -33,6 +37,13 @@ public:
         string httpAuthCredentials,
         bool allowQualitySelector,
         bool setupNavigationForwarding,
+        bool latencyTracing,
+        string latencyTraceFile,
+        string metricsPath,
+        string sessionRecordDir,
+        int compressionCPUBudget,
+        int uploadCacheFiles,
+        int uploadCacheSizeMB,
         string programName
     );
     ~Context();
@@ -40,6 +51,7 @@ public:
     // Public API functions:
     void URINavigation_enable(VicePluginAPI_URINavigation_Callbacks callbacks);
     int PluginNavigationControlSupportQuery_query();
+    void RenderScale_enable(double scale);
 
     void start(
         VicePluginAPI_Callbacks callbacks,
@@ -139,6 +151,7 @@ public:
 
 private:
     void handleClipboardHTTPRequest_(MCE, shared_ptr<HTTPRequest> request);
+    void handleMetricsHTTPRequest_(MCE, shared_ptr<HTTPRequest> request);
     void startClipboardTimeout_();
 
     int defaultQuality_;
@@ -147,6 +160,13 @@ private:
     string httpAuthCredentials_;
     bool allowQualitySelector_;
     bool setupNavigationForwarding_;
+    bool latencyTracing_;
+    string latencyTraceFile_;
+    string metricsPath_;
+    string sessionRecordDir_;
+    int compressionCPUBudget_;
+    int uploadCacheFiles_;
+    int uploadCacheSizeMB_;
     string programName_;
 
     enum {Pending, Running, ShutdownComplete} state_;
@@ -162,11 +182,16 @@ private:
     void* callbackData_;
 
     optional<VicePluginAPI_URINavigation_Callbacks> uriNavigationCallbacks_;
+    optional<double> renderScale_;
 
     shared_ptr<TaskQueue> taskQueue_;
     shared_ptr<HTTPServer> httpServer_;
     shared_ptr<SecretGenerator> secretGen_;
     shared_ptr<WindowManager> windowManager_;
+    shared_ptr<LatencyTracer> latencyTracer_;
+    shared_ptr<CompressionGovernor> compressionGovernor_;
+    shared_ptr<Metrics> metrics_;
+    shared_ptr<SessionRecorder> sessionRecorder_;
 
     string clipboardCSRFToken_;
     vector<shared_ptr<HTTPRequest>> clipboardRequests_;
@@ -87,6 +87,69 @@ optional<uint64_t> getFileSize(const PathStr& path) {
     return size;
 }
 
+// Parses the value of a Range header for a resource of given length. Returns
+// the requested range [start, end) if the header requests a single range, an
+// empty range if the range is not satisfiable, and an empty value if the
+// header should be ignored (it is malformed or requests multiple ranges, in
+// which case it is simplest to send the whole file).
+optional<pair<uint64_t, uint64_t>> parseRangeHeader(
+    string header,
+    uint64_t length
+) {
+    optional<pair<uint64_t, uint64_t>> ignore;
+    pair<uint64_t, uint64_t> unsatisfiable(0, 0);
+
+    header.erase(std::remove(header.begin(), header.end(), ' '), header.end());
+    for(char& c : header) {
+        c = tolower(c);
+    }
+    if(header.rfind("bytes=", 0) != 0) {
+        return ignore;
+    }
+    vector<string> bounds = splitStr(header.substr(6), '-', 1);
+    if(bounds.size() != 2) {
+        return ignore;
+    }
+    for(const string& bound : bounds) {
+        if(!bound.empty() && !isNonEmptyNumericStr(bound)) {
+            return ignore;
+        }
+    }
+
+    if(bounds[0].empty()) {
+        // Suffix range: the last N bytes.
+        optional<uint64_t> suffixLength = parseString<uint64_t>(bounds[1]);
+        if(!suffixLength) {
+            return ignore;
+        }
+        if(*suffixLength == 0 || length == 0) {
+            return unsatisfiable;
+        }
+        return make_pair(length - min(*suffixLength, length), length);
+    }
+
+    optional<uint64_t> first = parseString<uint64_t>(bounds[0]);
+    if(!first) {
+        return ignore;
+    }
+    uint64_t end = length;
+    if(!bounds[1].empty()) {
+        optional<uint64_t> last = parseString<uint64_t>(bounds[1]);
+        if(!last || *last < *first) {
+            return ignore;
+        }
+        if(*last < length) {
+            end = *last + 1;
+        }
+    }
+    if(*first >= length) {
+        return unsatisfiable;
+    }
+    return make_pair(*first, end);
+}
+
+atomic<uint64_t> nextDownloadID(1);
+
 }
 
 FileDownload::FileDownload(CKey,
@@ -97,6 +160,7 @@ FileDownload::FileDownload(CKey,
     name_ = sanitizeFilename(name);
     path_ = move(path);
     cleanup_ = move(cleanup);
+    id_ = nextDownloadID.fetch_add(1, memory_order_relaxed);
 }
 
 FileDownload::~FileDownload() {
@@ -118,43 +182,51 @@ void FileDownload::serve(shared_ptr<HTTPRequest> request) {
     }
     uint64_t length = *lengthOpt;
 
-    shared_ptr<FileDownload> self = shared_from_this();
-    function<void(ostream&)> body = [self, length](ostream& out) {
-        ifstream fp;
-        fp.open(self->path_, ifstream::binary);
-
-        if(!fp.good()) {
-            ERROR_LOG("Opening downloaded file ", self->path_, " failed");
-            return;
-        }
-
-        const uint64_t BufSize = 1 << 16;
-        char buf[BufSize];
+    // The file does not change during the lifetime of this object, so the
+    // ETag only needs to distinguish it from other downloads. Clients resuming
+    // an interrupted download send it in If-Range.
+    string etag = "\"" + toString(id_) + "-" + toString(length) + "\"";
 
-        uint64_t left = length;
-        while(left) {
-            uint64_t readSize = min(left, BufSize);
-            fp.read(buf, readSize);
-
-            if(!fp.good()) {
-                ERROR_LOG("Reading downloaded file ", self->path_, " failed");
-                return;
-            }
-
-            out.write(buf, readSize);
-            left -= readSize;
-        }
-        fp.close();
+    vector<pair<string, string>> headers = {
+        {"Content-Disposition", "attachment; filename=\"" + name_ + "\""},
+        {"Accept-Ranges", "bytes"},
+        {"ETag", etag}
     };
 
-    request->sendResponse(
-        200,
-        "application/download",
-        length,
-        body,
-        false,
-        {{"Content-Disposition", "attachment; filename=\"" + name_ + "\""}}
-    );
+    optional<pair<uint64_t, uint64_t>> range;
+    string rangeHeader = request->getHeader("Range");
+    string ifRange = request->getHeader("If-Range");
+    if(!rangeHeader.empty() && (ifRange.empty() || ifRange == etag)) {
+        range = parseRangeHeader(rangeHeader, length);
+    }
+
+    if(!range) {
+        request->sendFileResponse(
+            200, "application/download", path_, 0, length, false, move(headers)
+        );
+    } else if(range->first == range->second) {
+        request->sendTextResponse(
+            416,
+            "ERROR: Requested range not satisfiable\n",
+            true,
+            {{"Content-Range", "bytes */" + toString(length)}}
+        );
+    } else {
+        headers.emplace_back(
+            "Content-Range",
+            "bytes " + toString(range->first) + "-" +
+                toString(range->second - 1) + "/" + toString(length)
+        );
+        request->sendFileResponse(
+            206,
+            "application/download",
+            path_,
+            range->first,
+            range->second - range->first,
+            false,
+            move(headers)
+        );
+    }
 }
 
 }
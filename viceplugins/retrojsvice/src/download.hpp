@@ -16,13 +16,15 @@ public:
 
     // Serve the downloaded file to as response to given request. Note that
     // no-cache-headers are omitted, so the result may be cached (to circumvent
-    // bugs in IE).
+    // bugs in IE). Single byte ranges are supported so that interrupted
+    // downloads can be resumed.
     void serve(shared_ptr<HTTPRequest> request);
 
 private:
     string name_;
     PathStr path_;
     function<void()> cleanup_;
+    uint64_t id_;
 };
 
 }
@@ -0,0 +1,116 @@
+#include "event_parser.hpp"
+
+namespace retrojsvice {
+
+namespace {
+
+bool isNonEmptyNumericStrView(string_view str) {
+    if(str.empty()) {
+        return false;
+    }
+    for(char c : str) {
+        if(c < '0' || c > '9') {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Removes the prefix of str up to the first occurence of delim and returns
+// it; the delimiter itself is also removed. Returns empty if delim does not
+// occur in str.
+optional<string_view> popToken(string_view& str, char delim) {
+    size_t pos = str.find(delim);
+    if(pos == string_view::npos) {
+        optional<string_view> empty;
+        return empty;
+    }
+    string_view token = str.substr(0, pos);
+    str.remove_prefix(pos + 1);
+    return token;
+}
+
+}
+
+bool parseEvent(string_view str, ParsedEvent& event) {
+    if(str.empty() || str.back() != '/') {
+        return false;
+    }
+    str.remove_suffix(1);
+
+    size_t pos = str.find_first_of("_/");
+    event.name = str.substr(0, pos);
+    event.argCount = 0;
+    if(pos == string_view::npos) {
+        return true;
+    }
+    if(str[pos] == '/') {
+        return false;
+    }
+    str.remove_prefix(pos + 1);
+
+    while(true) {
+        if(event.argCount == MaxEventArgCount) {
+            return false;
+        }
+        pos = str.find_first_of("_/");
+        if(pos != string_view::npos && str[pos] == '/') {
+            return false;
+        }
+        optional<int> arg = parseDecimal<int>(str.substr(0, pos));
+        if(!arg) {
+            return false;
+        }
+        event.args[event.argCount++] = *arg;
+        if(pos == string_view::npos) {
+            return true;
+        }
+        str.remove_prefix(pos + 1);
+    }
+}
+
+optional<string_view> popEvent(string_view& str) {
+    size_t pos = str.find('/');
+    if(pos == string_view::npos) {
+        optional<string_view> empty;
+        return empty;
+    }
+    string_view event = str.substr(0, pos + 1);
+    str.remove_prefix(pos + 1);
+    return event;
+}
+
+bool parseImageRequestPath(string_view str, ImageRequestPath& path) {
+    string_view tokens[6];
+    for(string_view& token : tokens) {
+        optional<string_view> next = popToken(str, '/');
+        if(!next || !isNonEmptyNumericStrView(*next)) {
+            return false;
+        }
+        token = *next;
+    }
+    if(tokens[2] != "0" && tokens[2] != "1") {
+        return false;
+    }
+
+    optional<uint64_t> mainIdx = parseDecimal<uint64_t>(tokens[0]);
+    optional<uint64_t> imgIdx = parseDecimal<uint64_t>(tokens[1]);
+    optional<int> immediate = parseDecimal<int>(tokens[2]);
+    optional<int> width = parseDecimal<int>(tokens[3]);
+    optional<int> height = parseDecimal<int>(tokens[4]);
+    optional<uint64_t> startEventIdx = parseDecimal<uint64_t>(tokens[5]);
+    if(!(mainIdx && imgIdx && immediate && width && height && startEventIdx)) {
+        return false;
+    }
+
+    path.mainIdx = *mainIdx;
+    path.imgIdx = *imgIdx;
+    path.immediate = *immediate;
+    path.width = *width;
+    path.height = *height;
+    path.startEventIdx = *startEventIdx;
+    path.eventStr = str;
+    return true;
+}
+
+}
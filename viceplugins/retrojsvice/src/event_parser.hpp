@@ -0,0 +1,57 @@
+#pragma once
+
+#include "common.hpp"
+
+namespace retrojsvice {
+
+// Allocation-free parsers for the parts of the image request URLs that are
+// parsed on every image request. The returned string views point to the
+// parsed string.
+
+// Parses a nonnegative (or, for signed types, possibly negative) decimal
+// integer that spans the whole string.
+template <typename T>
+optional<T> parseDecimal(string_view str) {
+    T ret;
+    const char* end = str.data() + str.size();
+    std::from_chars_result result = std::from_chars(str.data(), end, ret);
+    if(result.ec != std::errc() || result.ptr != end || str.empty()) {
+        optional<T> empty;
+        return empty;
+    }
+    return ret;
+}
+
+const int MaxEventArgCount = 3;
+
+struct ParsedEvent {
+    string_view name;
+    int argCount;
+    int args[MaxEventArgCount];
+};
+
+// Parses a single event of form NAME/ or NAME_ARG_..._ARG/ (at most
+// MaxEventArgCount integer arguments). Returns false if the event is
+// malformed.
+bool parseEvent(string_view str, ParsedEvent& event);
+
+// Removes the first event (including the terminating '/') from the beginning of
+// str and returns it. Returns empty if str does not contain a complete event.
+optional<string_view> popEvent(string_view& str);
+
+struct ImageRequestPath {
+    uint64_t mainIdx;
+    uint64_t imgIdx;
+    int immediate;
+    int width;
+    int height;
+    uint64_t startEventIdx;
+    string_view eventStr;
+};
+
+// Parses the path of an image request after the "/image/" prefix, that is,
+// MAINIDX/IMGIDX/IMMEDIATE/WIDTH/HEIGHT/STARTEVENTIDX/EVENTSTR. Returns false
+// if the path is malformed.
+bool parseImageRequestPath(string_view str, ImageRequestPath& path);
+
+}
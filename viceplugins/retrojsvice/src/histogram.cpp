@@ -0,0 +1,90 @@
+#include "histogram.hpp"
+
+#include <cmath>
+
+namespace retrojsvice {
+
+namespace {
+
+// The upper bound of bucket i is MinBucketMicroseconds * 2^(i / 4), making
+// the largest finite bound (bucket BucketCount - 2) about 2 minutes.
+constexpr double MinBucketMicroseconds = 10.0;
+constexpr double BucketsPerDoubling = 4.0;
+
+}
+
+Histogram::Histogram() {
+    for(atomic<uint64_t>& bucket : buckets_) {
+        bucket.store(0, memory_order_relaxed);
+    }
+    count_.store(0, memory_order_relaxed);
+    sumMicroseconds_.store(0, memory_order_relaxed);
+}
+
+void Histogram::record(steady_clock::duration duration) {
+    int64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(
+        duration
+    ).count();
+    micros = max(micros, (int64_t)0);
+
+    int idx = 0;
+    if((double)micros > MinBucketMicroseconds) {
+        double pos = BucketsPerDoubling *
+            std::log2((double)micros / MinBucketMicroseconds);
+        idx = min((int)std::ceil(pos), BucketCount - 1);
+    }
+
+    buckets_[idx].fetch_add(1, memory_order_relaxed);
+    count_.fetch_add(1, memory_order_relaxed);
+    sumMicroseconds_.fetch_add((uint64_t)micros, memory_order_relaxed);
+}
+
+uint64_t Histogram::count() {
+    return count_.load(memory_order_relaxed);
+}
+
+uint64_t Histogram::sumMicroseconds() {
+    return sumMicroseconds_.load(memory_order_relaxed);
+}
+
+double Histogram::quantileMicroseconds(double q) {
+    q = max(0.0, min(1.0, q));
+
+    uint64_t counts[BucketCount];
+    uint64_t total = 0;
+    for(int i = 0; i < BucketCount; ++i) {
+        counts[i] = buckets_[i].load(memory_order_relaxed);
+        total += counts[i];
+    }
+    if(total == 0) {
+        return 0.0;
+    }
+
+    uint64_t target = max((uint64_t)std::ceil(q * (double)total), (uint64_t)1);
+    uint64_t cumulative = 0;
+    for(int i = 0; i < BucketCount - 1; ++i) {
+        cumulative += counts[i];
+        if(cumulative >= target) {
+            return bucketUpperBoundMicroseconds(i);
+        }
+    }
+
+    // Report the last bucket using its lower bound, as it is unbounded.
+    return bucketUpperBoundMicroseconds(BucketCount - 2);
+}
+
+double Histogram::bucketUpperBoundMicroseconds(int idx) {
+    REQUIRE(idx >= 0 && idx < BucketCount);
+
+    if(idx == BucketCount - 1) {
+        return numeric_limits<double>::infinity();
+    }
+    return MinBucketMicroseconds * std::exp2((double)idx / BucketsPerDoubling);
+}
+
+uint64_t Histogram::bucketCount(int idx) {
+    REQUIRE(idx >= 0 && idx < BucketCount);
+    return buckets_[idx].load(memory_order_relaxed);
+}
+
+}
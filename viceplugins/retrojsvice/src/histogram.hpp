@@ -0,0 +1,37 @@
+#pragma once
+
+#include "common.hpp"
+
+namespace retrojsvice {
+
+// Histogram of durations with exponentially growing buckets (each bucket is
+// about 19% wider than the previous one), suitable for estimating quantiles.
+// Recording values is lock-free and may be done from any thread.
+class Histogram {
+public:
+    static constexpr int BucketCount = 96;
+
+    Histogram();
+
+    DISABLE_COPY_MOVE(Histogram);
+
+    void record(steady_clock::duration duration);
+
+    uint64_t count();
+    uint64_t sumMicroseconds();
+
+    // Returns an upper bound estimate of the given quantile (0 <= q <= 1) in
+    // microseconds, or 0 if no values have been recorded.
+    double quantileMicroseconds(double q);
+
+    // Upper bound of bucket idx in microseconds (infinite for the last bucket).
+    static double bucketUpperBoundMicroseconds(int idx);
+    uint64_t bucketCount(int idx);
+
+private:
+    atomic<uint64_t> buckets_[BucketCount];
+    atomic<uint64_t> count_;
+    atomic<uint64_t> sumMicroseconds_;
+};
+
+}
@@ -4,18 +4,40 @@
 
 namespace retrojsvice {
 
+// The render functions are generated from the templates in the html directory
+// by gen_html_cpp.py; each %-name-% slot in a template is replaced by the
+// member name of the data structure.
+
+namespace html_ {
+
+inline size_t slotSize(const string& val) {
+    return val.size();
+}
+inline size_t slotSize(uint64_t val) {
+    return 20;
+}
+
+inline void appendSlot(string& out, const string& val) {
+    out.append(val);
+}
+inline void appendSlot(string& out, uint64_t val) {
+    out.append(toString(val));
+}
+
+}
+
 struct NewWindowHTMLData {
     const string& programName;
     const string& pathPrefix;
     const string& pathSuffix;
 };
-void writeNewWindowHTML(ostream& out, const NewWindowHTMLData& data);
+string renderNewWindowHTML(const NewWindowHTMLData& data);
 
 struct PreMainHTMLData {
     const string& programName;
     const string& pathPrefix;
 };
-void writePreMainHTML(ostream& out, const PreMainHTMLData& data);
+string renderPreMainHTML(const PreMainHTMLData& data);
 
 struct MainHTMLData {
     const string& programName;
@@ -23,45 +45,46 @@ struct MainHTMLData {
     uint64_t mainIdx;
     const string& nonCharKeyList;
     const string& snakeOilKeyCipherKeyWrites;
+    const string& renderScale;
 };
-void writeMainHTML(ostream& out, const MainHTMLData& data);
+string renderMainHTML(const MainHTMLData& data);
 
 struct PrePrevHTMLData {
     const string& programName;
     const string& pathPrefix;
 };
-void writePrePrevHTML(ostream& out, const PrePrevHTMLData& data);
+string renderPrePrevHTML(const PrePrevHTMLData& data);
 
 struct PrevHTMLData {
     const string& programName;
     const string& pathPrefix;
 };
-void writePrevHTML(ostream& out, const PrevHTMLData& data);
+string renderPrevHTML(const PrevHTMLData& data);
 
 struct NextHTMLData {
     const string& programName;
     const string& pathPrefix;
 };
-void writeNextHTML(ostream& out, const NextHTMLData& data);
+string renderNextHTML(const NextHTMLData& data);
 
 struct PopupIframeHTMLData {
     const string& programName;
     const string& popupPathPrefix;
     const string& popupPathSuffix;
 };
-void writePopupIframeHTML(ostream& out, const PopupIframeHTMLData& data);
+string renderPopupIframeHTML(const PopupIframeHTMLData& data);
 
 struct ClipboardIframeHTMLData {
     const string& programName;
 };
-void writeClipboardIframeHTML(ostream& out, const ClipboardIframeHTMLData& data);
+string renderClipboardIframeHTML(const ClipboardIframeHTMLData& data);
 
 struct ClipboardHTMLData {
     const string& programName;
     const string& escapedText;
     const string& csrfToken;
 };
-void writeClipboardHTML(ostream& out, const ClipboardHTMLData& data);
+string renderClipboardHTML(const ClipboardHTMLData& data);
 
 struct DownloadIframeHTMLData {
     const string& programName;
@@ -70,14 +93,14 @@ struct DownloadIframeHTMLData {
     string fileName;
 };
 
-void writeDownloadIframeHTML(ostream& out, const DownloadIframeHTMLData& data);
+string renderDownloadIframeHTML(const DownloadIframeHTMLData& data);
 
 struct UploadIframeHTMLData {
     const string& programName;
     const string& pathPrefix;
 };
 
-void writeUploadIframeHTML(ostream& out, const UploadIframeHTMLData& data);
+string renderUploadIframeHTML(const UploadIframeHTMLData& data);
 
 struct UploadHTMLData {
     const string& programName;
@@ -85,18 +108,18 @@ struct UploadHTMLData {
     const string& csrfToken;
 };
 
-void writeUploadHTML(ostream& out, const UploadHTMLData& data);
+string renderUploadHTML(const UploadHTMLData& data);
 
 struct UploadCancelHTMLData {
     const string& programName;
 };
 
-void writeUploadCancelHTML(ostream& out, const UploadCancelHTMLData& data);
+string renderUploadCancelHTML(const UploadCancelHTMLData& data);
 
 struct UploadCompleteHTMLData {
     const string& programName;
 };
 
-void writeUploadCompleteHTML(ostream& out, const UploadCompleteHTMLData& data);
+string renderUploadCompleteHTML(const UploadCompleteHTMLData& data);
 
 }
@@ -1,5 +1,7 @@
 #include "http.hpp"
 
+#include "metrics.hpp"
+#include "multipart.hpp"
 #include "task_queue.hpp"
 #include "upload.hpp"
 
@@ -10,9 +12,18 @@
 #include <Poco/Net/HTTPServerResponse.h>
 #include <Poco/Net/HTTPRequest.h>
 #include <Poco/Net/HTTPServerRequest.h>
+#include <Poco/Net/HTTPServerRequestImpl.h>
 #include <Poco/Net/HTTPRequestHandler.h>
-#include <Poco/Net/PartHandler.h>
 #include <Poco/Net/SocketAddress.h>
+#include <Poco/Net/SocketImpl.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+#endif
 
 namespace retrojsvice {
 
@@ -47,6 +58,194 @@ private:
     weak_ptr<AliveToken::Inner> inner_;
 };
 
+#ifndef _WIN32
+// Unlike the socket writes of Poco, which use MSG_NOSIGNAL, sendfile raises
+// SIGPIPE if the client has disconnected, and the plugin host might not ignore
+// it. While an instance of this class exists, SIGPIPE is blocked in the current
+// thread; if a SIGPIPE was raised in the meantime (and no SIGPIPE was pending
+// before), it is consumed in the destructor before restoring the mask.
+class SIGPIPEBlocker {
+public:
+    SIGPIPEBlocker() {
+        sigemptyset(&sigpipeSet_);
+        sigaddset(&sigpipeSet_, SIGPIPE);
+
+        sigset_t pending;
+        sigemptyset(&pending);
+        REQUIRE(sigpending(&pending) == 0);
+        wasPending_ = sigismember(&pending, SIGPIPE) == 1;
+
+        REQUIRE(pthread_sigmask(SIG_BLOCK, &sigpipeSet_, &oldMask_) == 0);
+    }
+    ~SIGPIPEBlocker() {
+        if(!wasPending_) {
+            sigset_t pending;
+            sigemptyset(&pending);
+            if(sigpending(&pending) == 0 && sigismember(&pending, SIGPIPE) == 1) {
+                timespec timeout = {0, 0};
+                while(
+                    sigtimedwait(&sigpipeSet_, nullptr, &timeout) < 0 &&
+                    errno == EINTR
+                ) {}
+            }
+        }
+        REQUIRE(pthread_sigmask(SIG_SETMASK, &oldMask_, nullptr) == 0);
+    }
+
+    DISABLE_COPY_MOVE(SIGPIPEBlocker);
+
+private:
+    sigset_t sigpipeSet_;
+    sigset_t oldMask_;
+    bool wasPending_;
+};
+
+enum class SendfileResult {Done, Failed, Unsupported};
+
+// Sends the file range directly to the socket of the request without copying
+// it through user space. Returns Unsupported if sendfile cannot be used for
+// this socket and file (in which case nothing has been sent).
+SendfileResult sendFileRangeWithSendfile(
+    Poco::Net::HTTPServerRequest& request,
+    const PathStr& path,
+    uint64_t offset,
+    uint64_t length
+) {
+    Poco::Net::HTTPServerRequestImpl* requestImpl =
+        dynamic_cast<Poco::Net::HTTPServerRequestImpl*>(&request);
+    if(requestImpl == nullptr) {
+        return SendfileResult::Unsupported;
+    }
+    int sock = requestImpl->socket().impl()->sockfd();
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        ERROR_LOG("Opening file ", path, " for sending failed");
+        return SendfileResult::Failed;
+    }
+
+    SIGPIPEBlocker sigpipeBlocker;
+
+    SendfileResult result = SendfileResult::Done;
+    off_t pos = (off_t)offset;
+    uint64_t left = length;
+    while(left) {
+        // Linux transfers at most about 2GB per call.
+        size_t count = (size_t)min(left, (uint64_t)1 << 30);
+        ssize_t sent = sendfile(sock, fd, &pos, count);
+        if(sent < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            if((errno == EINVAL || errno == ENOSYS) && left == length) {
+                result = SendfileResult::Unsupported;
+            } else {
+                WARNING_LOG(
+                    "Sending file ", path, " failed (client may have ",
+                    "disconnected), errno ", errno
+                );
+                result = SendfileResult::Failed;
+            }
+            break;
+        }
+        if(sent == 0) {
+            ERROR_LOG("File ", path, " ended before the end of the sent range");
+            result = SendfileResult::Failed;
+            break;
+        }
+        left -= (uint64_t)sent;
+    }
+
+    close(fd);
+    return result;
+}
+#endif
+
+// Writes the file range to the response body stream, using sendfile if
+// possible.
+void sendFileRange(
+    Poco::Net::HTTPServerRequest& request,
+    ostream& out,
+    const PathStr& path,
+    uint64_t offset,
+    uint64_t length
+) {
+#ifndef _WIN32
+    // The headers have already been written to the socket by
+    // HTTPServerResponse::send and the body stream has no buffered data, so
+    // we may write the body directly to the socket.
+    out.flush();
+    SendfileResult result =
+        sendFileRangeWithSendfile(request, path, offset, length);
+    if(result != SendfileResult::Unsupported) {
+        return;
+    }
+#endif
+
+    ifstream fp;
+    fp.open(path, ifstream::binary);
+    if(!fp.good()) {
+        ERROR_LOG("Opening file ", path, " for sending failed");
+        return;
+    }
+    fp.seekg((std::streamoff)offset);
+    if(!fp.good()) {
+        ERROR_LOG("Seeking file ", path, " for sending failed");
+        return;
+    }
+
+    const uint64_t BufSize = 1 << 16;
+    unique_ptr<char[]> buf(new char[BufSize]);
+
+    uint64_t left = length;
+    while(left) {
+        uint64_t readSize = min(left, BufSize);
+        fp.read(buf.get(), readSize);
+
+        if(!fp.good()) {
+            ERROR_LOG("Reading file ", path, " for sending failed");
+            return;
+        }
+
+        out.write(buf.get(), readSize);
+        left -= readSize;
+    }
+}
+
+// Returns true if the value of an Accept-Encoding header allows gzip, that is,
+// it lists gzip (or x-gzip, used by some old browsers) without "q=0".
+bool acceptEncodingAllowsGzip(const string& header) {
+    auto trim = [](const string& str) {
+        size_t start = str.find_first_not_of(" \t");
+        if(start == string::npos) {
+            return string();
+        }
+        size_t end = str.find_last_not_of(" \t");
+        return str.substr(start, end - start + 1);
+    };
+
+    for(string item : splitStr(header, ',')) {
+        for(char& c : item) {
+            c = tolower(c);
+        }
+        vector<string> params = splitStr(item, ';');
+        string coding = trim(params[0]);
+        if(coding != "gzip" && coding != "x-gzip") {
+            continue;
+        }
+        bool allowed = true;
+        for(size_t i = 1; i < params.size(); ++i) {
+            string param = trim(params[i]);
+            if(param.rfind("q=", 0) == 0) {
+                optional<double> q = parseString<double>(param.substr(2));
+                allowed = !q || *q > 0.0;
+            }
+        }
+        return allowed;
+    }
+    return false;
+}
+
 }
 
 class HTTPRequest::Impl {
@@ -55,6 +254,7 @@ public:
     Impl(
         Poco::Net::HTTPServerRequest& request,
         unique_ptr<Poco::Net::HTMLForm> form,
+        map<string, string> multipartFields,
         map<string, shared_ptr<FileUpload>> files,
         promise<function<void(Poco::Net::HTTPServerResponse&)>> responderPromise,
         AliveToken aliveToken
@@ -64,7 +264,9 @@ public:
           method_(request.getMethod()),
           path_(request.getURI()),
           userAgent_(request.get("User-Agent", "")),
+          acceptsGzip_(acceptEncodingAllowsGzip(request.get("Accept-Encoding", ""))),
           form_(move(form)),
+          multipartFields_(move(multipartFields)),
           files_(move(files)),
           responderPromise_(move(responderPromise))
     {
@@ -97,6 +299,26 @@ public:
         REQUIRE(request_ != nullptr);
         return userAgent_;
     }
+    bool acceptsGzip() {
+        REQUIRE(request_ != nullptr);
+        return acceptsGzip_;
+    }
+
+    string getHeader(string name) {
+        REQUIRE(request_ != nullptr);
+
+        // The Poco thread handling the request is waiting for the response,
+        // so reading the request is safe.
+        try {
+            return request_->get(name, "");
+        } catch(const Poco::Exception& e) {
+            WARNING_LOG(
+                "Reading HTTP header with Poco failed with exception ",
+                "(defaulting to empty): ", e.displayText()
+            );
+            return "";
+        }
+    }
 
     string getFormParam(string name) {
         REQUIRE(request_ != nullptr);
@@ -111,6 +333,11 @@ public:
                 );
             }
         }
+
+        auto it = multipartFields_.find(name);
+        if(it != multipartFields_.end()) {
+            return it->second;
+        }
         return "";
     }
 
@@ -220,6 +447,32 @@ public:
         }
     }
 
+    void sendFileResponse(
+        int status,
+        string contentType,
+        PathStr path,
+        uint64_t offset,
+        uint64_t length,
+        bool noCache,
+        vector<pair<string, string>> extraHeaders
+    ) {
+        REQUIRE(request_ != nullptr);
+
+        // The request object stays alive until the response has been sent by
+        // HTTPRequestHandler::handleRequest.
+        Poco::Net::HTTPServerRequest* request = request_;
+        sendResponse(
+            status,
+            move(contentType),
+            length,
+            [request, path{move(path)}, offset, length](ostream& out) {
+                sendFileRange(*request, out, path, offset, length);
+            },
+            noCache,
+            move(extraHeaders)
+        );
+    }
+
     void sendTextResponse(
         int status,
         string text,
@@ -250,8 +503,10 @@ private:
     string method_;
     string path_;
     string userAgent_;
+    bool acceptsGzip_;
 
     unique_ptr<Poco::Net::HTMLForm> form_;
+    map<string, string> multipartFields_;
     map<string, shared_ptr<FileUpload>> files_;
 
     promise<function<void(Poco::Net::HTTPServerResponse&)>> responderPromise_;
@@ -278,6 +533,11 @@ string HTTPRequest::userAgent() {
     return impl_->userAgent();
 }
 
+string HTTPRequest::getHeader(string name) {
+    REQUIRE_API_THREAD();
+    return impl_->getHeader(move(name));
+}
+
 string HTTPRequest::getFormParam(string name) {
     REQUIRE_API_THREAD();
     return impl_->getFormParam(move(name));
@@ -312,6 +572,59 @@ void HTTPRequest::sendResponse(
     );
 }
 
+void HTTPRequest::sendHTMLResponse(
+    int status,
+    shared_ptr<RenderedHTML> html,
+    bool noCache,
+    vector<pair<string, string>> extraHeaders
+) {
+    REQUIRE_API_THREAD();
+    REQUIRE(html);
+
+    const string* body = &html->html();
+    if(const string* gzipped = html->gzipped()) {
+        extraHeaders.emplace_back("Vary", "Accept-Encoding");
+        if(impl_->acceptsGzip()) {
+            body = gzipped;
+            extraHeaders.emplace_back("Content-Encoding", "gzip");
+        }
+    }
+
+    // The body points into html, which the lambda keeps alive.
+    uint64_t contentLength = body->size();
+    impl_->sendResponse(
+        status,
+        "text/html; charset=UTF-8",
+        contentLength,
+        [html, body](ostream& out) {
+            out.write(body->data(), body->size());
+        },
+        noCache,
+        move(extraHeaders)
+    );
+}
+
+void HTTPRequest::sendFileResponse(
+    int status,
+    string contentType,
+    PathStr path,
+    uint64_t offset,
+    uint64_t length,
+    bool noCache,
+    vector<pair<string, string>> extraHeaders
+) {
+    REQUIRE_API_THREAD();
+    impl_->sendFileResponse(
+        status,
+        move(contentType),
+        move(path),
+        offset,
+        length,
+        noCache,
+        move(extraHeaders)
+    );
+}
+
 void HTTPRequest::sendTextResponse(
     int status,
     string text,
@@ -329,39 +642,96 @@ void HTTPRequest::sendTextResponse(
 
 namespace http_ {
 
-struct FormPartHandler : public Poco::Net::PartHandler {
-    virtual void handlePart(
-        const Poco::Net::MessageHeader& header,
-        istream& dataStream
-    ) override {
-        string dispStr = header.get("Content-Disposition", "");
-        string dispVal;
-        Poco::Net::NameValueCollection disp;
-        header.splitParameters(dispStr, dispVal, disp);
+// Collects the fields of a multipart/form-data body. The files are written
+// directly to the upload storage as they are received.
+class MultipartFormCollector : public MultipartFormHandler {
+public:
+    MultipartFormCollector(
+        shared_ptr<UploadStorage> storage,
+        shared_ptr<Metrics> metrics
+    )
+        : storage_(storage),
+          metrics_(metrics)
+    {}
 
-        for(char& c : dispVal) {
-            c = tolower(c);
-        }
-        if(dispVal != "form-data") {
-            return;
+    virtual void onMultipartPartBegin(
+        string name,
+        optional<string> filename
+    ) override {
+        partName_ = move(name);
+        partValue_.clear();
+        partSkipped_ = false;
+        partSize_ = 0;
+
+        if(filename) {
+            // Browsers send an empty file part with an empty filename if no
+            // file was chosen.
+            if(filename->empty()) {
+                partSkipped_ = true;
+            } else {
+                REQUIRE(storage_);
+                writer_ = storage_->startUpload(*filename);
+                partStartTime_ = steady_clock::now();
+            }
         }
+    }
 
-        string name = disp.get("name", "");
-        string filename = disp.get("filename", "");
-
-        if(filename.empty()) {
-            return;
+    virtual void onMultipartPartData(const char* data, size_t size) override {
+        partSize_ += size;
+        if(writer_) {
+            writer_->write(data, size);
+        } else if(!partSkipped_) {
+            if(partValue_.size() + size > MaxFieldSize) {
+                WARNING_LOG("Ignoring too long form field '", partName_, "'");
+                partValue_.clear();
+                partSkipped_ = true;
+            } else {
+                partValue_.append(data, size);
+            }
         }
+    }
 
-        REQUIRE(storage);
-        shared_ptr<FileUpload> file = storage->upload(filename, dataStream);
-        if(file) {
-            files->emplace(name, file);
+    virtual void onMultipartPartEnd() override {
+        if(writer_) {
+            shared_ptr<FileUpload> file = writer_->finish();
+            writer_.reset();
+            if(file) {
+                steady_clock::duration duration =
+                    steady_clock::now() - partStartTime_;
+                double seconds =
+                    std::chrono::duration<double>(duration).count();
+                INFO_LOG(
+                    "Received file upload of ", partSize_, " bytes in ",
+                    seconds, " s (",
+                    (double)partSize_ / max(seconds, 1e-6) / 1e6, " MB/s)"
+                );
+                metrics_->uploadedFiles.fetch_add(1, memory_order_relaxed);
+                metrics_->uploadedBytes.fetch_add(partSize_, memory_order_relaxed);
+                metrics_->uploadTime.record(duration);
+
+                files.emplace(partName_, file);
+            }
+        } else if(!partSkipped_ && fields.size() < MaxFieldCount) {
+            fields.emplace(partName_, move(partValue_));
         }
     }
 
-    shared_ptr<UploadStorage> storage;
-    map<string, shared_ptr<FileUpload>>* files;
+    map<string, string> fields;
+    map<string, shared_ptr<FileUpload>> files;
+
+private:
+    static constexpr size_t MaxFieldSize = 1 << 16;
+    static constexpr size_t MaxFieldCount = 256;
+
+    shared_ptr<UploadStorage> storage_;
+    shared_ptr<Metrics> metrics_;
+
+    string partName_;
+    string partValue_;
+    bool partSkipped_;
+    uint64_t partSize_;
+    shared_ptr<UploadWriter> writer_;
+    steady_clock::time_point partStartTime_;
 };
 
 class HTTPRequestHandler : public Poco::Net::HTTPRequestHandler {
@@ -370,12 +740,14 @@ public:
         weak_ptr<HTTPServerEventHandler> eventHandler,
         shared_ptr<TaskQueue> taskQueue,
         shared_ptr<UploadStorage> uploadStorage,
+        shared_ptr<Metrics> metrics,
         AliveToken aliveToken
     )
         : aliveToken_(aliveToken),
           eventHandler_(eventHandler),
           taskQueue_(taskQueue),
-          uploadStorage_(uploadStorage)
+          uploadStorage_(uploadStorage),
+          metrics_(metrics)
     {}
 
     virtual void handleRequest(
@@ -384,16 +756,34 @@ public:
     ) override {
         ActiveTaskQueueLock activeTaskQueueLock(taskQueue_);
 
+        metrics_->httpRequests.fetch_add(1, memory_order_relaxed);
+        GaugeIncrement inProgress(metrics_->httpRequestsInProgress);
+
         unique_ptr<Poco::Net::HTMLForm> form;
+        map<string, string> multipartFields;
         map<string, shared_ptr<FileUpload>> files;
         try {
             if(request.getMethod() == "POST") {
-                FormPartHandler partHandler;
-                partHandler.storage = uploadStorage_;
-                partHandler.files = &files;
-                form = make_unique<Poco::Net::HTMLForm>(
-                    request, request.stream(), partHandler
-                );
+                // Multipart forms (used for file uploads) are parsed by our
+                // own streaming parser; Poco is only used for URL-encoded
+                // forms.
+                optional<string> boundary =
+                    parseMultipartFormBoundary(request.getContentType());
+                if(boundary) {
+                    MultipartFormCollector collector(uploadStorage_, metrics_);
+                    if(parseMultipartForm(request.stream(), *boundary, collector)) {
+                        multipartFields = move(collector.fields);
+                        files = move(collector.files);
+                    } else {
+                        WARNING_LOG(
+                            "Parsing multipart form failed (defaulting to empty)"
+                        );
+                    }
+                } else {
+                    form = make_unique<Poco::Net::HTMLForm>(
+                        request, request.stream()
+                    );
+                }
             }
         } catch(const Poco::Exception& e) {
             WARNING_LOG(
@@ -411,6 +801,7 @@ public:
                 make_unique<HTTPRequest::Impl>(
                     request,
                     move(form),
+                    move(multipartFields),
                     move(files),
                     move(responderPromise),
                     aliveToken_
@@ -434,6 +825,12 @@ public:
         }
 
         responder(response);
+
+        if(response.getContentLength64() > 0) {
+            metrics_->httpResponseBytes.fetch_add(
+                (uint64_t)response.getContentLength64(), memory_order_relaxed
+            );
+        }
     }
 
 private:
@@ -441,6 +838,7 @@ private:
     weak_ptr<HTTPServerEventHandler> eventHandler_;
     shared_ptr<TaskQueue> taskQueue_;
     shared_ptr<UploadStorage> uploadStorage_;
+    shared_ptr<Metrics> metrics_;
 };
 
 }
@@ -454,20 +852,22 @@ public:
     HTTPRequestHandlerFactory(
         weak_ptr<HTTPServerEventHandler> eventHandler,
         shared_ptr<TaskQueue> taskQueue,
+        shared_ptr<UploadStorage> uploadStorage,
+        shared_ptr<Metrics> metrics,
         AliveToken aliveToken
     )
         : aliveToken_(aliveToken),
           eventHandler_(eventHandler),
-          taskQueue_(taskQueue)
-    {
-        uploadStorage_ = UploadStorage::create();
-    }
+          taskQueue_(taskQueue),
+          uploadStorage_(uploadStorage),
+          metrics_(metrics)
+    {}
 
     virtual Poco::Net::HTTPRequestHandler* createRequestHandler(
         const Poco::Net::HTTPServerRequest& request
     ) override {
         return new HTTPRequestHandler(
-            eventHandler_, taskQueue_, uploadStorage_, aliveToken_
+            eventHandler_, taskQueue_, uploadStorage_, metrics_, aliveToken_
         );
     }
 
@@ -476,6 +876,7 @@ private:
     weak_ptr<HTTPServerEventHandler> eventHandler_;
     shared_ptr<TaskQueue> taskQueue_;
     shared_ptr<UploadStorage> uploadStorage_;
+    shared_ptr<Metrics> metrics_;
 };
 
 }
@@ -511,7 +912,9 @@ public:
     Impl(CKey,
         weak_ptr<HTTPServerEventHandler> eventHandler,
         SocketAddress listenAddr,
-        int maxThreads
+        int maxThreads,
+        shared_ptr<Metrics> metrics,
+        shared_ptr<UploadStorage> uploadStorage
     )
         : eventHandler_(eventHandler),
           state_(Running),
@@ -524,6 +927,8 @@ public:
             new HTTPRequestHandlerFactory(
                 eventHandler,
                 TaskQueue::getActiveQueue(),
+                uploadStorage,
+                metrics,
                 aliveToken_
             ),
             threadPool_,
@@ -596,6 +1001,13 @@ public:
         return state_ == ShutdownComplete;
     }
 
+    int currentConnections() {
+        if(state_ != Running) {
+            return 0;
+        }
+        return httpServer_->currentConnections();
+    }
+
 private:
     weak_ptr<HTTPServerEventHandler> eventHandler_;
 
@@ -612,15 +1024,21 @@ private:
 HTTPServer::HTTPServer(CKey,
     weak_ptr<HTTPServerEventHandler> eventHandler,
     SocketAddress listenAddr,
-    int maxThreads
+    int maxThreads,
+    shared_ptr<Metrics> metrics,
+    shared_ptr<UploadStorage> uploadStorage
 ) {
     REQUIRE_API_THREAD();
     REQUIRE(maxThreads > 0);
+    REQUIRE(metrics);
+    REQUIRE(uploadStorage);
 
     INFO_LOG("Starting HTTP server (listen address: ", listenAddr, ")");
 
     try {
-        impl_ = Impl::create(eventHandler, listenAddr, maxThreads);
+        impl_ = Impl::create(
+            eventHandler, listenAddr, maxThreads, metrics, uploadStorage
+        );
     } catch(const Poco::Exception& e) {
         PANIC("Starting Poco HTTP server failed with exception: ", e.displayText());
     }
@@ -632,6 +1050,11 @@ HTTPServer::~HTTPServer() {
     REQUIRE(impl_->isShutdownComplete());
 }
 
+int HTTPServer::currentConnections() {
+    REQUIRE_API_THREAD();
+    return impl_->currentConnections();
+}
+
 void HTTPServer::shutdown() {
     REQUIRE_API_THREAD();
     impl_->shutdown();
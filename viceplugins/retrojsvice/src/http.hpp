@@ -1,10 +1,12 @@
 #pragma once
 
-#include "common.hpp"
+#include "rendered_html.hpp"
 
 namespace retrojsvice {
 
 class FileUpload;
+class Metrics;
+class UploadStorage;
 
 namespace http_ {
     class HTTPRequestHandler;
@@ -27,6 +29,10 @@ public:
     string path();
     string userAgent();
 
+    // Returns the value of given request header, or an empty string if the
+    // header is not present.
+    string getHeader(string name);
+
     // Form accessors return empty string/pointer if there is no entry with
     // specified name.
     string getFormParam(string name);
@@ -48,6 +54,19 @@ public:
         vector<pair<string, string>> extraHeaders = {}
     );
 
+    // Sends length bytes of the file in given path starting from given offset
+    // as the body. Where possible, the file is sent to the socket with
+    // sendfile; otherwise, it is copied through the response stream.
+    void sendFileResponse(
+        int status,
+        string contentType,
+        PathStr path,
+        uint64_t offset,
+        uint64_t length,
+        bool noCache = true,
+        vector<pair<string, string>> extraHeaders = {}
+    );
+
     void sendTextResponse(
         int status,
         string text,
@@ -55,27 +74,26 @@ public:
         vector<pair<string, string>> extraHeaders = {}
     );
 
+    // Sends the gzip-compressed version of the page if it has one and the
+    // client accepts it.
+    void sendHTMLResponse(
+        int status,
+        shared_ptr<RenderedHTML> html,
+        bool noCache = true,
+        vector<pair<string, string>> extraHeaders = {}
+    );
+
     template <typename Data>
     void sendHTMLResponse(
         int status,
-        void (*writer)(ostream&, const Data&),
+        string (*render)(const Data&),
         const Data& data,
         bool noCache = true,
         vector<pair<string, string>> extraHeaders = {}
     ) {
-        stringstream htmlSS;
-        writer(htmlSS, data);
-
-        string html = htmlSS.str();
-        uint64_t contentLength = html.size();
-
-        sendResponse(
+        sendHTMLResponse(
             status,
-            "text/html; charset=UTF-8",
-            contentLength,
-            [html{move(html)}](ostream& out) {
-                out << html;
-            },
+            RenderedHTML::create(render(data)),
             noCache,
             move(extraHeaders)
         );
@@ -121,10 +139,15 @@ public:
     HTTPServer(CKey,
         weak_ptr<HTTPServerEventHandler> eventHandler,
         SocketAddress listenAddr,
-        int maxThreads
+        int maxThreads,
+        shared_ptr<Metrics> metrics,
+        shared_ptr<UploadStorage> uploadStorage
     );
     ~HTTPServer();
 
+    // Number of currently open connections.
+    int currentConnections();
+
     void shutdown();
 
 private:
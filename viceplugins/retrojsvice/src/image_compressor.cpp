@@ -1,14 +1,43 @@
 #include "image_compressor.hpp"
 
+#include "compression_governor.hpp"
 #include "http.hpp"
 #include "jpeg.hpp"
+#include "latency_trace.hpp"
+#include "metrics.hpp"
 #include "png.hpp"
 #include "task_queue.hpp"
+#include "tile_activity.hpp"
 
 namespace retrojsvice {
 
 namespace {
 
+// Number of values of the signal in the width of the compressed image: the
+// lowest bit is the iframe signal and the second lowest bit is set if the
+// image has a video layer.
+const int WidthSignalCount = 2 * ImageCompressor::IframeSignalCount;
+
+// Number of video layers kept available for sendVideoLayer.
+const size_t SentVideoLayerCount = 4;
+
+// Interval of refreshing hybrid mode images while there are video tiles.
+const steady_clock::duration VideoRefreshInterval = milliseconds(500);
+
+// JPEG quality of the video layer of hybrid mode images, unless capped by the
+// governor.
+const int VideoLayerQuality = 80;
+
+// Interval of checking whether the governor allows recompressing an image
+// sent with a reduced JPEG quality at a higher quality.
+const steady_clock::duration EffortCheckInterval = milliseconds(1000);
+
+// Color (blue, green, red) that marks the video tiles transparent in the PNG
+// part of a hybrid mode image. Occurrences of the color in the other tiles are
+// changed to NearKeyColor.
+const uint8_t KeyColor[3] = {255, 0, 255};
+const uint8_t NearKeyColor[3] = {254, 0, 255};
+
 void serveWhiteJPEGPixel(shared_ptr<HTTPRequest> request) {
     REQUIRE_API_THREAD();
 
@@ -45,7 +74,10 @@ function<void(shared_ptr<HTTPRequest>)> compressPNG_(
     vector<uint8_t> imageData,
     size_t imageWidth,
     size_t imageHeight,
-    shared_ptr<PNGCompressor> pngCompressor
+    shared_ptr<PNGCompressor> pngCompressor,
+    size_t maxPNGThreadCount,
+    shared_ptr<LatencyTrace> latencyTrace,
+    Metrics& metrics
 ) {
     REQUIRE(imageWidth && imageHeight);
     REQUIRE(imageData.size() == 4 * imageWidth * imageHeight);
@@ -56,7 +88,9 @@ function<void(shared_ptr<HTTPRequest>)> compressPNG_(
                 imageData.data(),
                 imageWidth,
                 imageHeight,
-                imageWidth
+                imageWidth,
+                nullptr,
+                maxPNGThreadCount
             )
         );
 
@@ -64,28 +98,159 @@ function<void(shared_ptr<HTTPRequest>)> compressPNG_(
     for(const vector<uint8_t>& chunk : *png) {
         length += chunk.size();
     }
+    metrics.compressedBytes.fetch_add(length, memory_order_relaxed);
 
-    return [png, length](shared_ptr<HTTPRequest> request) {
+    return [png, length, latencyTrace](shared_ptr<HTTPRequest> request) {
         REQUIRE_API_THREAD();
 
         request->sendResponse(
             200,
             "image/png",
             length,
-            [png](ostream& out) {
+            [png, latencyTrace](ostream& out) {
                 for(const vector<uint8_t>& chunk : *png) {
                     out.write((const char*)chunk.data(), chunk.size());
                 }
+                if(latencyTrace) {
+                    latencyTrace->mark(LatencyTrace::Sent);
+                }
             }
         );
     };
 }
 
+// Compresses the image in the hybrid mode, returning the PNG part and the video
+// layer (the latter is null if there are no video tiles).
+pair<
+    function<void(shared_ptr<HTTPRequest>)>,
+    function<void(shared_ptr<HTTPRequest>)>
+> compressHybrid_(
+    const vector<uint8_t>& imageData,
+    size_t imageWidth,
+    size_t imageHeight,
+    const TileActivity& tileActivity,
+    shared_ptr<PNGCompressor> pngCompressor,
+    size_t maxPNGThreadCount,
+    int videoQuality,
+    shared_ptr<LatencyTrace> latencyTrace,
+    Metrics& metrics
+) {
+    REQUIRE(imageWidth && imageHeight);
+    REQUIRE(imageData.size() == 4 * imageWidth * imageHeight);
+    REQUIRE(tileActivity.tilesX() * TileActivity::TileSize >= imageWidth);
+    REQUIRE(tileActivity.tilesY() * TileActivity::TileSize >= imageHeight);
+
+    // The PNG part contains the other tiles and the video layer contains the
+    // video tiles; the rest of each image is filled with a flat color that
+    // compresses to almost nothing.
+    vector<uint8_t> pngData = imageData;
+    vector<uint8_t> layerData;
+    bool videoTiles = tileActivity.hasVideoTiles();
+    if(videoTiles) {
+        layerData = imageData;
+    }
+
+    for(size_t y = 0; y < imageHeight; ++y) {
+        size_t tileY = y / TileActivity::TileSize;
+        for(size_t tileX = 0; tileX < tileActivity.tilesX(); ++tileX) {
+            size_t startX = tileX * TileActivity::TileSize;
+            size_t endX = min(startX + TileActivity::TileSize, imageWidth);
+            uint8_t* pngPos = &pngData[4 * (y * imageWidth + startX)];
+            if(tileActivity.isVideoTile(tileX, tileY)) {
+                for(size_t x = startX; x < endX; ++x) {
+                    memcpy(pngPos, KeyColor, 3);
+                    pngPos += 4;
+                }
+            } else {
+                for(size_t x = startX; x < endX; ++x) {
+                    if(!memcmp(pngPos, KeyColor, 3)) {
+                        memcpy(pngPos, NearKeyColor, 3);
+                    }
+                    pngPos += 4;
+                }
+                if(videoTiles) {
+                    memset(
+                        &layerData[4 * (y * imageWidth + startX)],
+                        255,
+                        4 * (endX - startX)
+                    );
+                }
+            }
+        }
+    }
+
+    shared_ptr<vector<vector<uint8_t>>> png =
+        make_shared<vector<vector<uint8_t>>>(
+            pngCompressor->compress(
+                pngData.data(),
+                imageWidth,
+                imageHeight,
+                imageWidth,
+                KeyColor,
+                maxPNGThreadCount
+            )
+        );
+
+    uint64_t length = 0;
+    for(const vector<uint8_t>& chunk : *png) {
+        length += chunk.size();
+    }
+    metrics.compressedBytes.fetch_add(length, memory_order_relaxed);
+
+    function<void(shared_ptr<HTTPRequest>)> compressedImage =
+        [png, length, latencyTrace](shared_ptr<HTTPRequest> request) {
+            REQUIRE_API_THREAD();
+
+            request->sendResponse(
+                200,
+                "image/png",
+                length,
+                [png, latencyTrace](ostream& out) {
+                    for(const vector<uint8_t>& chunk : *png) {
+                        out.write((const char*)chunk.data(), chunk.size());
+                    }
+                    if(latencyTrace) {
+                        latencyTrace->mark(LatencyTrace::Sent);
+                    }
+                }
+            );
+        };
+
+    function<void(shared_ptr<HTTPRequest>)> compressedVideoLayer;
+    if(videoTiles) {
+        shared_ptr<JPEGData> jpeg = make_shared<JPEGData>(compressJPEG(
+            layerData.data(),
+            imageWidth,
+            imageHeight,
+            imageWidth,
+            videoQuality
+        ));
+        metrics.compressedBytes.fetch_add(jpeg->length, memory_order_relaxed);
+
+        compressedVideoLayer = [jpeg](shared_ptr<HTTPRequest> request) {
+            REQUIRE_API_THREAD();
+
+            request->sendResponse(
+                200,
+                "image/jpeg",
+                jpeg->length,
+                [jpeg](ostream& out) {
+                    out.write((const char*)jpeg->data.get(), jpeg->length);
+                }
+            );
+        };
+    }
+
+    return {compressedImage, compressedVideoLayer};
+}
+
 function<void(shared_ptr<HTTPRequest>)> compressJPEG_(
     vector<uint8_t> imageData,
     size_t imageWidth,
     size_t imageHeight,
-    int quality
+    int quality,
+    shared_ptr<LatencyTrace> latencyTrace,
+    Metrics& metrics
 ) {
     REQUIRE(imageWidth && imageHeight);
     REQUIRE(imageData.size() == 4 * imageWidth * imageHeight);
@@ -98,15 +263,20 @@ function<void(shared_ptr<HTTPRequest>)> compressJPEG_(
         imageWidth,
         quality
     ));
-    return [jpeg](shared_ptr<HTTPRequest> request) {
+    metrics.compressedBytes.fetch_add(jpeg->length, memory_order_relaxed);
+
+    return [jpeg, latencyTrace](shared_ptr<HTTPRequest> request) {
         REQUIRE_API_THREAD();
 
         request->sendResponse(
             200,
             "image/jpeg",
             jpeg->length,
-            [jpeg](ostream& out) {
+            [jpeg, latencyTrace](ostream& out) {
                 out.write((const char*)jpeg->data.get(), jpeg->length);
+                if(latencyTrace) {
+                    latencyTrace->mark(LatencyTrace::Sent);
+                }
             }
         );
     };
@@ -117,12 +287,18 @@ function<void(shared_ptr<HTTPRequest>)> compressJPEG_(
 ImageCompressor::ImageCompressor(CKey,
     weak_ptr<ImageCompressorEventHandler> eventHandler,
     steady_clock::duration sendTimeout,
-    int quality
+    int quality,
+    shared_ptr<CompressionGovernor> governor,
+    shared_ptr<Metrics> metrics
 ) {
     REQUIRE_API_THREAD();
-    REQUIRE(quality >= 10 && quality <= 101);
+    REQUIRE(quality >= 10 && quality <= 102);
+    REQUIRE(governor);
+    REQUIRE(metrics);
 
     eventHandler_ = eventHandler;
+    governor_ = governor;
+    metrics_ = metrics;
     sendTimeout_ = sendTimeout;
 
     quality_ = quality;
@@ -134,11 +310,16 @@ ImageCompressor::ImageCompressor(CKey,
     pngThreadCount = min(pngThreadCount, 4);
     pngThreadCount = max(pngThreadCount, 1);
     pngCompressor_ = make_shared<PNGCompressor>(pngThreadCount);
+    tileActivity_ = make_shared<TileActivity>();
 
     compressorShutdownScheduled_ = false;
     compressorTaskScheduled_ = false;
 
     compressedImage_ = serveWhiteJPEGPixel;
+    videoTiles_ = false;
+
+    lastCompressionStartTime_ = steady_clock::time_point::min();
+    jpegQualityCap_ = 100;
 
     fetchingStopped_ = false;
     imageUpdated_ = false;
@@ -162,7 +343,7 @@ int ImageCompressor::quality() {
 
 void ImageCompressor::setQuality(MCE, int quality) {
     REQUIRE_API_THREAD();
-    REQUIRE(quality >= 10 && quality <= 101);
+    REQUIRE(quality >= 10 && quality <= 102);
 
     if(quality != quality_) {
         quality_ = quality;
@@ -178,7 +359,8 @@ void ImageCompressor::updateNotify(MCE) {
 }
 
 void ImageCompressor::sendCompressedImageNow(MCE,
-    shared_ptr<HTTPRequest> httpRequest
+    shared_ptr<HTTPRequest> httpRequest,
+    uint64_t imgIdx
 ) {
     REQUIRE_API_THREAD();
 
@@ -186,31 +368,63 @@ void ImageCompressor::sendCompressedImageNow(MCE,
 
     compressedImage_(httpRequest);
 
+    if(compressedVideoLayer_) {
+        sentVideoLayers_.emplace_back(imgIdx, compressedVideoLayer_);
+        if(sentVideoLayers_.size() > SentVideoLayerCount) {
+            sentVideoLayers_.pop_front();
+        }
+    }
+
     compressedImageUpdated_ = false;
     pump_(mce);
 }
 
 void ImageCompressor::sendCompressedImageWait(MCE,
-    shared_ptr<HTTPRequest> httpRequest
+    shared_ptr<HTTPRequest> httpRequest,
+    uint64_t imgIdx
 ) {
     REQUIRE_API_THREAD();
 
     flush(mce);
 
     if(compressedImageUpdated_) {
-        sendCompressedImageNow(mce, httpRequest);
+        sendCompressedImageNow(mce, httpRequest, imgIdx);
     } else {
+        // The gauge is decremented when the task is destroyed, i.e. after it
+        // has run or been cancelled.
+        shared_ptr<GaugeIncrement> pending =
+            make_shared<GaugeIncrement>(metrics_->pendingImageRequests);
         shared_ptr<ImageCompressor> self = shared_from_this();
-        waitTag_ = postDelayedTask(sendTimeout_, [self, httpRequest]() {
-            REQUIRE_API_THREAD();
-            self->sendCompressedImageNow(mce, httpRequest);
-        });
+        waitTag_ = postDelayedTask(
+            sendTimeout_,
+            [self, httpRequest, imgIdx, pending]() {
+                REQUIRE_API_THREAD();
+                self->sendCompressedImageNow(mce, httpRequest, imgIdx);
+            }
+        );
     }
 }
 
+void ImageCompressor::sendVideoLayer(MCE,
+    shared_ptr<HTTPRequest> httpRequest,
+    uint64_t imgIdx
+) {
+    REQUIRE_API_THREAD();
+
+    for(const pair<uint64_t, CompressedImage>& layer : sentVideoLayers_) {
+        if(layer.first == imgIdx) {
+            layer.second(httpRequest);
+            return;
+        }
+    }
+    serveWhiteJPEGPixel(httpRequest);
+}
+
 void ImageCompressor::stopFetching() {
     REQUIRE_API_THREAD();
     fetchingStopped_ = true;
+    frameIntervalTag_.reset();
+    effortCheckTag_.reset();
 }
 
 void ImageCompressor::flush(MCE) {
@@ -241,6 +455,15 @@ void ImageCompressor::setCursorSignal(MCE, int signal) {
     }
 }
 
+void ImageCompressor::addLatencyTrace(shared_ptr<LatencyTrace> trace) {
+    REQUIRE_API_THREAD();
+    REQUIRE(trace);
+
+    if(!latencyTrace_) {
+        latencyTrace_ = trace;
+    }
+}
+
 void ImageCompressor::afterConstruct_(shared_ptr<ImageCompressor> self) {
     shared_ptr<TaskQueue> taskQueue = TaskQueue::getActiveQueue();
     compressorThread_ = thread([this, taskQueue]() {
@@ -265,7 +488,9 @@ void ImageCompressor::afterConstruct_(shared_ptr<ImageCompressor> self) {
     });
 }
 
-tuple<vector<uint8_t>, size_t, size_t> ImageCompressor::fetchImage_(MCE) {
+tuple<vector<uint8_t>, size_t, size_t> ImageCompressor::fetchImage_(MCE,
+    bool videoLayer
+) {
     REQUIRE_API_THREAD();
     REQUIRE(!fetchingStopped_);
 
@@ -292,7 +517,8 @@ tuple<vector<uint8_t>, size_t, size_t> ImageCompressor::fetchImage_(MCE) {
             width = srcWidth;
             height = srcHeight;
 
-            while((int)(width % (size_t)IframeSignalCount) != iframeSignal_) {
+            int widthSignal = iframeSignal_ + (videoLayer ? IframeSignalCount : 0);
+            while((int)(width % (size_t)WidthSignalCount) != widthSignal) {
                 ++width;
             }
             while((int)(height % (size_t)CursorSignalCount) != cursorSignal_) {
@@ -334,36 +560,151 @@ void ImageCompressor::pump_(MCE) {
         return;
     }
 
+    steady_clock::time_point now = steady_clock::now();
+    steady_clock::duration minFrameInterval = governor_->minFrameInterval();
+    if(
+        lastCompressionStartTime_ != steady_clock::time_point::min() &&
+        now - lastCompressionStartTime_ < minFrameInterval
+    ) {
+        if(!frameIntervalTag_) {
+            weak_ptr<ImageCompressor> weakSelf = shared_from_this();
+            frameIntervalTag_ = postDelayedTask(
+                lastCompressionStartTime_ + minFrameInterval - now,
+                [weakSelf]() {
+                    REQUIRE_API_THREAD();
+                    if(shared_ptr<ImageCompressor> self = weakSelf.lock()) {
+                        self->frameIntervalTag_.reset();
+                        self->pump_(mce);
+                    }
+                }
+            );
+        }
+        return;
+    }
+    frameIntervalTag_.reset();
+    lastCompressionStartTime_ = now;
+
     compressionInProgress_ = true;
     imageUpdated_ = false;
+    governor_->compressionStarted();
 
     int quality = quality_;
 
+    // The JPEG quality (of the image or the video layer) as capped by the
+    // governor; jpegQualityCap is 100 if the cap has no effect.
+    int maxJPEGQuality = governor_->maxJPEGQuality();
+    size_t maxPNGThreadCount = governor_->maxPNGThreadCount();
+    int jpegQuality = quality;
+    int videoQuality = VideoLayerQuality;
+    int jpegQualityCap = 100;
+    if(quality <= 100 && quality > maxJPEGQuality) {
+        jpegQuality = maxJPEGQuality;
+        jpegQualityCap = maxJPEGQuality;
+    }
+
+    // Whether the image will have a video layer is decided based on the
+    // previous image, as the width signal has to be chosen when fetching.
+    bool videoLayer = quality == 102 && videoTiles_;
+
     vector<uint8_t> imageData;
     size_t imageWidth;
     size_t imageHeight;
-    tie(imageData, imageWidth, imageHeight) = fetchImage_(mce);
+    tie(imageData, imageWidth, imageHeight) = fetchImage_(mce, videoLayer);
+
+    if(videoLayer && VideoLayerQuality > maxJPEGQuality) {
+        videoQuality = maxJPEGQuality;
+        jpegQualityCap = maxJPEGQuality;
+    }
+
+    shared_ptr<LatencyTrace> latencyTrace;
+    swap(latencyTrace, latencyTrace_);
+    if(latencyTrace) {
+        latencyTrace->mark(LatencyTrace::Fetch);
+    }
 
     shared_ptr<ImageCompressor> self = shared_from_this();
     shared_ptr<PNGCompressor> pngCompressor = pngCompressor_;
+    shared_ptr<TileActivity> tileActivity = tileActivity_;
+    shared_ptr<Metrics> metrics = metrics_;
     function<void()> task = [
         self,
         pngCompressor,
+        tileActivity,
+        metrics,
         quality,
+        jpegQuality,
+        videoQuality,
+        jpegQualityCap,
+        maxPNGThreadCount,
+        videoLayer,
         imageData{move(imageData)},
         imageWidth,
-        imageHeight
+        imageHeight,
+        latencyTrace
     ]() {
+        steady_clock::time_point startTime = steady_clock::now();
+
         CompressedImage compressedImage;
-        if(quality == 101) {
-            compressedImage =
-                compressPNG_(imageData, imageWidth, imageHeight, pngCompressor);
+        CompressedImage compressedVideoLayer;
+        bool videoTiles = false;
+        if(quality == 102) {
+            tileActivity->update(imageData, imageWidth, imageHeight, startTime);
+            videoTiles = tileActivity->hasVideoTiles();
+            if(videoLayer) {
+                tie(compressedImage, compressedVideoLayer) = compressHybrid_(
+                    imageData,
+                    imageWidth,
+                    imageHeight,
+                    *tileActivity,
+                    pngCompressor,
+                    maxPNGThreadCount,
+                    videoQuality,
+                    latencyTrace,
+                    *metrics
+                );
+            } else {
+                compressedImage = compressPNG_(
+                    imageData,
+                    imageWidth,
+                    imageHeight,
+                    pngCompressor,
+                    maxPNGThreadCount,
+                    latencyTrace,
+                    *metrics
+                );
+            }
+            metrics->hybridFramesCompressed.fetch_add(1, memory_order_relaxed);
+        } else if(quality == 101) {
+            compressedImage = compressPNG_(
+                imageData,
+                imageWidth,
+                imageHeight,
+                pngCompressor,
+                maxPNGThreadCount,
+                latencyTrace,
+                *metrics
+            );
+            metrics->pngFramesCompressed.fetch_add(1, memory_order_relaxed);
         } else {
-            compressedImage =
-                compressJPEG_(imageData, imageWidth, imageHeight, quality);
+            compressedImage = compressJPEG_(
+                imageData, imageWidth, imageHeight, jpegQuality, latencyTrace, *metrics
+            );
+            metrics->jpegFramesCompressed.fetch_add(1, memory_order_relaxed);
+        }
+        metrics->compressionTime.record(steady_clock::now() - startTime);
+        if(latencyTrace) {
+            latencyTrace->mark(LatencyTrace::Compressed);
         }
 
-        postTask(self, &ImageCompressor::compressTaskDone_, mce, compressedImage);
+        postTask(
+            self,
+            &ImageCompressor::compressTaskDone_,
+            mce,
+            compressedImage,
+            compressedVideoLayer,
+            videoTiles,
+            jpegQualityCap
+        );
     };
 
     {
@@ -375,15 +716,65 @@ void ImageCompressor::pump_(MCE) {
     compressorCv_.notify_one();
 }
 
-void ImageCompressor::compressTaskDone_(MCE, CompressedImage compressedImage) {
+void ImageCompressor::compressTaskDone_(MCE,
+    CompressedImage compressedImage,
+    CompressedImage compressedVideoLayer,
+    bool videoTiles,
+    int jpegQualityCap
+) {
     REQUIRE_API_THREAD();
     REQUIRE(compressionInProgress_);
 
     compressionInProgress_ = false;
+    governor_->compressionFinished();
     compressedImageUpdated_ = true;
     compressedImage_ = compressedImage;
+    compressedVideoLayer_ = compressedVideoLayer;
+
+    videoTiles_ = videoTiles;
+    if(videoTiles_) {
+        // The rates of the tiles decay only when new images are compressed,
+        // so we keep compressing until the video tiles are gone, even if the
+        // image does not change.
+        weak_ptr<ImageCompressor> weakSelf = shared_from_this();
+        videoRefreshTag_ = postDelayedTask(VideoRefreshInterval, [weakSelf]() {
+            REQUIRE_API_THREAD();
+            if(shared_ptr<ImageCompressor> self = weakSelf.lock()) {
+                self->updateNotify(mce);
+            }
+        });
+    } else {
+        videoRefreshTag_.reset();
+    }
+
+    jpegQualityCap_ = jpegQualityCap;
+    if(jpegQualityCap_ < 100) {
+        scheduleEffortCheck_();
+    } else {
+        effortCheckTag_.reset();
+    }
 
     flush(mce);
 }
 
+void ImageCompressor::scheduleEffortCheck_() {
+    REQUIRE_API_THREAD();
+
+    weak_ptr<ImageCompressor> weakSelf = shared_from_this();
+    effortCheckTag_ = postDelayedTask(EffortCheckInterval, [weakSelf]() {
+        REQUIRE_API_THREAD();
+        if(shared_ptr<ImageCompressor> self = weakSelf.lock()) {
+            if(self->fetchingStopped_) {
+                return;
+            }
+            if(self->governor_->maxJPEGQuality() > self->jpegQualityCap_) {
+                self->effortCheckTag_.reset();
+                self->updateNotify(mce);
+            } else {
+                self->scheduleEffortCheck_();
+            }
+        }
+    });
+}
+
 }
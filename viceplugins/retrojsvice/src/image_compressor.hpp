@@ -24,8 +24,12 @@ public:
     ) = 0;
 };
 
+class CompressionGovernor;
 class DelayedTaskTag;
 class HTTPRequest;
+class LatencyTrace;
+class Metrics;
+class TileActivity;
 
 // Image compressor service for a single browser window. The image pipeline is
 // run asynchronously: when an updated image is available, the service is
@@ -35,28 +39,55 @@ class HTTPRequest;
 // background thread. At most one HTTP request is kept waiting for a new image
 // to complete at a time; the previous requests are responded to upon each
 // sendCompressedImage* call.
+//
+// In the hybrid mode (quality 102), the tiles of the image that change at a
+// high rate are classified as video (see TileActivity). While there are video
+// tiles, each image is sent as a PNG in which the video tiles are transparent,
+// and the client shows it on top of a separate JPEG video layer fetched using
+// sendVideoLayer. The presence of the layer is signaled to the client in the
+// second lowest bit of the image width.
+//
+// The compression effort is limited by the shared CompressionGovernor: while
+// it is lowered, the JPEG quality and the number of PNG compression threads
+// are capped and new images are compressed at most once per minimum frame
+// interval.
 class ImageCompressor : public enable_shared_from_this<ImageCompressor> {
 SHARED_ONLY_CLASS(ImageCompressor);
 public:
     ImageCompressor(CKey,
         weak_ptr<ImageCompressorEventHandler> eventHandler,
         steady_clock::duration sendTimeout,
-        int quality
+        int quality,
+        shared_ptr<CompressionGovernor> governor,
+        shared_ptr<Metrics> metrics
     );
     ~ImageCompressor();
 
-    // Supported values: 10..100 for JPEG and 101 for PNG.
+    // Supported values: 10..100 for JPEG, 101 for PNG and 102 for the hybrid
+    // mode.
     int quality();
     void setQuality(MCE, int quality);
 
     void updateNotify(MCE);
 
-    // Send the most recent compressed image immediately.
-    void sendCompressedImageNow(MCE, shared_ptr<HTTPRequest> httpRequest);
+    // Send the most recent compressed image immediately. The image index
+    // imgIdx given by the client is used to identify the video layer of the
+    // image in sendVideoLayer.
+    void sendCompressedImageNow(MCE,
+        shared_ptr<HTTPRequest> httpRequest,
+        uint64_t imgIdx
+    );
 
     // Send the image once a new compressed image is available or the timeout
     // sendTimeout (given in constructor) is reached.
-    void sendCompressedImageWait(MCE, shared_ptr<HTTPRequest> httpRequest);
+    void sendCompressedImageWait(MCE,
+        shared_ptr<HTTPRequest> httpRequest,
+        uint64_t imgIdx
+    );
+
+    // Send the video layer of the image recently sent as a response to the
+    // image request with index imgIdx, or a blank image if it is not available.
+    void sendVideoLayer(MCE, shared_ptr<HTTPRequest> httpRequest, uint64_t imgIdx);
 
     // Make sure that the compressor will never call onImageCompressorFetchImage
     // again (effectively stopping the compressor from starting to compress new
@@ -82,15 +113,26 @@ public:
 
     void setCursorSignal(MCE, int signal);
 
+    // Attach a latency trace to the next image fetched for compression; the
+    // trace is advanced through the Fetch, Compressed and Sent stages. If a
+    // trace is already waiting, the older one is kept.
+    void addLatencyTrace(shared_ptr<LatencyTrace> trace);
+
 private:
     void afterConstruct_(shared_ptr<ImageCompressor> self);
 
     typedef function<void(shared_ptr<HTTPRequest>)> CompressedImage;
 
-    tuple<vector<uint8_t>, size_t, size_t> fetchImage_(MCE);
+    tuple<vector<uint8_t>, size_t, size_t> fetchImage_(MCE, bool videoLayer);
 
     void pump_(MCE);
-    void compressTaskDone_(MCE, CompressedImage compressedImage);
+    void compressTaskDone_(MCE,
+        CompressedImage compressedImage,
+        CompressedImage compressedVideoLayer,
+        bool videoTiles,
+        int jpegQualityCap
+    );
+    void scheduleEffortCheck_();
 
     weak_ptr<ImageCompressorEventHandler> eventHandler_;
     steady_clock::duration sendTimeout_;
@@ -100,6 +142,9 @@ private:
     int cursorSignal_;
 
     shared_ptr<PNGCompressor> pngCompressor_;
+    shared_ptr<TileActivity> tileActivity_;
+    shared_ptr<CompressionGovernor> governor_;
+    shared_ptr<Metrics> metrics_;
 
     thread compressorThread_;
     mutex compressorMutex_;
@@ -108,9 +153,36 @@ private:
     bool compressorTaskScheduled_;
     function<void()> compressorTask_;
 
+    shared_ptr<LatencyTrace> latencyTrace_;
+
     shared_ptr<DelayedTaskTag> waitTag_;
     CompressedImage compressedImage_;
 
+    // Null if compressedImage_ has no video layer.
+    CompressedImage compressedVideoLayer_;
+
+    // The video layers of the most recently sent images with their image
+    // indices.
+    list<pair<uint64_t, CompressedImage>> sentVideoLayers_;
+
+    // True if the previous hybrid mode image had video tiles; while this is
+    // the case, the images are refreshed periodically so that tiles that stop
+    // changing are eventually sent losslessly.
+    bool videoTiles_;
+    shared_ptr<DelayedTaskTag> videoRefreshTag_;
+
+    // The start time of the latest compression, and the task that restarts
+    // the pipeline once the minimum frame interval of the governor has passed
+    // (null if not scheduled).
+    steady_clock::time_point lastCompressionStartTime_;
+    shared_ptr<DelayedTaskTag> frameIntervalTag_;
+
+    // If the JPEG quality of compressedImage_ was reduced by the governor,
+    // the cap that was used; the image is recompressed once the governor
+    // allows a higher quality. Otherwise, the value is 100.
+    int jpegQualityCap_;
+    shared_ptr<DelayedTaskTag> effortCheckTag_;
+
     bool fetchingStopped_;
     bool imageUpdated_;
     bool compressedImageUpdated_;
@@ -0,0 +1,154 @@
+#include "latency_trace.hpp"
+
+namespace retrojsvice {
+
+namespace {
+
+const char* StageNames[LatencyTrace::StageCount] = {
+    "input", "view-changed", "fetch", "compressed", "sent"
+};
+
+const steady_clock::duration SummaryInterval = std::chrono::seconds(60);
+
+}
+
+LatencyTrace::LatencyTrace(CKey,
+    shared_ptr<LatencyTracer> tracer,
+    uint64_t window
+) {
+    REQUIRE(tracer);
+
+    tracer_ = tracer;
+    window_ = window;
+    times_[Input] = steady_clock::now();
+    nextStage_ = ViewChanged;
+    sent_.store(false);
+}
+
+steady_clock::time_point LatencyTrace::inputTime() {
+    return times_[Input];
+}
+
+void LatencyTrace::mark(Stage stage) {
+    REQUIRE(stage > Input && stage < StageCount);
+
+    if(stage == Sent) {
+        if(sent_.exchange(true)) {
+            return;
+        }
+        REQUIRE(nextStage_ == Sent);
+        times_[Sent] = steady_clock::now();
+        tracer_->record_(*this);
+    } else {
+        REQUIRE(stage == nextStage_);
+        times_[stage] = steady_clock::now();
+        ++nextStage_;
+    }
+}
+
+LatencyTracer::LatencyTracer(CKey, string traceFilePath) {
+    tracesSinceSummary_ = 0;
+    lastSummaryTime_ = steady_clock::now();
+    traceFileEmpty_ = true;
+    startTime_ = steady_clock::now();
+
+    if(!traceFilePath.empty()) {
+        traceFile_.open(traceFilePath, std::ios::out | std::ios::trunc);
+        if(traceFile_.good()) {
+            INFO_LOG("Writing latency traces to '", traceFilePath, "'");
+            traceFile_ << "{\"traceEvents\":[";
+        } else {
+            WARNING_LOG(
+                "Opening latency trace file '", traceFilePath,
+                "' failed, not writing traces"
+            );
+            traceFile_.close();
+        }
+    }
+}
+
+LatencyTracer::~LatencyTracer() {
+    if(traceFile_.is_open()) {
+        traceFile_ << "\n]}\n";
+        traceFile_.close();
+    }
+}
+
+shared_ptr<LatencyTrace> LatencyTracer::startTrace(uint64_t window) {
+    return LatencyTrace::create(shared_from_this(), window);
+}
+
+void LatencyTracer::logSummary() {
+    lock_guard<mutex> lock(mutex_);
+    logSummaryLocked_();
+}
+
+void LatencyTracer::record_(LatencyTrace& trace) {
+    histograms_[LatencyTrace::Input].record(
+        trace.times_[LatencyTrace::Sent] - trace.times_[LatencyTrace::Input]
+    );
+    for(int stage = LatencyTrace::Input + 1; stage < LatencyTrace::StageCount; ++stage) {
+        histograms_[stage].record(trace.times_[stage] - trace.times_[stage - 1]);
+    }
+
+    lock_guard<mutex> lock(mutex_);
+
+    if(traceFile_.is_open()) {
+        auto micros = [&](steady_clock::time_point time) {
+            return std::chrono::duration_cast<std::chrono::microseconds>(
+                time - startTime_
+            ).count();
+        };
+        for(int stage = LatencyTrace::Input + 1; stage < LatencyTrace::StageCount; ++stage) {
+            int64_t start = micros(trace.times_[stage - 1]);
+            int64_t end = micros(trace.times_[stage]);
+            traceFile_
+                << (traceFileEmpty_ ? "\n" : ",\n")
+                << "{\"name\":\"" << StageNames[stage - 1] << " -> " << StageNames[stage]
+                << "\",\"cat\":\"latency\",\"ph\":\"X\",\"pid\":1,\"tid\":" << trace.window_
+                << ",\"ts\":" << start << ",\"dur\":" << (end - start) << "}";
+            traceFileEmpty_ = false;
+        }
+        traceFile_.flush();
+    }
+
+    ++tracesSinceSummary_;
+    if(steady_clock::now() - lastSummaryTime_ >= SummaryInterval) {
+        logSummaryLocked_();
+    }
+}
+
+void LatencyTracer::logSummaryLocked_() {
+    lastSummaryTime_ = steady_clock::now();
+    if(tracesSinceSummary_ == 0) {
+        return;
+    }
+    tracesSinceSummary_ = 0;
+
+    auto describe = [&](const string& label, Histogram& histogram) {
+        stringstream ss;
+        ss.precision(3);
+        ss
+            << label << ": p50 " << histogram.quantileMicroseconds(0.5) / 1000.0
+            << " ms, p95 " << histogram.quantileMicroseconds(0.95) / 1000.0
+            << " ms, p99 " << histogram.quantileMicroseconds(0.99) / 1000.0
+            << " ms";
+        return ss.str();
+    };
+
+    INFO_LOG(
+        "Input latency summary (", histograms_[LatencyTrace::Input].count(),
+        " traces): ", describe("total", histograms_[LatencyTrace::Input])
+    );
+    for(int stage = LatencyTrace::Input + 1; stage < LatencyTrace::StageCount; ++stage) {
+        INFO_LOG(
+            "  ",
+            describe(
+                string(StageNames[stage - 1]) + " -> " + StageNames[stage],
+                histograms_[stage]
+            )
+        );
+    }
+}
+
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "histogram.hpp"
+
+namespace retrojsvice {
+
+class LatencyTracer;
+
+// Timestamps of a single batch of input events as it travels through the image
+// pipeline of a window: the events are received from the client (Input), the
+// program notifies that the view has changed (ViewChanged), the image is
+// fetched from the program for compression (Fetch), the compression completes
+// (Compressed) and the compressed image is written to the HTTP response (Sent).
+class LatencyTrace {
+SHARED_ONLY_CLASS(LatencyTrace);
+public:
+    enum Stage {Input, ViewChanged, Fetch, Compressed, Sent, StageCount};
+
+    LatencyTrace(CKey, shared_ptr<LatencyTracer> tracer, uint64_t window);
+
+    steady_clock::time_point inputTime();
+
+    // Marks given stage as reached now. The stages must be marked in order;
+    // the calls may come from different threads as long as they are properly
+    // synchronized. The first Sent mark completes the trace and records it to
+    // the tracer; further marks are ignored.
+    void mark(Stage stage);
+
+private:
+    shared_ptr<LatencyTracer> tracer_;
+    uint64_t window_;
+
+    steady_clock::time_point times_[StageCount];
+    int nextStage_;
+    atomic<bool> sent_;
+
+    friend class LatencyTracer;
+};
+
+// Collects completed latency traces into per-stage histograms that are
+// periodically summarized in the log, and optionally writes them to a file in
+// the Chrome trace event format (viewable in chrome://tracing or Perfetto).
+// Thread-safe.
+class LatencyTracer : public enable_shared_from_this<LatencyTracer> {
+SHARED_ONLY_CLASS(LatencyTracer);
+public:
+    // If traceFilePath is nonempty, the traces are also written to it.
+    LatencyTracer(CKey, string traceFilePath);
+    ~LatencyTracer();
+
+    shared_ptr<LatencyTrace> startTrace(uint64_t window);
+
+    // Writes the p50/p95/p99 latencies of each stage to the log.
+    void logSummary();
+
+private:
+    void record_(LatencyTrace& trace);
+    void logSummaryLocked_();
+
+    // histograms_[stage] contains the durations between stages stage - 1 and
+    // stage; histograms_[Input] contains the total durations.
+    Histogram histograms_[LatencyTrace::StageCount];
+
+    mutex mutex_;
+    uint64_t tracesSinceSummary_;
+    steady_clock::time_point lastSummaryTime_;
+
+    ofstream traceFile_;
+    bool traceFileEmpty_;
+    steady_clock::time_point startTime_;
+
+    friend class LatencyTrace;
+};
+
+}
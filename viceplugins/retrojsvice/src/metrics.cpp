@@ -0,0 +1,178 @@
+#include "metrics.hpp"
+
+namespace retrojsvice {
+
+namespace {
+
+void writeHeader(ostream& out, const char* name, const char* type, const char* help) {
+    out << "# HELP " << name << " " << help << "\n";
+    out << "# TYPE " << name << " " << type << "\n";
+}
+
+template <typename T>
+void writeSimple(
+    ostream& out,
+    const char* name,
+    const char* type,
+    const char* help,
+    T value
+) {
+    writeHeader(out, name, type, help);
+    out << name << " " << value << "\n";
+}
+
+// Only every fourth bucket boundary of the histogram (one per doubling) is
+// exported to keep the output compact.
+void writeHistogramSeconds(
+    ostream& out,
+    const char* name,
+    const char* help,
+    Histogram& histogram
+) {
+    writeHeader(out, name, "histogram", help);
+
+    uint64_t cumulative = 0;
+    for(int idx = 0; idx < Histogram::BucketCount - 1; ++idx) {
+        cumulative += histogram.bucketCount(idx);
+        if(idx % 4 == 0) {
+            out << name << "_bucket{le=\""
+                << Histogram::bucketUpperBoundMicroseconds(idx) / 1e6 << "\"} "
+                << cumulative << "\n";
+        }
+    }
+    cumulative += histogram.bucketCount(Histogram::BucketCount - 1);
+    out << name << "_bucket{le=\"+Inf\"} " << cumulative << "\n";
+    out << name << "_sum " << (double)histogram.sumMicroseconds() / 1e6 << "\n";
+    out << name << "_count " << cumulative << "\n";
+}
+
+}
+
+Metrics::Metrics(CKey)
+    : httpRequests(0),
+      httpRequestsInProgress(0),
+      httpResponseBytes(0),
+      uploadedFiles(0),
+      uploadedBytes(0),
+      pendingImageRequests(0),
+      pngFramesCompressed(0),
+      jpegFramesCompressed(0),
+      hybridFramesCompressed(0),
+      compressedBytes(0),
+      openWindows(0),
+      windowEvents(0),
+      coalescedWindowEvents(0)
+{}
+
+void Metrics::write(ostream& out, Snapshot snapshot) {
+    writeSimple(
+        out, "retrojsvice_http_connections", "gauge",
+        "Number of open HTTP connections.",
+        snapshot.httpConnections
+    );
+    writeSimple(
+        out, "retrojsvice_http_requests_total", "counter",
+        "Number of HTTP requests received.",
+        httpRequests.load(memory_order_relaxed)
+    );
+    writeSimple(
+        out, "retrojsvice_http_requests_in_progress", "gauge",
+        "Number of HTTP requests that have not yet been fully responded to.",
+        httpRequestsInProgress.load(memory_order_relaxed)
+    );
+    writeSimple(
+        out, "retrojsvice_http_response_bytes_total", "counter",
+        "Total size of the HTTP response bodies sent.",
+        httpResponseBytes.load(memory_order_relaxed)
+    );
+    writeSimple(
+        out, "retrojsvice_uploaded_files_total", "counter",
+        "Number of files uploaded by clients.",
+        uploadedFiles.load(memory_order_relaxed)
+    );
+    writeSimple(
+        out, "retrojsvice_uploaded_bytes_total", "counter",
+        "Total size of the files uploaded by clients.",
+        uploadedBytes.load(memory_order_relaxed)
+    );
+    writeHistogramSeconds(
+        out, "retrojsvice_upload_seconds",
+        "Time spent receiving a single uploaded file.",
+        uploadTime
+    );
+    writeSimple(
+        out, "retrojsvice_pending_image_requests", "gauge",
+        "Number of image requests waiting for a new image (long polls).",
+        pendingImageRequests.load(memory_order_relaxed)
+    );
+
+    writeHeader(
+        out, "retrojsvice_frames_compressed_total", "counter",
+        "Number of images compressed."
+    );
+    out << "retrojsvice_frames_compressed_total{format=\"png\"} "
+        << pngFramesCompressed.load(memory_order_relaxed) << "\n";
+    out << "retrojsvice_frames_compressed_total{format=\"jpeg\"} "
+        << jpegFramesCompressed.load(memory_order_relaxed) << "\n";
+    out << "retrojsvice_frames_compressed_total{format=\"hybrid\"} "
+        << hybridFramesCompressed.load(memory_order_relaxed) << "\n";
+
+    writeSimple(
+        out, "retrojsvice_compressed_bytes_total", "counter",
+        "Total size of the compressed images.",
+        compressedBytes.load(memory_order_relaxed)
+    );
+    writeHistogramSeconds(
+        out, "retrojsvice_compression_seconds",
+        "Time spent compressing a single image.",
+        compressionTime
+    );
+    writeSimple(
+        out, "retrojsvice_compression_effort_level", "gauge",
+        "Compression effort level set by the governor (0 is full effort).",
+        snapshot.compressionEffortLevel
+    );
+    writeSimple(
+        out, "retrojsvice_compression_load", "gauge",
+        "Average number of images being compressed concurrently per CPU core.",
+        snapshot.compressionLoad
+    );
+    if(snapshot.hostCPULoad >= 0.0) {
+        writeSimple(
+            out, "retrojsvice_host_cpu_load", "gauge",
+            "Fraction of the CPU time of the host spent busy.",
+            snapshot.hostCPULoad
+        );
+    }
+
+    writeSimple(
+        out, "retrojsvice_open_windows", "gauge",
+        "Number of open windows.",
+        openWindows.load(memory_order_relaxed)
+    );
+    writeSimple(
+        out, "retrojsvice_window_events_total", "counter",
+        "Number of input events received from clients.",
+        windowEvents.load(memory_order_relaxed)
+    );
+    writeSimple(
+        out, "retrojsvice_coalesced_window_events_total", "counter",
+        "Number of input events merged into another event before forwarding.",
+        coalescedWindowEvents.load(memory_order_relaxed)
+    );
+    writeSimple(
+        out, "retrojsvice_task_queue_depth", "gauge",
+        "Number of tasks (including delayed tasks) pending in the task queue.",
+        snapshot.taskQueueDepth
+    );
+}
+
+GaugeIncrement::GaugeIncrement(atomic<int64_t>& gauge) : gauge_(gauge) {
+    gauge_.fetch_add(1, memory_order_relaxed);
+}
+
+GaugeIncrement::~GaugeIncrement() {
+    gauge_.fetch_sub(1, memory_order_relaxed);
+}
+
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "histogram.hpp"
+
+namespace retrojsvice {
+
+// Counters and gauges describing the operation of the plugin, exported in the
+// Prometheus text exposition format. All the members are lock-free and may be
+// updated from any thread.
+class Metrics {
+SHARED_ONLY_CLASS(Metrics);
+public:
+    Metrics(CKey);
+
+    // HTTP server
+    atomic<uint64_t> httpRequests;
+    atomic<int64_t> httpRequestsInProgress;
+    atomic<uint64_t> httpResponseBytes;
+
+    // File uploads
+    atomic<uint64_t> uploadedFiles;
+    atomic<uint64_t> uploadedBytes;
+    Histogram uploadTime;
+
+    // Image requests kept waiting for a new image (long polls).
+    atomic<int64_t> pendingImageRequests;
+
+    // Image compressor
+    atomic<uint64_t> pngFramesCompressed;
+    atomic<uint64_t> jpegFramesCompressed;
+    atomic<uint64_t> hybridFramesCompressed;
+    atomic<uint64_t> compressedBytes;
+    Histogram compressionTime;
+
+    // Windows
+    atomic<int64_t> openWindows;
+    atomic<uint64_t> windowEvents;
+    atomic<uint64_t> coalescedWindowEvents;
+
+    // Values that are sampled at the time the metrics are written.
+    struct Snapshot {
+        int64_t httpConnections;
+        uint64_t taskQueueDepth;
+
+        // See CompressionGovernor; hostCPULoad is negative if not available.
+        int compressionEffortLevel;
+        double hostCPULoad;
+        double compressionLoad;
+    };
+
+    // Writes all the metrics in the Prometheus text exposition format (version
+    // 0.0.4).
+    void write(ostream& out, Snapshot snapshot);
+};
+
+// RAII object that increments given gauge for its lifetime.
+class GaugeIncrement {
+public:
+    GaugeIncrement(atomic<int64_t>& gauge);
+    ~GaugeIncrement();
+
+    DISABLE_COPY_MOVE(GaugeIncrement);
+
+private:
+    atomic<int64_t>& gauge_;
+};
+
+}
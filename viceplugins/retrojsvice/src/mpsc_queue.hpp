@@ -0,0 +1,210 @@
+#pragma once
+
+#include "common.hpp"
+
+namespace retrojsvice {
+
+// Unbounded lock-free multi-producer single-consumer FIFO queue (the
+// node-based algorithm by Dmitry Vyukov). push may be called from any thread;
+// pop and empty may only be called from a single consumer thread at a time.
+//
+// A push that is in progress concurrently with pop may not yet be visible to
+// the consumer; the producer should signal the consumer after push returns
+// (see TaskQueue) instead of relying on the consumer seeing the element.
+//
+// To avoid a heap allocation in the producer and a cross-thread free in the
+// consumer for every element, the nodes are recycled through a pool shared by
+// all the queues with the same element type (see NodePool_).
+template <typename T>
+class MPSCQueue {
+public:
+    MPSCQueue() {
+        Node* stub = NodePool_::allocate();
+        head_.store(stub, memory_order_relaxed);
+        pushCount_.store(0, memory_order_relaxed);
+        tail_ = stub;
+        popCount_.store(0, memory_order_relaxed);
+    }
+
+    ~MPSCQueue() {
+        while(pop()) {}
+        freeBatch_.add(tail_);
+        freeBatch_.flush();
+    }
+
+    DISABLE_COPY_MOVE(MPSCQueue);
+
+    void push(T&& item) {
+        Node* node = NodePool_::allocate();
+        node->item.emplace(move(item));
+        pushCount_.fetch_add(1, memory_order_relaxed);
+        Node* prev = head_.exchange(node);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    // Returns an empty value if there are no (fully pushed) elements.
+    optional<T> pop() {
+        Node* next = tail_->next.load(std::memory_order_acquire);
+        if(next == nullptr) {
+            return {};
+        }
+        freeBatch_.add(tail_);
+        tail_ = next;
+
+        // The node of the popped element becomes the new stub node.
+        optional<T> item = move(next->item);
+        next->item.reset();
+
+        // Only the consumer writes popCount_, so no read-modify-write is
+        // needed.
+        popCount_.store(
+            popCount_.load(memory_order_relaxed) + 1, memory_order_relaxed
+        );
+        return item;
+    }
+
+    // Returns true if there are no elements in the queue, including elements
+    // that are still being pushed. As both this and push are sequentially
+    // consistent, a producer that checks a condition after push and a consumer
+    // that updates the condition after seeing the queue empty cannot miss each
+    // other.
+    bool empty() {
+        return head_.load() == tail_;
+    }
+
+    // Returns the approximate number of elements in the queue; may be called
+    // from any thread.
+    size_t size() {
+        uint64_t popCount = popCount_.load(memory_order_relaxed);
+        uint64_t pushCount = pushCount_.load(memory_order_relaxed);
+        return pushCount > popCount ? (size_t)(pushCount - popCount) : 0;
+    }
+
+private:
+    struct Node {
+        atomic<Node*> next{nullptr};
+        optional<T> item;
+
+        // Links the free nodes in NodePool_.
+        Node* poolNext = nullptr;
+        Node* poolNextBatch = nullptr;
+    };
+
+    // Pool of free nodes. The consumers give back the freed nodes in batches,
+    // and the producers take a whole batch at a time into a thread-local
+    // cache. The shared stack of batches is only modified by pushing and by
+    // taking the whole stack at once, which avoids the ABA problem.
+    class NodePool_ {
+    public:
+        static constexpr size_t BatchSize = 64;
+        static constexpr size_t MaxBatches = 64;
+
+        static Node* allocate() {
+            Cache& cache = cache_;
+            if(cache.head == nullptr) {
+                cache.head = takeBatch_();
+            }
+            if(cache.head == nullptr) {
+                return new Node();
+            }
+            Node* node = cache.head;
+            cache.head = node->poolNext;
+            node->next.store(nullptr, memory_order_relaxed);
+            node->poolNext = nullptr;
+            return node;
+        }
+
+        // Gives back a batch of nodes linked with poolNext. If the pool is
+        // already full, the nodes are deleted.
+        static void releaseBatch(Node* batch) {
+            if(batchCount_.fetch_add(1, memory_order_relaxed) >= MaxBatches) {
+                batchCount_.fetch_sub(1, memory_order_relaxed);
+                deleteList_(batch);
+                return;
+            }
+            pushBatches_(batch, batch);
+        }
+
+    private:
+        struct Cache {
+            Node* head = nullptr;
+            ~Cache() {
+                deleteList_(head);
+            }
+        };
+
+        static Node* takeBatch_() {
+            Node* batches = batches_.exchange(nullptr, std::memory_order_acquire);
+            if(batches == nullptr) {
+                return nullptr;
+            }
+            batchCount_.fetch_sub(1, memory_order_relaxed);
+
+            // Put back the batches we do not need.
+            Node* rest = batches->poolNextBatch;
+            batches->poolNextBatch = nullptr;
+            if(rest != nullptr) {
+                Node* last = rest;
+                while(last->poolNextBatch != nullptr) {
+                    last = last->poolNextBatch;
+                }
+                pushBatches_(rest, last);
+            }
+            return batches;
+        }
+
+        static void pushBatches_(Node* first, Node* last) {
+            Node* top = batches_.load(memory_order_relaxed);
+            do {
+                last->poolNextBatch = top;
+            } while(!batches_.compare_exchange_weak(
+                top, first, std::memory_order_release, memory_order_relaxed
+            ));
+        }
+
+        static void deleteList_(Node* node) {
+            while(node != nullptr) {
+                Node* next = node->poolNext;
+                delete node;
+                node = next;
+            }
+        }
+
+        static inline atomic<Node*> batches_{nullptr};
+        static inline atomic<size_t> batchCount_{0};
+        static inline thread_local Cache cache_;
+    };
+
+    // Nodes freed by the consumer that have not yet been given back to
+    // NodePool_.
+    struct FreeBatch {
+        Node* head = nullptr;
+        size_t size = 0;
+
+        void add(Node* node) {
+            node->poolNext = head;
+            head = node;
+            if(++size == NodePool_::BatchSize) {
+                flush();
+            }
+        }
+
+        void flush() {
+            if(head != nullptr) {
+                NodePool_::releaseBatch(head);
+                head = nullptr;
+                size = 0;
+            }
+        }
+    };
+
+    // Keep the parts written by the producers and the consumer on separate
+    // cache lines.
+    alignas(64) atomic<Node*> head_;
+    atomic<uint64_t> pushCount_;
+    alignas(64) Node* tail_;
+    atomic<uint64_t> popCount_;
+    FreeBatch freeBatch_;
+};
+
+}
@@ -0,0 +1,324 @@
+#include "multipart.hpp"
+
+namespace retrojsvice {
+
+namespace {
+
+// The part data is passed to the handler in chunks of at most this size.
+const size_t ReadBufSize = 1 << 20;
+const size_t ReadBufAlign = 4096;
+
+const size_t MaxPartHeaderSize = 16384;
+
+string toLowerStr(string str) {
+    for(char& c : str) {
+        c = tolower(c);
+    }
+    return str;
+}
+
+string trimStr(const string& str) {
+    size_t start = str.find_first_not_of(" \t");
+    if(start == string::npos) {
+        return "";
+    }
+    size_t end = str.find_last_not_of(" \t");
+    return str.substr(start, end - start + 1);
+}
+
+// Parses a header value of the form 'value; key1=val1; key2="val2"' into the
+// lowercase main value and the parameters (with lowercase keys). Backslashes
+// in quoted strings are not treated as escapes, as some old browsers send
+// Windows paths in filename parameters without escaping them.
+pair<string, map<string, string>> parseHeaderParams(const string& value) {
+    size_t pos = value.find(';');
+    string mainValue = toLowerStr(trimStr(value.substr(0, pos)));
+
+    map<string, string> params;
+    while(pos < value.size()) {
+        ++pos;
+        size_t keyEnd = value.find_first_of("=;", pos);
+        string key = toLowerStr(trimStr(value.substr(pos, keyEnd - pos)));
+        pos = keyEnd;
+        if(pos == string::npos || value[pos] == ';') {
+            continue;
+        }
+
+        ++pos;
+        while(pos < value.size() && (value[pos] == ' ' || value[pos] == '\t')) {
+            ++pos;
+        }
+        string val;
+        if(pos < value.size() && value[pos] == '"') {
+            size_t valEnd = value.find('"', pos + 1);
+            if(valEnd == string::npos) {
+                val = value.substr(pos + 1);
+                pos = string::npos;
+            } else {
+                val = value.substr(pos + 1, valEnd - pos - 1);
+                pos = value.find(';', valEnd);
+            }
+        } else {
+            size_t valEnd = value.find(';', pos);
+            val = trimStr(value.substr(pos, valEnd - pos));
+            pos = valEnd;
+        }
+        params.emplace(move(key), move(val));
+    }
+
+    return make_pair(move(mainValue), move(params));
+}
+
+class MultipartParser {
+public:
+    MultipartParser(
+        istream& in,
+        const string& boundary,
+        MultipartFormHandler& handler
+    )
+        : in_(in),
+          handler_(handler),
+          delimiter_("\r\n--" + boundary),
+          searcher_(delimiter_.begin(), delimiter_.end())
+    {
+        buf_ = (char*)::operator new(ReadBufSize, std::align_val_t(ReadBufAlign));
+
+        // The delimiter includes the preceding line break, which the first
+        // boundary of the body does not have; we add it here so that all the
+        // boundaries can be found in the same way.
+        buf_[0] = '\r';
+        buf_[1] = '\n';
+        pos_ = 0;
+        end_ = 2;
+        eof_ = false;
+    }
+
+    ~MultipartParser() {
+        ::operator delete(buf_, std::align_val_t(ReadBufAlign));
+    }
+
+    DISABLE_COPY_MOVE(MultipartParser);
+
+    bool run() {
+        // Skip the preamble.
+        if(!skipToDelimiter_(false)) {
+            return false;
+        }
+
+        while(true) {
+            if(!fill_(2)) {
+                return false;
+            }
+            if(buf_[pos_] == '-' && buf_[pos_ + 1] == '-') {
+                // Final boundary; the rest of the body is an epilogue that is
+                // ignored, but we consume it so that it is not left in the
+                // connection.
+                if(!eof_) {
+                    in_.ignore(numeric_limits<std::streamsize>::max());
+                }
+                return true;
+            }
+
+            // Skip the transport padding after the boundary.
+            while(true) {
+                if(!fill_(1)) {
+                    return false;
+                }
+                if(buf_[pos_] != ' ' && buf_[pos_] != '\t') {
+                    break;
+                }
+                ++pos_;
+            }
+            if(!fill_(2) || buf_[pos_] != '\r' || buf_[pos_ + 1] != '\n') {
+                WARNING_LOG("Malformed boundary line in multipart form data");
+                return false;
+            }
+
+            if(!readPartHeaders_()) {
+                return false;
+            }
+            if(!skipToDelimiter_(partActive_)) {
+                return false;
+            }
+            if(partActive_) {
+                handler_.onMultipartPartEnd();
+            }
+        }
+    }
+
+private:
+    // Makes sure that at least count bytes are available starting from pos_,
+    // reading more data from the stream if necessary. Returns false if the
+    // stream ends or fails before that.
+    bool fill_(size_t count) {
+        REQUIRE(count <= ReadBufSize);
+        if(end_ - pos_ >= count) {
+            return true;
+        }
+
+        memmove(buf_, buf_ + pos_, end_ - pos_);
+        end_ -= pos_;
+        pos_ = 0;
+
+        while(end_ < count) {
+            if(eof_) {
+                return false;
+            }
+            in_.read(buf_ + end_, (std::streamsize)(ReadBufSize - end_));
+            if(in_.bad() || (in_.fail() != in_.eof())) {
+                WARNING_LOG("Reading multipart form data from stream failed");
+                eof_ = true;
+                return false;
+            }
+            end_ += (size_t)in_.gcount();
+            eof_ = in_.eof();
+        }
+        return true;
+    }
+
+    // Reads data until the next delimiter, passing the data to the handler
+    // if emit is true. After a successful return, pos_ points to the byte
+    // right after the delimiter.
+    bool skipToDelimiter_(bool emit) {
+        while(true) {
+            const char* found =
+                std::search(buf_ + pos_, buf_ + end_, searcher_);
+            if(found != buf_ + end_) {
+                size_t idx = found - buf_;
+                if(emit && idx > pos_) {
+                    handler_.onMultipartPartData(buf_ + pos_, idx - pos_);
+                }
+                pos_ = idx + delimiter_.size();
+                return true;
+            }
+
+            // The end of the buffer may contain the beginning of the
+            // delimiter, so we keep it.
+            size_t keep = min(end_ - pos_, delimiter_.size() - 1);
+            size_t dataEnd = end_ - keep;
+            if(emit && dataEnd > pos_) {
+                handler_.onMultipartPartData(buf_ + pos_, dataEnd - pos_);
+            }
+            pos_ = dataEnd;
+
+            if(!fill_(end_ - pos_ + 1)) {
+                return false;
+            }
+        }
+    }
+
+    // Reads the headers of a part starting at the line break after the
+    // boundary and calls onMultipartPartBegin if the part is a form field.
+    bool readPartHeaders_() {
+        const string terminator = "\r\n\r\n";
+        size_t searchStart = pos_;
+        size_t headerEnd;
+        while(true) {
+            const char* found = std::search(
+                buf_ + searchStart, buf_ + end_,
+                terminator.begin(), terminator.end()
+            );
+            if(found != buf_ + end_) {
+                headerEnd = found - buf_;
+                break;
+            }
+            if(end_ - pos_ > MaxPartHeaderSize) {
+                WARNING_LOG("Too large part headers in multipart form data");
+                return false;
+            }
+            size_t searched = end_ - pos_;
+            if(!fill_(searched + 1)) {
+                return false;
+            }
+            searchStart = pos_ + searched - min(searched, terminator.size() - 1);
+        }
+
+        // The headers start after the line break that ends the boundary line
+        // (if there are no headers, the terminator starts at that line break).
+        string headers;
+        if(headerEnd > pos_ + 2) {
+            headers.assign(buf_ + pos_ + 2, headerEnd - pos_ - 2);
+        }
+        pos_ = headerEnd + terminator.size();
+
+        partActive_ = false;
+        for(const string& line : splitStr(headers, '\n')) {
+            string trimmedLine = line;
+            if(!trimmedLine.empty() && trimmedLine.back() == '\r') {
+                trimmedLine.pop_back();
+            }
+            size_t colon = trimmedLine.find(':');
+            if(colon == string::npos) {
+                continue;
+            }
+            string name = toLowerStr(trimStr(trimmedLine.substr(0, colon)));
+            if(name != "content-disposition") {
+                continue;
+            }
+
+            pair<string, map<string, string>> disp =
+                parseHeaderParams(trimmedLine.substr(colon + 1));
+            auto nameIt = disp.second.find("name");
+            if(disp.first != "form-data" || nameIt == disp.second.end()) {
+                continue;
+            }
+            optional<string> filename;
+            auto filenameIt = disp.second.find("filename");
+            if(filenameIt != disp.second.end()) {
+                filename = filenameIt->second;
+            }
+            handler_.onMultipartPartBegin(nameIt->second, move(filename));
+            partActive_ = true;
+            break;
+        }
+        return true;
+    }
+
+    istream& in_;
+    MultipartFormHandler& handler_;
+
+    string delimiter_;
+    std::boyer_moore_horspool_searcher<string::iterator> searcher_;
+
+    // The unprocessed data is buf_[pos_, end_).
+    char* buf_;
+    size_t pos_;
+    size_t end_;
+    bool eof_;
+
+    bool partActive_;
+};
+
+}
+
+optional<string> parseMultipartFormBoundary(const string& contentType) {
+    pair<string, map<string, string>> parsed = parseHeaderParams(contentType);
+    if(parsed.first != "multipart/form-data") {
+        return {};
+    }
+    auto it = parsed.second.find("boundary");
+    if(it == parsed.second.end() || it->second.empty()) {
+        return {};
+    }
+    return it->second;
+}
+
+bool parseMultipartForm(
+    istream& in,
+    const string& boundary,
+    MultipartFormHandler& handler
+) {
+    REQUIRE(!boundary.empty());
+
+    // Limit the boundary length so that it always fits in the buffer with
+    // the part headers.
+    if(boundary.size() > 256) {
+        WARNING_LOG("Too long multipart form data boundary");
+        return false;
+    }
+
+    MultipartParser parser(in, boundary, handler);
+    return parser.run();
+}
+
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "common.hpp"
+
+namespace retrojsvice {
+
+class MultipartFormHandler {
+public:
+    // Called when a new part begins. The filename is empty if the
+    // Content-Disposition header of the part has no filename parameter.
+    virtual void onMultipartPartBegin(string name, optional<string> filename) = 0;
+
+    // Called zero or more times for each part with the next chunk of its data.
+    virtual void onMultipartPartData(const char* data, size_t size) = 0;
+
+    // Called when the part has been read completely. If parsing fails in the
+    // middle of a part, this is not called for that part.
+    virtual void onMultipartPartEnd() = 0;
+};
+
+// Returns the boundary parameter of a Content-Type header value of type
+// multipart/form-data, or an empty value if the content type is something
+// else or the boundary is missing.
+optional<string> parseMultipartFormBoundary(const string& contentType);
+
+// Streaming parser for multipart/form-data bodies (RFC 7578). The body is read
+// from the stream in large blocks, and the part data is passed to the handler
+// directly from the read buffer; only the boundary search and the part headers
+// look at the data. Returns false if reading the stream fails or the body is
+// malformed.
+bool parseMultipartForm(
+    istream& in,
+    const string& boundary,
+    MultipartFormHandler& handler
+);
+
+}
@@ -137,6 +137,7 @@ struct JobData {
     size_t startY;
     size_t endY;
     bool endStream;
+    PNGCompressor::Encoder encoder;
 };
 
 struct Job {
@@ -165,6 +166,533 @@ int paeth(int leftVal, int upVal, int upLeftVal) {
     }
 }
 
+// Deflate encoder specialized for filtered screen content. As the Paeth filter
+// already predicts each row from the previous one, flat areas and rows
+// repeating the previous row both filter to runs of zeros, and the rest is
+// mostly noise-like. Thus instead of searching a hash chain like zlib, we only
+// try matches at distances 1 and 3 (byte and pixel runs); matching against
+// the previous row of filtered data was tried but its expensive distance codes
+// made the output larger. The tokens are encoded in blocks using dynamic
+// Huffman codes, falling back to fixed codes or stored blocks if they are
+// smaller.
+
+const size_t MaxMatchLength = 258;
+const size_t MinMatchLength = 3;
+const size_t MaxBlockTokens = 1 << 15;
+const size_t MaxStoredBlockSize = 65535;
+
+const int LitLenSymbolCount = 286;
+// The fixed code also assigns codes to the two unused symbols 286 and 287,
+// which affects the canonical codes of the other symbols.
+const int FixedLitLenSymbolCount = 288;
+const int DistSymbolCount = 30;
+const int CodeLenSymbolCount = 19;
+
+const int LengthBase[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+    67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+const int LengthExtraBits[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4,
+    5, 5, 5, 5, 0
+};
+const int CodeLenOrder[CodeLenSymbolCount] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+// lengthSymbols[len] is the index of the length code (offset from 257) for
+// match length len.
+std::array<uint8_t, MaxMatchLength + 1> computeLengthSymbols() {
+    std::array<uint8_t, MaxMatchLength + 1> ret = {};
+    for(int sym = 0; sym < 29; ++sym) {
+        int end = sym == 28 ? 259 : LengthBase[sym + 1];
+        for(int len = LengthBase[sym]; len < end && len <= 258; ++len) {
+            ret[len] = (uint8_t)sym;
+        }
+    }
+    return ret;
+}
+const std::array<uint8_t, MaxMatchLength + 1> lengthSymbols = computeLengthSymbols();
+
+// A literal byte (dist == 0, value in length) or a match. As the match
+// distances are at most 4, the distance symbol of a match is dist - 1 and it
+// has no extra bits.
+struct Token {
+    uint16_t length;
+    uint16_t dist;
+};
+
+size_t matchLength(const uint8_t* a, const uint8_t* b, size_t maxLength) {
+    size_t len = 0;
+    while(len + 8 <= maxLength) {
+        uint64_t aVal;
+        uint64_t bVal;
+        memcpy(&aVal, a + len, 8);
+        memcpy(&bVal, b + len, 8);
+        if(aVal != bVal) {
+            break;
+        }
+        len += 8;
+    }
+    while(len < maxLength && a[len] == b[len]) {
+        ++len;
+    }
+    return len;
+}
+
+// Tokenizes data starting from start until the end of data or until there
+// are maxTokens tokens, and returns the end position. The matches may refer
+// to data before start.
+size_t tokenize(
+    const uint8_t* data,
+    size_t start,
+    size_t size,
+    size_t maxTokens,
+    std::vector<Token>& tokens
+) {
+    size_t i = start;
+    while(i < size && tokens.size() < maxTokens) {
+        size_t maxLength = std::min(MaxMatchLength, size - i);
+        size_t bestLength = 0;
+        size_t bestDist = 0;
+
+        if(i >= 1 && data[i] == data[i - 1]) {
+            size_t len = matchLength(data + i, data + i - 1, maxLength);
+            if(len >= MinMatchLength) {
+                bestLength = len;
+                bestDist = 1;
+            }
+        }
+        if(i >= 3 && bestLength < maxLength && data[i] == data[i - 3]) {
+            size_t len = matchLength(data + i, data + i - 3, maxLength);
+            if(len >= MinMatchLength && len > bestLength) {
+                bestLength = len;
+                bestDist = 3;
+            }
+        }
+
+        if(bestDist) {
+            tokens.push_back({(uint16_t)bestLength, (uint16_t)bestDist});
+            i += bestLength;
+        } else {
+            tokens.push_back({(uint16_t)data[i], 0});
+            ++i;
+        }
+    }
+    return i;
+}
+
+// Computes length-limited Huffman code lengths for the symbols with given
+// frequencies. The resulting code is always complete (as required by
+// inflate), except when there is at most one used symbol, in which case it
+// is given length 1.
+void buildCodeLengths(
+    const uint32_t* freqs,
+    int symbolCount,
+    int maxLength,
+    uint8_t* lengths
+) {
+    std::vector<std::pair<uint32_t, int>> symbols;
+    for(int sym = 0; sym < symbolCount; ++sym) {
+        lengths[sym] = 0;
+        if(freqs[sym]) {
+            symbols.emplace_back(freqs[sym], sym);
+        }
+    }
+    if(symbols.size() <= 1) {
+        lengths[symbols.empty() ? 0 : symbols[0].second] = 1;
+        return;
+    }
+    std::sort(symbols.begin(), symbols.end());
+
+    // In-place computation of the code lengths from the sorted frequencies
+    // (Moffat & Katajainen); afterwards, a[i] is the length of the code for
+    // symbols[i].
+    int n = (int)symbols.size();
+    std::vector<uint32_t> a(n);
+    for(int i = 0; i < n; ++i) {
+        a[i] = symbols[i].first;
+    }
+    a[0] += a[1];
+    int root = 0;
+    int leaf = 2;
+    for(int next = 1; next < n - 1; ++next) {
+        if(leaf >= n || a[root] < a[leaf]) {
+            a[next] = a[root];
+            a[root++] = (uint32_t)next;
+        } else {
+            a[next] = a[leaf++];
+        }
+        if(leaf >= n || (root < next && a[root] < a[leaf])) {
+            a[next] += a[root];
+            a[root++] = (uint32_t)next;
+        } else {
+            a[next] += a[leaf++];
+        }
+    }
+    a[n - 2] = 0;
+    for(int next = n - 3; next >= 0; --next) {
+        a[next] = a[a[next]] + 1;
+    }
+    int avail = 1;
+    int used = 0;
+    uint32_t depth = 0;
+    root = n - 2;
+    int next = n - 1;
+    while(avail > 0) {
+        while(root >= 0 && a[root] == depth) {
+            ++used;
+            --root;
+        }
+        while(avail > used) {
+            a[next--] = depth;
+            --avail;
+        }
+        avail = 2 * used;
+        ++depth;
+        used = 0;
+    }
+
+    // Limit the lengths in the same way as zlib: the codes that are too long
+    // are shortened to maxLength, and for each pair of them, a leaf at a
+    // smaller depth is moved one level down to make room.
+    std::vector<int> lengthCounts(maxLength + 1, 0);
+    int overflow = 0;
+    for(int i = 0; i < n; ++i) {
+        if((int)a[i] > maxLength) {
+            ++lengthCounts[maxLength];
+            ++overflow;
+        } else {
+            ++lengthCounts[a[i]];
+        }
+    }
+    while(overflow > 0) {
+        int bits = maxLength - 1;
+        while(lengthCounts[bits] == 0) {
+            --bits;
+        }
+        --lengthCounts[bits];
+        lengthCounts[bits + 1] += 2;
+        --lengthCounts[maxLength];
+        overflow -= 2;
+    }
+
+    // The least frequent symbols get the longest codes.
+    int i = 0;
+    for(int len = maxLength; len >= 1; --len) {
+        for(int j = 0; j < lengthCounts[len]; ++j) {
+            lengths[symbols[i++].second] = (uint8_t)len;
+        }
+    }
+    CHECK(i == n);
+}
+
+// Computes the canonical codes for given code lengths, bit-reversed so that
+// they can be written least significant bit first.
+void buildCodes(const uint8_t* lengths, int symbolCount, uint16_t* codes) {
+    int lengthCounts[16] = {};
+    for(int sym = 0; sym < symbolCount; ++sym) {
+        ++lengthCounts[lengths[sym]];
+    }
+    lengthCounts[0] = 0;
+    int nextCode[16] = {};
+    int code = 0;
+    for(int len = 1; len < 16; ++len) {
+        code = (code + lengthCounts[len - 1]) << 1;
+        nextCode[len] = code;
+    }
+    for(int sym = 0; sym < symbolCount; ++sym) {
+        int len = lengths[sym];
+        codes[sym] = 0;
+        if(len) {
+            int val = nextCode[len]++;
+            int rev = 0;
+            for(int b = 0; b < len; ++b) {
+                rev = (rev << 1) | ((val >> b) & 1);
+            }
+            codes[sym] = (uint16_t)rev;
+        }
+    }
+}
+
+class BitWriter {
+public:
+    BitWriter(uint8_t* out) : out_(out), pos_(0), bitBuf_(0), bitCount_(0) {}
+
+    // count <= 32
+    void write(uint32_t bits, int count) {
+        bitBuf_ |= (uint64_t)bits << bitCount_;
+        bitCount_ += count;
+        if(bitCount_ >= 32) {
+            for(int i = 0; i < 4; ++i) {
+                out_[pos_++] = (uint8_t)(bitBuf_ >> (8 * i));
+            }
+            bitBuf_ >>= 32;
+            bitCount_ -= 32;
+        }
+    }
+    void alignToByte() {
+        write(0, (8 - bitCount_ % 8) % 8);
+        while(bitCount_ > 0) {
+            out_[pos_++] = (uint8_t)bitBuf_;
+            bitBuf_ >>= 8;
+            bitCount_ -= 8;
+        }
+    }
+    void writeBytes(const uint8_t* data, size_t size) {
+        CHECK(bitCount_ == 0);
+        memcpy(out_ + pos_, data, size);
+        pos_ += size;
+    }
+    uint64_t bitPosition() const {
+        return 8 * (uint64_t)pos_ + (uint64_t)bitCount_;
+    }
+    // Valid after alignToByte.
+    size_t size() const {
+        return pos_;
+    }
+
+private:
+    uint8_t* out_;
+    size_t pos_;
+    uint64_t bitBuf_;
+    int bitCount_;
+};
+
+size_t storedBlockCount(size_t size) {
+    return std::max((size + MaxStoredBlockSize - 1) / MaxStoredBlockSize, (size_t)1);
+}
+
+// Upper bound for the output size of encodeScreenDeflate. Each block is at
+// most as large as it would be as stored blocks, with an overhead of at most
+// 6 bytes per stored block.
+size_t screenDeflateBound(size_t size) {
+    size_t maxBlocks = size / MaxStoredBlockSize + size / MaxBlockTokens + 2;
+    return size + 6 * maxBlocks + 16;
+}
+
+void writeStoredBlocks(
+    BitWriter& writer,
+    const uint8_t* data,
+    size_t size,
+    bool final
+) {
+    do {
+        size_t blockSize = std::min(size, MaxStoredBlockSize);
+        bool last = blockSize == size;
+        writer.write(final && last ? 1 : 0, 1);
+        writer.write(0, 2);
+        writer.alignToByte();
+        writer.write((uint32_t)blockSize, 16);
+        writer.write((uint32_t)(~blockSize & 0xFFFF), 16);
+        writer.writeBytes(data, blockSize);
+        data += blockSize;
+        size -= blockSize;
+    } while(size > 0);
+}
+
+// Writes the tokens (which encode data[0, size)) as a single block using the
+// cheapest of dynamic Huffman codes, fixed Huffman codes and stored blocks.
+void writeBlock(
+    BitWriter& writer,
+    const Token* tokens,
+    size_t tokenCount,
+    const uint8_t* data,
+    size_t size,
+    bool final
+) {
+    uint32_t litLenFreqs[LitLenSymbolCount] = {};
+    uint32_t distFreqs[DistSymbolCount] = {};
+    uint64_t extraBits = 0;
+    for(size_t i = 0; i < tokenCount; ++i) {
+        const Token& token = tokens[i];
+        if(token.dist == 0) {
+            ++litLenFreqs[token.length];
+        } else {
+            int lenSym = lengthSymbols[token.length];
+            ++litLenFreqs[257 + lenSym];
+            ++distFreqs[token.dist - 1];
+            extraBits += LengthExtraBits[lenSym];
+        }
+    }
+    litLenFreqs[256] = 1;
+
+    uint8_t litLenLengths[FixedLitLenSymbolCount];
+    uint8_t distLengths[DistSymbolCount];
+    buildCodeLengths(litLenFreqs, LitLenSymbolCount, 15, litLenLengths);
+    buildCodeLengths(distFreqs, DistSymbolCount, 15, distLengths);
+
+    int litLenCount = LitLenSymbolCount;
+    while(litLenCount > 257 && litLenLengths[litLenCount - 1] == 0) {
+        --litLenCount;
+    }
+    int distCount = DistSymbolCount;
+    while(distCount > 1 && distLengths[distCount - 1] == 0) {
+        --distCount;
+    }
+
+    // Run-length encode the code lengths using the code length symbols 16
+    // (repeat previous 3-6 times), 17 (3-10 zeros) and 18 (11-138 zeros).
+    std::vector<uint8_t> allLengths(litLenLengths, litLenLengths + litLenCount);
+    allLengths.insert(allLengths.end(), distLengths, distLengths + distCount);
+    std::vector<std::pair<uint8_t, uint8_t>> codeLenTokens;
+    uint32_t codeLenFreqs[CodeLenSymbolCount] = {};
+    for(size_t i = 0; i < allLengths.size();) {
+        uint8_t len = allLengths[i];
+        size_t run = 1;
+        while(i + run < allLengths.size() && allLengths[i + run] == len) {
+            ++run;
+        }
+        if(len == 0 && run >= 3) {
+            run = std::min(run, (size_t)138);
+            if(run >= 11) {
+                codeLenTokens.emplace_back(18, (uint8_t)(run - 11));
+            } else {
+                codeLenTokens.emplace_back(17, (uint8_t)(run - 3));
+            }
+        } else if(len != 0 && run >= 4) {
+            run = std::min(run, (size_t)7);
+            codeLenTokens.emplace_back(len, 0);
+            codeLenTokens.emplace_back(16, (uint8_t)(run - 4));
+        } else {
+            run = 1;
+            codeLenTokens.emplace_back(len, 0);
+        }
+        i += run;
+    }
+    for(const std::pair<uint8_t, uint8_t>& token : codeLenTokens) {
+        ++codeLenFreqs[token.first];
+    }
+    uint8_t codeLenLengths[CodeLenSymbolCount];
+    buildCodeLengths(codeLenFreqs, CodeLenSymbolCount, 7, codeLenLengths);
+    int codeLenCount = CodeLenSymbolCount;
+    while(codeLenCount > 4 && codeLenLengths[CodeLenOrder[codeLenCount - 1]] == 0) {
+        --codeLenCount;
+    }
+
+    // Compute the size of the block in each form.
+    const int CodeLenExtraBits[CodeLenSymbolCount] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 3, 7
+    };
+    uint64_t dynamicBits = 3 + 5 + 5 + 4 + 3 * (uint64_t)codeLenCount + extraBits;
+    for(int sym = 0; sym < CodeLenSymbolCount; ++sym) {
+        dynamicBits += (uint64_t)codeLenFreqs[sym] * (codeLenLengths[sym] + CodeLenExtraBits[sym]);
+    }
+    uint64_t fixedBits = 3 + extraBits;
+    for(int sym = 0; sym < LitLenSymbolCount; ++sym) {
+        dynamicBits += (uint64_t)litLenFreqs[sym] * litLenLengths[sym];
+        int fixedLength = sym < 144 ? 8 : (sym < 256 ? 9 : (sym < 280 ? 7 : 8));
+        fixedBits += (uint64_t)litLenFreqs[sym] * fixedLength;
+    }
+    for(int sym = 0; sym < DistSymbolCount; ++sym) {
+        dynamicBits += (uint64_t)distFreqs[sym] * distLengths[sym];
+        fixedBits += (uint64_t)distFreqs[sym] * 5;
+    }
+    uint64_t storedBits =
+        (8 - (writer.bitPosition() + 3) % 8) % 8 +
+        40 * (uint64_t)storedBlockCount(size) +
+        8 * (uint64_t)size;
+
+    if(storedBits <= dynamicBits && storedBits <= fixedBits) {
+        writeStoredBlocks(writer, data, size, final);
+        return;
+    }
+
+    uint16_t litLenCodes[FixedLitLenSymbolCount];
+    int codeSymbolCount = LitLenSymbolCount;
+    uint16_t distCodes[DistSymbolCount];
+    writer.write(final ? 1 : 0, 1);
+    if(fixedBits < dynamicBits) {
+        writer.write(1, 2);
+        codeSymbolCount = FixedLitLenSymbolCount;
+        for(int sym = 0; sym < FixedLitLenSymbolCount; ++sym) {
+            litLenLengths[sym] = sym < 144 ? 8 : (sym < 256 ? 9 : (sym < 280 ? 7 : 8));
+        }
+        for(int sym = 0; sym < DistSymbolCount; ++sym) {
+            distLengths[sym] = 5;
+        }
+    } else {
+        writer.write(2, 2);
+        writer.write((uint32_t)(litLenCount - 257), 5);
+        writer.write((uint32_t)(distCount - 1), 5);
+        writer.write((uint32_t)(codeLenCount - 4), 4);
+        for(int i = 0; i < codeLenCount; ++i) {
+            writer.write(codeLenLengths[CodeLenOrder[i]], 3);
+        }
+        uint16_t codeLenCodes[CodeLenSymbolCount];
+        buildCodes(codeLenLengths, CodeLenSymbolCount, codeLenCodes);
+        for(const std::pair<uint8_t, uint8_t>& token : codeLenTokens) {
+            writer.write(codeLenCodes[token.first], codeLenLengths[token.first]);
+            if(token.first >= 16) {
+                writer.write(token.second, CodeLenExtraBits[token.first]);
+            }
+        }
+    }
+    buildCodes(litLenLengths, codeSymbolCount, litLenCodes);
+    buildCodes(distLengths, DistSymbolCount, distCodes);
+
+    for(size_t i = 0; i < tokenCount; ++i) {
+        const Token& token = tokens[i];
+        if(token.dist == 0) {
+            writer.write(litLenCodes[token.length], litLenLengths[token.length]);
+        } else {
+            int lenSym = lengthSymbols[token.length];
+            writer.write(litLenCodes[257 + lenSym], litLenLengths[257 + lenSym]);
+            writer.write(
+                (uint32_t)(token.length - LengthBase[lenSym]),
+                LengthExtraBits[lenSym]
+            );
+            writer.write(distCodes[token.dist - 1], distLengths[token.dist - 1]);
+        }
+    }
+    writer.write(litLenCodes[256], litLenLengths[256]);
+}
+
+// Compresses data as a raw deflate stream fragment to out, which must have
+// room for screenDeflateBound(size) bytes, and returns the number of bytes
+// written. Like zlib with Z_SYNC_FLUSH, the fragment ends at a byte boundary;
+// if endStream is true, its last block is marked final.
+size_t encodeScreenDeflate(
+    const uint8_t* data,
+    size_t size,
+    bool endStream,
+    uint8_t* out
+) {
+    std::vector<Token> tokens;
+    tokens.reserve(std::min(size, MaxBlockTokens));
+
+    BitWriter writer(out);
+    size_t blockStart = 0;
+    while(true) {
+        tokens.clear();
+        size_t blockEnd =
+            tokenize(data, blockStart, size, MaxBlockTokens, tokens);
+
+        bool last = blockEnd == size;
+        writeBlock(
+            writer,
+            tokens.data(),
+            tokens.size(),
+            data + blockStart,
+            blockEnd - blockStart,
+            endStream && last
+        );
+        blockStart = blockEnd;
+        if(last) {
+            break;
+        }
+    }
+    if(!endStream) {
+        // Empty stored block to align to a byte boundary.
+        writer.write(0, 3);
+        writer.alignToByte();
+        writer.write(0, 16);
+        writer.write(0xFFFF, 16);
+    }
+    writer.alignToByte();
+    return writer.size();
+}
+
 Result runJob(JobData jobData) {
     const uint8_t* image = jobData.image;
     size_t width = jobData.width;
@@ -218,71 +746,49 @@ Result runJob(JobData jobData) {
 
     CHECK(rawData.size() == uncompressedBytes);
 
-    z_stream zStream;
-    zStream.zalloc = nullptr;
-    zStream.zfree = nullptr;
-    zStream.opaque = nullptr;
-    CHECK(deflateInit2(&zStream, 1, Z_DEFLATED, 15, 8, Z_RLE) == Z_OK);
-
-    zStream.avail_in = (unsigned int)uncompressedBytes;
-    zStream.next_in = rawData.data();
+    uint32_t adler32 = (uint32_t)::adler32(
+        ::adler32(0, nullptr, 0), rawData.data(), (uInt)uncompressedBytes
+    );
 
+    // The output of both encoders is a raw deflate stream fragment that is
+    // written directly to the preallocated chunk.
     std::vector<uint8_t> chunk;
     ChunkWriter writer(chunk, "IDAT");
     size_t zStreamStart = chunk.size();
 
-    bool headerRead = false;
-    bool bufErrorSeen = false;
-    while(true) {
-        size_t blockSize = headerRead ? 8192 : 64;
-
-        size_t pos = chunk.size();
-        chunk.resize(pos + blockSize);
-
-        zStream.avail_out = (unsigned int)blockSize;
-        zStream.next_out = chunk.data() + pos;
-
-        int flush;
-        if(bufErrorSeen) {
-            flush = endStream ? Z_FINISH : Z_SYNC_FLUSH;;
-        } else {
-            flush = Z_NO_FLUSH;
-        }
-        int res = deflate(&zStream, flush);
-        CHECK(res == Z_OK || res == Z_STREAM_END || res == Z_BUF_ERROR);
-
+    if(jobData.encoder == PNGCompressor::Encoder::Screen) {
+        chunk.resize(zStreamStart + screenDeflateBound(uncompressedBytes));
+        size_t length = encodeScreenDeflate(
+            rawData.data(),
+            uncompressedBytes,
+            endStream,
+            chunk.data() + zStreamStart
+        );
+        chunk.resize(zStreamStart + length);
+    } else {
+        z_stream zStream;
+        zStream.zalloc = nullptr;
+        zStream.zfree = nullptr;
+        zStream.opaque = nullptr;
+        CHECK(deflateInit2(&zStream, 1, Z_DEFLATED, -15, 8, Z_RLE) == Z_OK);
+
+        // deflateBound assumes Z_FINISH; Z_SYNC_FLUSH may add an empty
+        // stored block.
+        size_t bound = deflateBound(&zStream, (uLong)uncompressedBytes) + 16;
+        chunk.resize(zStreamStart + bound);
+
+        zStream.avail_in = (unsigned int)uncompressedBytes;
+        zStream.next_in = rawData.data();
+        zStream.avail_out = (unsigned int)bound;
+        zStream.next_out = chunk.data() + zStreamStart;
+
+        int res = deflate(&zStream, endStream ? Z_FINISH : Z_SYNC_FLUSH);
+        CHECK(res == (endStream ? Z_STREAM_END : Z_OK));
+        CHECK(zStream.avail_in == 0 && zStream.avail_out > 0);
         chunk.resize(chunk.size() - zStream.avail_out);
 
-        if(!headerRead && chunk.size() >= zStreamStart + 2) {
-            // Check ZLIB header
-            CHECK((chunk[zStreamStart] & 0xf) == 8); // deflate compression
-            CHECK((chunk[zStreamStart] >> 4) == 7); // 32K window size
-            CHECK(!(chunk[zStreamStart + 1] & 32)); // no preset dictionary
-            chunk.erase(chunk.begin() + zStreamStart, chunk.begin() + zStreamStart + 2);
-            headerRead = true;
-        }
-
-        if(bufErrorSeen) {
-            if(res == Z_STREAM_END || res == Z_BUF_ERROR) {
-                break;
-            }
-        } else {
-            if(res == Z_BUF_ERROR) {
-                bufErrorSeen = true;
-            }
-        }
-    }
-    CHECK(headerRead);
-
-    uint32_t adler32 = zStream.adler;
-    
-    int res = deflateEnd(&zStream);
-    CHECK(res == Z_OK || res == Z_DATA_ERROR);
-
-    // Remove Adler32 value from the end of data
-    if(endStream) {
-        CHECK(chunk.size() >= 4);
-        chunk.resize(chunk.size() - 4);
+        res = deflateEnd(&zStream);
+        CHECK(res == Z_OK || res == Z_DATA_ERROR);
     }
 
     writer.registerWrite(zStreamStart);
@@ -306,22 +812,26 @@ void workerThread(std::future<std::unique_ptr<Job>> jobFuture) {
 
 class PNGCompressor::Impl {
 public:
-    Impl(size_t threadCount);
+    Impl(size_t threadCount, Encoder encoder);
     ~Impl();
 
     std::vector<std::vector<uint8_t>> compress(
         const uint8_t* image,
         size_t width,
         size_t height,
-        size_t pitch
+        size_t pitch,
+        const uint8_t* transparentColor,
+        size_t maxThreadCount
     );
 
 private:
     std::vector<Worker> workers_;
+    Encoder encoder_;
 };
 
-PNGCompressor::Impl::Impl(size_t threadCount) {
+PNGCompressor::Impl::Impl(size_t threadCount, Encoder encoder) {
     CHECK(threadCount >= 1);
+    encoder_ = encoder;
     for(size_t i = 1; i < threadCount; ++i) {
         std::promise<std::unique_ptr<Job>> jobPromise;
         std::future<std::unique_ptr<Job>> jobFuture = jobPromise.get_future();
@@ -344,11 +854,16 @@ std::vector<std::vector<uint8_t>> PNGCompressor::Impl::compress(
     const uint8_t* image,
     size_t width,
     size_t height,
-    size_t pitch
+    size_t pitch,
+    const uint8_t* transparentColor,
+    size_t maxThreadCount
 ) {
     CHECK(width > 0 && height > 0);
 
     size_t threadCount = std::min(workers_.size() + 1, height);
+    if(maxThreadCount != 0) {
+        threadCount = std::min(threadCount, maxThreadCount);
+    }
 
     std::vector<JobData> jobDatas(threadCount);
     for(size_t i = 0; i < threadCount; ++i) {
@@ -359,6 +874,7 @@ std::vector<std::vector<uint8_t>> PNGCompressor::Impl::compress(
         jobData.startY = height * i / threadCount;
         jobData.endY = height * (i + 1) / threadCount;
         jobData.endStream = i + 1 == threadCount;
+        jobData.encoder = encoder_;
     }
 
     std::vector<std::future<Result>> resultFutures(threadCount - 1);
@@ -404,6 +920,17 @@ std::vector<std::vector<uint8_t>> PNGCompressor::Impl::compress(
         writer.writeU8(0); // no interlace
         writer.finish();
     }
+    if(transparentColor != nullptr) {
+        ChunkWriter writer(headerData, "tRNS");
+
+        // For RGB images, the transparent color is given as 16-bit samples
+        for(int c = 2; c >= 0; --c) {
+            writer.writeU8(0);
+            writer.writeU8(transparentColor[c]);
+        }
+
+        writer.finish();
+    }
     {
         ChunkWriter writer(headerData, "IDAT");
 
@@ -441,8 +968,14 @@ std::vector<std::vector<uint8_t>> PNGCompressor::Impl::compress(
     return chunks;
 }
 
-PNGCompressor::PNGCompressor(size_t threadCount)
-    : impl_(new Impl(threadCount))
+#ifdef RETROJSVICE_PNG_ZLIB_ENCODER
+const PNGCompressor::Encoder PNGCompressor::DefaultEncoder = Encoder::Zlib;
+#else
+const PNGCompressor::Encoder PNGCompressor::DefaultEncoder = Encoder::Screen;
+#endif
+
+PNGCompressor::PNGCompressor(size_t threadCount, Encoder encoder)
+    : impl_(new Impl(threadCount, encoder))
 {}
 
 PNGCompressor::~PNGCompressor() {}
@@ -451,7 +984,11 @@ std::vector<std::vector<uint8_t>> PNGCompressor::compress(
     const uint8_t* image,
     size_t width,
     size_t height,
-    size_t pitch
+    size_t pitch,
+    const uint8_t* transparentColor,
+    size_t maxThreadCount
 ) {
-    return impl_->compress(image, width, height, pitch);
+    return impl_->compress(
+        image, width, height, pitch, transparentColor, maxThreadCount
+    );
 }
@@ -30,14 +30,29 @@ SOFTWARE.
 
 class PNGCompressor {
 public:
-    PNGCompressor(size_t threadCount);
+    // Implementations of the deflate compression of the image data.
+    enum class Encoder {
+        // zlib at level 1 with the run-length encoding strategy.
+        Zlib,
+        // Built-in encoder specialized for filtered screen content, matching
+        // only byte and pixel runs (see encodeScreenDeflate in png.cpp).
+        Screen
+    };
+
+    // Screen, unless RETROJSVICE_PNG_ZLIB_ENCODER is defined at build time.
+    static const Encoder DefaultEncoder;
+
+    PNGCompressor(size_t threadCount, Encoder encoder = DefaultEncoder);
     ~PNGCompressor();
 
     // Compress given image into PNG. The image data should be in a format where
     // for all 0 <= y < height and 0 <= x < width, image[4 * (y * pitch + x) + c]
     // is the value for color blue, green and red for c = 0, 1, 2, respectively.
     // The resulting compressed PNG data can be obtained by concatenating the
-    // returned chunks.
+    // returned chunks. If transparentColor is not null, it should point to
+    // three bytes (blue, green, red) specifying a color that is marked fully
+    // transparent in the PNG. At most maxThreadCount (if nonzero) of the
+    // threads given in the constructor are used.
     // 
     // This function is not safe to call from multiple threads at the same time
     // for the same PNGCompressor object.
@@ -45,7 +60,9 @@ public:
         const uint8_t* image,
         size_t width,
         size_t height,
-        size_t pitch
+        size_t pitch,
+        const uint8_t* transparentColor = nullptr,
+        size_t maxThreadCount = 0
     );
 
 private:
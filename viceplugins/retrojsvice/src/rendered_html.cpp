@@ -0,0 +1,49 @@
+#include "rendered_html.hpp"
+
+#include <zlib.h>
+
+namespace retrojsvice {
+
+namespace {
+
+// Smaller pages fit in a single TCP segment anyway.
+const size_t MinGzipSize = 1024;
+
+string gzipCompress(const string& data) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(z_stream));
+
+    // Window bits 15 + 16 selects the gzip format.
+    REQUIRE(deflateInit2(
+        &stream, 9, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY
+    ) == Z_OK);
+
+    string ret;
+    ret.resize(deflateBound(&stream, (uLong)data.size()));
+
+    stream.next_in = (Bytef*)data.data();
+    stream.avail_in = (uInt)data.size();
+    stream.next_out = (Bytef*)ret.data();
+    stream.avail_out = (uInt)ret.size();
+    REQUIRE(deflate(&stream, Z_FINISH) == Z_STREAM_END);
+
+    ret.resize(stream.total_out);
+    REQUIRE(deflateEnd(&stream) == Z_OK);
+
+    return ret;
+}
+
+}
+
+RenderedHTML::RenderedHTML(CKey, string html) {
+    html_ = move(html);
+
+    if(html_.size() >= MinGzipSize) {
+        string gzipped = gzipCompress(html_);
+        if(gzipped.size() < html_.size()) {
+            gzipped_ = move(gzipped);
+        }
+    }
+}
+
+}
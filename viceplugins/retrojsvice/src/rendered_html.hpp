@@ -0,0 +1,31 @@
+#pragma once
+
+#include "common.hpp"
+
+namespace retrojsvice {
+
+// A rendered HTML page that can be sent many times (see
+// HTTPRequest::sendHTMLResponse). Pages large enough to benefit from
+// compression are also gzip-compressed once at construction, so that the
+// compressed version can be sent to the clients that accept it without
+// compressing it again for every request.
+class RenderedHTML {
+SHARED_ONLY_CLASS(RenderedHTML);
+public:
+    RenderedHTML(CKey, string html);
+
+    const string& html() {
+        return html_;
+    }
+
+    // Returns nullptr if there is no gzip-compressed version.
+    const string* gzipped() {
+        return gzipped_ ? &*gzipped_ : nullptr;
+    }
+
+private:
+    string html_;
+    optional<string> gzipped_;
+};
+
+}
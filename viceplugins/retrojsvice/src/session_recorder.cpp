@@ -0,0 +1,364 @@
+#include "session_recorder.hpp"
+
+#include <zlib.h>
+
+namespace retrojsvice {
+
+// A trace file shared by a SessionRecording and the writer thread of the
+// SessionRecorder. The stream is only accessed by the writer thread (or after
+// it has been joined).
+struct SessionTraceFile {
+    string path;
+    ofstream stream;
+
+    // Set when writing has failed; after that, nothing is written to the
+    // file and the recording stops.
+    atomic<bool> failed;
+
+    // Must be called in the writer thread.
+    void write(const char* data, size_t size) {
+        if(failed.load(memory_order_relaxed)) {
+            return;
+        }
+        stream.write(data, size);
+        checkStream();
+    }
+
+    void checkStream() {
+        if(!failed.load(memory_order_relaxed) && !stream.good()) {
+            WARNING_LOG(
+                "Writing session trace file '", path, "' failed, stopping ",
+                "the recording"
+            );
+            failed.store(true, memory_order_relaxed);
+        }
+    }
+};
+
+namespace {
+
+// Maximum total size of the uncompressed data waiting to be written before
+// frames are dropped.
+const size_t MaxQueuedBytes = (size_t)256 << 20;
+
+void appendU32(string& out, uint32_t val) {
+    for(int i = 0; i < 4; ++i) {
+        out.push_back((char)(uint8_t)(val >> (8 * i)));
+    }
+}
+
+void appendU64(string& out, uint64_t val) {
+    for(int i = 0; i < 8; ++i) {
+        out.push_back((char)(uint8_t)(val >> (8 * i)));
+    }
+}
+
+}
+
+SessionRecording::SessionRecording(CKey, CKey,
+    shared_ptr<SessionRecorder> recorder,
+    shared_ptr<SessionTraceFile> file
+) {
+    recorder_ = recorder;
+    file_ = file;
+    startTime_ = steady_clock::now();
+    prevWidth_ = 0;
+    prevHeight_ = 0;
+}
+
+void SessionRecording::recordViewChanged() {
+    REQUIRE_API_THREAD();
+
+    if(file_->failed.load(memory_order_relaxed)) {
+        return;
+    }
+
+    string record;
+    writeHeader_(record, SessionTraceViewChanged);
+
+    shared_ptr<SessionTraceFile> file = file_;
+    recorder_->enqueue_(record.size(), false, [file, record{move(record)}]() {
+        file->write(record.data(), record.size());
+    });
+}
+
+void SessionRecording::recordEvent(string_view event) {
+    REQUIRE_API_THREAD();
+
+    if(file_->failed.load(memory_order_relaxed)) {
+        return;
+    }
+
+    string record;
+    writeHeader_(record, SessionTraceEvent);
+    appendU32(record, (uint32_t)event.size());
+    record.append(event.data(), event.size());
+
+    shared_ptr<SessionTraceFile> file = file_;
+    recorder_->enqueue_(record.size(), false, [file, record{move(record)}]() {
+        file->write(record.data(), record.size());
+    });
+}
+
+void SessionRecording::recordFrame(
+    const uint8_t* image,
+    size_t width,
+    size_t height,
+    size_t pitch
+) {
+    REQUIRE_API_THREAD();
+    REQUIRE(width && height);
+
+    if(file_->failed.load(memory_order_relaxed)) {
+        return;
+    }
+
+    auto srcPixel = [&](size_t x, size_t y) {
+        uint32_t val;
+        memcpy(&val, image + 4 * (y * pitch + x), 4);
+        return val;
+    };
+    auto prevPixel = [&](size_t x, size_t y) {
+        uint32_t val;
+        memcpy(&val, prevFrame_.data() + 4 * (y * width + x), 4);
+        return val;
+    };
+    auto rowEqual = [&](size_t y) {
+        return memcmp(
+            image + 4 * y * pitch, prevFrame_.data() + 4 * y * width, 4 * width
+        ) == 0;
+    };
+
+    // Compute the damaged rectangle [x0, x1) x [y0, y1) compared to the
+    // previous recorded frame.
+    size_t x0 = 0;
+    size_t y0 = 0;
+    size_t x1 = width;
+    size_t y1 = height;
+    if(width == prevWidth_ && height == prevHeight_) {
+        while(y0 < height && rowEqual(y0)) {
+            ++y0;
+        }
+        if(y0 == height) {
+            x0 = 0;
+            x1 = 0;
+            y0 = 0;
+            y1 = 0;
+        } else {
+            while(rowEqual(y1 - 1)) {
+                --y1;
+            }
+            x0 = width;
+            x1 = 0;
+            for(size_t y = y0; y < y1; ++y) {
+                size_t left = 0;
+                while(left < x0 && srcPixel(left, y) == prevPixel(left, y)) {
+                    ++left;
+                }
+                x0 = min(x0, left);
+                size_t right = width;
+                while(right > x1 && srcPixel(right - 1, y) == prevPixel(right - 1, y)) {
+                    --right;
+                }
+                x1 = max(x1, right);
+            }
+            REQUIRE(x0 < x1);
+        }
+    }
+
+    size_t rectWidth = x1 - x0;
+    size_t rectHeight = y1 - y0;
+    shared_ptr<vector<uint8_t>> rect =
+        make_shared<vector<uint8_t>>(4 * rectWidth * rectHeight);
+    for(size_t y = 0; y < rectHeight; ++y) {
+        memcpy(
+            rect->data() + 4 * y * rectWidth,
+            image + 4 * ((y0 + y) * pitch + x0),
+            4 * rectWidth
+        );
+    }
+
+    string header;
+    writeHeader_(header, SessionTraceFrame);
+    for(size_t val : {width, height, x0, y0, rectWidth, rectHeight}) {
+        appendU32(header, (uint32_t)val);
+    }
+
+    shared_ptr<SessionTraceFile> file = file_;
+    bool queued = recorder_->enqueue_(
+        rect->size(),
+        true,
+        [file, header{move(header)}, rect]() {
+            uLongf compressedLength = compressBound((uLong)rect->size());
+            vector<uint8_t> compressed(compressedLength);
+            REQUIRE(compress2(
+                compressed.data(),
+                &compressedLength,
+                rect->data(),
+                (uLong)rect->size(),
+                1
+            ) == Z_OK);
+
+            string lengthField;
+            appendU32(lengthField, (uint32_t)compressedLength);
+            file->write(header.data(), header.size());
+            file->write(lengthField.data(), lengthField.size());
+            file->write((const char*)compressed.data(), compressedLength);
+        }
+    );
+
+    // If the frame was dropped, the next frame is compared to the last
+    // recorded frame to keep the damaged rectangles consistent.
+    if(queued) {
+        if(width != prevWidth_ || height != prevHeight_) {
+            prevWidth_ = width;
+            prevHeight_ = height;
+            prevFrame_.resize(4 * width * height);
+        }
+        for(size_t y = 0; y < rectHeight; ++y) {
+            memcpy(
+                prevFrame_.data() + 4 * ((y0 + y) * width + x0),
+                rect->data() + 4 * y * rectWidth,
+                4 * rectWidth
+            );
+        }
+    }
+}
+
+void SessionRecording::writeHeader_(string& record, uint8_t type) {
+    record.push_back((char)type);
+    appendU64(record, (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        steady_clock::now() - startTime_
+    ).count());
+}
+
+SessionRecorder::SessionRecorder(CKey, string dirPath) {
+    dirPath_ = move(dirPath);
+    queuedBytes_ = 0;
+    shutdown_ = false;
+    droppedFrames_ = 0;
+    closed_ = false;
+}
+
+SessionRecorder::~SessionRecorder() {
+    close();
+}
+
+shared_ptr<SessionRecording> SessionRecorder::startRecording(uint64_t window) {
+    REQUIRE_API_THREAD();
+
+    int64_t timestamp = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()
+    ).count();
+    string path =
+        dirPath_ + "/window-" + toString(window) + "-" + toString(timestamp) +
+        ".rjtrace";
+
+    shared_ptr<SessionTraceFile> file = make_shared<SessionTraceFile>();
+    file->path = path;
+    file->stream.open(path, std::ios::binary | std::ios::trunc);
+    if(!file->stream.good()) {
+        WARNING_LOG("Could not open session trace file '", path, "' for writing");
+        return {};
+    }
+    file->failed.store(false, memory_order_relaxed);
+
+    shared_ptr<SessionTraceFile> magicFile = file;
+    if(!enqueue_(sizeof(SessionTraceMagic), false, [magicFile]() {
+        magicFile->write(SessionTraceMagic, sizeof(SessionTraceMagic));
+    })) {
+        return {};
+    }
+    files_.erase(
+        remove_if(
+            files_.begin(),
+            files_.end(),
+            [](const weak_ptr<SessionTraceFile>& weakFile) {
+                return weakFile.expired();
+            }
+        ),
+        files_.end()
+    );
+    files_.push_back(file);
+
+    INFO_LOG("Recording session of window ", window, " to '", path, "'");
+    return SessionRecording::create(
+        SessionRecording::CKey(), shared_from_this(), file
+    );
+}
+
+void SessionRecorder::close() {
+    if(closed_) {
+        return;
+    }
+    closed_ = true;
+
+    {
+        lock_guard<mutex> lock(mutex_);
+        shutdown_ = true;
+    }
+    cv_.notify_one();
+    writerThread_.join();
+
+    // The writer thread has finished, so the files are no longer accessed
+    // concurrently.
+    for(const weak_ptr<SessionTraceFile>& weakFile : files_) {
+        if(shared_ptr<SessionTraceFile> file = weakFile.lock()) {
+            if(!file->failed.load(memory_order_relaxed)) {
+                file->stream.flush();
+                file->checkStream();
+            }
+        }
+    }
+    files_.clear();
+
+    if(droppedFrames_) {
+        WARNING_LOG(
+            "Session recorder dropped ", droppedFrames_,
+            " frames because writing could not keep up"
+        );
+    }
+}
+
+void SessionRecorder::afterConstruct_(shared_ptr<SessionRecorder> self) {
+    // The thread does not own a reference to the recorder, as the destructor
+    // joins it.
+    writerThread_ = thread([this]() {
+        unique_lock<mutex> lock(mutex_);
+        while(true) {
+            if(!queue_.empty()) {
+                pair<size_t, function<void()>> item = move(queue_.front());
+                queue_.pop();
+
+                lock.unlock();
+                item.second();
+                lock.lock();
+
+                queuedBytes_ -= item.first;
+            } else if(shutdown_) {
+                return;
+            } else {
+                cv_.wait(lock);
+            }
+        }
+    });
+}
+
+bool SessionRecorder::enqueue_(size_t bytes, bool drop, function<void()> func) {
+    {
+        lock_guard<mutex> lock(mutex_);
+        if(shutdown_) {
+            return false;
+        }
+        if(drop && queuedBytes_ + bytes > MaxQueuedBytes) {
+            ++droppedFrames_;
+            return false;
+        }
+        queuedBytes_ += bytes;
+        queue_.emplace(bytes, move(func));
+    }
+    cv_.notify_one();
+    return true;
+}
+
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include "common.hpp"
+
+namespace retrojsvice {
+
+// Session trace file format (all integers little-endian): the 8-byte magic
+// SessionTraceMagic followed by records. Each record starts with a 1-byte type
+// and a 64-bit timestamp in microseconds since the start of the recording,
+// followed by type-specific data:
+//   SessionTraceViewChanged: no data; the program notified that the view of
+//     the window changed.
+//   SessionTraceEvent: 32-bit length followed by an input event string as
+//     received from the client (for example "MMO_10_20/").
+//   SessionTraceFrame: 32-bit frame width and height, 32-bit x, y, width and
+//     height of the damaged rectangle, 32-bit data length and the zlib-
+//     compressed BGRX pixel data of the damaged rectangle (row by row). The
+//     parts of the frame outside the damaged rectangle are equal to the
+//     previous frame; if the frame size changes, the damaged rectangle covers
+//     the whole frame.
+constexpr char SessionTraceMagic[8] = {'R', 'J', 'S', 'V', 'T', 'R', 'C', '1'};
+constexpr uint8_t SessionTraceViewChanged = 'V';
+constexpr uint8_t SessionTraceEvent = 'E';
+constexpr uint8_t SessionTraceFrame = 'F';
+
+class SessionRecorder;
+struct SessionTraceFile;
+
+// Records the session of a single window into a trace file. Should only be
+// used from the API thread; the compression and writing is done in the
+// background thread of the SessionRecorder. If writing the file fails, the
+// error is logged and the rest of the session is not recorded.
+class SessionRecording {
+SHARED_ONLY_CLASS(SessionRecording);
+public:
+    // Private constructor.
+    SessionRecording(CKey, CKey,
+        shared_ptr<SessionRecorder> recorder,
+        shared_ptr<SessionTraceFile> file
+    );
+
+    void recordViewChanged();
+    void recordEvent(string_view event);
+
+    // Records the image fetched from the program for compression (in the same
+    // format as in ImageCompressorEventHandler::onImageCompressorFetchImage).
+    void recordFrame(
+        const uint8_t* image,
+        size_t width,
+        size_t height,
+        size_t pitch
+    );
+
+private:
+    void writeHeader_(string& record, uint8_t type);
+
+    shared_ptr<SessionRecorder> recorder_;
+    shared_ptr<SessionTraceFile> file_;
+    steady_clock::time_point startTime_;
+
+    // The previous recorded frame, used to compute the damaged rectangle.
+    vector<uint8_t> prevFrame_;
+    size_t prevWidth_;
+    size_t prevHeight_;
+
+    friend class SessionRecorder;
+};
+
+// Writes the sessions of windows into trace files in a directory for offline
+// replay (see loadtest/replay.cpp). The files are written in a background
+// thread; if the writer falls behind by too much, frames are dropped. Thread
+// safe.
+class SessionRecorder : public enable_shared_from_this<SessionRecorder> {
+SHARED_ONLY_CLASS(SessionRecorder);
+public:
+    SessionRecorder(CKey, string dirPath);
+    ~SessionRecorder();
+
+    // Returns empty if the trace file could not be created.
+    shared_ptr<SessionRecording> startRecording(uint64_t window);
+
+    // Writes all the queued data and flushes the trace files. The data
+    // recorded after this is discarded. Called automatically by the destructor
+    // if not called before.
+    void close();
+
+private:
+    void afterConstruct_(shared_ptr<SessionRecorder> self);
+
+    // Queues func to be run in the writer thread. If the recorder has been
+    // closed, or if drop is true and the queue is already too large, func is
+    // not queued and false is returned.
+    bool enqueue_(size_t bytes, bool drop, function<void()> func);
+
+    string dirPath_;
+    vector<weak_ptr<SessionTraceFile>> files_;
+    bool closed_;
+
+    thread writerThread_;
+    mutex mutex_;
+    condition_variable cv_;
+    queue<pair<size_t, function<void()>>> queue_;
+    size_t queuedBytes_;
+    bool shutdown_;
+    uint64_t droppedFrames_;
+
+    friend class SessionRecording;
+};
+
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "common.hpp"
+
+namespace retrojsvice {
+
+// Move-only type-erased void() callable used for the tasks in TaskQueue.
+// Unlike function<void()>, captured state does not need to be copyable, and
+// callables of at most InlineSize bytes (such as lambdas capturing a few
+// pointers) are stored inline without a heap allocation.
+class Task {
+public:
+    static constexpr size_t InlineSize = 6 * sizeof(void*);
+
+    Task() noexcept : vtable_(nullptr) {}
+
+    template <
+        typename F,
+        typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, Task>>
+    >
+    Task(F&& func) {
+        typedef std::decay_t<F> Func;
+        if constexpr(fitsInline_<Func>()) {
+            new(storage_) Func(forward<F>(func));
+            vtable_ = &InlineVTable_<Func>;
+        } else {
+            Func* ptr = new Func(forward<F>(func));
+            memcpy(storage_, &ptr, sizeof(Func*));
+            vtable_ = &HeapVTable_<Func>;
+        }
+    }
+
+    Task(Task&& src) noexcept {
+        vtable_ = src.vtable_;
+        if(vtable_ != nullptr) {
+            vtable_->move(storage_, src.storage_);
+            src.vtable_ = nullptr;
+        }
+    }
+
+    Task& operator=(Task&& src) noexcept {
+        if(this != &src) {
+            reset_();
+            vtable_ = src.vtable_;
+            if(vtable_ != nullptr) {
+                vtable_->move(storage_, src.storage_);
+                src.vtable_ = nullptr;
+            }
+        }
+        return *this;
+    }
+
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+        reset_();
+    }
+
+    explicit operator bool() const {
+        return vtable_ != nullptr;
+    }
+
+    // Panics if the task is empty.
+    void operator()() {
+        REQUIRE(vtable_ != nullptr);
+        vtable_->call(storage_);
+    }
+
+private:
+    struct VTable {
+        void (*call)(void* storage);
+
+        // Move-constructs the callable from src into dest and destroys src.
+        void (*move)(void* dest, void* src);
+
+        void (*destroy)(void* storage);
+    };
+
+    template <typename Func>
+    static constexpr bool fitsInline_() {
+        return
+            sizeof(Func) <= InlineSize &&
+            alignof(std::max_align_t) % alignof(Func) == 0 &&
+            std::is_nothrow_move_constructible_v<Func>;
+    }
+
+    template <typename Func>
+    static constexpr VTable InlineVTable_ = {
+        [](void* storage) {
+            (*(Func*)storage)();
+        },
+        [](void* dest, void* src) {
+            new(dest) Func(move(*(Func*)src));
+            ((Func*)src)->~Func();
+        },
+        [](void* storage) {
+            ((Func*)storage)->~Func();
+        }
+    };
+
+    template <typename Func>
+    static Func* heapPtr_(void* storage) {
+        Func* ptr;
+        memcpy(&ptr, storage, sizeof(Func*));
+        return ptr;
+    }
+
+    template <typename Func>
+    static constexpr VTable HeapVTable_ = {
+        [](void* storage) {
+            (*heapPtr_<Func>(storage))();
+        },
+        [](void* dest, void* src) {
+            memcpy(dest, src, sizeof(Func*));
+        },
+        [](void* storage) {
+            delete heapPtr_<Func>(storage);
+        }
+    };
+
+    void reset_() {
+        if(vtable_ != nullptr) {
+            vtable_->destroy(storage_);
+            vtable_ = nullptr;
+        }
+    }
+
+    alignas(std::max_align_t) unsigned char storage_[InlineSize];
+    const VTable* vtable_;
+};
+
+}
@@ -14,6 +14,7 @@ TaskQueue::TaskQueue(CKey, weak_ptr<TaskQueueEventHandler> eventHandler) {
     eventHandler_ = eventHandler;
     state_ = Running;
     runTasksPending_ = false;
+    delayThreadWakeup_ = steady_clock::time_point::max();
     runningTasks_ = false;
 
     // Initialization is completed in afterConstruct_
@@ -29,7 +30,6 @@ void TaskQueue::runTasks(MCE) {
     REQUIRE(!runningTasks_);
     runningTasks_ = true;
 
-    vector<function<void()>> tasksToRun;
     steady_clock::time_point now = steady_clock::now();
     bool runDelayedTasks;
     bool shutdownPending;
@@ -37,56 +37,75 @@ void TaskQueue::runTasks(MCE) {
         lock_guard lock(mutex_);
         REQUIRE(state_ != ShutdownComplete);
 
-        runTasksPending_ = false;
+        // Tasks pushed after this will notify the event handler again, so we
+        // do not miss tasks whose push is not yet visible below.
+        runTasksPending_.store(false);
 
-        swap(tasks_, tasksToRun);
-
-        runDelayedTasks =
-            !delayedTasks_.empty() &&
-            delayedTasks_.begin()->first <= now;
+        timerWheel_.advance(now);
+        runDelayedTasks = timerWheel_.hasExpired();
 
         shutdownPending = state_ == ShutdownPending;
     }
 
-    for(function<void()>& task : tasksToRun) {
-        task();
-        task = []() {};
+    // Only run the tasks posted before this point; the tasks posted by these
+    // tasks are run on the next call.
+    size_t taskCount = tasks_.size();
+    for(size_t i = 0; i < taskCount; ++i) {
+        optional<Task> task = tasks_.pop();
+        if(!task) {
+            break;
+        }
+        (*task)();
+    }
+
+    // If there are tasks left in the queue (either posted while running the
+    // tasks or still being pushed), make sure that we are called again; the
+    // producers skip the notification if runTasksPending_ is already set,
+    // which may have happened before we cleared it.
+    if(!tasks_.empty() && !runTasksPending_.exchange(true)) {
+        needsRunTasks_();
     }
 
     if(runDelayedTasks) {
+        // The delayed tasks posted by these tasks cannot expire before the
+        // next call, as the wheel only expires them in advance.
         while(true) {
-            function<void()> task;
+            Task task;
             {
                 lock_guard lock(mutex_);
-                if(delayedTasks_.empty() || delayedTasks_.begin()->first > now) {
+                TimerWheelEntry* entry = timerWheel_.popExpired();
+                if(entry == nullptr) {
                     break;
                 }
-
-                weak_ptr<DelayedTaskTag> tagWeak;
-                tie(tagWeak, task) = delayedTasks_.begin()->second;
-                delayedTasks_.erase(delayedTasks_.begin());
-
-                shared_ptr<DelayedTaskTag> tag = tagWeak.lock();
-                REQUIRE(tag);
-                REQUIRE(tag->inQueue_);
-                tag->inQueue_ = false;
+                task = move(static_cast<DelayedTaskTag*>(entry)->task_);
             }
             task();
         }
     }
 
     bool shutdownComplete = false;
-    if(shutdownPending) {
+    bool notifyDelayThread = false;
+    {
         lock_guard lock(mutex_);
-        REQUIRE(state_ == ShutdownPending);
+        if(shutdownPending) {
+            REQUIRE(state_ == ShutdownPending);
 
-        if(tasks_.empty() && delayedTasks_.empty()) {
-            state_ = ShutdownComplete;
-            shutdownComplete = true;
+            if(tasks_.empty() && timerWheel_.size() == 0) {
+                state_ = ShutdownComplete;
+                shutdownComplete = true;
+            }
         }
+
+        // The delay thread does not track the delayed tasks while
+        // runTasksPending_ is set, so it may need to be woken up.
+        optional<steady_clock::time_point> wakeup = timerWheel_.nextWakeup();
+        notifyDelayThread =
+            shutdownComplete || (wakeup && *wakeup < delayThreadWakeup_);
     }
 
-    delayThreadCv_.notify_one();
+    if(notifyDelayThread) {
+        delayThreadCv_.notify_one();
+    }
 
     if(shutdownComplete) {
         delayThread_.join();
@@ -101,6 +120,11 @@ void TaskQueue::runTasks(MCE) {
     runningTasks_ = false;
 }
 
+size_t TaskQueue::pendingTaskCount() {
+    lock_guard lock(mutex_);
+    return tasks_.size() + timerWheel_.size();
+}
+
 void TaskQueue::shutdown() {
     REQUIRE_API_THREAD();
 
@@ -120,22 +144,27 @@ void TaskQueue::shutdown() {
 void TaskQueue::afterConstruct_(shared_ptr<TaskQueue> self) {
     delayThread_ = thread([self]() {
         unique_lock<mutex> lock(self->mutex_);
-        while(true) {
-            if(self->state_ == ShutdownComplete) {
-                break;
-            } else if(self->delayedTasks_.empty() || self->runTasksPending_) {
-                self->delayThreadCv_.wait(lock);
-            } else {
-                steady_clock::time_point now = steady_clock::now();
-                steady_clock::time_point wakeup = self->delayedTasks_.begin()->first;
-                if(wakeup <= now) {
-                    self->runTasksPending_ = true;
-                    self->needsRunTasks_();
-                    self->delayThreadCv_.wait(lock);
+        while(self->state_ != ShutdownComplete) {
+            // While runTasks is pending, it will advance the wheel itself.
+            optional<steady_clock::time_point> wakeup;
+            if(!self->runTasksPending_) {
+                self->timerWheel_.advance(steady_clock::now());
+                if(self->timerWheel_.hasExpired()) {
+                    if(!self->runTasksPending_.exchange(true)) {
+                        self->needsRunTasks_();
+                    }
                 } else {
-                    self->delayThreadCv_.wait_for(lock, wakeup - now);
+                    wakeup = self->timerWheel_.nextWakeup();
                 }
             }
+
+            if(wakeup) {
+                self->delayThreadWakeup_ = *wakeup;
+                self->delayThreadCv_.wait_until(lock, *wakeup);
+            } else {
+                self->delayThreadWakeup_ = steady_clock::time_point::max();
+                self->delayThreadCv_.wait(lock);
+            }
         }
     });
 }
@@ -162,78 +191,102 @@ ActiveTaskQueueLock::~ActiveTaskQueueLock() {
     activeTaskQueue.reset();
 }
 
-void postTask(function<void()> func) {
+void postTask(Task task) {
     REQUIRE(activeTaskQueue);
-
-    lock_guard lock(activeTaskQueue->mutex_);
     REQUIRE(activeTaskQueue->state_ != TaskQueue::ShutdownComplete);
 
-    activeTaskQueue->tasks_.push_back(func);
+    activeTaskQueue->tasks_.push(move(task));
 
-    if(!activeTaskQueue->runTasksPending_) {
-        activeTaskQueue->runTasksPending_ = true;
+    // runTasks only completes the shutdown if it sees the queue empty, so if
+    // the push raced with the shutdown completion, we catch it here.
+    REQUIRE(activeTaskQueue->state_ != TaskQueue::ShutdownComplete);
+
+    // Avoid the read-modify-write in the common case where the notification
+    // is already pending. If the load sees a stale true value that runTasks
+    // has just cleared, runTasks sees our task in the queue (push and the
+    // checks are sequentially consistent) and notifies itself.
+    if(
+        !activeTaskQueue->runTasksPending_.load() &&
+        !activeTaskQueue->runTasksPending_.exchange(true)
+    ) {
         activeTaskQueue->needsRunTasks_();
     }
 }
 
+void TaskQueue::scheduleDelayedTask_(
+    DelayedTaskTag* tag,
+    steady_clock::time_point time
+) {
+    REQUIRE(state_ != ShutdownComplete);
+
+    timerWheel_.insert(tag, time);
+
+    // Only wake up the delay thread if it would otherwise sleep past the new
+    // task; rescheduling a timeout to a later time is the common case.
+    if(time < delayThreadWakeup_) {
+        delayThreadWakeup_ = time;
+        delayThreadCv_.notify_one();
+    }
+}
+
 DelayedTaskTag::DelayedTaskTag(CKey, CKey) {}
 
 DelayedTaskTag::~DelayedTaskTag() {
-    {
-        lock_guard lock(taskQueue_->mutex_);
-        if(inQueue_) {
-            REQUIRE(taskQueue_->state_ != TaskQueue::ShutdownComplete);
-            taskQueue_->delayedTasks_.erase(iter_);
-        }
+    // Waking up the delay thread is not necessary, as it just finds nothing
+    // to do when it wakes up for a removed task.
+    lock_guard lock(taskQueue_->mutex_);
+    if(scheduled()) {
+        REQUIRE(taskQueue_->state_ != TaskQueue::ShutdownComplete);
+        taskQueue_->timerWheel_.remove(this);
     }
-    taskQueue_->delayThreadCv_.notify_one();
 }
 
 void DelayedTaskTag::expedite() {
     REQUIRE_API_THREAD();
 
-    function<void()> func = []() {};
-
+    Task task;
     {
         lock_guard lock(taskQueue_->mutex_);
-        if(inQueue_) {
+        if(scheduled()) {
             REQUIRE(taskQueue_->state_ != TaskQueue::ShutdownComplete);
-            func = iter_->second.second;
-            taskQueue_->delayedTasks_.erase(iter_);
-            inQueue_ = false;
+            taskQueue_->timerWheel_.remove(this);
+            task = move(task_);
         }
     }
-    taskQueue_->delayThreadCv_.notify_one();
 
-    func();
+    if(task) {
+        task();
+    }
+}
+
+bool DelayedTaskTag::reschedule(steady_clock::duration delay) {
+    REQUIRE_API_THREAD();
+
+    steady_clock::time_point time = steady_clock::now() + delay;
+
+    lock_guard lock(taskQueue_->mutex_);
+    if(!scheduled()) {
+        return false;
+    }
+    taskQueue_->timerWheel_.remove(this);
+    taskQueue_->scheduleDelayedTask_(this, time);
+    return true;
 }
 
 shared_ptr<DelayedTaskTag> postDelayedTask(
     steady_clock::duration delay,
-    function<void()> func
+    Task task
 ) {
     REQUIRE(activeTaskQueue);
 
     steady_clock::time_point time = steady_clock::now() + delay;
 
-    shared_ptr<DelayedTaskTag> tag;
-    {
-        lock_guard lock(activeTaskQueue->mutex_);
-        REQUIRE(activeTaskQueue->state_ != TaskQueue::ShutdownComplete);
-
-        tag = DelayedTaskTag::create(DelayedTaskTag::CKey());
-
-        auto iter = activeTaskQueue->delayedTasks_.emplace(
-            time,
-            pair<weak_ptr<DelayedTaskTag>, function<void()>>(tag, func)
-        );
+    shared_ptr<DelayedTaskTag> tag = DelayedTaskTag::create(DelayedTaskTag::CKey());
+    tag->taskQueue_ = activeTaskQueue;
+    tag->task_ = move(task);
 
-        tag->taskQueue_ = activeTaskQueue;
-        tag->inQueue_ = true;
-        tag->iter_ = iter;
-    }
-
-    activeTaskQueue->delayThreadCv_.notify_one();
+    lock_guard lock(activeTaskQueue->mutex_);
+    activeTaskQueue->scheduleDelayedTask_(tag.get(), time);
 
     return tag;
 }
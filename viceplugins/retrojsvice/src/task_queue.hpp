@@ -1,6 +1,8 @@
 #pragma once
 
-#include "common.hpp"
+#include "mpsc_queue.hpp"
+#include "task.hpp"
+#include "timer_wheel.hpp"
 
 namespace retrojsvice {
 
@@ -34,6 +36,10 @@ class DelayedTaskTag;
 //
 // Before destruction, the task queue must be shut down by calling shutdown and
 // waiting for the onTaskQueueShutdownComplete event (called by runTasks).
+//
+// Posting a task with postTask is lock-free, as it is done concurrently from
+// the HTTP server threads, compressor threads and the API thread; the mutex is
+// only used for the delayed tasks, which are kept in a TimerWheel.
 class TaskQueue {
 SHARED_ONLY_CLASS(TaskQueue);
 public:
@@ -52,6 +58,10 @@ public:
     // panic.
     void shutdown();
 
+    // Returns the number of tasks (including delayed tasks) currently waiting
+    // in the queue. May be called from any thread.
+    size_t pendingTaskCount();
+
     // Returns the active task queue for the current thread; panics if there is
     // none.
     static shared_ptr<TaskQueue> getActiveQueue();
@@ -61,27 +71,38 @@ private:
 
     void needsRunTasks_();
 
+    // Must be called with mutex_ locked.
+    void scheduleDelayedTask_(DelayedTaskTag* tag, steady_clock::time_point time);
+
     weak_ptr<TaskQueueEventHandler> eventHandler_;
 
+    enum State {Running, ShutdownPending, ShutdownComplete};
+    atomic<State> state_;
+
+    // Set when the event handler has been notified that runTasks needs to be
+    // called; cleared by runTasks (while holding mutex_) before running the
+    // tasks.
+    atomic<bool> runTasksPending_;
+
+    MPSCQueue<Task> tasks_;
+
     mutex mutex_;
-    enum {Running, ShutdownPending, ShutdownComplete} state_;
-    bool runTasksPending_;
-    vector<function<void()>> tasks_;
-    multimap<
-        steady_clock::time_point,
-        pair<weak_ptr<DelayedTaskTag>, function<void()>>
-    > delayedTasks_;
+    TimerWheel timerWheel_;
 
     thread delayThread_;
     condition_variable delayThreadCv_;
 
+    // The time until which the delay thread is sleeping (max if it sleeps
+    // until notified); protected by mutex_.
+    steady_clock::time_point delayThreadWakeup_;
+
     bool runningTasks_;
 
-    friend void postTask(function<void()> func);
+    friend void postTask(Task task);
     friend class DelayedTaskTag;
     friend shared_ptr<DelayedTaskTag> postDelayedTask(
         steady_clock::duration delay,
-        function<void()> func
+        Task task
     );
 };
 
@@ -96,7 +117,9 @@ public:
     DISABLE_COPY_MOVE(ActiveTaskQueueLock);
 };
 
-void postTask(function<void()> func);
+// Posts a task to be run in the API thread; the task may be any move-only
+// callable (see Task).
+void postTask(Task task);
 
 template <typename T, typename... Args>
 void postTask(shared_ptr<T> ptr, void (T::*func)(Args...), Args... args) {
@@ -116,7 +139,7 @@ void postTask(weak_ptr<T> weakPtr, void (T::*func)(Args...), Args... args) {
 
 // Object returned by postDelayedTask. If the object is destructed and the delay
 // for the task has not yet been reached, the task will be cancelled.
-class DelayedTaskTag {
+class DelayedTaskTag : private TimerWheelEntry {
 SHARED_ONLY_CLASS(DelayedTaskTag);
 public:
     // Private constructor
@@ -128,24 +151,26 @@ public:
     // immediately. Should only be run from the API thread.
     void expedite();
 
+    // If the task is still pending, change it to be run after given delay from
+    // now and return true; otherwise, return false. This is cheaper than
+    // replacing the tag with a new one. Should only be run from the API
+    // thread.
+    bool reschedule(steady_clock::duration delay);
+
 private:
     shared_ptr<TaskQueue> taskQueue_;
-    bool inQueue_;
-    multimap<
-        steady_clock::time_point,
-        pair<weak_ptr<DelayedTaskTag>, function<void()>>
-    >::iterator iter_;
+    Task task_;
 
     friend class TaskQueue;
     friend shared_ptr<DelayedTaskTag> postDelayedTask(
         steady_clock::duration delay,
-        function<void()> func
+        Task task
     );
 };
 
 shared_ptr<DelayedTaskTag> postDelayedTask(
     steady_clock::duration delay,
-    function<void()> func
+    Task task
 );
 
 template <typename T, typename... Args>
@@ -0,0 +1,141 @@
+#include "tile_activity.hpp"
+
+#include <cmath>
+
+namespace retrojsvice {
+
+namespace {
+
+// Time constant of the exponential decay of the change rates.
+const double RateTimeConstantSeconds = 1.0;
+
+// A tile becomes a video tile when its change rate has stayed at least
+// EnterVideoRate for EnterVideoSeconds, and stops being one when the rate drops
+// below LeaveVideoRate. Requiring the rate to persist keeps short bursts of
+// activity (such as fast typing in a tile that also scrolls) from turning the
+// tile into video.
+const float EnterVideoRate = 6.0f;
+const float EnterVideoSeconds = 1.0f;
+const float LeaveVideoRate = 3.0f;
+
+// A change of a tile is counted only if at least this fraction of its pixels
+// changed. A typed character or a caret changes only a small part of a tile,
+// while a video frame typically changes most of it.
+const size_t MinChangedPixelsDivisor = 4;
+
+}
+
+TileActivity::TileActivity() {
+    width_ = 0;
+    height_ = 0;
+    tilesX_ = 0;
+    tilesY_ = 0;
+    videoTileCount_ = 0;
+}
+
+void TileActivity::update(
+    const vector<uint8_t>& image,
+    size_t width,
+    size_t height,
+    steady_clock::time_point time
+) {
+    REQUIRE(image.size() == 4 * width * height);
+
+    if(width != width_ || height != height_ || prevImage_.empty()) {
+        width_ = width;
+        height_ = height;
+        tilesX_ = (width + TileSize - 1) / TileSize;
+        tilesY_ = (height + TileSize - 1) / TileSize;
+        rates_.assign(tilesX_ * tilesY_, 0.0f);
+        highRateSeconds_.assign(tilesX_ * tilesY_, 0.0f);
+        video_.assign(tilesX_ * tilesY_, 0);
+        videoTileCount_ = 0;
+        prevImage_ = image;
+        prevTime_ = time;
+        return;
+    }
+
+    double elapsed = max(
+        std::chrono::duration<double>(time - prevTime_).count(), 0.0
+    );
+    float decay = (float)std::exp(-elapsed / RateTimeConstantSeconds);
+    prevTime_ = time;
+
+    videoTileCount_ = 0;
+    for(size_t tileY = 0; tileY < tilesY_; ++tileY) {
+        for(size_t tileX = 0; tileX < tilesX_; ++tileX) {
+            size_t idx = tileY * tilesX_ + tileX;
+            float& rate = rates_[idx];
+            rate *= decay;
+            if(tileChanged_(image, tileX, tileY)) {
+                rate += 1.0f;
+            }
+
+            float& highRateSeconds = highRateSeconds_[idx];
+            if(rate >= EnterVideoRate) {
+                highRateSeconds += (float)elapsed;
+            } else {
+                highRateSeconds = 0.0f;
+            }
+
+            if(video_[idx]) {
+                video_[idx] = rate >= LeaveVideoRate;
+            } else {
+                video_[idx] = highRateSeconds >= EnterVideoSeconds;
+            }
+            videoTileCount_ += video_[idx];
+        }
+    }
+
+    prevImage_ = image;
+}
+
+size_t TileActivity::tilesX() const {
+    return tilesX_;
+}
+
+size_t TileActivity::tilesY() const {
+    return tilesY_;
+}
+
+bool TileActivity::isVideoTile(size_t tileX, size_t tileY) const {
+    REQUIRE(tileX < tilesX_ && tileY < tilesY_);
+    return (bool)video_[tileY * tilesX_ + tileX];
+}
+
+bool TileActivity::hasVideoTiles() const {
+    return videoTileCount_ != 0;
+}
+
+bool TileActivity::tileChanged_(
+    const vector<uint8_t>& image,
+    size_t tileX,
+    size_t tileY
+) {
+    size_t startX = tileX * TileSize;
+    size_t endX = min(startX + TileSize, width_);
+    size_t startY = tileY * TileSize;
+    size_t endY = min(startY + TileSize, height_);
+
+    size_t minChangedPixels =
+        max((endX - startX) * (endY - startY) / MinChangedPixelsDivisor, (size_t)1);
+    size_t changedPixels = 0;
+    for(size_t y = startY; y < endY; ++y) {
+        size_t offset = 4 * (y * width_ + startX);
+        size_t rowBytes = 4 * (endX - startX);
+        if(!memcmp(&image[offset], &prevImage_[offset], rowBytes)) {
+            continue;
+        }
+        for(size_t i = 0; i < rowBytes; i += 4) {
+            if(memcmp(&image[offset + i], &prevImage_[offset + i], 4)) {
+                ++changedPixels;
+            }
+        }
+        if(changedPixels >= minChangedPixels) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
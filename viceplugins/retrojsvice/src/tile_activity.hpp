@@ -0,0 +1,60 @@
+#pragma once
+
+#include "common.hpp"
+
+namespace retrojsvice {
+
+// Tracks how often each tile of a sequence of images changes over time, and
+// classifies the tiles that keep changing at a high rate (such as the area of
+// a playing video) as video tiles. Only changes that cover a significant part
+// of the tile are counted, so that small changes such as typed characters and
+// blinking carets do not turn text into video. The images are in the format
+// used by ImageCompressor with pitch equal to width. Not thread-safe.
+class TileActivity {
+public:
+    // Multiple of the 16x16 block size of JPEG (with chroma subsampling), so
+    // that JPEG blocks never cross tile boundaries.
+    static constexpr size_t TileSize = 32;
+
+    TileActivity();
+
+    DISABLE_COPY_MOVE(TileActivity);
+
+    // Compares the image to the image given in the previous call, updates the
+    // change rates of the tiles and reclassifies them. If the size of the
+    // image differs from the previous one, the state is reset.
+    void update(
+        const vector<uint8_t>& image,
+        size_t width,
+        size_t height,
+        steady_clock::time_point time
+    );
+
+    size_t tilesX() const;
+    size_t tilesY() const;
+
+    bool isVideoTile(size_t tileX, size_t tileY) const;
+    bool hasVideoTiles() const;
+
+private:
+    bool tileChanged_(const vector<uint8_t>& image, size_t tileX, size_t tileY);
+
+    vector<uint8_t> prevImage_;
+    size_t width_;
+    size_t height_;
+    size_t tilesX_;
+    size_t tilesY_;
+    steady_clock::time_point prevTime_;
+
+    // For each tile, the number of changes weighted by exp(-age / tau), which
+    // approximates the number of changes per tau.
+    vector<float> rates_;
+
+    // For each tile, the time in seconds for which its rate has continuously
+    // been high enough for the tile to become a video tile.
+    vector<float> highRateSeconds_;
+    vector<uint8_t> video_;
+    size_t videoTileCount_;
+};
+
+}
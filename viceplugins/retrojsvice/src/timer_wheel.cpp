@@ -0,0 +1,235 @@
+#include "timer_wheel.hpp"
+
+namespace retrojsvice {
+
+namespace {
+
+const steady_clock::duration TickDuration = milliseconds(1);
+
+int lowestBit(uint64_t val) {
+    REQUIRE(val != 0);
+    return __builtin_ctzll(val);
+}
+
+}
+
+TimerWheelEntry::TimerWheelEntry() {
+    prev_ = nullptr;
+    next_ = nullptr;
+    expiry_ = 0;
+    slot_ = 0;
+}
+
+TimerWheelEntry::~TimerWheelEntry() {
+    REQUIRE(!scheduled());
+}
+
+TimerWheel::TimerWheel() {
+    startTime_ = steady_clock::now();
+    nextTick_ = 0;
+    for(TimerWheelEntry& sentinel : slots_) {
+        sentinel.prev_ = &sentinel;
+        sentinel.next_ = &sentinel;
+    }
+    for(uint64_t& bits : occupied_) {
+        bits = 0;
+    }
+    expired_.prev_ = &expired_;
+    expired_.next_ = &expired_;
+    size_ = 0;
+}
+
+TimerWheel::~TimerWheel() {
+    REQUIRE(size_ == 0);
+
+    // Unlink the sentinels so that the TimerWheelEntry destructors pass.
+    for(TimerWheelEntry& sentinel : slots_) {
+        sentinel.prev_ = nullptr;
+        sentinel.next_ = nullptr;
+    }
+    expired_.prev_ = nullptr;
+    expired_.next_ = nullptr;
+}
+
+void TimerWheel::insert(TimerWheelEntry* entry, steady_clock::time_point time) {
+    REQUIRE(entry != nullptr && !entry->scheduled());
+
+    entry->expiry_ = max(timeToTickCeil_(time), nextTick_);
+    place_(entry);
+    ++size_;
+}
+
+void TimerWheel::remove(TimerWheelEntry* entry) {
+    REQUIRE(entry != nullptr && entry->scheduled());
+
+    unlink_(entry);
+    --size_;
+}
+
+void TimerWheel::advance(steady_clock::time_point now) {
+    uint64_t nowTick = timeToTickFloor_(now);
+    while(nextTick_ <= nowTick) {
+        optional<uint64_t> tick = nextEventTick_();
+        if(!tick || *tick > nowTick) {
+            nextTick_ = nowTick + 1;
+            break;
+        }
+        processTick_(*tick);
+        nextTick_ = *tick + 1;
+    }
+}
+
+TimerWheelEntry* TimerWheel::popExpired() {
+    if(!hasExpired()) {
+        return nullptr;
+    }
+    TimerWheelEntry* entry = expired_.next_;
+    remove(entry);
+    return entry;
+}
+
+bool TimerWheel::hasExpired() {
+    return expired_.next_ != &expired_;
+}
+
+optional<steady_clock::time_point> TimerWheel::nextWakeup() {
+    if(optional<uint64_t> tick = nextEventTick_()) {
+        return tickToTime_(*tick);
+    } else {
+        return {};
+    }
+}
+
+size_t TimerWheel::size() {
+    return size_;
+}
+
+uint64_t TimerWheel::timeToTickCeil_(steady_clock::time_point time) {
+    if(time <= startTime_) {
+        return 0;
+    }
+    steady_clock::duration offset = time - startTime_;
+    return (uint64_t)((offset + TickDuration - steady_clock::duration(1)) / TickDuration);
+}
+
+uint64_t TimerWheel::timeToTickFloor_(steady_clock::time_point time) {
+    if(time <= startTime_) {
+        return 0;
+    }
+    return (uint64_t)((time - startTime_) / TickDuration);
+}
+
+steady_clock::time_point TimerWheel::tickToTime_(uint64_t tick) {
+    return startTime_ + (int64_t)tick * TickDuration;
+}
+
+void TimerWheel::place_(TimerWheelEntry* entry) {
+    REQUIRE(entry->expiry_ >= nextTick_);
+
+    // The entry is placed to the lowest level whose slots (starting from
+    // nextTick_) cover the expiry. At the top level, entries too far in the
+    // future are placed to the last slot reached, and they are placed again
+    // when the slot is redistributed.
+    uint64_t delta = entry->expiry_ - nextTick_;
+    int level = 0;
+    while(
+        level < Levels - 1 &&
+        delta >= ((uint64_t)1 << (SlotBits * (level + 1)))
+    ) {
+        ++level;
+    }
+
+    uint64_t expiry = entry->expiry_;
+    uint64_t maxDelta = ((uint64_t)1 << (SlotBits * Levels)) - 1;
+    if(delta > maxDelta) {
+        expiry = nextTick_ + maxDelta;
+    }
+
+    int idx = (int)((expiry >> (SlotBits * level)) & (SlotCount - 1));
+    link_(entry, level * SlotCount + idx);
+}
+
+void TimerWheel::link_(TimerWheelEntry* entry, int slot) {
+    TimerWheelEntry* sentinel;
+    if(slot == ExpiredSlot) {
+        sentinel = &expired_;
+    } else {
+        sentinel = &slots_[slot];
+        occupied_[slot / SlotCount] |= (uint64_t)1 << (slot % SlotCount);
+    }
+
+    entry->slot_ = slot;
+    entry->prev_ = sentinel->prev_;
+    entry->next_ = sentinel;
+    sentinel->prev_->next_ = entry;
+    sentinel->prev_ = entry;
+}
+
+void TimerWheel::unlink_(TimerWheelEntry* entry) {
+    entry->prev_->next_ = entry->next_;
+    entry->next_->prev_ = entry->prev_;
+    entry->prev_ = nullptr;
+    entry->next_ = nullptr;
+
+    int slot = entry->slot_;
+    if(slot != ExpiredSlot) {
+        TimerWheelEntry& sentinel = slots_[slot];
+        if(sentinel.next_ == &sentinel) {
+            occupied_[slot / SlotCount] &= ~((uint64_t)1 << (slot % SlotCount));
+        }
+    }
+}
+
+optional<uint64_t> TimerWheel::nextEventTick_() {
+    optional<uint64_t> ret;
+    for(int level = 0; level < Levels; ++level) {
+        // Slot i of this level is processed at the ticks t where the bits of t
+        // below the level are zero and the bits of the level equal i.
+        int shift = SlotBits * level;
+        uint64_t period = (uint64_t)1 << (shift + SlotBits);
+        uint64_t base = nextTick_ & ~(period - 1);
+        uint64_t bits = occupied_[level];
+        while(bits != 0) {
+            int idx = lowestBit(bits);
+            bits &= bits - 1;
+
+            uint64_t tick = base + ((uint64_t)idx << shift);
+            if(tick < nextTick_) {
+                tick += period;
+            }
+            if(!ret || tick < *ret) {
+                ret = tick;
+            }
+        }
+    }
+    return ret;
+}
+
+void TimerWheel::processTick_(uint64_t tick) {
+    // Placement is done relative to the tick being processed.
+    nextTick_ = tick;
+
+    for(int level = 1; level < Levels; ++level) {
+        int shift = SlotBits * level;
+        if((tick & (((uint64_t)1 << shift) - 1)) != 0) {
+            break;
+        }
+        int slot = level * SlotCount + (int)((tick >> shift) & (SlotCount - 1));
+        TimerWheelEntry& sentinel = slots_[slot];
+        while(sentinel.next_ != &sentinel) {
+            TimerWheelEntry* entry = sentinel.next_;
+            unlink_(entry);
+            place_(entry);
+        }
+    }
+
+    TimerWheelEntry& sentinel = slots_[(int)(tick & (SlotCount - 1))];
+    while(sentinel.next_ != &sentinel) {
+        TimerWheelEntry* entry = sentinel.next_;
+        REQUIRE(entry->expiry_ == tick);
+        unlink_(entry);
+        link_(entry, ExpiredSlot);
+    }
+}
+
+}
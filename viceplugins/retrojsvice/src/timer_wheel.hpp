@@ -0,0 +1,122 @@
+#pragma once
+
+#include "common.hpp"
+
+namespace retrojsvice {
+
+class TimerWheel;
+
+// Base class for the objects scheduled in a TimerWheel. The entry is linked
+// into the wheel intrusively, so scheduling, cancelling and rescheduling an
+// entry do not allocate memory.
+class TimerWheelEntry {
+public:
+    TimerWheelEntry();
+
+    // The entry must not be scheduled in a wheel when destructed.
+    ~TimerWheelEntry();
+
+    DISABLE_COPY_MOVE(TimerWheelEntry);
+
+    // Returns true if the entry is scheduled in a wheel (including the entries
+    // that have expired but have not yet been popped).
+    bool scheduled() const {
+        return next_ != nullptr;
+    }
+
+private:
+    TimerWheelEntry* prev_;
+    TimerWheelEntry* next_;
+    uint64_t expiry_;
+    int slot_;
+
+    friend class TimerWheel;
+};
+
+// Hierarchical timer wheel with millisecond ticks: Levels levels of 64 slots,
+// where the slots of level L each cover 64^L ticks. Inserting and removing
+// entries takes constant time; when the time advances, the entries of a
+// higher level slot are redistributed to lower levels once the slot is
+// reached. The wheel is not thread-safe.
+class TimerWheel {
+public:
+    TimerWheel();
+
+    // The wheel must be empty when destructed.
+    ~TimerWheel();
+
+    DISABLE_COPY_MOVE(TimerWheel);
+
+    // Schedules the entry to expire at given time (rounded up to the next
+    // tick). Even if the time has already passed, the entry only expires in
+    // the next call to advance, so that an entry inserted while processing
+    // the expired entries is not processed in the same round. The entry must
+    // not already be scheduled.
+    void insert(TimerWheelEntry* entry, steady_clock::time_point time);
+
+    // Unschedules a scheduled entry.
+    void remove(TimerWheelEntry* entry);
+
+    // Advances the wheel to given time, moving the entries whose time has been
+    // reached to the list of expired entries.
+    void advance(steady_clock::time_point now);
+
+    // Removes and returns the first expired entry, or returns nullptr if there
+    // are no expired entries.
+    TimerWheelEntry* popExpired();
+
+    bool hasExpired();
+
+    // Returns the time when advance should be called next to make progress,
+    // or an empty value if there are no entries that have not expired. The
+    // returned time may be earlier than the time of the next expiry, as the
+    // entries in the higher levels need to be redistributed.
+    optional<steady_clock::time_point> nextWakeup();
+
+    // Number of scheduled entries (including expired entries).
+    size_t size();
+
+private:
+    static constexpr int SlotBits = 6;
+    static constexpr int SlotCount = 1 << SlotBits;
+    static constexpr int Levels = 4;
+    static constexpr int ExpiredSlot = -1;
+
+    // Convert a time to a tick, rounding up (for expiry times) or down (for
+    // the current time), so that the entries never expire early.
+    uint64_t timeToTickCeil_(steady_clock::time_point time);
+    uint64_t timeToTickFloor_(steady_clock::time_point time);
+    steady_clock::time_point tickToTime_(uint64_t tick);
+
+    // Links the entry to the slot matching its expiry tick.
+    void place_(TimerWheelEntry* entry);
+    void link_(TimerWheelEntry* entry, int slot);
+    void unlink_(TimerWheelEntry* entry);
+
+    // Returns the next tick at or after nextTick_ at which a nonempty slot is
+    // processed, or an empty value if all the slots are empty.
+    optional<uint64_t> nextEventTick_();
+
+    // Processes the given tick: redistributes the higher level slots reached
+    // at the tick and expires the entries of the level 0 slot.
+    void processTick_(uint64_t tick);
+
+    steady_clock::time_point startTime_;
+
+    // The next tick that has not been processed yet.
+    uint64_t nextTick_;
+
+    // Sentinels of the circular doubly linked lists of the slots; slot
+    // L * SlotCount + i is the slot i of level L.
+    TimerWheelEntry slots_[Levels * SlotCount];
+
+    // Bit i of occupied_[L] is set if slot i of level L is nonempty.
+    uint64_t occupied_[Levels];
+
+    // Sentinel of the list of expired entries in the order of expiry.
+    TimerWheelEntry expired_;
+
+    size_t size_;
+};
+
+}
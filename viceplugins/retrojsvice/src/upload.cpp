@@ -70,39 +70,38 @@ void unlinkFile(const PathStr& path) {
 
 }
 
+// Represents a content of the storage that is in use; the FileUploads with
+// the same content share the Impl.
 class FileUpload::Impl {
 SHARED_ONLY_CLASS(Impl);
 public:
     Impl(
         CKey,
         shared_ptr<UploadStorage> storage,
-        string name,
-        PathStr path,
-        string hash
+        string hash,
+        PathStr path
     ) {
         storage_ = storage;
-        name_ = move(name);
-        path_ = move(path);
         hash_ = move(hash);
+        path_ = move(path);
     }
 
     // The shared_ptr must expire when storage_->mutex_ is locked.
     ~Impl() {
-        REQUIRE(storage_->files_.erase(hash_));
-        unlinkFile(path_);
+        storage_->release_(hash_);
     }
 
 private:
     shared_ptr<UploadStorage> storage_;
-    string name_;
-    PathStr path_;
     string hash_;
+    PathStr path_;
 
     friend class FileUpload;
 };
 
-FileUpload::FileUpload(CKey, shared_ptr<Impl> impl) {
+FileUpload::FileUpload(CKey, shared_ptr<Impl> impl, string name) {
     impl_ = impl;
+    name_ = move(name);
 }
 
 FileUpload::~FileUpload() {
@@ -116,102 +115,467 @@ const PathStr& FileUpload::path() {
 }
 
 const string& FileUpload::name() {
-    return impl_->name_;
+    return name_;
 }
 
-UploadStorage::UploadStorage(CKey) {
+UploadStorage::UploadStorage(CKey,
+    size_t maxUnusedFileCount,
+    uint64_t maxUnusedTotalSize
+) {
+    maxUnusedFileCount_ = maxUnusedFileCount;
+    maxUnusedTotalSize_ = maxUnusedTotalSize;
     tempDir_ = TempDir::create();
     nextIdx_.store((uint64_t)1, memory_order_relaxed);
+    unusedSize_ = 0;
 }
 
 UploadStorage::~UploadStorage() {
-    REQUIRE(files_.empty());
+    // The contents hold a pointer to the storage while they are in use.
+    REQUIRE(lru_.size() == contents_.size());
+
+    for(const pair<const string, Content>& elem : contents_) {
+        unlinkFile(elem.second.path);
+    }
 }
 
-shared_ptr<FileUpload> UploadStorage::upload(
-    string name,
-    istream& dataStream
-) {
-    uint64_t idx = nextIdx_.fetch_add(1, memory_order_relaxed);
+namespace {
 
-    PathStr path = tempDir_->path() + PathSep + toPathStr(idx);
+// Size of each of the two buffers of UploadWriter.
+const size_t UploadBufSize = 4 << 20;
+const size_t UploadBufAlign = 4096;
+
+// The storage is searched for a matching file using a hash of the first
+// HeadBlockSize bytes of the upload (or the whole upload if it is shorter).
+const size_t HeadBlockSize = 1 << 16;
+
+// Block size used when comparing the upload to a candidate file.
+const size_t CompareBlockSize = 1 << 16;
+
+char* allocateUploadBuf() {
+    return (char*)::operator new(UploadBufSize, std::align_val_t(UploadBufAlign));
+}
+
+void freeUploadBuf(char* buf) {
+    ::operator delete(buf, std::align_val_t(UploadBufAlign));
+}
+
+uint64_t computeHeadHash(const char* data, size_t size) {
+    return (uint64_t)std::hash<string_view>()(
+        string_view(data, min(size, HeadBlockSize))
+    );
+}
+
+}
+
+class UploadWriter::Impl {
+public:
+    Impl(shared_ptr<UploadStorage> storage, string name, PathStr path) {
+        storage_ = storage;
+        name_ = move(name);
+        path_ = move(path);
+        finished_ = false;
+
+        mode_ = Head;
+        size_ = 0;
+        headHash_ = computeHeadHash(nullptr, 0);
+        matched_ = 0;
+        ok_ = true;
+        SHA256_Init(&hasher_);
+
+        fillBuf_ = allocateUploadBuf();
+        fillSize_ = 0;
+        workBuf_ = allocateUploadBuf();
+        workSize_ = 0;
+        workPending_ = false;
+        threadStopping_ = false;
+    }
 
-    ofstream fp;
-    fp.open(path, ofstream::binary);
-    REQUIRE(fp.good());
-
-    SHA256_CTX hasher;
-    SHA256_Init(&hasher);
-
-    bool ok = true;
-    try {
-        const size_t BufSize = 1 << 16;
-        char buf[BufSize];
-        while(!dataStream.eof()) {
-            dataStream.read(buf, BufSize);
-            if(
-                dataStream.bad() ||
-                (dataStream.fail() != dataStream.eof())
-            ) {
-                WARNING_LOG("Reading file upload stream failed");
-                ok = false;
+    ~Impl() {
+        stopThread_();
+        if(!finished_ && mode_ == Write) {
+            fp_.close();
+            unlinkFile(path_);
+        }
+        freeUploadBuf(fillBuf_);
+        freeUploadBuf(workBuf_);
+    }
+
+    DISABLE_COPY_MOVE(Impl);
+
+    void write(const char* data, size_t size) {
+        REQUIRE(!finished_);
+
+        while(size) {
+            size_t count = min(size, UploadBufSize - fillSize_);
+            memcpy(fillBuf_ + fillSize_, data, count);
+            fillSize_ += count;
+            data += count;
+            size -= count;
+
+            if(fillSize_ == UploadBufSize) {
+                handOff_();
+            }
+        }
+    }
+
+    shared_ptr<FileUpload> finish() {
+        REQUIRE(!finished_);
+
+        // The background thread is not needed for the last buffer, as we
+        // would just wait for it.
+        stopThread_();
+        process_(fillBuf_, fillSize_);
+        fillSize_ = 0;
+        finished_ = true;
+
+        if(mode_ == Compare) {
+            if(candidateFp_.peek() == ifstream::traits_type::eof()) {
+                // The whole upload matched the candidate, so no file was
+                // written.
+                INFO_LOG(
+                    "Upload of ", size_, " bytes matched an existing file, "
+                    "skipped writing it"
+                );
+                candidateFp_.close();
+                shared_ptr<FileUpload> ret = move(candidate_);
+                return ret;
+            }
+            diverge_();
+        }
+        if(mode_ == Head) {
+            // Empty upload.
+            startWriting_();
+        }
+
+        unsigned char hashBin[SHA256_DIGEST_LENGTH];
+        SHA256_Final(hashBin, &hasher_);
+
+        fp_.close();
+        if(!ok_ || !fp_.good()) {
+            WARNING_LOG("Writing file upload ", path_, " failed");
+            unlinkFile(path_);
+            shared_ptr<FileUpload> empty;
+            return empty;
+        }
+
+        string hash;
+        for(size_t i = 0; i < SHA256_DIGEST_LENGTH; ++i) {
+            int byte = (int)hashBin[i];
+            for(int nibble : {byte >> 4, byte & 15}) {
+                hash.push_back(nibble < 10 ? (char)('0' + nibble) : (char)('a' + (nibble - 10)));
+            }
+        }
+
+        return storage_->addFile_(
+            move(name_), move(path_), move(hash), size_, headHash_
+        );
+    }
+
+private:
+    // Head: the first buffer has not been processed yet.
+    // Compare: the data so far (matched_ bytes) matches candidate_, and
+    //          nothing has been written.
+    // Write: the data is written to path_.
+    enum Mode {Head, Compare, Write};
+
+    // Hashes a buffer and writes it or compares it to the candidate; called
+    // in the background thread, or in the calling thread when the background
+    // thread is not running. The first call gets the beginning of the upload
+    // of at least HeadBlockSize bytes (unless the upload is shorter), as
+    // only full buffers are handed off.
+    void process_(const char* data, size_t size) {
+        if(size == 0) {
+            return;
+        }
+        SHA256_Update(&hasher_, data, size);
+        size_ += size;
+
+        if(mode_ == Head) {
+            headHash_ = computeHeadHash(data, size);
+            candidate_ = storage_->findCandidate_(name_, headHash_);
+            if(candidate_) {
+                candidateFp_.open(candidate_->path(), ifstream::binary);
+            }
+            if(candidate_ && candidateFp_.good()) {
+                compareBuf_.resize(CompareBlockSize);
+                mode_ = Compare;
+            } else {
+                candidate_.reset();
+                startWriting_();
+            }
+        }
+
+        if(mode_ == Compare) {
+            size_t pos = 0;
+            while(pos < size) {
+                size_t count = min(size - pos, CompareBlockSize);
+                candidateFp_.read(compareBuf_.data(), (std::streamsize)count);
+                if(
+                    (size_t)candidateFp_.gcount() != count ||
+                    memcmp(compareBuf_.data(), data + pos, count)
+                ) {
+                    diverge_();
+                    writeData_(data + pos, size - pos);
+                    break;
+                }
+                matched_ += count;
+                pos += count;
+            }
+        } else {
+            writeData_(data, size);
+        }
+    }
+
+    void startWriting_() {
+        fp_.open(path_, ofstream::binary);
+        if(!fp_.good()) {
+            WARNING_LOG("Opening file upload ", path_, " for writing failed");
+            ok_ = false;
+        }
+        mode_ = Write;
+    }
+
+    // Switches from Compare mode to Write mode, copying the matched data from
+    // the candidate to the new file.
+    void diverge_() {
+        REQUIRE(mode_ == Compare);
+        startWriting_();
+
+        candidateFp_.clear();
+        candidateFp_.seekg(0);
+        uint64_t left = matched_;
+        while(left && ok_) {
+            size_t count = (size_t)min(left, (uint64_t)CompareBlockSize);
+            candidateFp_.read(compareBuf_.data(), (std::streamsize)count);
+            if((size_t)candidateFp_.gcount() != count) {
+                WARNING_LOG("Reading upload candidate file failed");
+                ok_ = false;
                 break;
             }
+            writeData_(compareBuf_.data(), count);
+            left -= count;
+        }
+
+        candidateFp_.close();
+        candidate_.reset();
+        compareBuf_.clear();
+        compareBuf_.shrink_to_fit();
+    }
+
+    void writeData_(const char* data, size_t size) {
+        if(ok_) {
+            fp_.write(data, size);
+            if(!fp_.good()) {
+                ok_ = false;
+            }
+        }
+    }
+
+    // Gives the full fill buffer to the background thread, waiting for it to
+    // finish the previous buffer first.
+    void handOff_() {
+        unique_lock<mutex> lock(mutex_);
+        if(!thread_.joinable()) {
+            thread_ = thread([this]() { threadMain_(); });
+        }
+        cv_.wait(lock, [&]() { return !workPending_; });
+        swap(fillBuf_, workBuf_);
+        workSize_ = fillSize_;
+        fillSize_ = 0;
+        workPending_ = true;
+        cv_.notify_all();
+    }
+
+    void threadMain_() {
+        unique_lock<mutex> lock(mutex_);
+        while(true) {
+            cv_.wait(lock, [&]() { return workPending_ || threadStopping_; });
+            if(!workPending_) {
+                return;
+            }
 
-            size_t readCount = dataStream.gcount();
-            REQUIRE(readCount >= 0 && readCount <= BufSize);
+            lock.unlock();
+            process_(workBuf_, workSize_);
+            lock.lock();
 
-            SHA256_Update(&hasher, buf, readCount);
+            workPending_ = false;
+            cv_.notify_all();
+        }
+    }
 
-            fp.write(buf, readCount);
-            REQUIRE(fp.good());
+    // Lets the background thread finish its current buffer and stops it.
+    void stopThread_() {
+        if(!thread_.joinable()) {
+            return;
         }
-    } catch(...) {
-        WARNING_LOG("Reading file upload stream failed with exception");
-        ok = false;
+        {
+            lock_guard<mutex> lock(mutex_);
+            threadStopping_ = true;
+        }
+        cv_.notify_all();
+        thread_.join();
     }
 
-    unsigned char hashBin[SHA256_DIGEST_LENGTH];
-    SHA256_Final(hashBin, &hasher);
+    shared_ptr<UploadStorage> storage_;
+    string name_;
+    PathStr path_;
+    bool finished_;
+
+    // Only accessed by the thread that owns the work buffer (see
+    // workPending_).
+    Mode mode_;
+    uint64_t size_;
+    uint64_t headHash_;
+    shared_ptr<FileUpload> candidate_;
+    ifstream candidateFp_;
+    uint64_t matched_;
+    vector<char> compareBuf_;
+    ofstream fp_;
+    SHA256_CTX hasher_;
+    bool ok_;
+
+    char* fillBuf_;
+    size_t fillSize_;
+
+    mutex mutex_;
+    condition_variable cv_;
+    char* workBuf_;
+    size_t workSize_;
+    bool workPending_;
+    bool threadStopping_;
+    thread thread_;
+};
 
-    fp.close();
-    REQUIRE(fp.good());
+UploadWriter::UploadWriter(CKey, unique_ptr<Impl> impl) {
+    impl_ = move(impl);
+}
+
+UploadWriter::~UploadWriter() {}
+
+void UploadWriter::write(const char* data, size_t size) {
+    impl_->write(data, size);
+}
 
-    if(!ok) {
+shared_ptr<FileUpload> UploadWriter::finish() {
+    return impl_->finish();
+}
+
+shared_ptr<UploadWriter> UploadStorage::startUpload(string name) {
+    uint64_t idx = nextIdx_.fetch_add(1, memory_order_relaxed);
+    PathStr path = tempDir_->path() + PathSep + toPathStr(idx);
+
+    return UploadWriter::create(make_unique<UploadWriter::Impl>(
+        shared_from_this(), move(name), move(path)
+    ));
+}
+
+shared_ptr<FileUpload> UploadStorage::addFile_(
+    string name,
+    PathStr path,
+    string hash,
+    uint64_t size,
+    uint64_t headHash
+) {
+    lock_guard<mutex> lock(mutex_);
+    if(contents_.count(hash)) {
         unlinkFile(path);
+    } else {
+        Content content;
+        content.path = move(path);
+        content.size = size;
+        content.headHash = headHash;
+
+        // The new content is immediately taken into use by acquire_.
+        lru_.push_front(hash);
+        content.lruIt = lru_.begin();
+        unusedSize_ += size;
+
+        REQUIRE(contents_.emplace(hash, move(content)).second);
+        headIndex_.emplace(headHash, hash);
+    }
+    return acquire_(hash, move(name));
+}
+
+shared_ptr<FileUpload> UploadStorage::findCandidate_(
+    string name,
+    uint64_t headHash
+) {
+    lock_guard<mutex> lock(mutex_);
+
+    // Prefer the contents in use and then the most recently used ones.
+    const string* best = nullptr;
+    bool bestInUse = false;
+    auto range = headIndex_.equal_range(headHash);
+    for(auto it = range.first; it != range.second; ++it) {
+        const Content& content = contents_.at(it->second);
+        bool inUse = !content.impl.expired();
+        if(best == nullptr || (inUse && !bestInUse)) {
+            best = &it->second;
+            bestInUse = inUse;
+        } else if(!inUse && !bestInUse) {
+            auto lruPos = [&](const string& hash) {
+                return std::distance(lru_.begin(), contents_.at(hash).lruIt);
+            };
+            if(lruPos(it->second) < lruPos(*best)) {
+                best = &it->second;
+            }
+        }
+    }
+
+    if(best == nullptr) {
         shared_ptr<FileUpload> empty;
         return empty;
     }
+    return acquire_(*best, move(name));
+}
 
-    string hash;
-    for(size_t i = 0; i < SHA256_DIGEST_LENGTH; ++i) {
-        int byte = (int)hashBin[i];
-        for(int nibble : {byte >> 4, byte & 15}) {
-            hash.push_back(nibble < 10 ? (char)('0' + nibble) : (char)('a' + (nibble - 10)));
-        }
+shared_ptr<FileUpload> UploadStorage::acquire_(
+    const string& hash,
+    string name
+) {
+    Content& content = contents_.at(hash);
+    shared_ptr<FileUpload::Impl> impl = content.impl.lock();
+    if(!impl) {
+        lru_.erase(content.lruIt);
+        unusedSize_ -= content.size;
+
+        impl = FileUpload::Impl::create(shared_from_this(), hash, content.path);
+        content.impl = impl;
     }
+    return FileUpload::create(impl, move(name));
+}
 
-    shared_ptr<FileUpload> ret;
-    {
-        lock_guard<mutex> lock(mutex_);
-        auto it = files_.find(hash);
-        shared_ptr<FileUpload::Impl> impl;
-        if(it == files_.end()) {
-            impl = FileUpload::Impl::create(
-                shared_from_this(),
-                move(name),
-                move(path),
-                hash
-            );
-            REQUIRE(files_.emplace(hash, impl).second);
-        } else {
-            impl = it->second.lock();
-            REQUIRE(impl);
-            unlinkFile(path);
+void UploadStorage::release_(const string& hash) {
+    Content& content = contents_.at(hash);
+    lru_.push_front(hash);
+    content.lruIt = lru_.begin();
+    unusedSize_ += content.size;
+    evict_();
+}
+
+void UploadStorage::evict_() {
+    while(
+        !lru_.empty() &&
+        (lru_.size() > maxUnusedFileCount_ || unusedSize_ > maxUnusedTotalSize_)
+    ) {
+        string hash = move(lru_.back());
+        lru_.pop_back();
+
+        auto it = contents_.find(hash);
+        REQUIRE(it != contents_.end());
+        Content& content = it->second;
+        unusedSize_ -= content.size;
+        unlinkFile(content.path);
+
+        auto range = headIndex_.equal_range(content.headHash);
+        for(auto indexIt = range.first; indexIt != range.second; ++indexIt) {
+            if(indexIt->second == hash) {
+                headIndex_.erase(indexIt);
+                break;
+            }
         }
-        ret = FileUpload::create(impl);
+        contents_.erase(it);
     }
-    return ret;
 }
 
 string extractUploadFilename(string src) {
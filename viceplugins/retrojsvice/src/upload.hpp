@@ -23,7 +23,7 @@ private:
 
 public:
     // Private constructor.
-    FileUpload(CKey, shared_ptr<Impl> impl);
+    FileUpload(CKey, shared_ptr<Impl> impl, string name);
 
     ~FileUpload();
 
@@ -32,31 +32,117 @@ public:
 
 private:
     shared_ptr<Impl> impl_;
+    string name_;
+
+    friend class UploadStorage;
+};
+
+// Receives the data of a single file upload in chunks (see
+// UploadStorage::startUpload). The data is collected into large buffers that
+// are written to the file and hashed in a background thread while the next
+// buffer is being filled, so the thread receiving the upload only copies the
+// data. The object itself is not thread-safe.
+class UploadWriter {
+SHARED_ONLY_CLASS(UploadWriter);
+private:
+    class Impl;
+
+public:
+    // Private constructor.
+    UploadWriter(CKey, unique_ptr<Impl> impl);
+
+    // If finish has not been called, the partially written file is removed.
+    ~UploadWriter();
+
+    void write(const char* data, size_t size);
+
+    // Completes the upload and returns the file upload object, or an empty
+    // pointer if writing the file failed. No other member functions may be
+    // called after this.
+    shared_ptr<FileUpload> finish();
+
+private:
+    unique_ptr<Impl> impl_;
 
     friend class UploadStorage;
 };
 
 // Shared storage for file uploads that deduplicates files that have the same
-// content. UploadStorages and FileUploads are thread-safe.
+// content. Files that are no longer used are kept in a bounded LRU cache so
+// that repeated uploads of the same file (for example from different windows)
+// can reuse them. While an upload is received, its first block is used to
+// look up a cached candidate with the same beginning; as long as the data
+// matches the candidate, it is not written to disk at all. UploadStorages and
+// FileUploads are thread-safe.
 class UploadStorage : public enable_shared_from_this<UploadStorage> {
 SHARED_ONLY_CLASS(UploadStorage);
 public:
-    UploadStorage(CKey);
+    // The unused files are evicted from the cache while there are more than
+    // maxUnusedFileCount of them or their total size exceeds
+    // maxUnusedTotalSize bytes; if either of them is zero, the files are
+    // deleted as soon as they are no longer used.
+    UploadStorage(CKey, size_t maxUnusedFileCount, uint64_t maxUnusedTotalSize);
 
     ~UploadStorage();
 
-    // Returns the file upload object if the reading the file from dataStream
-    // succeeds (badbit is not raised and no exceptions are thrown). Otherwise,
-    // returns an empty pointer.
-    shared_ptr<FileUpload> upload(string name, istream& dataStream);
+    // Starts receiving a new file upload with given name; the data is written
+    // directly to its location in the storage.
+    shared_ptr<UploadWriter> startUpload(string name);
 
 private:
+    struct Content {
+        PathStr path;
+        uint64_t size;
+        uint64_t headHash;
+
+        // Expired if the content is not in use, in which case the content is
+        // in lru_ at position lruIt.
+        weak_ptr<FileUpload::Impl> impl;
+        list<string>::iterator lruIt;
+    };
+
+    // Adds a completely written file with given SHA-256 hash (hex) to the
+    // storage; if the storage already has a file with the same content, the
+    // new file is removed and the existing one is used instead.
+    shared_ptr<FileUpload> addFile_(
+        string name,
+        PathStr path,
+        string hash,
+        uint64_t size,
+        uint64_t headHash
+    );
+
+    // Returns the most recently used file whose head hash (see
+    // UploadWriter) matches, or an empty pointer if there is no such file.
+    shared_ptr<FileUpload> findCandidate_(string name, uint64_t headHash);
+
+    // Returns a new FileUpload for an existing content, marking it in use.
+    // Must be called with mutex_ locked.
+    shared_ptr<FileUpload> acquire_(const string& hash, string name);
+
+    // Called by FileUpload::Impl when the content goes out of use, with
+    // mutex_ locked.
+    void release_(const string& hash);
+
+    // Removes the least recently used unused files while the cache is over
+    // its limits. Must be called with mutex_ locked.
+    void evict_();
+
+    size_t maxUnusedFileCount_;
+    uint64_t maxUnusedTotalSize_;
+
     shared_ptr<TempDir> tempDir_;
     atomic<uint64_t> nextIdx_;
     mutex mutex_;
-    map<string, weak_ptr<FileUpload::Impl>> files_;
+    map<string, Content> contents_;
+    multimap<uint64_t, string> headIndex_;
+
+    // The hashes of the unused contents, most recently used first.
+    list<string> lru_;
+    uint64_t unusedSize_;
 
     friend class FileUpload;
+    friend class UploadWriter;
 };
 
 string extractUploadFilename(string src);
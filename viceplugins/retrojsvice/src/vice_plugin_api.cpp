@@ -386,7 +386,11 @@ API_FUNC_START
     REQUIRE(apiVersion == (uint64_t)2000000);
 
     string nameStr = name;
-    if(nameStr == "URINavigation" || nameStr == "PluginNavigationControlSupportQuery") {
+    if(
+        nameStr == "URINavigation" ||
+        nameStr == "PluginNavigationControlSupportQuery" ||
+        nameStr == "RenderScale"
+    ) {
         return 1;
     } else {
         return 0;
@@ -406,4 +410,10 @@ API_EXPORT int vicePluginAPI_PluginNavigationControlSupportQuery_query(
 )
 WRAP_CTX_API(PluginNavigationControlSupportQuery_query);
 
+API_EXPORT void vicePluginAPI_RenderScale_enable(
+    VicePluginAPI_Context* ctx,
+    double scale
+)
+WRAP_CTX_API(RenderScale_enable, scale);
+
 }
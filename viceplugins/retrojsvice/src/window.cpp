@@ -1,11 +1,16 @@
 #include "window.hpp"
 
 #include "download.hpp"
+#include "event_parser.hpp"
 #include "gui.hpp"
 #include "html.hpp"
 #include "http.hpp"
 #include "key.hpp"
+#include "latency_trace.hpp"
+#include "metrics.hpp"
+#include "rendered_html.hpp"
 #include "secrets.hpp"
+#include "session_recorder.hpp"
 #include "upload.hpp"
 
 namespace retrojsvice {
@@ -15,22 +20,38 @@ Window::Window(CKey,
     uint64_t handle,
     shared_ptr<SecretGenerator> secretGen,
     string programName,
+    double renderScale,
     bool allowPNG,
     int initialQuality,
-    bool setupNavigationForwarding
+    bool setupNavigationForwarding,
+    shared_ptr<LatencyTracer> latencyTracer,
+    shared_ptr<CompressionGovernor> compressionGovernor,
+    shared_ptr<Metrics> metrics,
+    shared_ptr<SessionRecorder> sessionRecorder
 ) {
     REQUIRE_API_THREAD();
     REQUIRE(handle);
-    REQUIRE(initialQuality >= 10 && initialQuality <= 101);
+    REQUIRE(compressionGovernor);
+    REQUIRE(metrics);
+    REQUIRE(renderScale > 0.0 && renderScale <= 1.0);
+    REQUIRE(initialQuality >= 10 && initialQuality <= 102);
 
-    if(!allowPNG && initialQuality == 101) {
+    if(!allowPNG && initialQuality >= 101) {
         initialQuality = 100;
     }
 
     programName_ = move(programName);
+    renderScale_ = renderScale;
     allowPNG_ = allowPNG;
     initialQuality_ = initialQuality;
     setupNavigationForwarding_ = setupNavigationForwarding;
+    latencyTracer_ = latencyTracer;
+    compressionGovernor_ = compressionGovernor;
+    metrics_ = metrics;
+    sessionRecorder_ = sessionRecorder;
+    if(sessionRecorder_) {
+        sessionRecording_ = sessionRecorder_->startRecording(handle);
+    }
     secretGen_ = secretGen;
     snakeOilKeyCipherKey_ = secretGen_->generateSnakeOilCipherKey();
 
@@ -48,15 +69,34 @@ Window::Window(CKey,
     preMainVisited_ = false;
     navigationInProgress_ = false;
 
+    preMainHTML_ = RenderedHTML::create(
+        renderPreMainHTML({programName_, pathPrefix_})
+    );
+    prePrevHTML_ = RenderedHTML::create(
+        renderPrePrevHTML({programName_, pathPrefix_})
+    );
+    prevHTML_ = RenderedHTML::create(
+        renderPrevHTML({programName_, pathPrefix_})
+    );
+    nextHTML_ = RenderedHTML::create(
+        renderNextHTML({programName_, pathPrefix_})
+    );
+
     curMainIdx_ = 0;
     curImgIdx_ = 0;
     curEventIdx_ = 0;
     curDownloadIdx_ = 0;
+    inactivityTimeoutShortened_ = false;
+
+    coalescedMouseMoveCount_ = 0;
+    coalescedMouseWheelCount_ = 0;
 
     lastNavigateOperationTime_ = steady_clock::now();
 
     inFileUploadMode_ = false;
 
+    metrics_->openWindows.fetch_add(1, memory_order_relaxed);
+
     // Initialization is completed in afterConstruct_
 }
 
@@ -69,6 +109,15 @@ void Window::close() {
     REQUIRE(!closed_);
 
     closed_ = true;
+    metrics_->openWindows.fetch_sub(1, memory_order_relaxed);
+    sessionRecording_.reset();
+
+    if(coalescedMouseMoveCount_ || coalescedMouseWheelCount_) {
+        INFO_LOG(
+            "Coalesced ", coalescedMouseMoveCount_, " mouse move events and ",
+            coalescedMouseWheelCount_, " mouse wheel events in window ", handle_
+        );
+    }
 
     // stopFetching will make sure that imageCompressor_->flush will not call
     // event handlers
@@ -95,7 +144,7 @@ void Window::handleInitialForwardHTTPRequest(shared_ptr<HTTPRequest> request) {
     string pathSuffix = setupNavigationForwarding_ ? "prev/" : "";
 
     request->sendHTMLResponse(
-        200, writeNewWindowHTML, {programName_, pathPrefix_, pathSuffix}
+        200, renderNewWindowHTML, {programName_, pathPrefix_, pathSuffix}
     );
 }
 
@@ -110,7 +159,7 @@ void Window::handleHTTPRequest(MCE, shared_ptr<HTTPRequest> request) {
         request->sendTextResponse(403, "ERROR: Invalid CSRF token\n");
         return;
     }
-    string path = fullPath.substr(pathPrefix_.size());
+    string_view path = string_view(fullPath).substr(pathPrefix_.size());
 
     if(closed_) {
         request->sendTextResponse(400, "ERROR: Window has been closed\n");
@@ -124,48 +173,51 @@ void Window::handleHTTPRequest(MCE, shared_ptr<HTTPRequest> request) {
         return;
     }
 
-    vector<string> pathSplit = splitStr(path, '/', 2);
-    if(pathSplit.size() == 3 && pathSplit[0].empty()) {
-        string pathBase = move(pathSplit[1]);
-        string subPath = move(pathSplit[2]);
+    // Image requests are by far the most common, so we parse the path without
+    // allocating memory.
+    size_t pathBaseEnd = path.find('/', 1);
+    if(!path.empty() && path[0] == '/' && pathBaseEnd != string_view::npos) {
+        string_view pathBase = path.substr(1, pathBaseEnd - 1);
+        string_view subPathView = path.substr(pathBaseEnd + 1);
 
         if(method == "GET" && pathBase == "image") {
-            vector<string> subPathSplit = splitStr(subPath, '/', 6);
+            ImageRequestPath imagePath;
+            if(parseImageRequestPath(subPathView, imagePath)) {
+                handleImageRequest_(
+                    mce,
+                    request,
+                    imagePath.mainIdx,
+                    imagePath.imgIdx,
+                    imagePath.immediate,
+                    imagePath.width,
+                    imagePath.height,
+                    imagePath.startEventIdx,
+                    imagePath.eventStr
+                );
+                return;
+            }
+        }
+
+        string subPath(subPathView);
+
+        if(method == "GET" && pathBase == "iframe") {
+            vector<string> subPathSplit = splitStr(subPath, '/');
             if(
-                subPathSplit.size() == 7 &&
+                subPathSplit.size() == 3 &&
                 isNonEmptyNumericStr(subPathSplit[0]) &&
                 isNonEmptyNumericStr(subPathSplit[1]) &&
-                (subPathSplit[2] == "0" || subPathSplit[2] == "1") &&
-                isNonEmptyNumericStr(subPathSplit[3]) &&
-                isNonEmptyNumericStr(subPathSplit[4]) &&
-                isNonEmptyNumericStr(subPathSplit[5])
+                subPathSplit[2].empty()
             ) {
                 optional<uint64_t> mainIdx = parseString<uint64_t>(subPathSplit[0]);
-                optional<uint64_t> imgIdx = parseString<uint64_t>(subPathSplit[1]);
-                optional<int> immediate = parseString<int>(subPathSplit[2]);
-                optional<int> width = parseString<int>(subPathSplit[3]);
-                optional<int> height = parseString<int>(subPathSplit[4]);
-                optional<uint64_t> startEventIdx = parseString<uint64_t>(subPathSplit[5]);
-                string eventStr = subPathSplit[6];
-
-                if(mainIdx && imgIdx && immediate && width && height && startEventIdx) {
-                    handleImageRequest_(
-                        mce,
-                        request,
-                        *mainIdx,
-                        *imgIdx,
-                        *immediate,
-                        *width,
-                        *height,
-                        *startEventIdx,
-                        move(eventStr)
-                    );
+
+                if(mainIdx) {
+                    handleIframeRequest_(mce, request, *mainIdx);
                     return;
                 }
             }
         }
 
-        if(method == "GET" && pathBase == "iframe") {
+        if(method == "GET" && pathBase == "layer") {
             vector<string> subPathSplit = splitStr(subPath, '/');
             if(
                 subPathSplit.size() == 3 &&
@@ -174,9 +226,10 @@ void Window::handleHTTPRequest(MCE, shared_ptr<HTTPRequest> request) {
                 subPathSplit[2].empty()
             ) {
                 optional<uint64_t> mainIdx = parseString<uint64_t>(subPathSplit[0]);
+                optional<uint64_t> imgIdx = parseString<uint64_t>(subPathSplit[1]);
 
-                if(mainIdx) {
-                    handleIframeRequest_(mce, request, *mainIdx);
+                if(mainIdx && imgIdx) {
+                    handleVideoLayerRequest_(mce, request, *mainIdx, *imgIdx);
                     return;
                 }
             }
@@ -200,7 +253,7 @@ void Window::handleHTTPRequest(MCE, shared_ptr<HTTPRequest> request) {
 
         if(method == "GET" && pathBase == "upload" && subPath.empty()) {
             request->sendHTMLResponse(
-                200, writeUploadHTML, {programName_, pathPrefix_, uploadCSRFToken_}
+                200, renderUploadHTML, {programName_, pathPrefix_, uploadCSRFToken_}
             );
             return;
         }
@@ -255,9 +308,14 @@ shared_ptr<Window> Window::createPopup(uint64_t popupHandle) {
         popupHandle,
         secretGen_,
         programName_,
+        renderScale_,
         allowPNG_,
         imageCompressor_->quality(),
-        setupNavigationForwarding_
+        setupNavigationForwarding_,
+        latencyTracer_,
+        compressionGovernor_,
+        metrics_,
+        sessionRecorder_
     );
 
     shared_ptr<Window> self = shared_from_this();
@@ -270,7 +328,7 @@ shared_ptr<Window> Window::createPopup(uint64_t popupHandle) {
                 string pathSuffix = self->setupNavigationForwarding_ ? "prev/" : "";
                 request->sendHTMLResponse(
                     200,
-                    writePopupIframeHTML,
+                    renderPopupIframeHTML,
                     {self->programName_, popupWindow->pathPrefix_, pathSuffix}
                 );
             }
@@ -284,6 +342,20 @@ void Window::notifyViewChanged() {
     REQUIRE_API_THREAD();
     REQUIRE(!closed_);
 
+    // If the view has not changed in a while after the input, the input
+    // probably did not change the view at all, so we drop the trace.
+    if(latencyTrace_) {
+        if(steady_clock::now() - latencyTrace_->inputTime() <= milliseconds(1000)) {
+            latencyTrace_->mark(LatencyTrace::ViewChanged);
+            imageCompressor_->addLatencyTrace(latencyTrace_);
+        }
+        latencyTrace_.reset();
+    }
+
+    if(sessionRecording_) {
+        sessionRecording_->recordViewChanged();
+    }
+
     shared_ptr<Window> self = shared_from_this();
     postTask([self]() {
         if(!self->closed_) {
@@ -321,6 +393,7 @@ optional<pair<vector<string>, size_t>> Window::qualitySelectorQuery() {
     }
     if(allowPNG_) {
         labels.push_back("PNG");
+        labels.push_back("HYB");
     }
     return pair<vector<string>, size_t>(
         move(labels), (size_t)(imageCompressor_->quality() - 10)
@@ -333,7 +406,7 @@ void Window::qualityChanged(size_t qualityIdx) {
 
     int quality = (int)qualityIdx + 10;
     REQUIRE(quality >= 10);
-    REQUIRE(quality <= (allowPNG_ ? 101 : 100));
+    REQUIRE(quality <= (allowPNG_ ? 102 : 100));
 
     postTask([quality, imageCompressor{imageCompressor_}]() {
         imageCompressor->setQuality(mce, quality);
@@ -353,7 +426,7 @@ void Window::clipboardButtonPressed() {
             [self](shared_ptr<HTTPRequest> request) {
                 request->sendHTMLResponse(
                     200,
-                    writeClipboardIframeHTML,
+                    renderClipboardIframeHTML,
                     {self->programName_}
                 );
             }
@@ -386,7 +459,7 @@ void Window::putFileDownload(shared_ptr<FileDownload> file) {
             REQUIRE(self->downloads_.insert({downloadIdx, {file, tag}}).second);
 
             request->sendHTMLResponse(
-                200, writeDownloadIframeHTML, {
+                200, renderDownloadIframeHTML, {
                     self->programName_,
                     self->pathPrefix_,
                     downloadIdx,
@@ -417,7 +490,7 @@ bool Window::startFileUpload() {
             [self](shared_ptr<HTTPRequest> request) {
                 request->sendHTMLResponse(
                     200,
-                    writeUploadIframeHTML,
+                    renderUploadIframeHTML,
                     {self->programName_, self->pathPrefix_}
                 );
             }
@@ -446,7 +519,22 @@ void Window::onImageCompressorFetchImage(
         func(data.data(), 1, 1, 1);
     } else {
         REQUIRE(eventHandler_);
-        eventHandler_->onWindowFetchImage(handle_, func);
+        if(sessionRecording_) {
+            shared_ptr<SessionRecording> recording = sessionRecording_;
+            eventHandler_->onWindowFetchImage(handle_,
+                [&](
+                    const uint8_t* image,
+                    size_t width,
+                    size_t height,
+                    size_t pitch
+                ) {
+                    recording->recordFrame(image, width, height, pitch);
+                    func(image, width, height, pitch);
+                }
+            );
+        } else {
+            eventHandler_->onWindowFetchImage(handle_, func);
+        }
     }
 }
 
@@ -462,7 +550,11 @@ void Window::onImageCompressorRenderGUI(
 
 void Window::afterConstruct_(shared_ptr<Window> self) {
     imageCompressor_ = ImageCompressor::create(
-        self, milliseconds(2000), initialQuality_
+        self,
+        milliseconds(2000),
+        initialQuality_,
+        compressionGovernor_,
+        metrics_
     );
 
     updateInactivityTimeout_();
@@ -481,22 +573,32 @@ void Window::updateInactivityTimeout_(bool shorten) {
     REQUIRE_API_THREAD();
     if(closed_) return;
 
+    // This is called for every image request, so we reuse the pending timer
+    // if possible.
+    milliseconds delay(shorten ? 4000 : 30000);
+    inactivityTimeoutShortened_ = shorten;
+    if(inactivityTimeoutTag_ && inactivityTimeoutTag_->reschedule(delay)) {
+        return;
+    }
     inactivityTimeoutTag_ = postDelayedTask(
-        milliseconds(shorten ? 4000 : 30000),
+        delay,
         weak_ptr<Window>(shared_from_this()),
         &Window::inactivityTimeoutReached_,
-        mce,
-        shorten
+        mce
     );
 }
 
-void Window::inactivityTimeoutReached_(MCE, bool shortened) {
+void Window::inactivityTimeoutReached_(MCE) {
     REQUIRE_API_THREAD();
     if(closed_) return;
 
     INFO_LOG(
         "Closing window ", handle_, " due to inactivity timeout",
-        (shortened ? " (shortened due to client close signal)" : "")
+        (
+            inactivityTimeoutShortened_
+                ? " (shortened due to client close signal)"
+                : ""
+        )
     );
     selfClose_(mce);
 }
@@ -509,12 +611,47 @@ int Window::decodeKey_(uint64_t eventIdx, int key) {
 
 bool Window::handleTokenizedEvent_(MCE,
     uint64_t eventIdx,
-    const string& name,
+    string_view name,
     int argCount,
     const int* args
 ) {
     REQUIRE(eventHandler_);
 
+    // Coalesce consecutive mouse moves and consecutive mouse wheel events; to
+    // preserve the event ordering, the held back event is forwarded before
+    // handling any other event.
+    if(name == "MMO" && argCount == 2 && !inFileUploadMode_) {
+        if(coalescedMouseMove_) {
+            ++coalescedMouseMoveCount_;
+            metrics_->coalescedWindowEvents.fetch_add(1, memory_order_relaxed);
+        } else {
+            flushCoalescedInput_();
+        }
+        coalescedMouseMove_ = pair<int, int>(args[0], args[1]);
+        return true;
+    }
+    if(name == "MWH" && argCount == 3 && !inFileUploadMode_) {
+        int x = args[0];
+        int y = args[1];
+        int delta = max(-180, min(180, args[2]));
+
+        // The wheel delta is clamped to [-180, 180] in the program, so we do
+        // not merge events beyond that range.
+        if(coalescedMouseWheel_) {
+            int sum = get<2>(*coalescedMouseWheel_) + delta;
+            if(sum >= -180 && sum <= 180) {
+                ++coalescedMouseWheelCount_;
+                metrics_->coalescedWindowEvents.fetch_add(1, memory_order_relaxed);
+                coalescedMouseWheel_ = tuple<int, int, int>(x, y, sum);
+                return true;
+            }
+        }
+        flushCoalescedInput_();
+        coalescedMouseWheel_ = tuple<int, int, int>(x, y, delta);
+        return true;
+    }
+    flushCoalescedInput_();
+
     auto keyDown = [&](int key) {
         keysDown_.insert(key);
         eventHandler_->onWindowKeyDown(handle_, key);
@@ -530,12 +667,7 @@ bool Window::handleTokenizedEvent_(MCE,
         int y = args[1];
         int button = args[2];
         if(inFileUploadMode_) {
-            if(
-                button == 0 &&
-                isOverUploadModeCancelButton(
-                    (size_t)x, (size_t)y, (size_t)width_, (size_t)height_
-                )
-            ) {
+            if(button == 0 && isOverUploadModeCancelButton_(x, y)) {
                 fileUploadModeButtonPressed_ = true;
                 fileUploadModeButtonDown_ = true;
                 notifyViewChanged();
@@ -561,9 +693,7 @@ bool Window::handleTokenizedEvent_(MCE,
                 fileUploadModeButtonDown_ = false;
                 notifyViewChanged();
 
-                if(isOverUploadModeCancelButton(
-                    (size_t)x, (size_t)y, (size_t)width_, (size_t)height_
-                )) {
+                if(isOverUploadModeCancelButton_(x, y)) {
                     selfCancelFileUpload_(mce);
                 }
             }
@@ -573,20 +703,16 @@ bool Window::handleTokenizedEvent_(MCE,
         return true;
     }
     if(name == "MMO" && argCount == 2) {
+        // Only reached in file upload mode; otherwise the event is coalesced
+        // above.
         int x = args[0];
         int y = args[1];
-        if(inFileUploadMode_) {
-            if(fileUploadModeButtonPressed_) {
-                bool over = isOverUploadModeCancelButton(
-                    (size_t)x, (size_t)y, (size_t)width_, (size_t)height_
-                );
-                if(over != fileUploadModeButtonDown_) {
-                    fileUploadModeButtonDown_ = over;
-                    notifyViewChanged();
-                }
+        if(fileUploadModeButtonPressed_) {
+            bool over = isOverUploadModeCancelButton_(x, y);
+            if(over != fileUploadModeButtonDown_) {
+                fileUploadModeButtonDown_ = over;
+                notifyViewChanged();
             }
-        } else {
-            eventHandler_->onWindowMouseMove(handle_, x, y);
         }
         return true;
     }
@@ -610,14 +736,6 @@ bool Window::handleTokenizedEvent_(MCE,
         eventHandler_->onWindowMouseDoubleClick(handle_, x, y, 0);
         return true;
     }
-    if(name == "MWH" && argCount == 3) {
-        int x = args[0];
-        int y = args[1];
-        int delta = args[2];
-        delta = max(-180, min(180, delta));
-        eventHandler_->onWindowMouseWheel(handle_, x, y, delta);
-        return true;
-    }
     if(name == "MOUT" && argCount == 2) {
         int x = args[0];
         int y = args[1];
@@ -647,54 +765,33 @@ bool Window::handleTokenizedEvent_(MCE,
     return false;
 }
 
-bool Window::handleEvent_(MCE,
-    uint64_t eventIdx,
-    string::const_iterator begin,
-    string::const_iterator end
-) {
-    REQUIRE(begin < end && *(end - 1) == '/');
-
-    string name;
-
-    const int MaxArgCount = 3;
-    int args[MaxArgCount];
-    int argCount = 0;
+void Window::flushCoalescedInput_() {
+    REQUIRE(eventHandler_);
 
-    string::const_iterator pos = begin;
-    while(*pos != '/' && *pos != '_') {
-        ++pos;
+    if(coalescedMouseMove_) {
+        pair<int, int> p = *coalescedMouseMove_;
+        coalescedMouseMove_.reset();
+        eventHandler_->onWindowMouseMove(handle_, p.first, p.second);
     }
-    name = string(begin, pos);
-
-    bool ok = true;
-    if(*pos == '_') {
-        ++pos;
-        while(true) {
-            if(argCount == MaxArgCount) {
-                ok = false;
-                break;
-            }
-            string::const_iterator argStart = pos;
-            while(*pos != '/' && *pos != '_') {
-                ++pos;
-            }
-            optional<int> arg = parseString<int>(string(argStart, pos));
-            if(!arg) {
-                ok = false;
-                break;
-            }
-            args[argCount++] = *arg;
-            if(*pos == '/') {
-                break;
-            }
-            ++pos;
-        }
+    if(coalescedMouseWheel_) {
+        tuple<int, int, int> w = *coalescedMouseWheel_;
+        coalescedMouseWheel_.reset();
+        eventHandler_->onWindowMouseWheel(
+            handle_, get<0>(w), get<1>(w), get<2>(w)
+        );
     }
+}
 
-    return ok && handleTokenizedEvent_(mce, eventIdx, name, argCount, args);
+bool Window::handleEvent_(MCE, uint64_t eventIdx, string_view eventStr) {
+    ParsedEvent event;
+    return
+        parseEvent(eventStr, event) &&
+        handleTokenizedEvent_(
+            mce, eventIdx, event.name, event.argCount, event.args
+        );
 }
 
-void Window::handleEvents_(MCE, uint64_t startIdx, string eventStr) {
+void Window::handleEvents_(MCE, uint64_t startIdx, string_view eventStr) {
     REQUIRE_API_THREAD();
     if(closed_) return;
 
@@ -712,27 +809,18 @@ void Window::handleEvents_(MCE, uint64_t startIdx, string eventStr) {
         curEventIdx_ = eventIdx;
     }
 
-    string::const_iterator begin = eventStr.begin();
-    string::const_iterator end = eventStr.end();
-
-    string::const_iterator itemEnd = begin;
-    while(true) {
-        string::const_iterator itemBegin = itemEnd;
-        while(true) {
-            if(itemEnd >= end) {
-                return;
+    while(optional<string_view> item = popEvent(eventStr)) {
+        if(eventIdx == curEventIdx_) {
+            if(latencyTracer_ && !latencyTrace_) {
+                latencyTrace_ = latencyTracer_->startTrace(handle_);
             }
-            if(*itemEnd == '/') {
-                ++itemEnd;
-                break;
+            metrics_->windowEvents.fetch_add(1, memory_order_relaxed);
+            if(sessionRecording_) {
+                sessionRecording_->recordEvent(*item);
             }
-            ++itemEnd;
-        }
-
-        if(eventIdx == curEventIdx_) {
-            if(!handleEvent_(mce, eventIdx, itemBegin, itemEnd)) {
+            if(!handleEvent_(mce, eventIdx, *item)) {
                 WARNING_LOG(
-                    "Could not parse event '", string(itemBegin, itemEnd),
+                    "Could not parse event '", string(*item),
                     "' in window ", handle_
                 );
             }
@@ -742,6 +830,10 @@ void Window::handleEvents_(MCE, uint64_t startIdx, string eventStr) {
             ++eventIdx;
         }
     }
+
+    if(!closed_) {
+        flushCoalescedInput_();
+    }
 }
 
 void Window::navigate_(MCE, int direction) {
@@ -814,20 +906,20 @@ void Window::handleMainPageRequest_(MCE, shared_ptr<HTTPRequest> request) {
             snakeOilKeyStream << "));";
         }
         string snakeOilKeyCipherKeyWrites = snakeOilKeyStream.str();
+        string renderScale = toString(renderScale_);
 
         curImgIdx_ = 0;
         curEventIdx_ = 0;
-        request->sendHTMLResponse(200, writeMainHTML, {
+        request->sendHTMLResponse(200, renderMainHTML, {
             programName_,
             pathPrefix_,
             curMainIdx_,
             validNonCharKeyList,
-            snakeOilKeyCipherKeyWrites
+            snakeOilKeyCipherKeyWrites,
+            renderScale
         });
     } else {
-        request->sendHTMLResponse(
-            200, writePreMainHTML, {programName_, pathPrefix_}
-        );
+        request->sendHTMLResponse(200, preMainHTML_);
         preMainVisited_ = true;
     }
 }
@@ -840,14 +932,14 @@ void Window::handleImageRequest_(MCE,
     int width,
     int height,
     uint64_t startEventIdx,
-    string eventStr
+    string_view eventStr
 ) {
     if(mainIdx != curMainIdx_ || imgIdx <= curImgIdx_) {
         request->sendTextResponse(400, "ERROR: Outdated request");
     } else {
         updateInactivityTimeout_();
 
-        handleEvents_(mce, startEventIdx, move(eventStr));
+        handleEvents_(mce, startEventIdx, eventStr);
         curImgIdx_ = imgIdx;
 
         width = min(max(width, 1), 16384);
@@ -870,13 +962,25 @@ void Window::handleImageRequest_(MCE,
         }
 
         if(immediate) {
-            imageCompressor_->sendCompressedImageNow(mce, request);
+            imageCompressor_->sendCompressedImageNow(mce, request, imgIdx);
         } else {
-            imageCompressor_->sendCompressedImageWait(mce, request);
+            imageCompressor_->sendCompressedImageWait(mce, request, imgIdx);
         }
     }
 }
 
+void Window::handleVideoLayerRequest_(MCE,
+    shared_ptr<HTTPRequest> request,
+    uint64_t mainIdx,
+    uint64_t imgIdx
+) {
+    if(mainIdx != curMainIdx_) {
+        request->sendTextResponse(400, "ERROR: Outdated request");
+    } else {
+        imageCompressor_->sendVideoLayer(mce, request, imgIdx);
+    }
+}
+
 void Window::handleIframeRequest_(MCE,
     shared_ptr<HTTPRequest> request,
     uint64_t mainIdx
@@ -919,18 +1023,18 @@ void Window::handleUploadPostRequest_(MCE, shared_ptr<HTTPRequest> request) {
                 completeFileUpload_(mce, move(name), file);
 
                 request->sendHTMLResponse(
-                    200, writeUploadCompleteHTML, {programName_}
+                    200, renderUploadCompleteHTML, {programName_}
                 );
             } else {
                 request->sendHTMLResponse(
                     200,
-                    writeUploadHTML,
+                    renderUploadHTML,
                     {programName_, pathPrefix_, uploadCSRFToken_}
                 );
             }
         } else {
             request->sendHTMLResponse(
-                200, writeUploadCancelHTML, {programName_}
+                200, renderUploadCancelHTML, {programName_}
             );
         }
     } else if(mode == "cancel") {
@@ -939,7 +1043,7 @@ void Window::handleUploadPostRequest_(MCE, shared_ptr<HTTPRequest> request) {
         }
 
         request->sendHTMLResponse(
-            200, writeUploadCancelHTML, {programName_}
+            200, renderUploadCancelHTML, {programName_}
         );
     } else {
         request->sendTextResponse(400, "ERROR: Invalid request parameters");
@@ -974,13 +1078,9 @@ void Window::handlePrevPageRequest_(MCE, shared_ptr<HTTPRequest> request) {
     }
 
     if(prePrevVisited_) {
-        request->sendHTMLResponse(
-            200, writePrevHTML, {programName_, pathPrefix_}
-        );
+        request->sendHTMLResponse(200, prevHTML_);
     } else {
-        request->sendHTMLResponse(
-            200, writePrePrevHTML, {programName_, pathPrefix_}
-        );
+        request->sendHTMLResponse(200, prePrevHTML_);
         prePrevVisited_ = true;
     }
 }
@@ -993,7 +1093,7 @@ void Window::handleNextPageRequest_(MCE, shared_ptr<HTTPRequest> request) {
         navigate_(mce, 1);
     }
 
-    request->sendHTMLResponse(200, writeNextHTML, {programName_, pathPrefix_});
+    request->sendHTMLResponse(200, nextHTML_);
 }
 
 void Window::handleGotoURIRequest_(MCE, shared_ptr<HTTPRequest> request, string uri) {
@@ -1010,7 +1110,7 @@ void Window::handleGotoURIRequest_(MCE, shared_ptr<HTTPRequest> request, string
 
     string pathSuffix = setupNavigationForwarding_ ? "prev/" : "";
 
-    request->sendHTMLResponse(200, writeNewWindowHTML, {programName_, pathPrefix_, pathSuffix});
+    request->sendHTMLResponse(200, renderNewWindowHTML, {programName_, pathPrefix_, pathSuffix});
 }
 
 void Window::addIframe_(MCE, function<void(shared_ptr<HTTPRequest>)> iframe) {
@@ -1046,4 +1146,16 @@ void Window::selfCancelFileUpload_(MCE) {
     eventHandler_->onWindowCancelFileUpload(handle_);
 }
 
+bool Window::isOverUploadModeCancelButton_(int x, int y) {
+    auto scale = [&](int val) {
+        return (size_t)std::floor(val * renderScale_);
+    };
+    auto scaleSize = [&](int val) {
+        return (size_t)std::ceil(val * renderScale_);
+    };
+    return isOverUploadModeCancelButton(
+        scale(x), scale(y), scaleSize(width_), scaleSize(height_)
+    );
+}
+
 }
@@ -5,7 +5,14 @@
 
 namespace retrojsvice {
 
+class CompressionGovernor;
 class FileUpload;
+class LatencyTrace;
+class LatencyTracer;
+class Metrics;
+class RenderedHTML;
+class SessionRecorder;
+class SessionRecording;
 
 class WindowEventHandler {
 public:
@@ -64,9 +71,14 @@ public:
         uint64_t handle,
         shared_ptr<SecretGenerator> secretGen,
         string programName,
+        double renderScale,
         bool allowPNG,
         int initialQuality,
-        bool setupNavigationForwarding
+        bool setupNavigationForwarding,
+        shared_ptr<LatencyTracer> latencyTracer,
+        shared_ptr<CompressionGovernor> compressionGovernor,
+        shared_ptr<Metrics> metrics,
+        shared_ptr<SessionRecorder> sessionRecorder
     );
     ~Window();
 
@@ -109,21 +121,22 @@ private:
     void selfClose_(MCE);
 
     void updateInactivityTimeout_(bool shorten = false);
-    void inactivityTimeoutReached_(MCE, bool shortened);
+    void inactivityTimeoutReached_(MCE);
 
     int decodeKey_(uint64_t eventIdx, int key);
+
+    // Forwards the mouse move or wheel event held back for coalescing (if any)
+    // to the event handler.
+    void flushCoalescedInput_();
+
     bool handleTokenizedEvent_(MCE,
         uint64_t eventIdx,
-        const string& name,
+        string_view name,
         int argCount,
         const int* args
     );
-    bool handleEvent_(MCE,
-        uint64_t eventIdx,
-        string::const_iterator begin,
-        string::const_iterator end
-    );
-    void handleEvents_(MCE, uint64_t startIdx, string eventStr);
+    bool handleEvent_(MCE, uint64_t eventIdx, string_view eventStr);
+    void handleEvents_(MCE, uint64_t startIdx, string_view eventStr);
 
     void navigate_(MCE, int direction);
 
@@ -136,7 +149,12 @@ private:
         int width,
         int height,
         uint64_t startEventIdx,
-        string eventStr
+        string_view eventStr
+    );
+    void handleVideoLayerRequest_(MCE,
+        shared_ptr<HTTPRequest> request,
+        uint64_t mainIdx,
+        uint64_t imgIdx
     );
     void handleIframeRequest_(MCE,
         shared_ptr<HTTPRequest> request,
@@ -156,7 +174,13 @@ private:
     void completeFileUpload_(MCE, string name, shared_ptr<FileUpload> file);
     void selfCancelFileUpload_(MCE);
 
+    // Hit test for the cancel button of the upload mode GUI, which is
+    // rendered into the image (scaled by renderScale_ relative to the window
+    // coordinates x and y).
+    bool isOverUploadModeCancelButton_(int x, int y);
+
     string programName_;
+    double renderScale_;
     bool allowPNG_;
     int initialQuality_;
     bool setupNavigationForwarding_;
@@ -180,6 +204,20 @@ private:
     bool closed_;
 
     shared_ptr<ImageCompressor> imageCompressor_;
+
+    // Empty if latency tracing is disabled.
+    shared_ptr<LatencyTracer> latencyTracer_;
+
+    // Trace for the oldest input event batch received after the previous view
+    // change notification, if any.
+    shared_ptr<LatencyTrace> latencyTrace_;
+
+    shared_ptr<CompressionGovernor> compressionGovernor_;
+    shared_ptr<Metrics> metrics_;
+
+    // Empty if session recording is disabled.
+    shared_ptr<SessionRecorder> sessionRecorder_;
+    shared_ptr<SessionRecording> sessionRecording_;
     shared_ptr<DelayedTaskTag> animationTag_;
 
     int width_;
@@ -188,10 +226,29 @@ private:
     set<int> mouseButtonsDown_;
     set<int> keysDown_;
 
+    // Consecutive mouse move events and consecutive mouse wheel events within
+    // a single batch of events from the client are coalesced into one event
+    // to reduce the number of events passed to the program. The held back
+    // event is stored here (at most one of these is nonempty at a time) and
+    // forwarded before any other event or at the end of the batch.
+    optional<pair<int, int>> coalescedMouseMove_;
+    optional<tuple<int, int, int>> coalescedMouseWheel_;
+
+    // Number of events that have been merged into another event by coalescing.
+    uint64_t coalescedMouseMoveCount_;
+    uint64_t coalescedMouseWheelCount_;
+
     bool prePrevVisited_;
     bool preMainVisited_;
     bool navigationInProgress_;
 
+    // The pages used for navigation only depend on programName_ and
+    // pathPrefix_, so they are rendered once when the window is created.
+    shared_ptr<RenderedHTML> preMainHTML_;
+    shared_ptr<RenderedHTML> prePrevHTML_;
+    shared_ptr<RenderedHTML> prevHTML_;
+    shared_ptr<RenderedHTML> nextHTML_;
+
     // How many times the main page has been requested. The main page mentions
     // its index to all the requests it makes, and we discard all the requests
     // that are not from the newest main page.
@@ -215,6 +272,7 @@ private:
     uint64_t curDownloadIdx_;
 
     shared_ptr<DelayedTaskTag> inactivityTimeoutTag_;
+    bool inactivityTimeoutShortened_;
 
     steady_clock::time_point lastNavigateOperationTime_;
 
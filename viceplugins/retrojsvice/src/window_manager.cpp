@@ -8,19 +8,29 @@ WindowManager::WindowManager(CKey,
     shared_ptr<WindowManagerEventHandler> eventHandler,
     shared_ptr<SecretGenerator> secretGen,
     string programName,
+    double renderScale,
     int defaultQuality,
-    bool setupNavigationForwarding
+    bool setupNavigationForwarding,
+    shared_ptr<LatencyTracer> latencyTracer,
+    shared_ptr<CompressionGovernor> compressionGovernor,
+    shared_ptr<Metrics> metrics,
+    shared_ptr<SessionRecorder> sessionRecorder
 ) {
     REQUIRE_API_THREAD();
-    REQUIRE(defaultQuality >= 10 && defaultQuality <= 101);
+    REQUIRE(defaultQuality >= 10 && defaultQuality <= 102);
 
     eventHandler_ = eventHandler;
     closed_ = false;
 
     secretGen_ = secretGen;
     programName_ = move(programName);
+    renderScale_ = renderScale;
     defaultQuality_ = defaultQuality;
     setupNavigationForwarding_ = setupNavigationForwarding;
+    latencyTracer_ = latencyTracer;
+    compressionGovernor_ = compressionGovernor;
+    metrics_ = metrics;
+    sessionRecorder_ = sessionRecorder;
 }
 
 WindowManager::~WindowManager() {
@@ -331,9 +341,14 @@ void WindowManager::handleNewWindowRequest_(MCE, shared_ptr<HTTPRequest> request
                 handle,
                 secretGen_,
                 programName_,
+                renderScale_,
                 allowPNG,
                 defaultQuality_,
-                setupNavigationForwarding_
+                setupNavigationForwarding_,
+                latencyTracer_,
+                compressionGovernor_,
+                metrics_,
+                sessionRecorder_
             );
             REQUIRE(windows_.emplace(handle, window).second);
 
@@ -66,8 +66,13 @@ public:
         shared_ptr<WindowManagerEventHandler> eventHandler,
         shared_ptr<SecretGenerator> secretGen,
         string programName,
+        double renderScale,
         int defaultQuality,
-        bool setupNavigationForwarding
+        bool setupNavigationForwarding,
+        shared_ptr<LatencyTracer> latencyTracer,
+        shared_ptr<CompressionGovernor> compressionGovernor,
+        shared_ptr<Metrics> metrics,
+        shared_ptr<SessionRecorder> sessionRecorder
     );
     ~WindowManager();
 
@@ -147,8 +152,13 @@ private:
 
     shared_ptr<SecretGenerator> secretGen_;
     string programName_;
+    double renderScale_;
     int defaultQuality_;
     bool setupNavigationForwarding_;
+    shared_ptr<LatencyTracer> latencyTracer_;
+    shared_ptr<CompressionGovernor> compressionGovernor_;
+    shared_ptr<Metrics> metrics_;
+    shared_ptr<SessionRecorder> sessionRecorder_;
 };
 
 }